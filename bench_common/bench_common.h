@@ -0,0 +1,69 @@
+/* ===========================================================
+   #File: bench_common.h #
+   #Description: Helpers shared by the headless benchmarks #
+   =========================================================== */
+// Timing, median and command line helpers of waves_bench, model_bench and render_bench.
+// The benches don't include windows.h; off windows they only need DirectXMath on the include path.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+// Most entries of a list argument (-sizes, -threads ...)
+#define BENCH_MAX_LIST              16
+// Most timed runs a median is taken over; longer requests are clamped (and reported)
+#define BENCH_MAX_RUNS              64
+
+inline double
+bench_seconds () {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+// Sorts values in place.
+inline double
+bench_median (double values [], int n) {
+    std::sort(values, values + n);
+    return values[n / 2];
+}
+// Clamps a requested number of timed runs to [1, BENCH_MAX_RUNS], saying so when it had to.
+inline int
+bench_clamp_runs (int runs) {
+    if (runs > BENCH_MAX_RUNS) {
+        ::printf("runs: %d requested, timing the first %d\n", runs, BENCH_MAX_RUNS);
+        return BENCH_MAX_RUNS;
+    }
+    return (runs < 1) ? 1 : runs;
+}
+// Parses a comma separated list ("1,2,4") into out_list[BENCH_MAX_LIST], returns the count.
+// Entries past BENCH_MAX_LIST are reported and dropped.
+inline int
+bench_parse_list (char const * str, int * out_list) {
+    int count = 0;
+    while (*str && count < BENCH_MAX_LIST) {
+        out_list[count++] = atoi(str);
+        while (*str && *str != ',')
+            ++str;
+        if (*str == ',')
+            ++str;
+    }
+    if (*str)
+        ::printf("list: only the first %d entries are used, ignoring \"%s\"\n", BENCH_MAX_LIST, str);
+    return count;
+}
+inline int
+bench_hardware_threads () {
+    int ret = (int)std::thread::hardware_concurrency();
+    return (ret > 0) ? ret : 1;
+}
+// Default thread counts: 1, 2, 4, ... up to hw_threads. Returns the count.
+inline int
+bench_default_threads (int hw_threads, int * out_threads) {
+    int count = 0;
+    for (int t = 1; t < hw_threads && count < BENCH_MAX_LIST - 1; t *= 2)
+        out_threads[count++] = t;
+    out_threads[count++] = hw_threads;
+    return count;
+}
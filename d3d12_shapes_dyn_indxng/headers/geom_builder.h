@@ -0,0 +1,104 @@
+#pragma once
+
+#include "common.h"
+#include "mesh_geometry.h"
+#include "utils.h"
+
+// Builds all submeshes of a MeshGeometry into one vertex pool and one index pool.
+// Both pools live in a single caller-owned block (see GeomBuilder_CalculateRequiredSize).
+// Submeshes are bump-allocated from the pools in the order they are added and their
+// SubmeshGeometry is recorded in the mesh on the way. Generators write straight into the pools
+// in the uploaded vertex layout, so the only copy left is the one into the upload buffers.
+struct GeomBuilder {
+    MeshGeometry * mesh;
+
+    UINT32 vtx_stride;
+    UINT32 idx_size;            // 2 or 4 bytes
+    DXGI_FORMAT index_format;   // R16_UINT or R32_UINT
+
+    UINT32 max_vtx;
+    UINT32 max_idx;
+    UINT32 n_vtx;
+    UINT32 n_idx;
+    UINT32 n_submeshes;
+
+    BYTE * vertices;
+    BYTE * indices;
+};
+inline size_t
+GeomBuilder_CalculateRequiredSize (UINT32 max_vtx, UINT32 vtx_stride, UINT32 max_idx, DXGI_FORMAT index_format) {
+    UINT32 idx_size = (DXGI_FORMAT_R16_UINT == index_format) ? 2 : 4;
+    // keep the vertex pool 16-byte aligned after the header
+    size_t header = (sizeof(GeomBuilder) + 15) & ~(size_t)15;
+    size_t vb = ((size_t)max_vtx * vtx_stride + 15) & ~(size_t)15;
+    return header + vb + (size_t)max_idx * idx_size;
+}
+// memory must be 16-byte aligned (malloc) and hold GeomBuilder_CalculateRequiredSize bytes.
+// Clears the mesh's submesh table, submeshes are added from slot 0.
+inline GeomBuilder *
+GeomBuilder_Init (BYTE * memory, MeshGeometry * mesh, UINT32 max_vtx, UINT32 vtx_stride, UINT32 max_idx, DXGI_FORMAT index_format) {
+    _ASSERT_EXPR(DXGI_FORMAT_R16_UINT == index_format || DXGI_FORMAT_R32_UINT == index_format, "unsupported index format");
+
+    size_t header = (sizeof(GeomBuilder) + 15) & ~(size_t)15;
+    size_t vb = ((size_t)max_vtx * vtx_stride + 15) & ~(size_t)15;
+
+    GeomBuilder * ret = reinterpret_cast<GeomBuilder *>(memory);
+    *ret = {};
+    ret->mesh = mesh;
+    ret->vtx_stride = vtx_stride;
+    ret->index_format = index_format;
+    ret->idx_size = (DXGI_FORMAT_R16_UINT == index_format) ? 2 : 4;
+    ret->max_vtx = max_vtx;
+    ret->max_idx = max_idx;
+    ret->vertices = memory + header;
+    ret->indices = memory + header + vb;
+
+    for (UINT32 i = 0; i < MAX_SUBMESH_COUNT; ++i) {
+        mesh->submesh_names[i] = nullptr;
+        mesh->submesh_geoms[i] = {};
+    }
+    return ret;
+}
+// Reserves counts.n_vtx vertices and counts.n_idx indices at the end of the pools and records
+// the submesh. The generator writes submesh-local indices to *out_idx, base_vertex_location
+// rebases them at draw time (so 16-bit indices only need to address the submesh itself).
+// Returns the submesh slot in mesh->submesh_geoms.
+template <typename V, typename T>
+inline UINT32
+GeomBuilder_AddSubmesh (GeomBuilder * builder, char const * name, GeomCounts counts, V ** out_vtx, T ** out_idx) {
+    _ASSERT_EXPR(sizeof(V) == builder->vtx_stride, "vertex type does not match the pool stride");
+    _ASSERT_EXPR(sizeof(T) == builder->idx_size, "index type does not match the pool format");
+    _ASSERT_EXPR(builder->n_submeshes < MAX_SUBMESH_COUNT, "too many submeshes");
+    _ASSERT_EXPR(builder->n_vtx + counts.n_vtx <= builder->max_vtx, "vertex pool exhausted");
+    _ASSERT_EXPR(builder->n_idx + counts.n_idx <= builder->max_idx, "index pool exhausted");
+
+    UINT32 slot = builder->n_submeshes++;
+    SubmeshGeometry * submesh = &builder->mesh->submesh_geoms[slot];
+    submesh->index_count = counts.n_idx;
+    submesh->start_index_location = builder->n_idx;
+    submesh->base_vertex_location = (INT)builder->n_vtx;
+    builder->mesh->submesh_names[slot] = name;
+
+    *out_vtx = reinterpret_cast<V *>(builder->vertices + (size_t)builder->n_vtx * builder->vtx_stride);
+    *out_idx = reinterpret_cast<T *>(builder->indices + (size_t)builder->n_idx * builder->idx_size);
+    builder->n_vtx += counts.n_vtx;
+    builder->n_idx += counts.n_idx;
+    return slot;
+}
+// Creates the mesh's default buffers from the used part of the pools (the copies are recorded
+// on cmd_list) and fills in its buffer description. No system memory copy is kept, the builder's
+// block can be freed right after this returns.
+inline void
+GeomBuilder_Upload (GeomBuilder * builder, ID3D12Device * device, ID3D12GraphicsCommandList * cmd_list) {
+    MeshGeometry * mesh = builder->mesh;
+    UINT vb_byte_size = builder->n_vtx * builder->vtx_stride;
+    UINT ib_byte_size = builder->n_idx * builder->idx_size;
+
+    create_default_buffer(device, cmd_list, builder->vertices, vb_byte_size, &mesh->vb_gpu, &mesh->vb_uploader);
+    create_default_buffer(device, cmd_list, builder->indices, ib_byte_size, &mesh->ib_gpu, &mesh->ib_uploader);
+
+    mesh->vb_byte_stide = builder->vtx_stride;
+    mesh->vb_byte_size = vb_byte_size;
+    mesh->ib_byte_size = ib_byte_size;
+    mesh->index_format = builder->index_format;
+}
@@ -33,11 +33,6 @@ struct MeshGeometry {
     UINT vb_byte_size;
     UINT ib_byte_size;
 
-    // System memory copies.  Use Blobs because the vertex/index format can be generic.
-    // It is up to the client to cast appropriately.  
-    ID3DBlob * vb_cpu;
-    ID3DBlob * ib_cpu;
-
     ID3D12Resource * vb_gpu;
     ID3D12Resource * ib_gpu;
 
@@ -76,9 +71,6 @@ Mesh_GetIndexBufferView (MeshGeometry * mesh) {
 // We can free this memory after we finish upload to the GPU.
 inline void
 Mesh_Dispose (MeshGeometry * mesh) {
-    mesh->vb_cpu->Release();
-    mesh->ib_cpu->Release();
-
     mesh->vb_gpu->Release();
     mesh->ib_gpu->Release();
 
@@ -574,8 +574,48 @@ spherical_to_cartesian (float radius, float theta, float phi) {
     );
 }
 
+// -- shape generators
+// Every generator has a companion get_*_counts returning the # of vertices/indices it writes for
+// the same parameters; size out_vtx/out_idx from it. Indices are uint16_t or uint32_t (T),
+// 16-bit output asserts that all vertices are addressable.
+// Vertices are written through geom_store, so V can be GeomVertex or directly the layout the
+// renderer uploads (Vertex drops the tangent).
+
+// Tessellation of the original fixed 20 x 20 shapes
+#define GEOM_DEFAULT_SLICES     20
+#define GEOM_DEFAULT_STACKS     20
+
+struct GeomCounts {
+    UINT32 n_vtx;
+    UINT32 n_idx;
+};
+inline void
+geom_store (GeomVertex & dst, GeomVertex const & src) {
+    dst = src;
+}
+inline void
+geom_store (Vertex & dst, GeomVertex const & src) {
+    dst.position = src.Position;
+    dst.normal = src.Normal;
+    dst.texc = src.TexC;
+}
+static GeomCounts
+get_box_counts () {
+    GeomCounts ret = {};
+    ret.n_vtx = 24;
+    ret.n_idx = 36;
+    return ret;
+}
+static GeomCounts
+get_grid_counts (UINT32 m, UINT32 n) {
+    GeomCounts ret = {};
+    ret.n_vtx = m * n;
+    ret.n_idx = 6 * (m - 1) * (n - 1);
+    return ret;
+}
+template <typename V, typename T>
 static void
-create_box (float width, float height, float depth, GeomVertex out_vtx [], uint16_t out_idx []) {
+create_box (float width, float height, float depth, V out_vtx [], T out_idx []) {
 
     // Creating Vertices
 
@@ -584,40 +624,40 @@ create_box (float width, float height, float depth, GeomVertex out_vtx [], uint1
     float half_depth = 0.5f * depth;
 
     // Fill in the front face vertex data.
-    out_vtx[0] = {.Position = {-half_width, -half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}};
-    out_vtx[1] = {.Position = {-half_width, +half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}};
-    out_vtx[2] = {.Position = {+half_width, +half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}};
-    out_vtx[3] = {.Position = {+half_width, -half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}};
+    geom_store(out_vtx[0], {.Position = {-half_width, -half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}});
+    geom_store(out_vtx[1], {.Position = {-half_width, +half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}});
+    geom_store(out_vtx[2], {.Position = {+half_width, +half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}});
+    geom_store(out_vtx[3], {.Position = {+half_width, -half_height, -half_depth}, .Normal = { 0.0f, 0.0f, -1.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}});
 
     // Fill in the back face vertex data.
-    out_vtx[4] = {.Position = {-half_width, -half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}};
-    out_vtx[5] = {.Position = {+half_width, -half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}};
-    out_vtx[6] = {.Position = {+half_width, +half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}};
-    out_vtx[7] = {.Position = {-half_width, +half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}};
+    geom_store(out_vtx[4], {.Position = {-half_width, -half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}});
+    geom_store(out_vtx[5], {.Position = {+half_width, -half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}});
+    geom_store(out_vtx[6], {.Position = {+half_width, +half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}});
+    geom_store(out_vtx[7], {.Position = {-half_width, +half_height, +half_depth}, .Normal = { 0.0f, 0.0f, 1.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}});
 
     // Fill in the top face vertex data.
-    out_vtx[8] = {.Position = {-half_width, +half_height, -half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}};
-    out_vtx[9] = {.Position = {-half_width, +half_height, +half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}};
-    out_vtx[10] = {.Position = {+half_width, +half_height, +half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}};
-    out_vtx[11] = {.Position = {+half_width, +half_height, -half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}};
+    geom_store(out_vtx[8], {.Position = {-half_width, +half_height, -half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}});
+    geom_store(out_vtx[9], {.Position = {-half_width, +half_height, +half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}});
+    geom_store(out_vtx[10], {.Position = {+half_width, +half_height, +half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}});
+    geom_store(out_vtx[11], {.Position = {+half_width, +half_height, -half_depth}, .Normal = { 0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}});
 
     // Fill in the bottom face vertex data.
-    out_vtx[12] = {.Position = {-half_width, -half_height, -half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}};
-    out_vtx[13] = {.Position = {+half_width, -half_height, -half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}};
-    out_vtx[14] = {.Position = {+half_width, -half_height, +half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}};
-    out_vtx[15] = {.Position = {-half_width, -half_height, +half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}};
+    geom_store(out_vtx[12], {.Position = {-half_width, -half_height, -half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 1.0f}});
+    geom_store(out_vtx[13], {.Position = {+half_width, -half_height, -half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}});
+    geom_store(out_vtx[14], {.Position = {+half_width, -half_height, +half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}});
+    geom_store(out_vtx[15], {.Position = {-half_width, -half_height, +half_depth}, .Normal = { 0.0f, -1.0f, 0.0f}, .TangentU = {-1.0f, 0.0f, 0.0f}, .TexC = {1.0f, 0.0f}});
 
     // Fill in the left face vertex data.
-    out_vtx[16] = {.Position = {-half_width, -half_height, +half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {0.0f, 1.0f}};
-    out_vtx[17] = {.Position = {-half_width, +half_height, +half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {0.0f, 0.0f}};
-    out_vtx[18] = {.Position = {-half_width, +half_height, -half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {1.0f, 0.0f}};
-    out_vtx[19] = {.Position = {-half_width, -half_height, -half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {1.0f, 1.0f}};
+    geom_store(out_vtx[16], {.Position = {-half_width, -half_height, +half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {0.0f, 1.0f}});
+    geom_store(out_vtx[17], {.Position = {-half_width, +half_height, +half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {0.0f, 0.0f}});
+    geom_store(out_vtx[18], {.Position = {-half_width, +half_height, -half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {1.0f, 0.0f}});
+    geom_store(out_vtx[19], {.Position = {-half_width, -half_height, -half_depth}, .Normal = { -1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, -1.0f}, .TexC = {1.0f, 1.0f}});
 
     // Fill in the right face vertex data.
-    out_vtx[20] = {.Position = {+half_width, -half_height, -half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {0.0f, 1.0f}};
-    out_vtx[21] = {.Position = {+half_width, +half_height, -half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {0.0f, 0.0f}};
-    out_vtx[22] = {.Position = {+half_width, +half_height, +half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {1.0f, 0.0f}};
-    out_vtx[23] = {.Position = {+half_width, -half_height, +half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {1.0f, 1.0f}};
+    geom_store(out_vtx[20], {.Position = {+half_width, -half_height, -half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {0.0f, 1.0f}});
+    geom_store(out_vtx[21], {.Position = {+half_width, +half_height, -half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {0.0f, 0.0f}});
+    geom_store(out_vtx[22], {.Position = {+half_width, +half_height, +half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {1.0f, 0.0f}});
+    geom_store(out_vtx[23], {.Position = {+half_width, -half_height, +half_depth}, .Normal = { 1.0f, 0.0f, 0.0f}, .TangentU = {0.0f, 0.0f, 1.0f}, .TexC = {1.0f, 1.0f}});
 
     // -- Creating Indices 
 
@@ -645,16 +685,40 @@ create_box (float width, float height, float depth, GeomVertex out_vtx [], uint1
     out_idx[30] = 20; out_idx[31] = 21; out_idx[32] = 22;
     out_idx[33] = 20; out_idx[34] = 22; out_idx[35] = 23;
 }
+static GeomCounts
+get_sphere_counts (UINT32 n_slice, UINT32 n_stack) {
+    // two poles + (n_stack - 1) rings of n_slice + 1 (seam vertex duplicated for texc)
+    GeomCounts ret = {};
+    ret.n_vtx = (n_stack - 1) * (n_slice + 1) + 2;
+    ret.n_idx = 6 * n_slice * (n_stack - 1);
+    return ret;
+}
+static GeomCounts
+get_cylinder_counts (UINT32 n_slice, UINT32 n_stack) {
+    // n_stack + 1 side rings and two caps of n_slice + 1 ring vertices + center
+    GeomCounts ret = {};
+    ret.n_vtx = (n_stack + 1) * (n_slice + 1) + 2 * (n_slice + 2);
+    ret.n_idx = 6 * n_slice * n_stack + 2 * 3 * n_slice;
+    return ret;
+}
+static GeomCounts
+get_geosphere_counts (UINT32 n_div) {
+    // 20 faces of n_div^2 triangles, vertices shared: 12 corners + 30 edges * (n_div - 1)
+    // + 20 faces * (n_div - 1)(n_div - 2) / 2 = 10 * n_div^2 + 2
+    GeomCounts ret = {};
+    ret.n_vtx = 10 * n_div * n_div + 2;
+    ret.n_idx = 60 * n_div * n_div;
+    return ret;
+}
+template <typename V, typename T>
 static void
-create_sphere (float radius, GeomVertex out_vtx [], uint16_t out_idx []) {
+create_sphere (float radius, UINT32 n_slice, UINT32 n_stack, V out_vtx [], T out_idx []) {
 
-    // TODO(omid): add some validation for array sizes
-    /* out_vtx [401], out_idx [2280] */
+    _ASSERT_EXPR(n_slice >= 3 && n_stack >= 2, "too few slices/stacks");
+    GeomCounts counts = get_sphere_counts(n_slice, n_stack);
+    _ASSERT_EXPR(counts.n_vtx - 1 <= (UINT32)(T)~(T)0, "index type too small");
 
     // -- Compute the vertices stating at the top pole and moving down the stacks.
-    UINT32 n_stack = 20;
-    UINT32 n_slice = 20;
-    UINT32 n_vtx = n_stack * n_slice;
     float phi_step = XM_PI / n_stack;
     float theta_step = 2.0f * XM_PI / n_slice;
 
@@ -664,8 +728,8 @@ create_sphere (float radius, GeomVertex out_vtx [], uint16_t out_idx []) {
     GeomVertex top = {.Position = {0.0f, +radius, 0.0f}, .Normal = {0.0f, +1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 0.0f}};
     GeomVertex bottom = {.Position = {0.0f, -radius, 0.0f}, .Normal = {0.0f, -1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.0f, 1.0f}};
 
-    out_vtx[0] = top;
-    out_vtx[n_vtx + 1] = bottom;
+    geom_store(out_vtx[0], top);
+    geom_store(out_vtx[counts.n_vtx - 1], bottom);
 
     // -- Compute vertices for each stack ring (do not count the poles as rings).
     UINT32 _curr_idx = 1;
@@ -688,8 +752,8 @@ create_sphere (float radius, GeomVertex out_vtx [], uint16_t out_idx []) {
             v.TangentU.y = 0.0f;
             v.TangentU.z = +radius * sinf(phi) * cosf(theta);
 
-            XMVECTOR T = XMLoadFloat3(&v.TangentU);
-            XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+            XMVECTOR T_ = XMLoadFloat3(&v.TangentU);
+            XMStoreFloat3(&v.TangentU, XMVector3Normalize(T_));
 
             XMVECTOR p = XMLoadFloat3(&v.Position);
             XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
@@ -697,61 +761,61 @@ create_sphere (float radius, GeomVertex out_vtx [], uint16_t out_idx []) {
             v.TexC.x = theta / XM_2PI;
             v.TexC.y = phi / XM_PI;
 
-            out_vtx[_curr_idx++] = v;
+            geom_store(out_vtx[_curr_idx++], v);
         }
     }
 
     // -- Compute indices for top stack.  The top stack was written first to the vertex buffer and connects the top pole to the first ring.
 
     UINT32 _idx_cnt = 0;
-    for (UINT16 i = 1; i <= n_slice; ++i) {
+    for (UINT32 i = 1; i <= n_slice; ++i) {
         out_idx[_idx_cnt++] = 0;
-        out_idx[_idx_cnt++] = i + 1;
-        out_idx[_idx_cnt++] = i;
+        out_idx[_idx_cnt++] = (T)(i + 1);
+        out_idx[_idx_cnt++] = (T)i;
     }
 
     // -- Compute indices for inner stacks (not connected to poles).
 
-    // -- Offset the indices to the index of the first vertex in the first ring.
-    // TODO(omid): fix this shenanigan 
+    // Offset the indices to the index of the first vertex in the first ring.
     // This is just skipping the top pole vertex.
-    UINT16 base_index = 1;
-    UINT16 ring_vtx_cnt = (UINT16)n_slice + 1;
-    for (UINT16 i = 0; i < n_stack - 2; ++i) {
-        for (UINT16 j = 0; j < n_slice; ++j) {
-            out_idx[_idx_cnt++] = base_index + i * ring_vtx_cnt + j;
-            out_idx[_idx_cnt++] = base_index + i * ring_vtx_cnt + j + 1;
-            out_idx[_idx_cnt++] = base_index + (i + 1) * ring_vtx_cnt + j;
-
-            out_idx[_idx_cnt++] = base_index + (i + 1) * ring_vtx_cnt + j;
-            out_idx[_idx_cnt++] = base_index + i * ring_vtx_cnt + j + 1;
-            out_idx[_idx_cnt++] = base_index + (i + 1) * ring_vtx_cnt + j + 1;
+    UINT32 base_index = 1;
+    UINT32 ring_vtx_cnt = n_slice + 1;
+    for (UINT32 i = 0; i < n_stack - 2; ++i) {
+        for (UINT32 j = 0; j < n_slice; ++j) {
+            out_idx[_idx_cnt++] = (T)(base_index + i * ring_vtx_cnt + j);
+            out_idx[_idx_cnt++] = (T)(base_index + i * ring_vtx_cnt + j + 1);
+            out_idx[_idx_cnt++] = (T)(base_index + (i + 1) * ring_vtx_cnt + j);
+
+            out_idx[_idx_cnt++] = (T)(base_index + (i + 1) * ring_vtx_cnt + j);
+            out_idx[_idx_cnt++] = (T)(base_index + i * ring_vtx_cnt + j + 1);
+            out_idx[_idx_cnt++] = (T)(base_index + (i + 1) * ring_vtx_cnt + j + 1);
         }
     }
 
     // -- Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer and connects the bottom pole to the bottom ring.
 
     // South pole vertex was added last.
-    UINT16 south_pole_index = (UINT16)n_vtx - 1;
+    UINT32 south_pole_index = counts.n_vtx - 1;
 
     // offset the indices to the index of the first vertex in the last ring.
     base_index = south_pole_index - ring_vtx_cnt;
 
-    for (UINT16 i = 0; i < n_slice; ++i) {
-        out_idx[_idx_cnt++] = south_pole_index;
-        out_idx[_idx_cnt++] = base_index + i;
-        out_idx[_idx_cnt++] = base_index + i + 1;
+    for (UINT32 i = 0; i < n_slice; ++i) {
+        out_idx[_idx_cnt++] = (T)south_pole_index;
+        out_idx[_idx_cnt++] = (T)(base_index + i);
+        out_idx[_idx_cnt++] = (T)(base_index + i + 1);
     }
+    _ASSERT_EXPR(counts.n_idx == _idx_cnt, "wrong idx count");
 }
+template <typename V, typename T>
 static void
-create_cylinder (float bottom_radius, float top_radius, float height, GeomVertex out_vtx [], uint16_t out_idx []) {
+create_cylinder (float bottom_radius, float top_radius, float height, UINT32 n_slice, UINT32 n_stack, V out_vtx [], T out_idx []) {
 
-    // TODO(omid): add some validation for array sizes
-    /* out_vtx [485], out_idx [2520] */
+    _ASSERT_EXPR(n_slice >= 3 && n_stack >= 1, "too few slices/stacks");
+    GeomCounts counts = get_cylinder_counts(n_slice, n_stack);
+    _ASSERT_EXPR(counts.n_vtx - 1 <= (UINT32)(T)~(T)0, "index type too small");
 
     // -- Build Stacks.
-    UINT32 n_stack = 20;
-    UINT32 n_slice = 20;
     float stack_height = height / n_stack;
 
     // Amount to increment radius as we move up each stack level from bottom to top.
@@ -785,35 +849,35 @@ create_cylinder (float bottom_radius, float top_radius, float height, GeomVertex
             float dr = bottom_radius - top_radius;
             XMFLOAT3 bitangent(dr * c, -height, dr * s);
 
-            XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
+            XMVECTOR T_ = XMLoadFloat3(&vertex.TangentU);
             XMVECTOR B = XMLoadFloat3(&bitangent);
-            XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
+            XMVECTOR N = XMVector3Normalize(XMVector3Cross(T_, B));
             XMStoreFloat3(&vertex.Normal, N);
 
-            out_vtx[_vtx_cnt++] = vertex;
+            geom_store(out_vtx[_vtx_cnt++], vertex);
         }
     }
 
     // Add one because we duplicate the first and last vertex per ring
     // since the texture coordinates are different.
-    UINT16 ring_vertex_count = (UINT16)n_slice + 1;
+    UINT32 ring_vertex_count = n_slice + 1;
 
     // Compute indices for each stack.
-    for (UINT16 i = 0; i < n_stack; ++i) {
-        for (UINT16 j = 0; j < n_slice; ++j) {
-            out_idx[_idx_cnt++] = i * ring_vertex_count + j;
-            out_idx[_idx_cnt++] = (i + 1) * ring_vertex_count + j;
-            out_idx[_idx_cnt++] = (i + 1) * ring_vertex_count + j + 1;
-
-            out_idx[_idx_cnt++] = i * ring_vertex_count + j;
-            out_idx[_idx_cnt++] = (i + 1) * ring_vertex_count + j + 1;
-            out_idx[_idx_cnt++] = i * ring_vertex_count + j + 1;
+    for (UINT32 i = 0; i < n_stack; ++i) {
+        for (UINT32 j = 0; j < n_slice; ++j) {
+            out_idx[_idx_cnt++] = (T)(i * ring_vertex_count + j);
+            out_idx[_idx_cnt++] = (T)((i + 1) * ring_vertex_count + j);
+            out_idx[_idx_cnt++] = (T)((i + 1) * ring_vertex_count + j + 1);
+
+            out_idx[_idx_cnt++] = (T)(i * ring_vertex_count + j);
+            out_idx[_idx_cnt++] = (T)((i + 1) * ring_vertex_count + j + 1);
+            out_idx[_idx_cnt++] = (T)(i * ring_vertex_count + j + 1);
         }
     }
 
 #pragma region build cylinder top
-    UINT16 base_index_top = (UINT16)_vtx_cnt;
-    _ASSERT_EXPR(441 == base_index_top, "wrong vtx count");
+    UINT32 base_index_top = _vtx_cnt;
+    _ASSERT_EXPR(ring_cnt * ring_vertex_count == base_index_top, "wrong vtx count");
     float y1 = 0.5f * height;
     float dtheta = 2.0f * XM_PI / n_slice;
 
@@ -827,30 +891,27 @@ create_cylinder (float bottom_radius, float top_radius, float height, GeomVertex
         float u = x / height + 0.5f;
         float v = z / height + 0.5f;
 
-        out_vtx[_vtx_cnt++] = {.Position = {x, y1, z}, .Normal = {0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {u, v}};
+        geom_store(out_vtx[_vtx_cnt++], {.Position = {x, y1, z}, .Normal = {0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {u, v}});
     }
 
     // Cap center vertex.
-    out_vtx[_vtx_cnt++] = {.Position = {0.0f, y1, 0.0f}, .Normal = {0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.5f, 0.5f}};
+    geom_store(out_vtx[_vtx_cnt++], {.Position = {0.0f, y1, 0.0f}, .Normal = {0.0f, 1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.5f, 0.5f}});
 
     // Index of center vertex.
-    UINT16 center_index_top = (UINT16)_vtx_cnt - 1;
-    _ASSERT_EXPR(462 == center_index_top, "wrong vtx count");
+    UINT32 center_index_top = _vtx_cnt - 1;
 
-    for (UINT16 i = 0; i < n_slice; ++i) {
-        out_idx[_idx_cnt++] = center_index_top;
-        out_idx[_idx_cnt++] = base_index_top + i + 1;
-        out_idx[_idx_cnt++] = base_index_top + i;
+    for (UINT32 i = 0; i < n_slice; ++i) {
+        out_idx[_idx_cnt++] = (T)center_index_top;
+        out_idx[_idx_cnt++] = (T)(base_index_top + i + 1);
+        out_idx[_idx_cnt++] = (T)(base_index_top + i);
     }
 #pragma endregion build cylinder top
 
 #pragma region build cylinder bottom
-    UINT16 base_index_bottom = (UINT16)_vtx_cnt;
-    _ASSERT_EXPR(463 == base_index_bottom, "wrong vtx count");
+    UINT32 base_index_bottom = _vtx_cnt;
     float y2 = -0.5f * height;
 
     // vertices of ring
-    //float dTheta = 2.0f * XM_PI / n_slice; // not used
     for (UINT32 i = 0; i <= n_slice; ++i) {
         float x = bottom_radius * cosf(i * dtheta);
         float z = bottom_radius * sinf(i * dtheta);
@@ -859,26 +920,267 @@ create_cylinder (float bottom_radius, float top_radius, float height, GeomVertex
         // proportional to base.
         float u = x / height + 0.5f;
         float v = z / height + 0.5f;
-        out_vtx[_vtx_cnt++] = {.Position = {x, y2, z}, .Normal = {0.0f, -1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {u, v}};
+        geom_store(out_vtx[_vtx_cnt++], {.Position = {x, y2, z}, .Normal = {0.0f, -1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {u, v}});
     }
 
     // Cap center vertex.
-    out_vtx[_vtx_cnt++] = {.Position = {0.0f, y2, 0.0f}, .Normal = {0.0f, -1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.5f, 0.5f}};
+    geom_store(out_vtx[_vtx_cnt++], {.Position = {0.0f, y2, 0.0f}, .Normal = {0.0f, -1.0f, 0.0f}, .TangentU = {1.0f, 0.0f, 0.0f}, .TexC = {0.5f, 0.5f}});
 
     // Cache the index of center vertex.
-    UINT16 center_index_bottom = (UINT16)_vtx_cnt - 1;
-    _ASSERT_EXPR(484 == center_index_bottom, "wrong vtx count");
+    UINT32 center_index_bottom = _vtx_cnt - 1;
 
-    for (UINT16 i = 0; i < n_slice; ++i) {
-        out_idx[_idx_cnt++] = center_index_bottom;
-        out_idx[_idx_cnt++] = base_index_bottom + i;
-        out_idx[_idx_cnt++] = base_index_bottom + i + 1;
+    for (UINT32 i = 0; i < n_slice; ++i) {
+        out_idx[_idx_cnt++] = (T)center_index_bottom;
+        out_idx[_idx_cnt++] = (T)(base_index_bottom + i);
+        out_idx[_idx_cnt++] = (T)(base_index_bottom + i + 1);
     }
 #pragma endregion build cylinder bottom
 
+    _ASSERT_EXPR(counts.n_vtx == _vtx_cnt, "wrong vtx count");
+    _ASSERT_EXPR(counts.n_idx == _idx_cnt, "wrong idx count");
 }
+// Sphere of (nearly) uniform triangles: every icosahedron edge is split in n_div segments
+// (n_div = 1 << k gives k rounds of midpoint subdivision), each face becomes a triangular
+// lattice of n_div^2 triangles and the points are pushed out to the sphere.
+// Lattice points on shared edges/corners are written once, so the mesh is welded.
+template <typename V, typename T>
 static void
-create_grid16 (float width, float depth, UINT32 m, UINT32 n, GeomVertex out_vtx [], uint16_t out_idx []) {
+create_geosphere (float radius, UINT32 n_div, V out_vtx [], T out_idx []) {
+
+    _ASSERT_EXPR(n_div >= 1, "n_div must be at least 1");
+    GeomCounts counts = get_geosphere_counts(n_div);
+    _ASSERT_EXPR(counts.n_vtx - 1 <= (UINT32)(T)~(T)0, "index type too small");
+
+    // Approximate a sphere by tessellating an icosahedron.
+    float const X = 0.525731f;
+    float const Z = 0.850651f;
+    XMFLOAT3 const corners[12] = {
+        XMFLOAT3(-X, 0.0f, Z),  XMFLOAT3(X, 0.0f, Z),
+        XMFLOAT3(-X, 0.0f, -Z), XMFLOAT3(X, 0.0f, -Z),
+        XMFLOAT3(0.0f, Z, X),   XMFLOAT3(0.0f, Z, -X),
+        XMFLOAT3(0.0f, -Z, X),  XMFLOAT3(0.0f, -Z, -X),
+        XMFLOAT3(Z, X, 0.0f),   XMFLOAT3(-Z, X, 0.0f),
+        XMFLOAT3(Z, -X, 0.0f),  XMFLOAT3(-Z, -X, 0.0f)
+    };
+    UINT32 const faces[20][3] = {
+        {1, 4, 0},  {4, 9, 0},  {4, 5, 9},  {8, 5, 4},  {1, 8, 4},
+        {1, 10, 8}, {10, 3, 8}, {8, 3, 5},  {3, 2, 5},  {3, 7, 2},
+        {3, 10, 7}, {10, 6, 7}, {6, 11, 7}, {6, 0, 11}, {6, 1, 0},
+        {10, 1, 6}, {11, 0, 9}, {2, 11, 9}, {5, 2, 9},  {11, 2, 7}
+    };
+
+    // -- Edge table: 30 unique edges, each owning n_div - 1 vertices ordered from v[0] to v[1]
+    UINT32 edges[30][2] = {};
+    UINT32 face_edges[20][3] = {};  // edge of (a, b), (a, c), (b, c)
+    UINT32 n_edges = 0;
+    for (UINT32 f = 0; f < 20; ++f) {
+        UINT32 const ends[3][2] = {
+            {faces[f][0], faces[f][1]}, {faces[f][0], faces[f][2]}, {faces[f][1], faces[f][2]}
+        };
+        for (UINT32 e = 0; e < 3; ++e) {
+            UINT32 found = n_edges;
+            for (UINT32 k = 0; k < n_edges; ++k) {
+                if ((edges[k][0] == ends[e][0] && edges[k][1] == ends[e][1]) ||
+                    (edges[k][0] == ends[e][1] && edges[k][1] == ends[e][0])) {
+                    found = k;
+                    break;
+                }
+            }
+            if (found == n_edges) {
+                edges[n_edges][0] = ends[e][0];
+                edges[n_edges][1] = ends[e][1];
+                ++n_edges;
+            }
+            face_edges[f][e] = found;
+        }
+    }
+    _ASSERT_EXPR(30 == n_edges, "icosahedron has 30 edges");
+
+    UINT32 edge_base = 12;
+    UINT32 face_base = edge_base + 30 * (n_div - 1);
+    UINT32 n_face_inner = (n_div - 1) * (n_div - 2) / 2;
+    _ASSERT_EXPR(face_base + 20 * n_face_inner == counts.n_vtx, "wrong vtx count");
+
+    // Vertex on the sphere through direction p (not normalized).
+    auto write_vertex = [&](UINT32 index, XMVECTOR p) {
+        XMVECTOR n = XMVector3Normalize(p);
+
+        GeomVertex v = {};
+        XMStoreFloat3(&v.Normal, n);
+        XMStoreFloat3(&v.Position, XMVectorScale(n, radius));
+
+        // Derive texture coordinates (and tangent) from spherical coordinates.
+        float theta = atan2f(v.Normal.z, v.Normal.x);
+        if (theta < 0.0f)
+            theta += XM_2PI;
+        float y = v.Normal.y < -1.0f ? -1.0f : (v.Normal.y > 1.0f ? 1.0f : v.Normal.y);
+        float phi = acosf(y);
+
+        v.TexC.x = theta / XM_2PI;
+        v.TexC.y = phi / XM_PI;
+
+        // dP/dtheta direction, stays unit length at the poles too
+        v.TangentU = XMFLOAT3(-sinf(theta), 0.0f, cosf(theta));
+
+        geom_store(out_vtx[index], v);
+    };
+
+    // -- Vertices: corners, then edge vertices, then face interiors
+    for (UINT32 c = 0; c < 12; ++c)
+        write_vertex(c, XMLoadFloat3(&corners[c]));
+    for (UINT32 e = 0; e < 30; ++e) {
+        XMVECTOR p0 = XMLoadFloat3(&corners[edges[e][0]]);
+        XMVECTOR p1 = XMLoadFloat3(&corners[edges[e][1]]);
+        for (UINT32 k = 1; k < n_div; ++k)
+            write_vertex(edge_base + e * (n_div - 1) + k - 1, XMVectorLerp(p0, p1, (float)k / n_div));
+    }
+
+    // Lattice point (i, j) of a face is a + i/n_div (b - a) + j/n_div (c - a), i + j <= n_div;
+    // lattice[] maps it to its vertex index (row i holds n_div + 1 - i points).
+    UINT32 n_lattice = (n_div + 1) * (n_div + 2) / 2;
+    UINT32 * lattice = (UINT32 *)::malloc(sizeof(UINT32) * n_lattice);
+    auto lattice_at = [n_div](UINT32 i, UINT32 j) -> UINT32 {
+        return i * (n_div + 1) - i * (i - 1) / 2 + j;
+    };
+    // Index of the k-th (0 < k < n_div) point on edge e walking from vertex 'from'.
+    auto edge_vertex = [&](UINT32 e, UINT32 from, UINT32 k) -> UINT32 {
+        UINT32 kk = (edges[e][0] == from) ? k : n_div - k;
+        return edge_base + e * (n_div - 1) + kk - 1;
+    };
+
+    UINT32 _idx_cnt = 0;
+    for (UINT32 f = 0; f < 20; ++f) {
+        UINT32 a = faces[f][0];
+        UINT32 b = faces[f][1];
+        UINT32 c = faces[f][2];
+        XMVECTOR pa = XMLoadFloat3(&corners[a]);
+        XMVECTOR pb = XMLoadFloat3(&corners[b]);
+        XMVECTOR pc = XMLoadFloat3(&corners[c]);
+
+        UINT32 _inner = face_base + f * n_face_inner;
+        for (UINT32 i = 0; i <= n_div; ++i) {
+            for (UINT32 j = 0; i + j <= n_div; ++j) {
+                UINT32 index;
+                if (0 == j)
+                    index = (0 == i) ? a : ((n_div == i) ? b : edge_vertex(face_edges[f][0], a, i));
+                else if (0 == i)
+                    index = (n_div == j) ? c : edge_vertex(face_edges[f][1], a, j);
+                else if (n_div == i + j)
+                    index = edge_vertex(face_edges[f][2], b, j);
+                else {
+                    index = _inner++;
+                    XMVECTOR p = XMVectorAdd(pa, XMVectorAdd(
+                        XMVectorScale(XMVectorSubtract(pb, pa), (float)i / n_div),
+                        XMVectorScale(XMVectorSubtract(pc, pa), (float)j / n_div)));
+                    write_vertex(index, p);
+                }
+                lattice[lattice_at(i, j)] = index;
+            }
+        }
+
+        // -- Indices: n_div^2 triangles with the winding of (a, b, c)
+        for (UINT32 i = 0; i < n_div; ++i) {
+            for (UINT32 j = 0; i + j < n_div; ++j) {
+                out_idx[_idx_cnt++] = (T)lattice[lattice_at(i, j)];
+                out_idx[_idx_cnt++] = (T)lattice[lattice_at(i + 1, j)];
+                out_idx[_idx_cnt++] = (T)lattice[lattice_at(i, j + 1)];
+                if (i + j + 1 < n_div) {
+                    out_idx[_idx_cnt++] = (T)lattice[lattice_at(i + 1, j)];
+                    out_idx[_idx_cnt++] = (T)lattice[lattice_at(i + 1, j + 1)];
+                    out_idx[_idx_cnt++] = (T)lattice[lattice_at(i, j + 1)];
+                }
+            }
+        }
+    }
+    ::free(lattice);
+    _ASSERT_EXPR(counts.n_idx == _idx_cnt, "wrong idx count");
+}
+// -- vertex cache friendly grid indices
+
+// Post-transform cache entries assumed by GRID_INDEX_ORDER_CACHE_STRIPS
+#define GRID_DEFAULT_VCACHE_SIZE    16
+
+enum GRID_INDEX_ORDER : int {
+    // quads row by row over the whole width (a row of vertices is long gone from the cache
+    // when the next row needs it, so every vertex is transformed ~twice)
+    GRID_INDEX_ORDER_ROW_MAJOR = 0,
+    // quads row by row inside vertical strips narrow enough that two rows of strip vertices
+    // fit in the cache, so each vertex is transformed ~once (plus the strip seams)
+    GRID_INDEX_ORDER_CACHE_STRIPS = 1,
+
+    _COUNT_GRID_INDEX_ORDER
+};
+
+// Same triangles (and winding) for every order, only the sequence changes:
+// 6 * (m - 1) * (n - 1) indices.
+template <typename T>
+static void
+create_grid_indices (UINT32 m, UINT32 n, GRID_INDEX_ORDER order, UINT32 cache_size, T out_idx []) {
+    // Strip of w quads has w + 1 vertices per row. The strip's first quad row loads both of its
+    // vertex rows interleaved, so the lower row's first vertex is next used 2 * w insertions
+    // later; 2 * w < cache_size keeps it, and every row after it, cached (FIFO).
+    UINT32 strip = n - 1;
+    if (GRID_INDEX_ORDER_CACHE_STRIPS == order)
+        strip = (cache_size >= 3) ? (cache_size - 1) / 2 : 1;
+
+    UINT32 k = 0;
+    for (UINT32 j0 = 0; j0 < n - 1; j0 += strip) {
+        UINT32 j1 = (j0 + strip < n - 1) ? j0 + strip : n - 1;
+        for (UINT32 i = 0; i < m - 1; ++i) {
+            for (UINT32 j = j0; j < j1; ++j) {
+                out_idx[k] = (T)(i * n + j);
+                out_idx[k + 1] = (T)(i * n + j + 1);
+                out_idx[k + 2] = (T)((i + 1) * n + j);
+
+                out_idx[k + 3] = (T)((i + 1) * n + j);
+                out_idx[k + 4] = (T)(i * n + j + 1);
+                out_idx[k + 5] = (T)((i + 1) * n + j + 1);
+
+                k += 6; // next quad
+            }
+        }
+    }
+}
+
+// Post-transform vertex cache simulation (FIFO of cache_size entries, the usual model for
+// comparing index orders offline; real hardware differs in details but ranks them the same).
+//  ACMR: average cache miss ratio = transformed vertices per triangle (3 = no reuse, ~0.5 ideal grid)
+//  ATVR: average transformed vertex ratio = transformed / referenced vertices (1 = ideal)
+struct VertexCacheStats {
+    UINT32 n_tris;
+    UINT32 n_referenced;
+    UINT32 n_transformed;
+    float acmr;
+    float atvr;
+};
+template <typename T>
+static VertexCacheStats
+simulate_vertex_cache (T const indices [], UINT32 n_idx, UINT32 n_vtx, UINT32 cache_size) {
+    // # of the insertion that last brought the vertex in (1-based), 0 = never referenced;
+    // the vertex is cached while fewer than cache_size insertions happened after it
+    UINT32 * inserted = (UINT32 *)::calloc(n_vtx, sizeof(UINT32));
+    VertexCacheStats ret = {};
+    ret.n_tris = n_idx / 3;
+
+    UINT32 n_insertions = 0;
+    for (UINT32 k = 0; k < n_idx; ++k) {
+        UINT32 v = (UINT32)indices[k];
+        _ASSERT_EXPR(v < n_vtx, "index out of range");
+        if (0 == inserted[v])
+            ++ret.n_referenced;
+        if (0 == inserted[v] || n_insertions - inserted[v] >= cache_size) {
+            inserted[v] = ++n_insertions;
+            ++ret.n_transformed;
+        }
+    }
+    ret.acmr = (ret.n_tris > 0) ? (float)ret.n_transformed / ret.n_tris : 0.0f;
+    ret.atvr = (ret.n_referenced > 0) ? (float)ret.n_transformed / ret.n_referenced : 0.0f;
+    ::free(inserted);
+    return ret;
+}
+template <typename V>
+static void
+create_grid16 (float width, float depth, UINT32 m, UINT32 n, GRID_INDEX_ORDER order, UINT32 cache_size, V out_vtx [], uint16_t out_idx []) {
 
     // -- Create the vertices.
 
@@ -896,37 +1198,25 @@ create_grid16 (float width, float depth, UINT32 m, UINT32 n, GeomVertex out_vtx
         for (UINT32 j = 0; j < n; ++j) {
             float x = -half_width + j * dx;
 
-            out_vtx[i * n + j].Position = XMFLOAT3(x, 0.0f, z);
-            out_vtx[i * n + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            out_vtx[i * n + j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+            GeomVertex v = {};
+            v.Position = XMFLOAT3(x, 0.0f, z);
+            v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+            v.TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
             // Stretch texture over grid.
-            out_vtx[i * n + j].TexC.x = j * du;
-            out_vtx[i * n + j].TexC.y = i * dv;
+            v.TexC.x = j * du;
+            v.TexC.y = i * dv;
+
+            geom_store(out_vtx[i * n + j], v);
         }
     }
 
     // -- Create the indices.
-
-    // Iterate over each quad and compute indices.
-    UINT32 k = 0;
-    UINT16 nn = (UINT16)n; // cast to avoid compiler warnings
-    for (UINT16 i = 0; i < m - 1; ++i) {
-        for (UINT16 j = 0; j < n - 1; ++j) {
-            out_idx[k] = i * nn + j;
-            out_idx[k + 1] = i * nn + j + 1;
-            out_idx[k + 2] = (i + 1) * nn + j;
-
-            out_idx[k + 3] = (i + 1) * nn + j;
-            out_idx[k + 4] = i * nn + j + 1;
-            out_idx[k + 5] = (i + 1) * nn + j + 1;
-
-            k += 6; // next quad
-        }
-    }
+    create_grid_indices(m, n, order, cache_size, out_idx);
 }
+template <typename V>
 static void
-create_grid32 (float width, float depth, UINT32 m, UINT32 n, GeomVertex out_vtx [], uint32_t out_idx []) {
+create_grid32 (float width, float depth, UINT32 m, UINT32 n, GRID_INDEX_ORDER order, UINT32 cache_size, V out_vtx [], uint32_t out_idx []) {
 
     // -- Create the vertices.
 
@@ -944,32 +1234,19 @@ create_grid32 (float width, float depth, UINT32 m, UINT32 n, GeomVertex out_vtx
         for (UINT32 j = 0; j < n; ++j) {
             float x = -half_width + j * dx;
 
-            out_vtx[i * n + j].Position = XMFLOAT3(x, 0.0f, z);
-            out_vtx[i * n + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            out_vtx[i * n + j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+            GeomVertex v = {};
+            v.Position = XMFLOAT3(x, 0.0f, z);
+            v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+            v.TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
             // Stretch texture over grid.
-            out_vtx[i * n + j].TexC.x = j * du;
-            out_vtx[i * n + j].TexC.y = i * dv;
+            v.TexC.x = j * du;
+            v.TexC.y = i * dv;
+
+            geom_store(out_vtx[i * n + j], v);
         }
     }
 
     // -- Create the indices.
-
-    // Iterate over each quad and compute indices.
-    UINT32 k = 0;
-    UINT32 nn = n;
-    for (UINT i = 0; i < m - 1; ++i) {
-        for (UINT j = 0; j < n - 1; ++j) {
-            out_idx[k] = i * nn + j;
-            out_idx[k + 1] = i * nn + j + 1;
-            out_idx[k + 2] = (i + 1) * nn + j;
-
-            out_idx[k + 3] = (i + 1) * nn + j;
-            out_idx[k + 4] = i * nn + j + 1;
-            out_idx[k + 5] = (i + 1) * nn + j + 1;
-
-            k += 6; // next quad
-        }
-    }
+    create_grid_indices(m, n, order, cache_size, out_idx);
 }
@@ -8,6 +8,7 @@
 #include <dxcapi.h>
 
 #include "headers/utils.h"
+#include "headers/geom_builder.h"
 #include "headers/game_timer.h"
 #include "headers/dds_loader.h"
 
@@ -271,171 +272,67 @@ create_materials (Material out_materials []) {
     out_materials[MAT_CRATE].mat_transform = Identity4x4();
     out_materials[MAT_CRATE].n_frames_dirty = NUM_QUEUING_FRAMES;
 }
-#define _BOX_VTX_CNT   24
-#define _BOX_IDX_CNT   36
+// grid vertices (rows x columns)
+#define _GRID_M             60
+#define _GRID_N             40
 
-#define _GRID_VTX_CNT   2400
-#define _GRID_IDX_CNT   13806
+#define _SPHERE_SLICES      GEOM_DEFAULT_SLICES
+#define _SPHERE_STACKS      GEOM_DEFAULT_STACKS
 
-#define _SPHERE_VTX_CNT   401
-#define _SPHERE_IDX_CNT   2280
-
-#define _CYLINDER_VTX_CNT   485
-#define _CYLINDER_IDX_CNT   2520
-
-#define _TOTAL_VTX_CNT  (_BOX_VTX_CNT + _GRID_VTX_CNT + _SPHERE_VTX_CNT + _CYLINDER_VTX_CNT)
-#define _TOTAL_IDX_CNT  (_BOX_IDX_CNT + _GRID_IDX_CNT + _SPHERE_IDX_CNT + _CYLINDER_IDX_CNT)
+#define _CYLINDER_SLICES    GEOM_DEFAULT_SLICES
+#define _CYLINDER_STACKS    GEOM_DEFAULT_STACKS
 
+static void
+print_vertex_cache_stats (char const * name, uint16_t const indices [], UINT32 n_idx, UINT32 n_vtx) {
+    VertexCacheStats stats = simulate_vertex_cache(indices, n_idx, n_vtx, GRID_DEFAULT_VCACHE_SIZE);
+    ::printf("\t%-10s %6u tris  ACMR %.3f  ATVR %.3f\n", name, stats.n_tris, stats.acmr, stats.atvr);
+}
 static void
 create_shape_geometry (D3DRenderContext * render_ctx) {
 
-    Vertex *    vertices = (Vertex *)::malloc(sizeof(Vertex) * _TOTAL_VTX_CNT);
-    uint16_t *  indices = (uint16_t *)::malloc(sizeof(uint16_t) * _TOTAL_IDX_CNT);
-    BYTE *      scratch = (BYTE *)::malloc(sizeof(GeomVertex) * _TOTAL_VTX_CNT + sizeof(uint16_t) * _TOTAL_IDX_CNT);
-
-    // box
-    UINT bsz = sizeof(GeomVertex) * _BOX_VTX_CNT;
-    UINT bsz_id = bsz + sizeof(uint16_t) * _BOX_IDX_CNT;
-    // grid
-    UINT gsz = bsz_id + sizeof(GeomVertex) * _GRID_VTX_CNT;
-    UINT gsz_id = gsz + sizeof(uint16_t) * _GRID_IDX_CNT;
-    // sphere
-    UINT ssz = gsz_id + sizeof(GeomVertex) * _SPHERE_VTX_CNT;
-    UINT ssz_id = ssz + sizeof(uint16_t) * _SPHERE_IDX_CNT;
-    // cylinder
-    UINT csz = ssz_id + sizeof(GeomVertex) * _CYLINDER_VTX_CNT;
-    //UINT csz_id = csz + sizeof(uint16_t) * _CYLINDER_IDX_CNT; // not used
-
-    GeomVertex *    box_vertices = reinterpret_cast<GeomVertex *>(scratch);
-    uint16_t *      box_indices = reinterpret_cast<uint16_t *>(scratch + bsz);
-    GeomVertex *    grid_vertices = reinterpret_cast<GeomVertex *>(scratch + bsz_id);
-    uint16_t *      grid_indices = reinterpret_cast<uint16_t *>(scratch + gsz);
-    GeomVertex *    sphere_vertices = reinterpret_cast<GeomVertex *>(scratch + gsz_id);
-    uint16_t *      sphere_indices = reinterpret_cast<uint16_t *>(scratch + ssz);
-    GeomVertex *    cylinder_vertices = reinterpret_cast<GeomVertex *>(scratch + ssz_id);
-    uint16_t *      cylinder_indices = reinterpret_cast<uint16_t *>(scratch + csz);
-
-    create_box(1.5f, 0.5f, 1.5f, box_vertices, box_indices);
-    create_grid16(20.0f, 30.0f, 60, 40, grid_vertices, grid_indices);
-    create_sphere(0.5f, sphere_vertices, sphere_indices);
-    create_cylinder(0.5f, 0.3f, 3.0f, cylinder_vertices, cylinder_indices);
-
-    // We are concatenating all the geometry into one big vertex/index buffer.  So
-    // define the regions in the buffer each submesh covers.
-
-    // Cache the vertex offsets to each object in the concatenated vertex buffer.
-    UINT box_vertex_offset = 0;
-    UINT grid_vertex_offset = _BOX_VTX_CNT;
-    UINT sphere_vertex_offset = grid_vertex_offset + _GRID_VTX_CNT;
-    UINT cylinder_vertex_offset = sphere_vertex_offset + _SPHERE_VTX_CNT;
-
-    // Cache the starting index for each object in the concatenated index buffer.
-    UINT box_index_offset = 0;
-    UINT grid_index_offset = _BOX_IDX_CNT;
-    UINT sphere_index_offset = grid_index_offset + _GRID_IDX_CNT;
-    UINT cylinder_index_offsett = sphere_index_offset + _SPHERE_IDX_CNT;
-
-    // Define the SubmeshGeometry that cover different 
-    // regions of the vertex/index buffers.
-    SubmeshGeometry box_submesh = {};
-    box_submesh.index_count = _BOX_IDX_CNT;
-    box_submesh.start_index_location = box_index_offset;
-    box_submesh.base_vertex_location = box_vertex_offset;
-
-    SubmeshGeometry grid_submesh = {};
-    grid_submesh.index_count = _GRID_IDX_CNT;
-    grid_submesh.start_index_location = grid_index_offset;
-    grid_submesh.base_vertex_location = grid_vertex_offset;
-
-    SubmeshGeometry sphere_submesh = {};
-    sphere_submesh.index_count = _SPHERE_IDX_CNT;
-    sphere_submesh.start_index_location = sphere_index_offset;
-    sphere_submesh.base_vertex_location = sphere_vertex_offset;
-
-    SubmeshGeometry cylinder_submesh = {};
-    cylinder_submesh.index_count = _CYLINDER_IDX_CNT;
-    cylinder_submesh.start_index_location = cylinder_index_offsett;
-    cylinder_submesh.base_vertex_location = cylinder_vertex_offset;
-
-    // Extract the vertex elements we are interested in and pack the
-    // vertices of all the meshes into one vertex buffer.
-
-    UINT k = 0;
-    for (size_t i = 0; i < _BOX_VTX_CNT; ++i, ++k) {
-        vertices[k].position = box_vertices[i].Position;
-        vertices[k].normal = box_vertices[i].Normal;
-        vertices[k].texc = box_vertices[i].TexC;
-    }
+    GeomCounts box_counts = get_box_counts();
+    GeomCounts grid_counts = get_grid_counts(_GRID_M, _GRID_N);
+    GeomCounts sphere_counts = get_sphere_counts(_SPHERE_SLICES, _SPHERE_STACKS);
+    GeomCounts cylinder_counts = get_cylinder_counts(_CYLINDER_SLICES, _CYLINDER_STACKS);
+    UINT32 total_vtx_cnt = box_counts.n_vtx + grid_counts.n_vtx + sphere_counts.n_vtx + cylinder_counts.n_vtx;
+    UINT32 total_idx_cnt = box_counts.n_idx + grid_counts.n_idx + sphere_counts.n_idx + cylinder_counts.n_idx;
 
-    for (size_t i = 0; i < _GRID_VTX_CNT; ++i, ++k) {
-        vertices[k].position = grid_vertices[i].Position;
-        vertices[k].normal = grid_vertices[i].Normal;
-        vertices[k].texc = grid_vertices[i].TexC;
-    }
+    // We are concatenating all the geometry into one big vertex/index buffer,
+    // the builder records the region each submesh covers as it goes.
+    size_t builder_size = GeomBuilder_CalculateRequiredSize(total_vtx_cnt, sizeof(Vertex), total_idx_cnt, DXGI_FORMAT_R16_UINT);
+    BYTE * builder_memory = (BYTE *)::malloc(builder_size);
+    GeomBuilder * builder = GeomBuilder_Init(builder_memory, &render_ctx->geom[GEOM_SHAPES], total_vtx_cnt, sizeof(Vertex), total_idx_cnt, DXGI_FORMAT_R16_UINT);
 
-    for (size_t i = 0; i < _SPHERE_VTX_CNT; ++i, ++k) {
-        vertices[k].position = sphere_vertices[i].Position;
-        vertices[k].normal = sphere_vertices[i].Normal;
-        vertices[k].texc = sphere_vertices[i].TexC;
-    }
+    Vertex * vertices = nullptr;
+    uint16_t * indices = nullptr;
 
-    for (size_t i = 0; i < _CYLINDER_VTX_CNT; ++i, ++k) {
-        vertices[k].position = cylinder_vertices[i].Position;
-        vertices[k].normal = cylinder_vertices[i].Normal;
-        vertices[k].texc = cylinder_vertices[i].TexC;
-    }
-
-    // -- pack indices
-    k = 0;
-    for (size_t i = 0; i < _BOX_IDX_CNT; ++i, ++k) {
-        indices[k] = box_indices[i];
-    }
+    ::printf("Vertex cache (%d entries FIFO):\n", GRID_DEFAULT_VCACHE_SIZE);
 
-    for (size_t i = 0; i < _GRID_IDX_CNT; ++i, ++k) {
-        indices[k] = grid_indices[i];
-    }
+    // submesh 0
+    GeomBuilder_AddSubmesh(builder, "box", box_counts, &vertices, &indices);
+    create_box(1.5f, 0.5f, 1.5f, vertices, indices);
+    print_vertex_cache_stats("box", indices, box_counts.n_idx, box_counts.n_vtx);
 
-    for (size_t i = 0; i < _SPHERE_IDX_CNT; ++i, ++k) {
-        indices[k] = sphere_indices[i];
-    }
+    // submesh 1
+    GeomBuilder_AddSubmesh(builder, "grid", grid_counts, &vertices, &indices);
+    create_grid16(20.0f, 30.0f, _GRID_M, _GRID_N, GRID_INDEX_ORDER_CACHE_STRIPS, GRID_DEFAULT_VCACHE_SIZE, vertices, indices);
+    print_vertex_cache_stats("grid", indices, grid_counts.n_idx, grid_counts.n_vtx);
 
-    for (size_t i = 0; i < _CYLINDER_IDX_CNT; ++i, ++k) {
-        indices[k] = cylinder_indices[i];
-    }
+    // submesh 2
+    GeomBuilder_AddSubmesh(builder, "sphere", sphere_counts, &vertices, &indices);
+    create_sphere(0.5f, _SPHERE_SLICES, _SPHERE_STACKS, vertices, indices);
+    print_vertex_cache_stats("sphere", indices, sphere_counts.n_idx, sphere_counts.n_vtx);
 
-    UINT vb_byte_size = _TOTAL_VTX_CNT * sizeof(Vertex);
-    UINT ib_byte_size = _TOTAL_IDX_CNT * sizeof(uint16_t);
+    // submesh 3
+    GeomBuilder_AddSubmesh(builder, "cylinder", cylinder_counts, &vertices, &indices);
+    create_cylinder(0.5f, 0.3f, 3.0f, _CYLINDER_SLICES, _CYLINDER_STACKS, vertices, indices);
+    print_vertex_cache_stats("cylinder", indices, cylinder_counts.n_idx, cylinder_counts.n_vtx);
 
     // -- Fill out render_ctx geom[0] (shapes)
-    D3DCreateBlob(vb_byte_size, &render_ctx->geom[GEOM_SHAPES].vb_cpu);
-    if (vertices)
-        CopyMemory(render_ctx->geom[GEOM_SHAPES].vb_cpu->GetBufferPointer(), vertices, vb_byte_size);
-
-    D3DCreateBlob(ib_byte_size, &render_ctx->geom[GEOM_SHAPES].ib_cpu);
-    if (indices)
-        CopyMemory(render_ctx->geom[GEOM_SHAPES].ib_cpu->GetBufferPointer(), indices, ib_byte_size);
-
-    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, vertices, vb_byte_size, &render_ctx->geom[GEOM_SHAPES].vb_uploader, &render_ctx->geom[GEOM_SHAPES].vb_gpu);
-    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, indices, ib_byte_size, &render_ctx->geom[GEOM_SHAPES].ib_uploader, &render_ctx->geom[GEOM_SHAPES].ib_gpu);
-
-    render_ctx->geom[GEOM_SHAPES].vb_byte_stide = sizeof(Vertex);
-    render_ctx->geom[GEOM_SHAPES].vb_byte_size = vb_byte_size;
-    render_ctx->geom[GEOM_SHAPES].ib_byte_size = ib_byte_size;
-    render_ctx->geom[GEOM_SHAPES].index_format = DXGI_FORMAT_R16_UINT;
-
-    render_ctx->geom[GEOM_SHAPES].submesh_names[0] = "box";
-    render_ctx->geom[GEOM_SHAPES].submesh_geoms[0] = box_submesh;
-    render_ctx->geom[GEOM_SHAPES].submesh_names[1] = "grid";
-    render_ctx->geom[GEOM_SHAPES].submesh_geoms[1] = grid_submesh;
-    render_ctx->geom[GEOM_SHAPES].submesh_names[2] = "shpere";
-    render_ctx->geom[GEOM_SHAPES].submesh_geoms[2] = sphere_submesh;
-    render_ctx->geom[GEOM_SHAPES].submesh_names[3] = "cylinder";
-    render_ctx->geom[GEOM_SHAPES].submesh_geoms[3] = cylinder_submesh;
+    GeomBuilder_Upload(builder, render_ctx->device, render_ctx->direct_cmd_list);
 
     // -- cleanup
-    free(scratch);
-    free(indices);
-    free(vertices);
+    ::free(builder_memory);
 }
 static void
 create_render_items (D3DRenderContext * render_ctx, MeshGeometry * geom) {
@@ -28,6 +28,12 @@
 #include "./headers/utils.h"
 #include "./headers/game_timer.h"
 
+#include "mesh_cache.h"
+#include "mesh_opt.h"
+#include "model_loader.h"
+
+static_assert(MESH_CACHE_MAX_SUBMESHES <= MAX_SUBMESH_COUNT, "every valid cache has to fit a MeshGeometry");
+
 //#include <time.h> /* for srand */
 
 // TODO(omid): Swapchain backbuffer count and queuing frames count can be the same (refer to earlier samples)
@@ -40,6 +46,9 @@
 
 #define NUM_GEOM                2       /* shapes and skull */
 
+#define SKULL_SOURCE_PATH       "./models/skull.txt"
+#define SKULL_CACHE_PATH        "./models/skull.mesh"
+
 enum SUBMESH_INDEX {
     _BOX_ID,
     _GRID_ID,
@@ -92,6 +101,7 @@ struct D3DRenderContext {
     ID3D12CommandQueue *            cmd_queue;
     ID3D12RootSignature *           root_signature;
     ID3D12PipelineState *           pso;
+    ID3D12PipelineState *           pso_quantized;  // for MeshGeometry::quantized meshes
     ID3D12GraphicsCommandList *     direct_cmd_list;
     UINT                            rtv_descriptor_size;
     UINT                            cbv_srv_uav_descriptor_size;
@@ -294,8 +304,8 @@ create_shape_geometry (D3DRenderContext * render_ctx) {
     if (indices)
         CopyMemory(render_ctx->geom[0].ib_cpu->GetBufferPointer(), indices, ib_byte_size);
 
-    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, vertices, vb_byte_size, &render_ctx->geom[0].vb_uploader, &render_ctx->geom[0].vb_gpu);
-    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, indices, ib_byte_size, &render_ctx->geom[0].ib_uploader, &render_ctx->geom[0].ib_gpu);
+    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, vertices, vb_byte_size, &render_ctx->geom[0].vb_gpu, &render_ctx->geom[0].vb_uploader);
+    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, indices, ib_byte_size, &render_ctx->geom[0].ib_gpu, &render_ctx->geom[0].ib_uploader);
 
     render_ctx->geom[0].vb_byte_stide = sizeof(Vertex);
     render_ctx->geom[0].vb_byte_size = vb_byte_size;
@@ -316,110 +326,142 @@ create_shape_geometry (D3DRenderContext * render_ctx) {
     free(indices);
     free(vertices);
 }
-static void
-create_skull_geometry (D3DRenderContext * render_ctx   /*, Vertex vertices [], uint16_t indices []*/) {
-
-#pragma region Read_Data_File
-    FILE * f = nullptr;
-    errno_t err = fopen_s(&f, "./models/skull.txt", "r");
-    if (0 == f || err != 0) {
-        printf("could not open file\n");
-        return;
-    }
-    char linebuf[100];
-    int cnt = 0;
-    unsigned vcount = 0;
-    unsigned tcount = 0;
-    // -- read 1st line
-    if (fgets(linebuf, sizeof(linebuf), f))
-        cnt = sscanf_s(linebuf, "%*s %d", &vcount);
-    if (cnt != 1) {
-        printf("read error\n");
-        printf("read line: %s\n", linebuf);
-        return;
+// Parses the text model and runs the mesh_opt passes (weld, cache/overdraw/fetch reordering,
+// 12-byte vertices and 16-bit indices when they fit). out_desc->vertices/indices are malloc'd.
+static bool
+build_skull_mesh (char const * path, MeshCacheSubmesh * out_submesh, MeshCacheDesc * out_desc) {
+    Model model = {};
+    if (!ModelLoader_LoadText(path, MODEL_LOADER_THREADS_AUTO, &model))
+        return false;
+
+    static_assert(sizeof(MeshOptVertex) == sizeof(ModelVertex), "model vertices are optimized in place");
+    MeshOptVertex * opt_vertices = reinterpret_cast<MeshOptVertex *>(model.vertices);
+    uint32_t * indices = model.indices;
+    uint32_t vcount = model.n_vtx;
+    uint32_t n_idx = model.n_idx;
+    MeshOptStats before = MeshOpt_Analyze(indices, n_idx, opt_vertices, vcount, sizeof(Vertex), sizeof(uint32_t));
+
+    uint32_t n_vtx = MeshOpt_WeldVertices(opt_vertices, vcount, indices, n_idx);
+    MeshOpt_OptimizeVertexCache(indices, n_idx, n_vtx);
+    MeshOpt_OptimizeOverdraw(indices, n_idx, opt_vertices, n_vtx, MESH_OPT_OVERDRAW_THRESHOLD);
+    n_vtx = MeshOpt_OptimizeVertexFetch(opt_vertices, n_vtx, indices, n_idx);
+    // overfetch compared at the same vertex size; quantizing then halves the bytes per vertex
+    MeshOptStats reordered = MeshOpt_Analyze(indices, n_idx, opt_vertices, n_vtx, sizeof(Vertex), sizeof(uint32_t));
+
+    MeshOptQuantizedVertex * quantized_vertices = (MeshOptQuantizedVertex *)calloc(n_vtx, sizeof(MeshOptQuantizedVertex));
+    MeshOptDequant dequant = {};
+    MeshOpt_Quantize(opt_vertices, n_vtx, quantized_vertices, &dequant);
+
+    bool index16 = MeshOpt_FitsIndex16(n_vtx);
+    UINT index_size = index16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    MeshOptStats after = MeshOpt_Analyze(indices, n_idx, opt_vertices, n_vtx, sizeof(MeshOptQuantizedVertex), index_size);
+    printf("skull: %u -> %u vertices, vb %zu -> %zu bytes, ib %zu -> %zu bytes\n",
+           before.n_vtx, after.n_vtx, before.vb_bytes, after.vb_bytes, before.ib_bytes, after.ib_bytes);
+    printf("skull: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f, overfetch %.2f -> %.2f (%zu-byte vertices), %.2f (%zu-byte)\n",
+           before.acmr, after.acmr, before.atvr, after.atvr, before.overdraw, after.overdraw, before.overfetch, reordered.overfetch,
+           sizeof(Vertex), after.overfetch, sizeof(MeshOptQuantizedVertex));
+
+    // out_desc takes over the 32-bit indices unless they are packed
+    void * index_data = indices;
+    if (index16) {
+        uint16_t * indices16 = (uint16_t *)calloc(n_idx, sizeof(uint16_t));
+        MeshOpt_PackIndices16(indices, n_idx, indices16);
+        index_data = indices16;
+        free(indices);
     }
-    // -- read 2nd line
-    if (fgets(linebuf, sizeof(linebuf), f))
-        cnt = sscanf_s(linebuf, "%*s %d", &tcount);
-    if (cnt != 1) {
-        printf("read error\n");
-        printf("read line: %s\n", linebuf);
-        return;
-    }
-    // -- skip two lines
-    fgets(linebuf, sizeof(linebuf), f);
-    fgets(linebuf, sizeof(linebuf), f);
-    // -- read vertices
-    Vertex * vertices = (Vertex *)calloc(vcount, sizeof(Vertex));
-    for (unsigned i = 0; i < vcount; i++) {
-        fgets(linebuf, sizeof(linebuf), f);
-        cnt = sscanf_s(
-            linebuf, "%f %f %f %f %f %f",
-            &vertices[i].position.x, &vertices[i].position.y, &vertices[i].position.z,
-            &vertices[i].normal.x, &vertices[i].normal.y, &vertices[i].normal.z
-        );
-        if (cnt != 6) {
-            printf("read error\n");
-            printf("read line: %s\n", linebuf);
-            return;
-        }
+    free(model.vertices);
+
+    *out_submesh = {};
+    strcpy_s(out_submesh->name, sizeof(out_submesh->name), "skull");
+    out_submesh->index_count = n_idx;
+
+    *out_desc = {};
+    out_desc->flags = MESH_CACHE_FLAG_QUANTIZED;
+    out_desc->vertex_stride = sizeof(MeshOptQuantizedVertex);
+    out_desc->index_format = index16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+    out_desc->n_vtx = n_vtx;
+    out_desc->n_idx = n_idx;
+    out_desc->n_submeshes = 1;
+    out_desc->pos_scale[0] = dequant.scale.x; out_desc->pos_scale[1] = dequant.scale.y; out_desc->pos_scale[2] = dequant.scale.z;
+    out_desc->pos_bias[0] = dequant.bias.x; out_desc->pos_bias[1] = dequant.bias.y; out_desc->pos_bias[2] = dequant.bias.z;
+    out_desc->submeshes = out_submesh;
+    out_desc->vertices = quantized_vertices;
+    out_desc->indices = index_data;
+    return true;
+}
+static void
+upload_mesh (D3DRenderContext * render_ctx, MeshGeometry * mesh, MeshCacheDesc const * desc) {
+    UINT index_size = (DXGI_FORMAT_R16_UINT == desc->index_format) ? sizeof(uint16_t) : sizeof(uint32_t);
+    UINT vb_byte_size = desc->n_vtx * desc->vertex_stride;
+    UINT ib_byte_size = desc->n_idx * index_size;
+
+    // NOTE(omid): No system memory copy; the data may be a mapped cache file
+    mesh->vb_cpu = nullptr;
+    mesh->ib_cpu = nullptr;
+    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, (void *)desc->vertices, vb_byte_size, &mesh->vb_gpu, &mesh->vb_uploader);
+    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, (void *)desc->indices, ib_byte_size, &mesh->ib_gpu, &mesh->ib_uploader);
+
+    mesh->vb_byte_stide = desc->vertex_stride;
+    mesh->vb_byte_size = vb_byte_size;
+    mesh->ib_byte_size = ib_byte_size;
+    mesh->index_format = (DXGI_FORMAT)desc->index_format;
+    mesh->quantized = 0 != (desc->flags & MESH_CACHE_FLAG_QUANTIZED);
+    mesh->pos_scale = XMFLOAT3(desc->pos_scale[0], desc->pos_scale[1], desc->pos_scale[2]);
+    mesh->pos_bias = XMFLOAT3(desc->pos_bias[0], desc->pos_bias[1], desc->pos_bias[2]);
+
+    SIMPLE_ASSERT(desc->n_submeshes <= MAX_SUBMESH_COUNT, "too many submeshes");
+    for (uint32_t i = 0; i < desc->n_submeshes; ++i) {
+        // the cache is unmapped after upload, so the caller names the submeshes
+        mesh->submesh_names[i] = nullptr;
+        mesh->submesh_geoms[i] = {};
+        mesh->submesh_geoms[i].index_count = desc->submeshes[i].index_count;
+        mesh->submesh_geoms[i].start_index_location = desc->submeshes[i].start_index_location;
+        mesh->submesh_geoms[i].base_vertex_location = desc->submeshes[i].base_vertex_location;
     }
-    // -- skip three lines
-    fgets(linebuf, sizeof(linebuf), f);
-    fgets(linebuf, sizeof(linebuf), f);
-    fgets(linebuf, sizeof(linebuf), f);
-    // -- read indices
-    uint32_t * indices = (uint32_t *)calloc(tcount * 3, sizeof(uint32_t));
-    for (unsigned i = 0; i < tcount; i++) {
-        fgets(linebuf, sizeof(linebuf), f);
-        cnt = sscanf_s(
-            linebuf, "%d %d %d",
-            &indices[i * 3 + 0], &indices[i * 3 + 1], &indices[i * 3 + 2]
-        );
-        if (cnt != 3) {
-            printf("read error\n");
-            printf("read line: %s\n", linebuf);
+}
+// The skull is loaded from the compiled cache next to the text model, which is (re)built from
+// the text on the first run and whenever the text changes.
+static void
+create_skull_geometry (D3DRenderContext * render_ctx) {
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+
+    MeshGeometry * mesh = &render_ctx->geom[1];
+    MeshCacheView view = {};
+    bool cached = MeshCache_Open(SKULL_CACHE_PATH, SKULL_SOURCE_PATH, &view);
+    if (cached) {
+        MeshCacheHeader const * h = view.header;
+        MeshCacheDesc desc = {};
+        desc.flags = h->flags;
+        desc.vertex_stride = h->vertex_stride;
+        desc.index_format = h->index_format;
+        desc.n_vtx = h->n_vtx;
+        desc.n_idx = h->n_idx;
+        desc.n_submeshes = h->n_submeshes;
+        memcpy(desc.pos_scale, h->pos_scale, sizeof(desc.pos_scale));
+        memcpy(desc.pos_bias, h->pos_bias, sizeof(desc.pos_bias));
+        desc.submeshes = view.submeshes;
+        desc.vertices = view.vertices;
+        desc.indices = view.indices;
+        upload_mesh(render_ctx, mesh, &desc);
+        MeshCache_Close(&view);
+    } else {
+        MeshCacheSubmesh submesh = {};
+        MeshCacheDesc desc = {};
+        if (!build_skull_mesh(SKULL_SOURCE_PATH, &submesh, &desc))
             return;
-        }
+        if (!MeshCache_Write(SKULL_CACHE_PATH, SKULL_SOURCE_PATH, &desc))
+            printf("could not write %s\n", SKULL_CACHE_PATH);
+        upload_mesh(render_ctx, mesh, &desc);
+        free((void *)desc.indices);
+        free((void *)desc.vertices);
     }
-
-    // -- remember to free heap-allocated memory
-    /*
-    free(vertices);
-    free(indices);
-    */
-    fclose(f);
-#pragma endregion   Read_Data_File
-
-    UINT vb_byte_size = vcount * sizeof(Vertex);
-    UINT ib_byte_size = (tcount * 3) * sizeof(uint32_t);
-
-    // -- Fill out render_ctx geom[1] (skull)
-    D3DCreateBlob(vb_byte_size, &render_ctx->geom[1].vb_cpu);
-    CopyMemory(render_ctx->geom[1].vb_cpu->GetBufferPointer(), vertices, vb_byte_size);
-
-    D3DCreateBlob(ib_byte_size, &render_ctx->geom[1].ib_cpu);
-    CopyMemory(render_ctx->geom[1].ib_cpu->GetBufferPointer(), indices, ib_byte_size);
-
-    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, vertices, vb_byte_size, &render_ctx->geom[1].vb_uploader, &render_ctx->geom[1].vb_gpu);
-    create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, indices, ib_byte_size, &render_ctx->geom[1].ib_uploader, &render_ctx->geom[1].ib_gpu);
-
-    render_ctx->geom[1].vb_byte_stide = sizeof(Vertex);
-    render_ctx->geom[1].vb_byte_size = vb_byte_size;
-    render_ctx->geom[1].ib_byte_size = ib_byte_size;
-    render_ctx->geom[1].index_format = DXGI_FORMAT_R32_UINT;
-
-    SubmeshGeometry submesh = {};
-    submesh.index_count = tcount * 3;
-    submesh.start_index_location = 0;
-    submesh.base_vertex_location = 0;
-
     render_ctx->geom[1].submesh_names[0] = "skull";
-    render_ctx->geom[1].submesh_geoms[0] = submesh;
 
-    // -- cleanup
-    free(vertices);
-    free(indices);
+    QueryPerformanceCounter(&end);
+    printf("skull: loaded from %s in %.3f ms\n", cached ? SKULL_CACHE_PATH : SKULL_SOURCE_PATH,
+           1000.0 * (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart);
 }
 static void
 create_render_items (RenderItem render_items [], MeshGeometry * shapes_geom, MeshGeometry * skull_geom, Material materials []) {
@@ -533,11 +575,20 @@ draw_render_items (
     ID3D12Resource * mat_cbuffer,
     UINT64 descriptor_increment_size,
     RenderItem render_items [],
-    UINT current_frame_index
+    UINT current_frame_index,
+    ID3D12PipelineState * pso,
+    ID3D12PipelineState * pso_quantized
 ) {
     UINT objcb_byte_size = (UINT64)sizeof(ObjectConstants);
     UINT matcb_byte_size = (UINT64)sizeof(MaterialConstants);
+    // the command list was reset with pso
+    ID3D12PipelineState * current_pso = pso;
     for (size_t i = 0; i < OBJ_COUNT; ++i) {
+        ID3D12PipelineState * item_pso = render_items[i].geometry->quantized ? pso_quantized : pso;
+        if (item_pso != current_pso) {
+            cmd_list->SetPipelineState(item_pso);
+            current_pso = item_pso;
+        }
         D3D12_VERTEX_BUFFER_VIEW vbv = Mesh_GetVertexBufferView(render_items[i].geometry);
         D3D12_INDEX_BUFFER_VIEW ibv = Mesh_GetIndexBufferView(render_items[i].geometry);
         cmd_list->IASetVertexBuffers(0, 1, &vbv);
@@ -613,20 +664,21 @@ create_root_signature (ID3D12Device * device, ID3D12RootSignature ** root_signat
 
     device->CreateRootSignature(0, serialized_root_sig->GetBufferPointer(), serialized_root_sig->GetBufferSize(), IID_PPV_ARGS(root_signature));
 }
+// quantized selects the MeshOptQuantizedVertex input layout (vertex_shader_code has to match)
 static void
-create_pso (D3DRenderContext * render_ctx, IDxcBlob * vertex_shader_code, IDxcBlob * pixel_shader_code) {
+create_pso (D3DRenderContext * render_ctx, IDxcBlob * vertex_shader_code, IDxcBlob * pixel_shader_code, bool quantized, ID3D12PipelineState ** out_pso) {
     // -- Create vertex-input-layout Elements
 
     D3D12_INPUT_ELEMENT_DESC input_desc[2];
     input_desc[0] = {};
     input_desc[0].SemanticName = "POSITION";
-    input_desc[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+    input_desc[0].Format = quantized ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
     input_desc[0].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
 
     input_desc[1] = {};
     input_desc[1].SemanticName = "NORMAL";
-    input_desc[1].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-    input_desc[1].AlignedByteOffset = 12; // bc of the position byte-size
+    input_desc[1].Format = quantized ? DXGI_FORMAT_R16G16_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+    input_desc[1].AlignedByteOffset = quantized ? 8 : 12; // bc of the position byte-size
     input_desc[1].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
 
     // -- Create pipeline state object
@@ -687,7 +739,7 @@ create_pso (D3DRenderContext * render_ctx, IDxcBlob * vertex_shader_code, IDxcBl
     pso_desc.SampleDesc.Count = 1;
     pso_desc.SampleDesc.Quality = 0;
 
-    CHECK_AND_FAIL(render_ctx->device->CreateGraphicsPipelineState(&pso_desc, IID_PPV_ARGS(&render_ctx->pso)));
+    CHECK_AND_FAIL(render_ctx->device->CreateGraphicsPipelineState(&pso_desc, IID_PPV_ARGS(out_pso)));
 }
 static void
 handle_keyboard_input (SceneContext * scene_ctx, GameTimer * gt) {
@@ -761,6 +813,11 @@ update_obj_cbuffers (D3DRenderContext * render_ctx) {
             XMMATRIX world = XMLoadFloat4x4(&render_ctx->render_items[i].world);
             ObjectConstants obj_cbuffer = {};
             XMStoreFloat4x4(&obj_cbuffer.world, XMMatrixTranspose(world));
+            MeshGeometry * geom = render_ctx->render_items[i].geometry;
+            if (geom->quantized) {
+                obj_cbuffer.pos_scale = XMFLOAT4(geom->pos_scale.x, geom->pos_scale.y, geom->pos_scale.z, 0.0f);
+                obj_cbuffer.pos_bias = XMFLOAT4(geom->pos_bias.x, geom->pos_bias.y, geom->pos_bias.z, 0.0f);
+            }
 
             uint8_t * obj_ptr = render_ctx->frame_resources[frame_index].obj_cb_data_ptr + ((UINT64)obj_index * cbuffer_size);
             memcpy(obj_ptr, &obj_cbuffer, cbuffer_size);
@@ -951,7 +1008,8 @@ draw_main (D3DRenderContext * render_ctx) {
         render_ctx->frame_resources[frame_index].obj_cb,
         render_ctx->frame_resources[frame_index].mat_cb,
         render_ctx->cbv_srv_uav_descriptor_size,
-        render_ctx->render_items, frame_index
+        render_ctx->render_items, frame_index,
+        render_ctx->pso, render_ctx->pso_quantized
     );
 
     // -- indicate that the backbuffer will now be used to present
@@ -1285,6 +1343,7 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
     IDxcBlobEncoding * shader_blob = nullptr;
     IDxcOperationResult * dxc_res = nullptr;
     IDxcBlob * vertex_shader_code = nullptr;
+    IDxcBlob * vertex_shader_quantized_code = nullptr;
     IDxcBlob * pixel_shader_code = nullptr;
     hr = dxc_lib->CreateBlobFromFile(shaders_path, &code_page, &shader_blob);
     if (shader_blob) {
@@ -1293,6 +1352,9 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
         hr = dxc_compiler->Compile(shader_blob, shaders_path, L"VertexShader_Main", L"vs_6_0", nullptr, 0, nullptr, 0, include_handler, &dxc_res);
         dxc_res->GetStatus(&hr);
         dxc_res->GetResult(&vertex_shader_code);
+        hr = dxc_compiler->Compile(shader_blob, shaders_path, L"VertexShader_Quantized", L"vs_6_0", nullptr, 0, nullptr, 0, include_handler, &dxc_res);
+        dxc_res->GetStatus(&hr);
+        dxc_res->GetResult(&vertex_shader_quantized_code);
         hr = dxc_compiler->Compile(shader_blob, shaders_path, L"PixelShader_Main", L"ps_6_0", nullptr, 0, nullptr, 0, include_handler, &dxc_res);
         dxc_res->GetStatus(&hr);
         dxc_res->GetResult(&pixel_shader_code);
@@ -1310,12 +1372,14 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
         }
     }
     SIMPLE_ASSERT(vertex_shader_code, "invalid shader");
+    SIMPLE_ASSERT(vertex_shader_quantized_code, "invalid shader");
     SIMPLE_ASSERT(pixel_shader_code, "invalid shader");
 
 #pragma endregion Compile_Shaders
 
 #pragma region PSO_Creation
-    create_pso(render_ctx, vertex_shader_code, pixel_shader_code);
+    create_pso(render_ctx, vertex_shader_code, pixel_shader_code, false, &render_ctx->pso);
+    create_pso(render_ctx, vertex_shader_quantized_code, pixel_shader_code, true, &render_ctx->pso_quantized);
 
     // Create command list
     ID3D12CommandAllocator * current_alloc = render_ctx->frame_resources[render_ctx->frame_index].cmd_list_alloc;
@@ -1427,9 +1491,11 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
     }
 
     render_ctx->direct_cmd_list->Release();
+    render_ctx->pso_quantized->Release();
     render_ctx->pso->Release();
 
     pixel_shader_code->Release();
+    vertex_shader_quantized_code->Release();
     vertex_shader_code->Release();
 
     render_ctx->root_signature->Release();
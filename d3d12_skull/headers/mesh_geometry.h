@@ -46,6 +46,12 @@ struct MeshGeometry {
 
     DXGI_FORMAT index_format;
 
+    // Vertices are MeshOptQuantizedVertex (see mesh_opt.h) instead of Vertex,
+    // the vertex shader rebuilds positions as pos_bias + pos_scale * unorm.
+    bool quantized;
+    DirectX::XMFLOAT3 pos_scale;
+    DirectX::XMFLOAT3 pos_bias;
+
     // A MeshGeometry may store multiple geometries in one vertex/index buffer.
     // Use this container to define the Submesh geometries so we can draw
     // the Submeshes individually.
@@ -76,8 +82,11 @@ Mesh_GetIndexBufferView (MeshGeometry * mesh) {
 // We can free this memory after we finish upload to the GPU.
 void
 Mesh_Dispose (MeshGeometry * mesh) {
-    mesh->vb_cpu->Release();
-    mesh->ib_cpu->Release();
+    // the skull keeps no system memory copy (see upload_mesh)
+    if (mesh->vb_cpu)
+        mesh->vb_cpu->Release();
+    if (mesh->ib_cpu)
+        mesh->ib_cpu->Release();
 
     mesh->vb_gpu->Release();
     mesh->ib_gpu->Release();
@@ -31,7 +31,10 @@ struct Light {
 struct ObjectConstants {
     XMFLOAT4X4 world;
     //XMFLOAT4   color; /* color change experiment*/
-    float padding[48];  // Padding so the constant buffer is 256-byte aligned
+    // dequantization of quantized meshes (w unused)
+    XMFLOAT4 pos_scale;
+    XMFLOAT4 pos_bias;
+    float padding[40];  // Padding so the constant buffer is 256-byte aligned
 };
 static_assert(256 == sizeof(ObjectConstants), "Constant buffer size must be 256b aligned");
 // -- per pass constants
@@ -0,0 +1,268 @@
+#include "mesh_cache.h"
+#include "mesh_opt.h"
+
+#include <string.h>
+
+static_assert(0 == sizeof(MeshCacheHeader) % 8, "submesh table follows the header");
+
+// FNV-1a, but over 8-byte words (plus a fold of the high half) so hashing the text source
+// stays cheap. Every step is a bijection of the state, so any single changed word changes the hash.
+#define MESH_CACHE_HASH_SEED        0xcbf29ce484222325ull
+#define MESH_CACHE_HASH_PRIME       0x100000001b3ull
+
+static uint64_t
+mesh_cache_hash (uint8_t const * data, size_t size) {
+    uint64_t h = MESH_CACHE_HASH_SEED ^ (uint64_t)size;
+    size_t n_words = size / 8;
+    for (size_t i = 0; i < n_words; ++i) {
+        uint64_t w;
+        memcpy(&w, data + i * 8, 8);
+        h = (h ^ w) * MESH_CACHE_HASH_PRIME;
+        h ^= h >> 32;
+    }
+    for (size_t i = n_words * 8; i < size; ++i)
+        h = (h ^ data[i]) * MESH_CACHE_HASH_PRIME;
+    return h;
+}
+uint64_t
+MeshCache_PipelineHash () {
+    float const overdraw_threshold = MESH_OPT_OVERDRAW_THRESHOLD;
+    uint32_t overdraw_threshold_bits;
+    memcpy(&overdraw_threshold_bits, &overdraw_threshold, sizeof(overdraw_threshold_bits));
+    uint32_t const pipeline[] = {
+        MESH_OPT_VERSION,
+        MESH_OPT_VCACHE_SIZE,
+        overdraw_threshold_bits,
+        MESH_OPT_OVERDRAW_GRID,
+        MESH_OPT_OVERDRAW_VIEWS,
+        (uint32_t)sizeof(MeshOptVertex),
+        (uint32_t)sizeof(MeshOptQuantizedVertex),
+    };
+    return mesh_cache_hash(reinterpret_cast<uint8_t const *>(pipeline), sizeof(pipeline));
+}
+static uint64_t
+mesh_cache_align (uint64_t offset) {
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+static bool
+mesh_cache_source_stamp (char const * path, uint64_t * out_size, uint64_t * out_write_time) {
+    WIN32_FILE_ATTRIBUTE_DATA attr = {};
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attr))
+        return false;
+    *out_size = ((uint64_t)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+    *out_write_time = ((uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+bool
+MeshCache_HashFile (char const * path, uint64_t * out_hash) {
+    FILE * f = nullptr;
+    if (0 != fopen_s(&f, path, "rb") || nullptr == f)
+        return false;
+    _fseeki64(f, 0, SEEK_END);
+    int64_t size = _ftelli64(f);
+    _fseeki64(f, 0, SEEK_SET);
+
+    bool ret = false;
+    uint8_t * data = (size >= 0) ? (uint8_t *)::malloc((size_t)size + 1) : nullptr;
+    if (data && (size_t)size == fread(data, 1, (size_t)size, f)) {
+        *out_hash = mesh_cache_hash(data, (size_t)size);
+        ret = true;
+    }
+    ::free(data);
+    fclose(f);
+    return ret;
+}
+
+// -- loading
+
+static bool
+mesh_cache_in_file (uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && size <= file_size - offset;
+}
+static bool
+mesh_cache_is_compatible (MeshCacheHeader const * h) {
+    return MESH_CACHE_MAGIC == h->magic && MESH_CACHE_VERSION == h->version && MeshCache_PipelineHash() == h->pipeline_hash;
+}
+static bool
+mesh_cache_validate (MeshCacheHeader const * h, uint8_t const * base, uint64_t file_size) {
+    if (!mesh_cache_is_compatible(h))
+        return false;
+    // the stride has to match the layout the flags promise, the shaders assume it
+    if (0 != (h->flags & ~MESH_CACHE_FLAG_QUANTIZED))
+        return false;
+    uint32_t vertex_stride = (h->flags & MESH_CACHE_FLAG_QUANTIZED) ? sizeof(MeshOptQuantizedVertex) : sizeof(MeshOptVertex);
+    if (vertex_stride != h->vertex_stride)
+        return false;
+    uint32_t index_size;
+    if (DXGI_FORMAT_R16_UINT == h->index_format)
+        index_size = 2;
+    else if (DXGI_FORMAT_R32_UINT == h->index_format)
+        index_size = 4;
+    else
+        return false;
+
+    if (h->n_submeshes > MESH_CACHE_MAX_SUBMESHES ||
+        h->vb_size != (uint64_t)h->n_vtx * h->vertex_stride ||
+        h->ib_size != (uint64_t)h->n_idx * index_size ||
+        0 != h->vb_offset % MESH_CACHE_ALIGNMENT || 0 != h->ib_offset % MESH_CACHE_ALIGNMENT ||
+        0 != h->submeshes_offset % 8)
+        return false;
+    if (!mesh_cache_in_file(h->submeshes_offset, (uint64_t)h->n_submeshes * sizeof(MeshCacheSubmesh), file_size) ||
+        !mesh_cache_in_file(h->vb_offset, h->vb_size, file_size) ||
+        !mesh_cache_in_file(h->ib_offset, h->ib_size, file_size))
+        return false;
+
+    MeshCacheSubmesh const * submeshes = reinterpret_cast<MeshCacheSubmesh const *>(base + h->submeshes_offset);
+    for (uint32_t i = 0; i < h->n_submeshes; ++i) {
+        if (nullptr == memchr(submeshes[i].name, 0, MESH_CACHE_NAME_LENGTH))
+            return false;
+        if ((uint64_t)submeshes[i].start_index_location + submeshes[i].index_count > h->n_idx)
+            return false;
+    }
+    return true;
+}
+// Compares the header's source stamp with the file on disk. Only a changed size or write time
+// costs a hash; a matching hash re-stamps the cache so the next startup is cheap again.
+static bool
+mesh_cache_is_current (char const * cache_path, char const * source_path) {
+    MeshCacheHeader header = {};
+    FILE * f = nullptr;
+    if (0 != fopen_s(&f, cache_path, "rb") || nullptr == f)
+        return false;
+    size_t n_read = fread(&header, sizeof(header), 1, f);
+    fclose(f);
+    if (1 != n_read || !mesh_cache_is_compatible(&header))
+        return false;
+
+    uint64_t source_size = 0;
+    uint64_t source_write_time = 0;
+    if (nullptr == source_path || !mesh_cache_source_stamp(source_path, &source_size, &source_write_time))
+        return true;    // no source to compare with, the cache is all there is
+    if (source_size == header.source_size && source_write_time == header.source_write_time)
+        return true;
+
+    uint64_t source_hash = 0;
+    if (source_size != header.source_size || !MeshCache_HashFile(source_path, &source_hash) || source_hash != header.source_hash)
+        return false;
+
+    // same content under a new time stamp (e.g. a fresh checkout); failing to re-stamp is harmless
+    header.source_write_time = source_write_time;
+    if (0 == fopen_s(&f, cache_path, "r+b") && nullptr != f) {
+        fwrite(&header, sizeof(header), 1, f);
+        fclose(f);
+    }
+    return true;
+}
+bool
+MeshCache_Open (char const * cache_path, char const * source_path, MeshCacheView * out_view) {
+    *out_view = {};
+    out_view->file = INVALID_HANDLE_VALUE;
+    if (!mesh_cache_is_current(cache_path, source_path))
+        return false;
+
+    out_view->file = CreateFileA(cache_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == out_view->file)
+        return false;
+    LARGE_INTEGER file_size = {};
+    if (!GetFileSizeEx(out_view->file, &file_size) || (uint64_t)file_size.QuadPart < sizeof(MeshCacheHeader)) {
+        MeshCache_Close(out_view);
+        return false;
+    }
+    out_view->size = (uint64_t)file_size.QuadPart;
+    out_view->mapping = CreateFileMappingA(out_view->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (nullptr != out_view->mapping)
+        out_view->base = (uint8_t const *)MapViewOfFile(out_view->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (nullptr == out_view->base) {
+        MeshCache_Close(out_view);
+        return false;
+    }
+
+    MeshCacheHeader const * header = reinterpret_cast<MeshCacheHeader const *>(out_view->base);
+    if (!mesh_cache_validate(header, out_view->base, out_view->size)) {
+        MeshCache_Close(out_view);
+        return false;
+    }
+    out_view->header = header;
+    out_view->submeshes = reinterpret_cast<MeshCacheSubmesh const *>(out_view->base + header->submeshes_offset);
+    out_view->vertices = out_view->base + header->vb_offset;
+    out_view->indices = out_view->base + header->ib_offset;
+    return true;
+}
+void
+MeshCache_Close (MeshCacheView * view) {
+    if (view->base)
+        UnmapViewOfFile(view->base);
+    if (view->mapping)
+        CloseHandle(view->mapping);
+    if (INVALID_HANDLE_VALUE != view->file && nullptr != view->file)
+        CloseHandle(view->file);
+    *view = {};
+    view->file = INVALID_HANDLE_VALUE;
+}
+
+// -- writing
+
+static bool
+mesh_cache_write_at (FILE * f, uint64_t * cursor, uint64_t offset, void const * data, uint64_t size) {
+    static uint8_t const zeros[MESH_CACHE_ALIGNMENT] = {};
+    SIMPLE_ASSERT(offset >= *cursor && offset - *cursor <= MESH_CACHE_ALIGNMENT, "invalid cache layout");
+    size_t padding = (size_t)(offset - *cursor);
+    if (padding > 0 && 1 != fwrite(zeros, padding, 1, f))
+        return false;
+    if (size > 0 && 1 != fwrite(data, (size_t)size, 1, f))
+        return false;
+    *cursor = offset + size;
+    return true;
+}
+bool
+MeshCache_Write (char const * cache_path, char const * source_path, MeshCacheDesc const * desc) {
+    SIMPLE_ASSERT(DXGI_FORMAT_R16_UINT == desc->index_format || DXGI_FORMAT_R32_UINT == desc->index_format, "unsupported index format");
+    uint32_t index_size = (DXGI_FORMAT_R16_UINT == desc->index_format) ? 2 : 4;
+    SIMPLE_ASSERT(desc->n_submeshes <= MESH_CACHE_MAX_SUBMESHES, "too many submeshes");
+    SIMPLE_ASSERT(desc->vertex_stride == ((desc->flags & MESH_CACHE_FLAG_QUANTIZED) ? sizeof(MeshOptQuantizedVertex) : sizeof(MeshOptVertex)),
+                  "vertex stride does not match the flags");
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.pipeline_hash = MeshCache_PipelineHash();
+    if (!mesh_cache_source_stamp(source_path, &header.source_size, &header.source_write_time) ||
+        !MeshCache_HashFile(source_path, &header.source_hash))
+        return false;
+
+    header.flags = desc->flags;
+    header.vertex_stride = desc->vertex_stride;
+    header.index_format = desc->index_format;
+    header.n_vtx = desc->n_vtx;
+    header.n_idx = desc->n_idx;
+    header.n_submeshes = desc->n_submeshes;
+    memcpy(header.pos_scale, desc->pos_scale, sizeof(header.pos_scale));
+    memcpy(header.pos_bias, desc->pos_bias, sizeof(header.pos_bias));
+
+    header.submeshes_offset = sizeof(MeshCacheHeader);
+    header.vb_offset = mesh_cache_align(header.submeshes_offset + (uint64_t)desc->n_submeshes * sizeof(MeshCacheSubmesh));
+    header.vb_size = (uint64_t)desc->n_vtx * desc->vertex_stride;
+    header.ib_offset = mesh_cache_align(header.vb_offset + header.vb_size);
+    header.ib_size = (uint64_t)desc->n_idx * index_size;
+
+    // write next to the target and rename, so an interrupted write never leaves a cache behind
+    char tmp_path[MAX_PATH];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path) >= (int)sizeof(tmp_path))
+        return false;
+    FILE * f = nullptr;
+    if (0 != fopen_s(&f, tmp_path, "wb") || nullptr == f)
+        return false;
+    uint64_t cursor = 0;
+    bool ok =
+        mesh_cache_write_at(f, &cursor, 0, &header, sizeof(header)) &&
+        mesh_cache_write_at(f, &cursor, header.submeshes_offset, desc->submeshes, (uint64_t)desc->n_submeshes * sizeof(MeshCacheSubmesh)) &&
+        mesh_cache_write_at(f, &cursor, header.vb_offset, desc->vertices, header.vb_size) &&
+        mesh_cache_write_at(f, &cursor, header.ib_offset, desc->indices, header.ib_size);
+    ok = (0 == fclose(f)) && ok;
+
+    if (ok)
+        ok = (0 != MoveFileExA(tmp_path, cache_path, MOVEFILE_REPLACE_EXISTING));
+    if (!ok)
+        DeleteFileA(tmp_path);
+    return ok;
+}
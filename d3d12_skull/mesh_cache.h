@@ -0,0 +1,101 @@
+#pragma once
+#include "headers/common.h"
+#include <stdint.h>
+
+// Compiled mesh file, built once from a text model and memory mapped afterwards:
+//      MeshCacheHeader
+//      MeshCacheSubmesh [n_submeshes]
+//      vertex blob     (MESH_CACHE_ALIGNMENT aligned, ready for upload)
+//      index blob      (MESH_CACHE_ALIGNMENT aligned, ready for upload)
+// The header remembers the source's size, write time and content hash. A cache whose source
+// changed on disk is rejected (see MeshCache_Open), a missing source is not an error.
+// It also remembers the pipeline that compiled it (MeshCache_PipelineHash), so caches written by
+// another mesh_opt version or vertex layout are rebuilt as well.
+
+#define MESH_CACHE_MAGIC            0x4853454du     // "MESH"
+#define MESH_CACHE_VERSION          2
+#define MESH_CACHE_ALIGNMENT        256
+#define MESH_CACHE_NAME_LENGTH      32
+// Caches with more submeshes are rejected; must not exceed MeshGeometry's MAX_SUBMESH_COUNT
+#define MESH_CACHE_MAX_SUBMESHES    50
+
+// vertices are MeshOptQuantizedVertex, pos_scale/pos_bias apply
+#define MESH_CACHE_FLAG_QUANTIZED   0x1u
+
+struct MeshCacheSubmesh {
+    char name[MESH_CACHE_NAME_LENGTH];
+    uint32_t index_count;
+    uint32_t start_index_location;
+    int32_t base_vertex_location;
+};
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t pipeline_hash;         // MeshCache_PipelineHash of the build that wrote it
+
+    // -- source stamp
+    uint64_t source_size;
+    uint64_t source_write_time;     // FILETIME
+    uint64_t source_hash;
+
+    uint32_t flags;
+    uint32_t vertex_stride;
+    uint32_t index_format;          // DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT
+    uint32_t n_vtx;
+    uint32_t n_idx;
+    uint32_t n_submeshes;
+    float pos_scale[3];
+    float pos_bias[3];
+
+    // byte offsets from the start of the file
+    uint64_t submeshes_offset;
+    uint64_t vb_offset;
+    uint64_t vb_size;
+    uint64_t ib_offset;
+    uint64_t ib_size;
+};
+
+// Everything MeshCache_Write needs besides the source stamp (which it computes).
+struct MeshCacheDesc {
+    uint32_t flags;
+    uint32_t vertex_stride;
+    uint32_t index_format;
+    uint32_t n_vtx;
+    uint32_t n_idx;
+    uint32_t n_submeshes;
+    float pos_scale[3];
+    float pos_bias[3];
+    MeshCacheSubmesh const * submeshes;
+    void const * vertices;
+    void const * indices;
+};
+
+// Read-only mapping of a cache file. The pointers stay valid until MeshCache_Close.
+struct MeshCacheView {
+    HANDLE file;
+    HANDLE mapping;
+    uint8_t const * base;
+    uint64_t size;
+
+    MeshCacheHeader const * header;
+    MeshCacheSubmesh const * submeshes;
+    void const * vertices;
+    void const * indices;
+};
+
+// Hash of MESH_OPT_VERSION, the mesh_opt tuning constants and the vertex layouts the blobs use.
+uint64_t
+MeshCache_PipelineHash ();
+// 64-bit hash of the whole file; returns false if it cannot be read.
+bool
+MeshCache_HashFile (char const * path, uint64_t * out_hash);
+// Maps cache_path and validates it against source_path. Returns false (with out_view closed)
+// when the cache is missing, malformed, of another version or pipeline, or stale. A source whose size or
+// write time moved is hashed; if only the stamp changed the cache is re-stamped and kept.
+bool
+MeshCache_Open (char const * cache_path, char const * source_path, MeshCacheView * out_view);
+void
+MeshCache_Close (MeshCacheView * view);
+// Writes desc to cache_path, stamped with source_path. Returns false on I/O failure.
+bool
+MeshCache_Write (char const * cache_path, char const * source_path, MeshCacheDesc const * desc);
@@ -0,0 +1,602 @@
+#include "mesh_opt.h"
+
+#include <float.h>
+#include <string.h>
+
+using namespace DirectX;
+
+#define MESH_OPT_INVALID            0xffffffffu
+
+// Vertex fetch model of MeshOpt_Analyze: direct mapped, 128 lines of 64 bytes
+#define MESH_OPT_FETCH_LINE         64
+#define MESH_OPT_FETCH_LINES        128
+
+// -- welding
+
+static uint32_t
+mesh_opt_hash_vertex (MeshOptVertex const * v) {
+    // FNV-1a over the raw bits, so only bitwise identical vertices are merged
+    uint8_t const * bytes = reinterpret_cast<uint8_t const *>(v);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(MeshOptVertex); ++i) {
+        h ^= bytes[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+uint32_t
+MeshOpt_WeldVertices (MeshOptVertex vertices [], uint32_t n_vtx, uint32_t indices [], uint32_t n_idx) {
+    uint32_t table_size = 1;
+    while (table_size < 2 * n_vtx)
+        table_size *= 2;
+    uint32_t * table = (uint32_t *)::malloc(sizeof(uint32_t) * table_size);
+    uint32_t * remap = (uint32_t *)::malloc(sizeof(uint32_t) * n_vtx);
+    memset(table, 0xff, sizeof(uint32_t) * table_size);
+
+    // vertices[0, n_unique) is the compacted output; writing slot n_unique <= i never
+    // overwrites a vertex that is still to be visited.
+    uint32_t n_unique = 0;
+    for (uint32_t i = 0; i < n_vtx; ++i) {
+        uint32_t slot = mesh_opt_hash_vertex(&vertices[i]) & (table_size - 1);
+        while (MESH_OPT_INVALID != table[slot] &&
+               0 != memcmp(&vertices[table[slot]], &vertices[i], sizeof(MeshOptVertex)))
+            slot = (slot + 1) & (table_size - 1);
+
+        if (MESH_OPT_INVALID == table[slot]) {
+            vertices[n_unique] = vertices[i];
+            table[slot] = n_unique++;
+        }
+        remap[i] = table[slot];
+    }
+    for (uint32_t i = 0; i < n_idx; ++i) {
+        SIMPLE_ASSERT(indices[i] < n_vtx, "index out of range");
+        indices[i] = remap[indices[i]];
+    }
+    ::free(remap);
+    ::free(table);
+    return n_unique;
+}
+
+// -- vertex cache (Tipsify, Sander et al. "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw"): fan out all remaining triangles around a vertex, then move on to the
+// neighbour that is still cached and will stay so while its own fan is emitted.
+
+// FIFO cache model shared by the passes: a vertex is cached while fewer than cache_size
+// insertions happened after its own. stamp is that insertion # (1-based), 0 = never inserted;
+// bumping *n_insertions by cache_size flushes the cache. Returns true on a miss.
+static bool
+mesh_opt_fifo_touch (uint32_t v, uint32_t stamps [], uint32_t * n_insertions, uint32_t cache_size) {
+    if (0 == stamps[v] || *n_insertions - stamps[v] >= cache_size) {
+        stamps[v] = ++(*n_insertions);
+        return true;
+    }
+    return false;
+}
+static uint32_t
+mesh_opt_count_misses (uint32_t const indices [], uint32_t n_idx, uint32_t n_vtx) {
+    uint32_t * stamps = (uint32_t *)::calloc(n_vtx, sizeof(uint32_t));
+    uint32_t n_insertions = 0;
+    uint32_t misses = 0;
+    for (uint32_t i = 0; i < n_idx; ++i)
+        misses += mesh_opt_fifo_touch(indices[i], stamps, &n_insertions, MESH_OPT_VCACHE_SIZE) ? 1 : 0;
+    ::free(stamps);
+    return misses;
+}
+void
+MeshOpt_OptimizeVertexCache (uint32_t indices [], uint32_t n_idx, uint32_t n_vtx) {
+    uint32_t n_tris = n_idx / 3;
+    if (0 == n_tris)
+        return;
+    uint32_t const k = MESH_OPT_VCACHE_SIZE;
+
+    // -- vertex -> triangle adjacency, live[v] = # of v's triangles not emitted yet
+    uint32_t * adj_offset = (uint32_t *)::calloc(n_vtx + 1, sizeof(uint32_t));
+    uint32_t * live = (uint32_t *)::calloc(n_vtx, sizeof(uint32_t));
+    uint32_t * adj = (uint32_t *)::malloc(sizeof(uint32_t) * n_idx);
+    for (uint32_t i = 0; i < n_idx; ++i) {
+        SIMPLE_ASSERT(indices[i] < n_vtx, "index out of range");
+        ++live[indices[i]];
+    }
+    for (uint32_t v = 0; v < n_vtx; ++v)
+        adj_offset[v + 1] = adj_offset[v] + live[v];
+    memset(live, 0, sizeof(uint32_t) * n_vtx);
+    for (uint32_t t = 0; t < n_tris; ++t)
+        for (uint32_t c = 0; c < 3; ++c) {
+            uint32_t v = indices[t * 3 + c];
+            adj[adj_offset[v] + live[v]++] = t;
+        }
+
+    uint32_t * stamps = (uint32_t *)::calloc(n_vtx, sizeof(uint32_t));     // time a vertex entered the cache
+    uint8_t * emitted = (uint8_t *)::calloc(n_tris, sizeof(uint8_t));
+    uint32_t * dead_end = (uint32_t *)::malloc(sizeof(uint32_t) * n_idx);  // recently used vertices
+    uint32_t * candidates = (uint32_t *)::malloc(sizeof(uint32_t) * n_idx);
+    uint32_t * result = (uint32_t *)::malloc(sizeof(uint32_t) * n_idx);
+    uint32_t n_dead_end = 0;
+    uint32_t n_result = 0;
+    uint32_t time = k + 1;
+    uint32_t cursor = 0;
+
+    uint32_t fan = 0;
+    while (MESH_OPT_INVALID != fan) {
+        // -- emit every remaining triangle around fan
+        uint32_t n_candidates = 0;
+        for (uint32_t a = adj_offset[fan]; a < adj_offset[fan + 1]; ++a) {
+            uint32_t t = adj[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+            for (uint32_t c = 0; c < 3; ++c) {
+                uint32_t v = indices[t * 3 + c];
+                result[n_result++] = v;
+                dead_end[n_dead_end++] = v;
+                candidates[n_candidates++] = v;
+                --live[v];
+                if (time - stamps[v] > k)
+                    stamps[v] = time++;
+            }
+        }
+
+        // -- next fan: the candidate that entered the cache earliest but still stays in it
+        // while its own triangles (up to 2 new vertices each) are emitted
+        uint32_t next = MESH_OPT_INVALID;
+        uint32_t best = 0;
+        for (uint32_t c = 0; c < n_candidates; ++c) {
+            uint32_t v = candidates[c];
+            if (0 == live[v])
+                continue;
+            uint32_t priority = (time - stamps[v] + 2 * live[v] <= k) ? time - stamps[v] : 0;
+            if (MESH_OPT_INVALID == next || priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+        if (MESH_OPT_INVALID == next) {
+            // dead end: back to the most recent vertex with triangles left, else the next in order
+            while (n_dead_end > 0 && MESH_OPT_INVALID == next) {
+                uint32_t v = dead_end[--n_dead_end];
+                if (live[v] > 0)
+                    next = v;
+            }
+            while (cursor < n_vtx && MESH_OPT_INVALID == next) {
+                if (live[cursor] > 0)
+                    next = cursor;
+                ++cursor;
+            }
+        }
+        fan = next;
+    }
+    SIMPLE_ASSERT(n_result == n_tris * 3, "every triangle must be emitted once");
+
+    // The input may already be ordered better (exported models often are), keep the better one.
+    if (mesh_opt_count_misses(result, n_result, n_vtx) < mesh_opt_count_misses(indices, n_result, n_vtx))
+        memcpy(indices, result, sizeof(uint32_t) * n_result);
+
+    ::free(result);
+    ::free(candidates);
+    ::free(dead_end);
+    ::free(emitted);
+    ::free(stamps);
+    ::free(adj);
+    ::free(live);
+    ::free(adj_offset);
+}
+
+// -- overdraw
+
+// Depth complexity model of MeshOpt_Analyze and the overdraw pass: each view rasterizes the mesh
+// orthographically into a MESH_OPT_OVERDRAW_GRID^2 depth buffer fitted to the projected bounds,
+// in index order with a less-than depth test. Front faces are clockwise, like the demo's.
+struct MeshOptOverdraw {
+    uint64_t shaded;    // pixels that passed the depth test
+    uint64_t covered;   // pixels left with a depth
+};
+// View direction d of view #view with u, v completing a left-handed basis (u x v = d)
+static void
+mesh_opt_overdraw_view (uint32_t view, XMVECTOR * u, XMVECTOR * v, XMVECTOR * d) {
+    if (view < 6) {
+        float s = (view & 1) ? -1.0f : 1.0f;
+        *d = XMVectorSet(view / 2 == 0 ? s : 0.0f, view / 2 == 1 ? s : 0.0f, view / 2 == 2 ? s : 0.0f, 0.0f);
+    } else {
+        uint32_t c = view - 6;
+        *d = XMVector3Normalize(XMVectorSet((c & 1) ? -1.0f : 1.0f, (c & 2) ? -1.0f : 1.0f, (c & 4) ? -1.0f : 1.0f, 0.0f));
+    }
+    XMVECTOR up = (fabsf(XMVectorGetY(*d)) > 0.9f) ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    *u = XMVector3Normalize(XMVector3Cross(up, *d));
+    *v = XMVector3Cross(*d, *u);
+}
+static float
+mesh_opt_edge (float ax, float ay, float bx, float by, float px, float py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+static MeshOptOverdraw
+mesh_opt_measure_overdraw (uint32_t const indices [], uint32_t n_idx, MeshOptVertex const vertices [], uint32_t n_vtx) {
+    MeshOptOverdraw ret = {};
+    uint32_t const grid = MESH_OPT_OVERDRAW_GRID;
+    float * depth = (float *)::malloc(sizeof(float) * grid * grid);
+    float * projected = (float *)::malloc(sizeof(float) * 3 * n_vtx);
+
+    for (uint32_t view = 0; view < MESH_OPT_OVERDRAW_VIEWS; ++view) {
+        XMVECTOR u, v, d;
+        mesh_opt_overdraw_view(view, &u, &v, &d);
+
+        // -- project and fit the referenced vertices into the grid
+        float lo[2] = {FLT_MAX, FLT_MAX};
+        float hi[2] = {-FLT_MAX, -FLT_MAX};
+        for (uint32_t i = 0; i < n_idx; ++i) {
+            uint32_t k = indices[i];
+            XMVECTOR p = XMLoadFloat3(&vertices[k].position);
+            projected[k * 3 + 0] = XMVectorGetX(XMVector3Dot(p, u));
+            projected[k * 3 + 1] = XMVectorGetX(XMVector3Dot(p, v));
+            projected[k * 3 + 2] = XMVectorGetX(XMVector3Dot(p, d));
+            for (uint32_t c = 0; c < 2; ++c) {
+                lo[c] = (projected[k * 3 + c] < lo[c]) ? projected[k * 3 + c] : lo[c];
+                hi[c] = (projected[k * 3 + c] > hi[c]) ? projected[k * 3 + c] : hi[c];
+            }
+        }
+        float extent = (hi[0] - lo[0] > hi[1] - lo[1]) ? hi[0] - lo[0] : hi[1] - lo[1];
+        float scale = (extent > 0.0f) ? (float)grid * 0.999f / extent : 0.0f;
+        for (uint32_t i = 0; i < grid * grid; ++i)
+            depth[i] = FLT_MAX;
+
+        for (uint32_t t = 0; t + 2 < n_idx; t += 3) {
+            float x[3], y[3], z[3];
+            for (uint32_t c = 0; c < 3; ++c) {
+                uint32_t k = indices[t + c];
+                x[c] = (projected[k * 3 + 0] - lo[0]) * scale;
+                y[c] = (projected[k * 3 + 1] - lo[1]) * scale;
+                z[c] = projected[k * 3 + 2];
+            }
+            // clockwise seen along d (y up) is a negative area: cull the rest, then wind it CCW
+            float area = -mesh_opt_edge(x[0], y[0], x[1], y[1], x[2], y[2]);
+            if (area <= 0.0f)
+                continue;
+            float tx = x[1]; x[1] = x[2]; x[2] = tx;
+            float ty = y[1]; y[1] = y[2]; y[2] = ty;
+            float tz = z[1]; z[1] = z[2]; z[2] = tz;
+
+            // pixel centers at (i + 0.5, j + 0.5) inside the triangle's bounds
+            float min_x = fminf(x[0], fminf(x[1], x[2])), max_x = fmaxf(x[0], fmaxf(x[1], x[2]));
+            float min_y = fminf(y[0], fminf(y[1], y[2])), max_y = fmaxf(y[0], fmaxf(y[1], y[2]));
+            int i0 = (int)ceilf(min_x - 0.5f), i1 = (int)floorf(max_x - 0.5f);
+            int j0 = (int)ceilf(min_y - 0.5f), j1 = (int)floorf(max_y - 0.5f);
+            i0 = (i0 < 0) ? 0 : i0; i1 = (i1 > (int)grid - 1) ? (int)grid - 1 : i1;
+            j0 = (j0 < 0) ? 0 : j0; j1 = (j1 > (int)grid - 1) ? (int)grid - 1 : j1;
+            for (int j = j0; j <= j1; ++j) {
+                float py = (float)j + 0.5f;
+                for (int i = i0; i <= i1; ++i) {
+                    float px = (float)i + 0.5f;
+                    float w0 = mesh_opt_edge(x[1], y[1], x[2], y[2], px, py);
+                    float w1 = mesh_opt_edge(x[2], y[2], x[0], y[0], px, py);
+                    float w2 = mesh_opt_edge(x[0], y[0], x[1], y[1], px, py);
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+                    float pz = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+                    float * dst = &depth[j * grid + i];
+                    if (pz < *dst) {
+                        *dst = pz;
+                        ++ret.shaded;
+                    }
+                }
+            }
+        }
+        for (uint32_t i = 0; i < grid * grid; ++i)
+            ret.covered += (FLT_MAX != depth[i]) ? 1 : 0;
+    }
+    ::free(projected);
+    ::free(depth);
+    return ret;
+}
+
+
+static uint32_t
+mesh_opt_tri_misses (uint32_t const tri [3], uint32_t stamps [], uint32_t * n_insertions) {
+    uint32_t misses = 0;
+    for (uint32_t c = 0; c < 3; ++c)
+        misses += mesh_opt_fifo_touch(tri[c], stamps, n_insertions, MESH_OPT_VCACHE_SIZE) ? 1 : 0;
+    return misses;
+}
+struct MeshOptCluster {
+    float key;
+    uint32_t begin;     // first triangle
+    uint32_t end;
+};
+static int
+mesh_opt_compare_clusters (void const * a, void const * b) {
+    MeshOptCluster const * ca = (MeshOptCluster const *)a;
+    MeshOptCluster const * cb = (MeshOptCluster const *)b;
+    // larger key first, input order on ties
+    if (ca->key != cb->key)
+        return (ca->key > cb->key) ? -1 : 1;
+    return (ca->begin < cb->begin) ? -1 : (ca->begin > cb->begin ? 1 : 0);
+}
+void
+MeshOpt_OptimizeOverdraw (uint32_t indices [], uint32_t n_idx, MeshOptVertex const vertices [], uint32_t n_vtx, float threshold) {
+    uint32_t n_tris = n_idx / 3;
+    if (0 == n_tris)
+        return;
+
+    uint32_t * stamps = (uint32_t *)::calloc(n_vtx, sizeof(uint32_t));
+    uint32_t n_insertions = 0;
+
+    // -- hard boundaries: triangles that miss with all 3 vertices (the cache order restarted there)
+    uint32_t * hard = (uint32_t *)::malloc(sizeof(uint32_t) * (n_tris + 1));
+    uint32_t n_hard = 0;
+    for (uint32_t t = 0; t < n_tris; ++t) {
+        if (3 == mesh_opt_tri_misses(&indices[t * 3], stamps, &n_insertions) || 0 == t)
+            hard[n_hard++] = t;
+    }
+    hard[n_hard] = n_tris;
+
+    // -- soft boundaries: cut a hard cluster whenever the running ACMR since the last cut
+    // reaches threshold * the cluster's own ACMR (cheap in cache terms, finer sort granularity)
+    MeshOptCluster * clusters = (MeshOptCluster *)::malloc(sizeof(MeshOptCluster) * n_tris);
+    uint32_t n_clusters = 0;
+    for (uint32_t h = 0; h < n_hard; ++h) {
+        uint32_t begin = hard[h];
+        uint32_t end = hard[h + 1];
+
+        n_insertions += MESH_OPT_VCACHE_SIZE;
+        uint32_t cluster_misses = 0;
+        for (uint32_t t = begin; t < end; ++t)
+            cluster_misses += mesh_opt_tri_misses(&indices[t * 3], stamps, &n_insertions);
+        float cluster_threshold = threshold * (float)cluster_misses / (float)(end - begin);
+
+        uint32_t first_of_hard = n_clusters;
+        uint32_t start = begin;
+        uint32_t running_misses = 0;
+        n_insertions += MESH_OPT_VCACHE_SIZE;
+        for (uint32_t t = begin; t < end; ++t) {
+            running_misses += mesh_opt_tri_misses(&indices[t * 3], stamps, &n_insertions);
+            if ((float)running_misses <= cluster_threshold * (float)(t + 1 - start)) {
+                clusters[n_clusters++] = {0.0f, start, t + 1};
+                start = t + 1;
+                running_misses = 0;
+                n_insertions += MESH_OPT_VCACHE_SIZE;
+            }
+        }
+        if (start < end) {
+            // the tail never got cheap enough: merge it into the previous cut of this cluster
+            if (n_clusters > first_of_hard)
+                clusters[n_clusters - 1].end = end;
+            else
+                clusters[n_clusters++] = {0.0f, start, end};
+        }
+    }
+
+    // -- sort key: how much the cluster faces away from the mesh center
+    XMVECTOR mesh_center = XMVectorZero();
+    for (uint32_t i = 0; i < n_idx; ++i)
+        mesh_center = XMVectorAdd(mesh_center, XMLoadFloat3(&vertices[indices[i]].position));
+    mesh_center = XMVectorScale(mesh_center, 1.0f / n_idx);
+
+    for (uint32_t c = 0; c < n_clusters; ++c) {
+        XMVECTOR centroid = XMVectorZero();
+        XMVECTOR normal = XMVectorZero();
+        float area = 0.0f;
+        for (uint32_t t = clusters[c].begin; t < clusters[c].end; ++t) {
+            XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3 + 0]].position);
+            XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].position);
+            XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].position);
+            // front faces are clockwise, which makes this the outward normal (times 2 * area)
+            XMVECTOR n = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+            float a = XMVectorGetX(XMVector3Length(n));
+            centroid = XMVectorAdd(centroid, XMVectorScale(XMVectorAdd(p0, XMVectorAdd(p1, p2)), a / 3.0f));
+            normal = XMVectorAdd(normal, n);
+            area += a;
+        }
+        float key = 0.0f;
+        if (area > 0.0f) {
+            centroid = XMVectorScale(centroid, 1.0f / area);
+            normal = XMVector3Normalize(normal);
+            key = XMVectorGetX(XMVector3Dot(XMVectorSubtract(centroid, mesh_center), normal));
+        }
+        clusters[c].key = key;
+    }
+    qsort(clusters, n_clusters, sizeof(MeshOptCluster), mesh_opt_compare_clusters);
+
+    uint32_t * result = (uint32_t *)::malloc(sizeof(uint32_t) * n_tris * 3);
+    uint32_t k = 0;
+    for (uint32_t c = 0; c < n_clusters; ++c) {
+        uint32_t count = (clusters[c].end - clusters[c].begin) * 3;
+        memcpy(&result[k], &indices[clusters[c].begin * 3], sizeof(uint32_t) * count);
+        k += count;
+    }
+    SIMPLE_ASSERT(k == n_tris * 3, "clusters must cover every triangle");
+
+    // The sort key is only a heuristic and the cluster order costs cache hits and fetches, so it
+    // has to pay for itself: keep it only when it draws fewer pixels than the cache order.
+    // Both orders cover the same pixels, only the shaded count differs.
+    MeshOptOverdraw cache_order = mesh_opt_measure_overdraw(indices, k, vertices, n_vtx);
+    MeshOptOverdraw cluster_order = mesh_opt_measure_overdraw(result, k, vertices, n_vtx);
+    if (cluster_order.shaded < cache_order.shaded)
+        memcpy(indices, result, sizeof(uint32_t) * k);
+
+    ::free(result);
+    ::free(clusters);
+    ::free(hard);
+    ::free(stamps);
+}
+
+// -- vertex fetch
+
+// Fetches the vertex at byte offset into the direct mapped line cache, returns the bytes read.
+static size_t
+mesh_opt_fetch_vertex (size_t offset, uint32_t vertex_stride, size_t lines []) {
+    size_t fetched = 0;
+    size_t first = offset / MESH_OPT_FETCH_LINE;
+    size_t last = (offset + vertex_stride - 1) / MESH_OPT_FETCH_LINE;
+    for (size_t l = first; l <= last; ++l) {
+        if (lines[l % MESH_OPT_FETCH_LINES] != l) {
+            lines[l % MESH_OPT_FETCH_LINES] = l;
+            fetched += MESH_OPT_FETCH_LINE;
+        }
+    }
+    return fetched;
+}
+// Bytes MeshOpt_Analyze would fetch with vertex v stored at slot remap[v].
+static size_t
+mesh_opt_count_fetched (uint32_t const indices [], uint32_t n_idx, uint32_t const remap [], uint32_t n_vtx) {
+    uint32_t * stamps = (uint32_t *)::calloc(n_vtx, sizeof(uint32_t));
+    size_t lines[MESH_OPT_FETCH_LINES];
+    for (uint32_t i = 0; i < MESH_OPT_FETCH_LINES; ++i)
+        lines[i] = (size_t)-1;
+
+    uint32_t n_insertions = 0;
+    size_t fetched = 0;
+    for (uint32_t i = 0; i < n_idx; ++i) {
+        uint32_t v = indices[i];
+        if (mesh_opt_fifo_touch(v, stamps, &n_insertions, MESH_OPT_VCACHE_SIZE))
+            fetched += mesh_opt_fetch_vertex((size_t)remap[v] * sizeof(MeshOptVertex), sizeof(MeshOptVertex), lines);
+    }
+    ::free(stamps);
+    return fetched;
+}
+uint32_t
+MeshOpt_OptimizeVertexFetch (MeshOptVertex vertices [], uint32_t n_vtx, uint32_t indices [], uint32_t n_idx) {
+    uint32_t * remap = (uint32_t *)::malloc(sizeof(uint32_t) * n_vtx);
+    uint32_t * kept = (uint32_t *)::malloc(sizeof(uint32_t) * n_vtx);
+    memset(remap, 0xff, sizeof(uint32_t) * n_vtx);
+
+    uint32_t n_used = 0;
+    for (uint32_t i = 0; i < n_idx; ++i) {
+        uint32_t v = indices[i];
+        SIMPLE_ASSERT(v < n_vtx, "index out of range");
+        if (MESH_OPT_INVALID == remap[v])
+            remap[v] = n_used++;
+    }
+
+    // First-use order is not always cheaper: after the overdraw pass a vertex shared by clusters
+    // drawn far apart lands next to whichever cluster used it first. Then keep the current order
+    // and only drop the unused vertices.
+    uint32_t n_kept = 0;
+    for (uint32_t v = 0; v < n_vtx; ++v)
+        kept[v] = (MESH_OPT_INVALID != remap[v]) ? n_kept++ : MESH_OPT_INVALID;
+    if (mesh_opt_count_fetched(indices, n_idx, kept, n_vtx) <= mesh_opt_count_fetched(indices, n_idx, remap, n_vtx))
+        memcpy(remap, kept, sizeof(uint32_t) * n_vtx);
+
+    for (uint32_t i = 0; i < n_idx; ++i)
+        indices[i] = remap[indices[i]];
+
+    MeshOptVertex * tmp = (MeshOptVertex *)::malloc(sizeof(MeshOptVertex) * n_vtx);
+    memcpy(tmp, vertices, sizeof(MeshOptVertex) * n_vtx);
+    for (uint32_t v = 0; v < n_vtx; ++v)
+        if (MESH_OPT_INVALID != remap[v])
+            vertices[remap[v]] = tmp[v];
+
+    ::free(tmp);
+    ::free(kept);
+    ::free(remap);
+    return n_used;
+}
+
+// -- quantization
+
+static uint16_t
+mesh_opt_unorm16 (float v) {
+    v = (v < 0.0f) ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint16_t)(v * 65535.0f + 0.5f);
+}
+static int16_t
+mesh_opt_snorm16 (float v) {
+    v = (v < -1.0f) ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int16_t)(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+}
+void
+MeshOpt_Quantize (MeshOptVertex const vertices [], uint32_t n_vtx, MeshOptQuantizedVertex out_vertices [], MeshOptDequant * out_dequant) {
+    XMFLOAT3 lo = (n_vtx > 0) ? vertices[0].position : XMFLOAT3(0.0f, 0.0f, 0.0f);
+    XMFLOAT3 hi = lo;
+    for (uint32_t i = 1; i < n_vtx; ++i) {
+        XMFLOAT3 const & p = vertices[i].position;
+        lo.x = (p.x < lo.x) ? p.x : lo.x; hi.x = (p.x > hi.x) ? p.x : hi.x;
+        lo.y = (p.y < lo.y) ? p.y : lo.y; hi.y = (p.y > hi.y) ? p.y : hi.y;
+        lo.z = (p.z < lo.z) ? p.z : lo.z; hi.z = (p.z > hi.z) ? p.z : hi.z;
+    }
+    XMFLOAT3 extent(hi.x - lo.x, hi.y - lo.y, hi.z - lo.z);
+    XMFLOAT3 inv_extent(
+        extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+        extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+        extent.z > 0.0f ? 1.0f / extent.z : 0.0f
+    );
+    out_dequant->scale = extent;
+    out_dequant->bias = lo;
+
+    for (uint32_t i = 0; i < n_vtx; ++i) {
+        XMFLOAT3 const & p = vertices[i].position;
+        out_vertices[i].position[0] = mesh_opt_unorm16((p.x - lo.x) * inv_extent.x);
+        out_vertices[i].position[1] = mesh_opt_unorm16((p.y - lo.y) * inv_extent.y);
+        out_vertices[i].position[2] = mesh_opt_unorm16((p.z - lo.z) * inv_extent.z);
+        out_vertices[i].position[3] = 0;
+
+        // Octahedral encoding: project on the octahedron |x| + |y| + |z| = 1 and fold the
+        // lower half over the diagonals, the shader unfolds it.
+        XMFLOAT3 const & n = vertices[i].normal;
+        float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+        float x = (l1 > 0.0f) ? n.x / l1 : 0.0f;
+        float y = (l1 > 0.0f) ? n.y / l1 : 0.0f;
+        if (n.z < 0.0f) {
+            float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+        out_vertices[i].normal[0] = mesh_opt_snorm16(x);
+        out_vertices[i].normal[1] = mesh_opt_snorm16(y);
+    }
+}
+bool
+MeshOpt_FitsIndex16 (uint32_t n_vtx) {
+    return n_vtx <= 0x10000;
+}
+void
+MeshOpt_PackIndices16 (uint32_t const indices [], uint32_t n_idx, uint16_t out_indices []) {
+    for (uint32_t i = 0; i < n_idx; ++i) {
+        SIMPLE_ASSERT(indices[i] <= 0xffff, "index does not fit 16 bits");
+        out_indices[i] = (uint16_t)indices[i];
+    }
+}
+
+// -- analysis
+
+MeshOptStats
+MeshOpt_Analyze (uint32_t const indices [], uint32_t n_idx, MeshOptVertex const vertices [], uint32_t n_vtx, uint32_t vertex_stride, uint32_t index_size) {
+    MeshOptStats ret = {};
+    ret.n_vtx = n_vtx;
+    ret.n_tris = n_idx / 3;
+    ret.vb_bytes = (size_t)n_vtx * vertex_stride;
+    ret.ib_bytes = (size_t)n_idx * index_size;
+
+    uint32_t * stamps = (uint32_t *)::calloc(n_vtx, sizeof(uint32_t));
+    uint8_t * referenced = (uint8_t *)::calloc(n_vtx, sizeof(uint8_t));
+    size_t lines[MESH_OPT_FETCH_LINES];
+    for (uint32_t i = 0; i < MESH_OPT_FETCH_LINES; ++i)
+        lines[i] = (size_t)-1;
+
+    uint32_t n_insertions = 0;
+    uint32_t n_referenced = 0;
+    uint32_t n_transformed = 0;
+    size_t fetched = 0;
+    for (uint32_t i = 0; i < n_idx; ++i) {
+        uint32_t v = indices[i];
+        SIMPLE_ASSERT(v < n_vtx, "index out of range");
+        if (!referenced[v]) {
+            referenced[v] = 1;
+            ++n_referenced;
+        }
+        if (mesh_opt_fifo_touch(v, stamps, &n_insertions, MESH_OPT_VCACHE_SIZE)) {
+            ++n_transformed;
+
+            // only transformed vertices are fetched
+            fetched += mesh_opt_fetch_vertex((size_t)v * vertex_stride, vertex_stride, lines);
+        }
+    }
+    ret.acmr = (ret.n_tris > 0) ? (float)n_transformed / ret.n_tris : 0.0f;
+    ret.atvr = (n_referenced > 0) ? (float)n_transformed / n_referenced : 0.0f;
+    ret.overfetch = (ret.vb_bytes > 0) ? (float)fetched / ret.vb_bytes : 0.0f;
+
+    MeshOptOverdraw overdraw = mesh_opt_measure_overdraw(indices, n_idx, vertices, n_vtx);
+    ret.overdraw = (overdraw.covered > 0) ? (float)overdraw.shaded / overdraw.covered : 0.0f;
+
+    ::free(referenced);
+    ::free(stamps);
+    return ret;
+}
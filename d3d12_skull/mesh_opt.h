@@ -0,0 +1,83 @@
+#pragma once
+#include "headers/common.h"
+#include <DirectXMath.h>
+
+// At-load optimization of indexed triangle meshes (the skull/car models).
+// The usual order is:
+//      MeshOpt_WeldVertices         merge bitwise identical vertices
+//      MeshOpt_OptimizeVertexCache  reorder triangles for post-transform cache reuse
+//      MeshOpt_OptimizeOverdraw     reorder clusters of those triangles outside-in, if it draws less
+//      MeshOpt_OptimizeVertexFetch  reorder vertices in first-use order
+// then optionally MeshOpt_Quantize and MeshOpt_PackIndices16.
+// All passes work in place on 32-bit indices and keep the triangle set (and winding) intact.
+
+// Bump whenever a pass changes its output for the same input; compiled meshes (see mesh_cache.h)
+// built by another version are rebuilt
+#define MESH_OPT_VERSION                3
+// FIFO entries MeshOpt_OptimizeVertexCache targets and the analysis simulates
+#define MESH_OPT_VCACHE_SIZE            16
+// Clusters may be cut while their ACMR stays within this factor of the cache-optimized one
+#define MESH_OPT_OVERDRAW_THRESHOLD     1.05f
+// Overdraw is estimated by rasterizing the mesh into a square depth buffer of this size, once per
+// view direction (the 6 axes and the 8 cube diagonals)
+#define MESH_OPT_OVERDRAW_GRID          256
+#define MESH_OPT_OVERDRAW_VIEWS         14
+
+// Unquantized vertex, same layout as the demo's Vertex
+struct MeshOptVertex {
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT3 normal;
+};
+// 12 bytes instead of 24:
+// position as R16G16B16A16_UNORM inside the mesh bounds (w = 0),
+// normal as R16G16_SNORM octahedral encoding.
+struct MeshOptQuantizedVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+};
+// position = bias + scale * unorm (unorm being the [0, 1] value the input assembler fetches)
+struct MeshOptDequant {
+    DirectX::XMFLOAT3 scale;
+    DirectX::XMFLOAT3 bias;
+};
+
+struct MeshOptStats {
+    uint32_t n_vtx;
+    uint32_t n_tris;
+    size_t vb_bytes;
+    size_t ib_bytes;
+    // post-transform cache (MESH_OPT_VCACHE_SIZE FIFO)
+    float acmr;         // transformed vertices per triangle
+    float atvr;         // transformed per referenced vertex
+    // pre-transform fetch: bytes read from memory / vertex buffer size (64-byte lines, 8KB cache)
+    float overfetch;
+    // depth complexity: pixels passing the depth test / pixels covered, over the overdraw views
+    // (orthographic, back faces culled, triangles drawn in index order)
+    float overdraw;
+};
+
+// Returns the new vertex count; vertices are compacted in place and indices remapped.
+uint32_t
+MeshOpt_WeldVertices (MeshOptVertex vertices [], uint32_t n_vtx, uint32_t indices [], uint32_t n_idx);
+// Keeps the input order when it already misses the cache less.
+void
+MeshOpt_OptimizeVertexCache (uint32_t indices [], uint32_t n_idx, uint32_t n_vtx);
+// Expects cache-optimized indices. Splits them in clusters where the cache restarts (and where
+// the local ACMR stays under threshold * ACMR) and sorts the clusters by how much they face
+// outward, so near surfaces tend to be drawn before the ones they hide. The sorted order is only
+// kept when it measures less overdraw than the input one.
+void
+MeshOpt_OptimizeOverdraw (uint32_t indices [], uint32_t n_idx, MeshOptVertex const vertices [], uint32_t n_vtx, float threshold);
+// Returns the # of vertices kept (unreferenced ones are dropped). Keeps the current vertex order
+// when it already fetches less than first-use order.
+uint32_t
+MeshOpt_OptimizeVertexFetch (MeshOptVertex vertices [], uint32_t n_vtx, uint32_t indices [], uint32_t n_idx);
+void
+MeshOpt_Quantize (MeshOptVertex const vertices [], uint32_t n_vtx, MeshOptQuantizedVertex out_vertices [], MeshOptDequant * out_dequant);
+// 16-bit indices are enough when every vertex is addressable.
+bool
+MeshOpt_FitsIndex16 (uint32_t n_vtx);
+void
+MeshOpt_PackIndices16 (uint32_t const indices [], uint32_t n_idx, uint16_t out_indices []);
+MeshOptStats
+MeshOpt_Analyze (uint32_t const indices [], uint32_t n_idx, MeshOptVertex const vertices [], uint32_t n_vtx, uint32_t vertex_stride, uint32_t index_size);
@@ -0,0 +1,374 @@
+#include "model_loader.h"
+
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#define MODEL_LOADER_CHUNKS_PER_THREAD  4
+// significant digits kept in the mantissa, more than a float (or a double) can hold
+#define MODEL_LOADER_MAX_DIGITS         19
+
+enum MODEL_LIST : int {
+    MODEL_LIST_VERTICES = 0,
+    MODEL_LIST_TRIANGLES = 1,
+
+    _COUNT_MODEL_LIST
+};
+
+struct ModelChunk {
+    MODEL_LIST list;
+    char const * begin;     // starts a line
+    char const * end;       // one past a '\n' (or the end of the list)
+    uint32_t first_record;  // filled in between the count and the parse pass
+    uint32_t n_records;
+    bool ok;
+};
+
+// -- number parsing
+
+static bool
+model_is_blank (char c) {
+    return ' ' == c || '\t' == c || '\r' == c;
+}
+static char const *
+model_skip_blanks (char const * p, char const * end) {
+    while (p < end && model_is_blank(*p))
+        ++p;
+    return p;
+}
+static double
+model_pow10 (int e) {
+    // exact up to 1e22
+    static double const table[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    double ret = 1.0;
+    while (e > 22) {
+        ret *= 1e22;
+        e -= 22;
+    }
+    return ret * table[e];
+}
+// A number has to end at a blank, a line end or the end of the text.
+static bool
+model_at_separator (char const * p, char const * end) {
+    return p == end || model_is_blank(*p) || '\n' == *p;
+}
+// [+-]digits[.digits][(e|E)[+-]digits], also ".5" and "5."
+static bool
+model_parse_float (char const ** cursor, char const * end, float * out) {
+    char const * p = model_skip_blanks(*cursor, end);
+    bool negative = false;
+    if (p < end && ('-' == *p || '+' == *p))
+        negative = ('-' == *p++);
+
+    uint64_t mantissa = 0;
+    int n_significant = 0;
+    int n_digits = 0;
+    int exp10 = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++n_digits) {
+        if (n_significant < MODEL_LOADER_MAX_DIGITS) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            n_significant += (0 != mantissa) ? 1 : 0;
+        } else {
+            ++exp10;
+        }
+    }
+    if (p < end && '.' == *p) {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++n_digits) {
+            if (n_significant < MODEL_LOADER_MAX_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                n_significant += (0 != mantissa) ? 1 : 0;
+                --exp10;
+            }
+        }
+    }
+    if (0 == n_digits)
+        return false;
+    if (p < end && ('e' == *p || 'E' == *p)) {
+        ++p;
+        bool negative_exp = false;
+        if (p < end && ('-' == *p || '+' == *p))
+            negative_exp = ('-' == *p++);
+        int e = 0;
+        int n_exp_digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, ++n_exp_digits)
+            e = (e < 10000) ? e * 10 + (*p - '0') : e;
+        if (0 == n_exp_digits)
+            return false;
+        exp10 += negative_exp ? -e : e;
+    }
+    if (!model_at_separator(p, end))
+        return false;
+
+    // mantissa < 2^63 and the power of ten are exact (for |exp10| <= 22), so this is one rounding
+    // to double and one to float
+    double value = (double)mantissa;
+    if (exp10 < -600 || 0 == mantissa)
+        value = 0.0;
+    else if (exp10 < 0)
+        value /= model_pow10(-exp10);
+    else if (exp10 > 0)
+        value = (exp10 > 600) ? HUGE_VAL : value * model_pow10(exp10);
+    *out = (float)(negative ? -value : value);
+    *cursor = p;
+    return true;
+}
+static bool
+model_parse_uint (char const ** cursor, char const * end, uint32_t * out) {
+    char const * p = model_skip_blanks(*cursor, end);
+    uint64_t value = 0;
+    char const * first = p;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        value = value * 10 + (uint64_t)(*p - '0');
+        if (value > 0xffffffffull)
+            return false;
+    }
+    if (p == first || !model_at_separator(p, end))
+        return false;
+    *out = (uint32_t)value;
+    *cursor = p;
+    return true;
+}
+
+// -- chunks
+
+// Records are the non-blank lines of a list.
+static uint32_t
+model_count_records (char const * p, char const * end) {
+    uint32_t ret = 0;
+    bool content = false;
+    for (; p < end; ++p) {
+        if ('\n' == *p) {
+            ret += content ? 1 : 0;
+            content = false;
+        } else if (!model_is_blank(*p)) {
+            content = true;
+        }
+    }
+    return ret + (content ? 1 : 0);
+}
+static void
+model_parse_chunk (ModelChunk * chunk, Model * model) {
+    char const * p = chunk->begin;
+    char const * end = chunk->end;
+    uint32_t record = chunk->first_record;
+    uint32_t last = chunk->first_record + chunk->n_records;
+    chunk->ok = false;
+    while (p < end) {
+        // -- skip blank lines
+        p = model_skip_blanks(p, end);
+        if (p < end && '\n' == *p) {
+            ++p;
+            continue;
+        }
+        if (p == end || record == last)
+            break;
+
+        bool ok;
+        if (MODEL_LIST_VERTICES == chunk->list) {
+            ModelVertex * v = &model->vertices[record];
+            ok = model_parse_float(&p, end, &v->position.x) && model_parse_float(&p, end, &v->position.y) &&
+                 model_parse_float(&p, end, &v->position.z) && model_parse_float(&p, end, &v->normal.x) &&
+                 model_parse_float(&p, end, &v->normal.y) && model_parse_float(&p, end, &v->normal.z);
+        } else {
+            uint32_t * tri = &model->indices[record * 3];
+            ok = model_parse_uint(&p, end, &tri[0]) && model_parse_uint(&p, end, &tri[1]) &&
+                 model_parse_uint(&p, end, &tri[2]) &&
+                 tri[0] < model->n_vtx && tri[1] < model->n_vtx && tri[2] < model->n_vtx;
+        }
+        // nothing else may follow on the line
+        p = model_skip_blanks(p, end);
+        if (!ok || (p < end && '\n' != *p)) {
+            printf("model: bad %s %u\n", (MODEL_LIST_VERTICES == chunk->list) ? "vertex" : "triangle", record);
+            return;
+        }
+        ++record;
+    }
+    chunk->ok = (record == last);
+}
+// Splits [begin, end) at line starts into pieces of at least MODEL_LOADER_MIN_CHUNK bytes.
+static uint32_t
+model_split_list (MODEL_LIST list, char const * begin, char const * end, uint32_t n_pieces, ModelChunk out_chunks []) {
+    size_t size = (size_t)(end - begin);
+    size_t piece = size / n_pieces + 1;
+    piece = (piece < MODEL_LOADER_MIN_CHUNK) ? MODEL_LOADER_MIN_CHUNK : piece;
+
+    uint32_t ret = 0;
+    char const * p = begin;
+    while (p < end) {
+        char const * cut = ((size_t)(end - p) > piece) ? p + piece : end;
+        if (cut < end) {
+            char const * nl = (char const *)memchr(cut, '\n', (size_t)(end - cut));
+            cut = nl ? nl + 1 : end;
+        }
+        out_chunks[ret++] = {list, p, cut, 0, 0, false};
+        p = cut;
+    }
+    return ret;
+}
+// Runs fn on every chunk on up to n_threads threads (the caller is one of them).
+template <typename F>
+static void
+model_for_each_chunk (ModelChunk chunks [], uint32_t n_chunks, int n_threads, F const & fn) {
+    std::atomic<uint32_t> next(0);
+    auto work = [&]() {
+        for (uint32_t c = next++; c < n_chunks; c = next++)
+            fn(&chunks[c]);
+    };
+    int n_workers = ((uint32_t)n_threads < n_chunks ? n_threads : (int)n_chunks) - 1;
+    std::thread * workers = (n_workers > 0) ? new std::thread[n_workers] : nullptr;
+    for (int i = 0; i < n_workers; ++i)
+        workers[i] = std::thread(work);
+    work();
+    for (int i = 0; i < n_workers; ++i)
+        workers[i].join();
+    delete [] workers;
+}
+
+// -- header
+
+// Finds "name" at a line start at or after *cursor and leaves *cursor after it.
+static bool
+model_find_line (char const ** cursor, char const * end, char const * name) {
+    size_t len = strlen(name);
+    for (char const * p = *cursor; p + len <= end; ) {
+        p = model_skip_blanks(p, end);
+        if ((size_t)(end - p) >= len && 0 == memcmp(p, name, len)) {
+            *cursor = p + len;
+            return true;
+        }
+        char const * nl = (char const *)memchr(p, '\n', (size_t)(end - p));
+        if (nullptr == nl)
+            break;
+        p = nl + 1;
+    }
+    return false;
+}
+// Body of the { } block following *cursor: [*out_begin, *out_end) excludes both braces.
+static bool
+model_find_block (char const ** cursor, char const * end, char const ** out_begin, char const ** out_end) {
+    char const * open = (char const *)memchr(*cursor, '{', (size_t)(end - *cursor));
+    if (nullptr == open)
+        return false;
+    char const * close = (char const *)memchr(open + 1, '}', (size_t)(end - open - 1));
+    if (nullptr == close)
+        return false;
+    *out_begin = open + 1;
+    *out_end = close;
+    *cursor = close + 1;
+    return true;
+}
+
+bool
+ModelLoader_ParseText (char const * text, size_t size, int n_threads, Model * out_model) {
+    *out_model = {};
+    if (n_threads <= MODEL_LOADER_THREADS_AUTO) {
+        unsigned hw = std::thread::hardware_concurrency();
+        n_threads = (hw > 0) ? (int)hw : 1;
+    }
+
+    char const * end = text + size;
+    char const * p = text;
+    uint32_t n_vtx = 0;
+    uint32_t n_tris = 0;
+    char const * list_begin[_COUNT_MODEL_LIST];
+    char const * list_end[_COUNT_MODEL_LIST];
+    bool ok =
+        model_find_line(&p, end, "VertexCount:") && model_parse_uint(&p, end, &n_vtx) &&
+        model_find_line(&p, end, "TriangleCount:") && model_parse_uint(&p, end, &n_tris) &&
+        model_find_line(&p, end, "VertexList") &&
+        model_find_block(&p, end, &list_begin[MODEL_LIST_VERTICES], &list_end[MODEL_LIST_VERTICES]) &&
+        model_find_line(&p, end, "TriangleList") &&
+        model_find_block(&p, end, &list_begin[MODEL_LIST_TRIANGLES], &list_end[MODEL_LIST_TRIANGLES]) &&
+        n_tris <= 0xffffffffu / 3;
+    if (!ok) {
+        printf("model: malformed header\n");
+        return false;
+    }
+
+    // -- cut both lists, count their records in parallel, then parse straight into place
+    uint32_t n_pieces = (uint32_t)n_threads * MODEL_LOADER_CHUNKS_PER_THREAD;
+    uint32_t max_chunks = 0;
+    for (int l = 0; l < _COUNT_MODEL_LIST; ++l)
+        max_chunks += (uint32_t)((list_end[l] - list_begin[l]) / MODEL_LOADER_MIN_CHUNK) + 2;
+    max_chunks = (max_chunks < 2 * (n_pieces + 1)) ? max_chunks : 2 * (n_pieces + 1);
+    ModelChunk * chunks = (ModelChunk *)::malloc(sizeof(ModelChunk) * max_chunks);
+    uint32_t n_chunks = 0;
+    for (int l = 0; l < _COUNT_MODEL_LIST; ++l)
+        n_chunks += model_split_list((MODEL_LIST)l, list_begin[l], list_end[l], n_pieces, &chunks[n_chunks]);
+
+    model_for_each_chunk(chunks, n_chunks, n_threads, [](ModelChunk * c) {
+        c->n_records = model_count_records(c->begin, c->end);
+    });
+    uint32_t n_records[_COUNT_MODEL_LIST] = {};
+    for (uint32_t c = 0; c < n_chunks; ++c) {
+        chunks[c].first_record = n_records[chunks[c].list];
+        n_records[chunks[c].list] += chunks[c].n_records;
+    }
+    if (n_records[MODEL_LIST_VERTICES] != n_vtx || n_records[MODEL_LIST_TRIANGLES] != n_tris) {
+        printf("model: expected %u vertices and %u triangles, found %u and %u\n",
+               n_vtx, n_tris, n_records[MODEL_LIST_VERTICES], n_records[MODEL_LIST_TRIANGLES]);
+        ::free(chunks);
+        return false;
+    }
+
+    Model model = {};
+    model.n_vtx = n_vtx;
+    model.n_idx = n_tris * 3;
+    model.vertices = (ModelVertex *)::malloc(sizeof(ModelVertex) * (n_vtx ? n_vtx : 1));
+    model.indices = (uint32_t *)::malloc(sizeof(uint32_t) * (model.n_idx ? model.n_idx : 1));
+    model_for_each_chunk(chunks, n_chunks, n_threads, [&model](ModelChunk * c) {
+        model_parse_chunk(c, &model);
+    });
+    for (uint32_t c = 0; c < n_chunks; ++c)
+        ok = ok && chunks[c].ok;
+    ::free(chunks);
+
+    if (!ok) {
+        ModelLoader_Free(&model);
+        return false;
+    }
+    *out_model = model;
+    return true;
+}
+bool
+ModelLoader_LoadText (char const * path, int n_threads, Model * out_model) {
+    *out_model = {};
+    FILE * f = nullptr;
+#if defined(_MSC_VER)
+    if (0 != fopen_s(&f, path, "rb"))
+        f = nullptr;
+#else
+    f = fopen(path, "rb");
+#endif
+    if (nullptr == f) {
+        printf("model: could not open %s\n", path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char * text = (size >= 0) ? (char *)::malloc((size_t)size + 1) : nullptr;
+    bool ok = text && (size_t)size == fread(text, 1, (size_t)size, f);
+    fclose(f);
+    if (!ok) {
+        printf("model: could not read %s\n", path);
+        ::free(text);
+        return false;
+    }
+    ok = ModelLoader_ParseText(text, (size_t)size, n_threads, out_model);
+    ::free(text);
+    return ok;
+}
+void
+ModelLoader_Free (Model * model) {
+    ::free(model->vertices);
+    ::free(model->indices);
+    *model = {};
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Loader for the text models (skull.txt, car.txt):
+//      VertexCount: N
+//      TriangleCount: M
+//      VertexList (pos, normal)
+//      {
+//          px py pz nx ny nz       (N lines)
+//      }
+//      TriangleList
+//      {
+//          i0 i1 i2                (M lines)
+//      }
+// The file is read in one go, both lists are cut into chunks at line boundaries and the chunks
+// are parsed in parallel. Numbers are parsed by hand, so the result does not depend on the C locale.
+
+// threads <= 0 uses all hardware threads
+#define MODEL_LOADER_THREADS_AUTO   0
+// Lists are cut into chunks of at least this many bytes (small models stay single threaded)
+#define MODEL_LOADER_MIN_CHUNK      (64 * 1024)
+
+// Same layout as the demo's Vertex and MeshOptVertex
+struct ModelVertex {
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT3 normal;
+};
+struct Model {
+    ModelVertex * vertices;
+    uint32_t n_vtx;
+    uint32_t * indices;     // 3 per triangle, validated against n_vtx
+    uint32_t n_idx;
+};
+
+// Returns false on I/O or format errors (printing what and where), *out_model is left empty then.
+bool
+ModelLoader_LoadText (char const * path, int n_threads, Model * out_model);
+// Same as ModelLoader_LoadText on a file already in memory (text need not be NUL-terminated).
+bool
+ModelLoader_ParseText (char const * text, size_t size, int n_threads, Model * out_model);
+void
+ModelLoader_Free (Model * model);
@@ -12,6 +12,8 @@
 
 cbuffer PerObjectConstantBuffer : register(b0) {
     float4x4 global_world;
+    float4 global_pos_scale;
+    float4 global_pos_bias;
 }
 cbuffer MaterialConstantBuffer : register(b1) {
     float4 global_diffuse_albedo;
@@ -46,6 +48,11 @@ struct VertexShaderInput {
     float3 pos_local  : POSITION;
     float3 normal_local : NORMAL;
 };
+// mesh_opt.h MeshOptQuantizedVertex
+struct VertexShaderInputQuantized {
+    float4 pos_unorm : POSITION;    // R16G16B16A16_UNORM inside the mesh bounds
+    float2 normal_oct : NORMAL;     // R16G16_SNORM octahedral
+};
 struct VertexShaderOutput {
     float4 pos_homogenous_clip_space : SV_Position;
     float3 pos_world : Position;
@@ -67,6 +74,21 @@ VertexShader_Main (VertexShaderInput vin) {
 
     return res;
 }
+float3
+decode_octahedral (float2 e) {
+    float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    // unfold the lower hemisphere
+    if (n.z < 0.0f)
+        n.xy = (1.0f - abs(n.yx)) * (step(0.0f, n.xy) * 2.0f - 1.0f);
+    return normalize(n);
+}
+VertexShaderOutput
+VertexShader_Quantized (VertexShaderInputQuantized vin) {
+    VertexShaderInput v;
+    v.pos_local = global_pos_bias.xyz + global_pos_scale.xyz * vin.pos_unorm.xyz;
+    v.normal_local = decode_octahedral(vin.normal_oct);
+    return VertexShader_Main(v);
+}
 float4
 PixelShader_Main (VertexShaderOutput pin) : SV_Target {
     // interpolations of normal can unnormalize it so renormalize!
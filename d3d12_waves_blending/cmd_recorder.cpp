@@ -0,0 +1,336 @@
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS     // plain fopen for the capture files
+#endif
+
+#include "cmd_recorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CMD_CAPTURE_MAGIC           0x43444d43u     // "CMDC"
+#define CMD_CAPTURE_VERSION         2
+#define CMD_CAPTURE_PAYLOAD_ALIGN   16
+
+int
+CmdRecorder_ChunkCount (int n_items, int max_chunks, int min_items_per_chunk) {
+    int min_items = (min_items_per_chunk > 1) ? min_items_per_chunk : 1;
+    int n_chunks = n_items / min_items;
+    n_chunks = (n_chunks < max_chunks) ? n_chunks : max_chunks;
+    return (n_chunks > 1) ? n_chunks : 1;
+}
+void
+CmdRecorder_SplitRange (int n_items, int n_chunks, int out_begin []) {
+    SIMPLE_ASSERT(n_items >= 0 && n_chunks > 0, "Invalid chunk split");
+    // 64-bit product so large lists can't overflow
+    for (int c = 0; c <= n_chunks; ++c)
+        out_begin[c] = (int)((int64_t)n_items * c / n_chunks);
+}
+struct CmdRecordJob {
+    int const * begin;
+    CmdRecorder * recorders;
+    void * ctx;
+    CmdRecordChunkFn fn;
+};
+static void
+cmd_record_chunks (void * ctx, int chunk_begin, int chunk_end) {
+    CmdRecordJob const * job = reinterpret_cast<CmdRecordJob const *>(ctx);
+    for (int c = chunk_begin; c < chunk_end; ++c)
+        job->fn(job->ctx, c, &job->recorders[c], job->begin[c], job->begin[c + 1]);
+}
+void
+CmdRecorder_RecordChunks (Scheduler * sched, int n_items, int n_chunks, CmdRecorder recorders [], void * ctx, CmdRecordChunkFn fn) {
+    SIMPLE_ASSERT(n_chunks > 0 && n_chunks <= CMD_RECORDER_MAX_CHUNKS, "Invalid chunk count");
+    int begin[CMD_RECORDER_MAX_CHUNKS + 1];
+    CmdRecorder_SplitRange(n_items, n_chunks, begin);
+
+    CmdRecordJob job = {begin, recorders, ctx, fn};
+    if (1 == n_chunks)
+        cmd_record_chunks(&job, 0, 1);
+    else
+        Scheduler_ParallelForRange(sched, 0, n_chunks, 1, &job, cmd_record_chunks);
+}
+
+// -- null backend
+
+static void
+cmd_null_set_pipeline_state (void * ctx, uint32_t) {
+    ++reinterpret_cast<CmdNull *>(ctx)->n_calls[CMD_OP_SET_PIPELINE_STATE];
+}
+static void
+cmd_null_set_geometry (void * ctx, uint32_t) {
+    ++reinterpret_cast<CmdNull *>(ctx)->n_calls[CMD_OP_SET_GEOMETRY];
+}
+static void
+cmd_null_set_topology (void * ctx, uint32_t) {
+    ++reinterpret_cast<CmdNull *>(ctx)->n_calls[CMD_OP_SET_TOPOLOGY];
+}
+static void
+cmd_null_set_root_table (void * ctx, uint32_t, uint64_t) {
+    ++reinterpret_cast<CmdNull *>(ctx)->n_calls[CMD_OP_SET_ROOT_TABLE];
+}
+static void
+cmd_null_set_root_cbv (void * ctx, uint32_t, uint64_t) {
+    ++reinterpret_cast<CmdNull *>(ctx)->n_calls[CMD_OP_SET_ROOT_CBV];
+}
+static void
+cmd_null_draw_indexed (void * ctx, uint32_t index_count, uint32_t instance_count, uint32_t, int32_t, uint32_t) {
+    CmdNull * null = reinterpret_cast<CmdNull *>(ctx);
+    ++null->n_calls[CMD_OP_DRAW_INDEXED];
+    null->n_indices += (uint64_t)index_count * instance_count;
+}
+static uint8_t *
+cmd_null_upload (void * ctx, uint32_t buffer, uint64_t offset, uint32_t size) {
+    CmdNull * null = reinterpret_cast<CmdNull *>(ctx);
+    ++null->n_calls[CMD_OP_UPLOAD];
+    null->n_upload_bytes += size;
+    return CmdUploadTable_Get(&null->uploads, buffer, offset, size);
+}
+static void
+cmd_null_set_root_constant (void * ctx, uint32_t, uint32_t, uint32_t) {
+    ++reinterpret_cast<CmdNull *>(ctx)->n_calls[CMD_OP_SET_ROOT_CONSTANT];
+}
+static CmdRecorderFns const cmd_null_fns = {
+    cmd_null_set_pipeline_state,
+    cmd_null_set_geometry,
+    cmd_null_set_topology,
+    cmd_null_set_root_table,
+    cmd_null_set_root_cbv,
+    cmd_null_draw_indexed,
+    cmd_null_upload,
+    cmd_null_set_root_constant,
+};
+void
+CmdNull_Init (CmdNull * null) {
+    memset(null, 0, sizeof(CmdNull));
+}
+void
+CmdNull_Reset (CmdNull * null) {
+    memset(null->n_calls, 0, sizeof(null->n_calls));
+    null->n_indices = 0;
+    null->n_upload_bytes = 0;
+}
+CmdRecorder
+CmdNull_GetRecorder (CmdNull * null) {
+    CmdRecorder ret = {&cmd_null_fns, null};
+    return ret;
+}
+
+// -- capture backend
+
+static CmdPacket *
+cmd_capture_push (void * ctx, uint32_t op) {
+    CmdCapture * capture = reinterpret_cast<CmdCapture *>(ctx);
+    if (capture->count == capture->capacity) {
+        capture->capacity = (capture->capacity > 0) ? capture->capacity * 2 : 1024;
+        capture->packets = (CmdPacket *)::realloc(capture->packets, sizeof(CmdPacket) * capture->capacity);
+        SIMPLE_ASSERT(capture->packets, "out of memory");
+    }
+    CmdPacket * p = &capture->packets[capture->count++];
+    memset(p, 0, sizeof(CmdPacket));
+    p->op = op;
+    return p;
+}
+static void
+cmd_capture_set_pipeline_state (void * ctx, uint32_t pso) {
+    cmd_capture_push(ctx, CMD_OP_SET_PIPELINE_STATE)->args[0] = pso;
+}
+static void
+cmd_capture_set_geometry (void * ctx, uint32_t geom) {
+    cmd_capture_push(ctx, CMD_OP_SET_GEOMETRY)->args[0] = geom;
+}
+static void
+cmd_capture_set_topology (void * ctx, uint32_t topology) {
+    cmd_capture_push(ctx, CMD_OP_SET_TOPOLOGY)->args[0] = topology;
+}
+static void
+cmd_capture_set_root_table (void * ctx, uint32_t param, uint64_t gpu_descriptor) {
+    CmdPacket * p = cmd_capture_push(ctx, CMD_OP_SET_ROOT_TABLE);
+    p->args[0] = param;
+    p->address = gpu_descriptor;
+}
+static void
+cmd_capture_set_root_cbv (void * ctx, uint32_t param, uint64_t gpu_address) {
+    CmdPacket * p = cmd_capture_push(ctx, CMD_OP_SET_ROOT_CBV);
+    p->args[0] = param;
+    p->address = gpu_address;
+}
+static void
+cmd_capture_draw_indexed (void * ctx, uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance) {
+    CmdPacket * p = cmd_capture_push(ctx, CMD_OP_DRAW_INDEXED);
+    p->args[0] = index_count;
+    p->args[1] = instance_count;
+    p->args[2] = start_index;
+    p->args[3] = (uint32_t)base_vertex;
+    p->args[4] = start_instance;
+}
+static uint8_t *
+cmd_capture_upload (void * ctx, uint32_t buffer, uint64_t offset, uint32_t size) {
+    CmdCapture * capture = reinterpret_cast<CmdCapture *>(ctx);
+    uint64_t at = (capture->payload_size + (CMD_CAPTURE_PAYLOAD_ALIGN - 1)) & ~(uint64_t)(CMD_CAPTURE_PAYLOAD_ALIGN - 1);
+    SIMPLE_ASSERT(at <= 0xffffffffu, "capture payload too large");
+    if (at + size > capture->payload_capacity) {
+        uint64_t capacity = (capture->payload_capacity > 0) ? capture->payload_capacity : 64 * 1024;
+        while (capacity < at + size)
+            capacity *= 2;
+        capture->payload = (uint8_t *)::realloc(capture->payload, (size_t)capacity);
+        SIMPLE_ASSERT(capture->payload, "out of memory");
+        capture->payload_capacity = capacity;
+    }
+    // padding, and whatever the caller leaves unwritten, stays zeroed so the same uploads always
+    // give the same file
+    memset(capture->payload + capture->payload_size, 0, (size_t)(at + size - capture->payload_size));
+    capture->payload_size = at + size;
+
+    CmdPacket * p = cmd_capture_push(ctx, CMD_OP_UPLOAD);
+    p->args[0] = buffer;
+    p->args[1] = size;
+    p->args[2] = (uint32_t)at;
+    p->address = offset;
+    return capture->payload + at;
+}
+static void
+cmd_capture_set_root_constant (void * ctx, uint32_t param, uint32_t offset, uint32_t value) {
+    CmdPacket * p = cmd_capture_push(ctx, CMD_OP_SET_ROOT_CONSTANT);
+    p->args[0] = param;
+    p->args[1] = offset;
+    p->args[2] = value;
+}
+static CmdRecorderFns const cmd_capture_fns = {
+    cmd_capture_set_pipeline_state,
+    cmd_capture_set_geometry,
+    cmd_capture_set_topology,
+    cmd_capture_set_root_table,
+    cmd_capture_set_root_cbv,
+    cmd_capture_draw_indexed,
+    cmd_capture_upload,
+    cmd_capture_set_root_constant,
+};
+void
+CmdCapture_Init (CmdCapture * capture) {
+    memset(capture, 0, sizeof(CmdCapture));
+}
+void
+CmdCapture_Free (CmdCapture * capture) {
+    ::free(capture->packets);
+    ::free(capture->payload);
+    memset(capture, 0, sizeof(CmdCapture));
+}
+void
+CmdCapture_Clear (CmdCapture * capture) {
+    capture->count = 0;
+    capture->payload_size = 0;
+}
+CmdRecorder
+CmdCapture_GetRecorder (CmdCapture * capture) {
+    CmdRecorder ret = {&cmd_capture_fns, capture};
+    return ret;
+}
+struct CmdCaptureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t packet_size;
+    uint32_t count;
+    uint64_t payload_size;
+};
+bool
+CmdCapture_WriteFile (CmdCapture const * capture, char const * path) {
+    FILE * f = fopen(path, "wb");
+    if (nullptr == f)
+        return false;
+    CmdCaptureHeader header = {CMD_CAPTURE_MAGIC, CMD_CAPTURE_VERSION, (uint32_t)sizeof(CmdPacket), (uint32_t)capture->count, capture->payload_size};
+    bool ok =
+        1 == fwrite(&header, sizeof(header), 1, f) &&
+        (size_t)capture->count == fwrite(capture->packets, sizeof(CmdPacket), (size_t)capture->count, f) &&
+        (size_t)capture->payload_size == fwrite(capture->payload, 1, (size_t)capture->payload_size, f);
+    ok = (0 == fclose(f)) && ok;
+    return ok;
+}
+bool
+CmdCapture_ReadFile (CmdCapture * capture, char const * path) {
+    CmdCapture_Clear(capture);
+    FILE * f = fopen(path, "rb");
+    if (nullptr == f)
+        return false;
+    CmdCaptureHeader header = {};
+    bool ok =
+        1 == fread(&header, sizeof(header), 1, f) &&
+        CMD_CAPTURE_MAGIC == header.magic && CMD_CAPTURE_VERSION == header.version &&
+        sizeof(CmdPacket) == header.packet_size && header.count <= 0x7fffffffu;
+    if (ok) {
+        if ((int)header.count > capture->capacity) {
+            capture->packets = (CmdPacket *)::realloc(capture->packets, sizeof(CmdPacket) * header.count);
+            capture->capacity = (int)header.count;
+        }
+        if (header.payload_size > capture->payload_capacity) {
+            capture->payload = (uint8_t *)::realloc(capture->payload, (size_t)header.payload_size);
+            capture->payload_capacity = header.payload_size;
+        }
+        ok = (0 == header.count || capture->packets) && (0 == header.payload_size || capture->payload) &&
+            header.count == fread(capture->packets, sizeof(CmdPacket), header.count, f) &&
+            (size_t)header.payload_size == fread(capture->payload, 1, (size_t)header.payload_size, f);
+    }
+    fclose(f);
+    // every upload has to point inside the payload
+    for (uint32_t i = 0; ok && i < header.count; ++i) {
+        CmdPacket const * p = &capture->packets[i];
+        ok = p->op < _COUNT_CMD_OP &&
+            (CMD_OP_UPLOAD != p->op || (uint64_t)p->args[2] + p->args[1] <= header.payload_size);
+    }
+    if (ok) {
+        capture->count = (int)header.count;
+        capture->payload_size = header.payload_size;
+    }
+    return ok;
+}
+void
+CmdCapture_Replay (CmdCapture const * capture, CmdRecorder * rec) {
+    for (int i = 0; i < capture->count; ++i) {
+        CmdPacket const * p = &capture->packets[i];
+        switch (p->op) {
+        case CMD_OP_SET_PIPELINE_STATE:
+            CmdRecorder_SetPipelineState(rec, p->args[0]);
+            break;
+        case CMD_OP_SET_GEOMETRY:
+            CmdRecorder_SetGeometry(rec, p->args[0]);
+            break;
+        case CMD_OP_SET_TOPOLOGY:
+            CmdRecorder_SetTopology(rec, p->args[0]);
+            break;
+        case CMD_OP_SET_ROOT_TABLE:
+            CmdRecorder_SetRootTable(rec, p->args[0], p->address);
+            break;
+        case CMD_OP_SET_ROOT_CBV:
+            CmdRecorder_SetRootCbv(rec, p->args[0], p->address);
+            break;
+        case CMD_OP_DRAW_INDEXED:
+            CmdRecorder_DrawIndexed(rec, p->args[0], p->args[1], p->args[2], (int32_t)p->args[3], p->args[4]);
+            break;
+        case CMD_OP_UPLOAD:
+            memcpy(CmdRecorder_Upload(rec, p->args[0], p->address, p->args[1]), capture->payload + p->args[2], p->args[1]);
+            break;
+        case CMD_OP_SET_ROOT_CONSTANT:
+            CmdRecorder_SetRootConstant(rec, p->args[0], p->args[1], p->args[2]);
+            break;
+        default:
+            SIMPLE_ASSERT(false, "Invalid capture packet");
+        }
+    }
+}
+int
+CmdCapture_Compare (CmdCapture const * a, CmdCapture const * b) {
+    int count = (a->count < b->count) ? a->count : b->count;
+    for (int i = 0; i < count; ++i) {
+        CmdPacket const * pa = &a->packets[i];
+        CmdPacket const * pb = &b->packets[i];
+        if (CMD_OP_UPLOAD == pa->op && CMD_OP_UPLOAD == pb->op) {
+            // payload offsets can differ, the data can't
+            if (pa->args[0] != pb->args[0] || pa->args[1] != pb->args[1] || pa->address != pb->address ||
+                0 != memcmp(a->payload + pa->args[2], b->payload + pb->args[2], pa->args[1]))
+                return i;
+        } else if (0 != memcmp(pa, pb, sizeof(CmdPacket))) {
+            return i;
+        }
+    }
+    return (a->count == b->count) ? -1 : count;
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include "headers/common.h"
+#include "scheduler.h"
+
+// Command recording interface for the frame: cbuffer uploads and draws.
+// The render path (see draw_recording.h) records through a CmdRecorder instead of an
+// ID3D12GraphicsCommandList and mapped upload buffers, so the same code drives
+//  - the D3D12 backend (in the app),
+//  - CmdNull: only counts calls, to time the CPU side of a frame without a GPU,
+//  - CmdCapture: keeps the stream (upload payloads included), writes/reads it to a file for
+//    diffing and replays it into another recorder for timing.
+// Values are backend neutral: pso/geometry/upload buffer are indices into the backend's tables,
+// descriptor tables and cbvs are GPU addresses, root constants are raw 32-bit values.
+
+enum CMD_OP : uint32_t {
+    CMD_OP_SET_PIPELINE_STATE = 0,
+    CMD_OP_SET_GEOMETRY = 1,            // vertex + index buffer
+    CMD_OP_SET_TOPOLOGY = 2,
+    CMD_OP_SET_ROOT_TABLE = 3,          // root descriptor table
+    CMD_OP_SET_ROOT_CBV = 4,
+    CMD_OP_DRAW_INDEXED = 5,
+    CMD_OP_UPLOAD = 6,                  // cpu write into an upload buffer
+    CMD_OP_SET_ROOT_CONSTANT = 7,       // one 32-bit value of a root constants parameter
+
+    _COUNT_CMD_OP
+};
+
+struct CmdRecorderFns {
+    void (*set_pipeline_state) (void * ctx, uint32_t pso);
+    void (*set_geometry) (void * ctx, uint32_t geom);
+    void (*set_topology) (void * ctx, uint32_t topology);
+    void (*set_root_table) (void * ctx, uint32_t param, uint64_t gpu_descriptor);
+    void (*set_root_cbv) (void * ctx, uint32_t param, uint64_t gpu_address);
+    void (*draw_indexed) (void * ctx, uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance);
+    uint8_t * (*upload) (void * ctx, uint32_t buffer, uint64_t offset, uint32_t size);
+    void (*set_root_constant) (void * ctx, uint32_t param, uint32_t offset, uint32_t value);
+};
+struct CmdRecorder {
+    CmdRecorderFns const * fns;
+    void * ctx;                         // backend state, passed back to every fn
+};
+
+inline void
+CmdRecorder_SetPipelineState (CmdRecorder * rec, uint32_t pso) {
+    rec->fns->set_pipeline_state(rec->ctx, pso);
+}
+inline void
+CmdRecorder_SetGeometry (CmdRecorder * rec, uint32_t geom) {
+    rec->fns->set_geometry(rec->ctx, geom);
+}
+inline void
+CmdRecorder_SetTopology (CmdRecorder * rec, uint32_t topology) {
+    rec->fns->set_topology(rec->ctx, topology);
+}
+inline void
+CmdRecorder_SetRootTable (CmdRecorder * rec, uint32_t param, uint64_t gpu_descriptor) {
+    rec->fns->set_root_table(rec->ctx, param, gpu_descriptor);
+}
+inline void
+CmdRecorder_SetRootCbv (CmdRecorder * rec, uint32_t param, uint64_t gpu_address) {
+    rec->fns->set_root_cbv(rec->ctx, param, gpu_address);
+}
+// offset is in 32-bit values from the start of the parameter's constants
+inline void
+CmdRecorder_SetRootConstant (CmdRecorder * rec, uint32_t param, uint32_t offset, uint32_t value) {
+    rec->fns->set_root_constant(rec->ctx, param, offset, value);
+}
+inline void
+CmdRecorder_DrawIndexed (CmdRecorder * rec, uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance) {
+    rec->fns->draw_indexed(rec->ctx, index_count, instance_count, start_index, base_vertex, start_instance);
+}
+// Returns size bytes for the caller to fill right away (valid until the next call on rec);
+// they end up at offset in the backend's upload buffer, e.g. the frame's mapped cbuffer.
+// Bytes the caller skips keep the buffer's contents (zero in a capture).
+inline uint8_t *
+CmdRecorder_Upload (CmdRecorder * rec, uint32_t buffer, uint64_t offset, uint32_t size) {
+    return rec->fns->upload(rec->ctx, buffer, offset, size);
+}
+
+// CPU memory behind the upload buffer indices, for backends that write uploads in place
+#define CMD_RECORDER_MAX_UPLOAD_BUFFERS     8
+struct CmdUploadTable {
+    uint8_t * memory[CMD_RECORDER_MAX_UPLOAD_BUFFERS];
+    uint64_t size[CMD_RECORDER_MAX_UPLOAD_BUFFERS];
+};
+inline uint8_t *
+CmdUploadTable_Get (CmdUploadTable const * table, uint32_t buffer, uint64_t offset, uint32_t size) {
+    SIMPLE_ASSERT(buffer < CMD_RECORDER_MAX_UPLOAD_BUFFERS && table->memory[buffer] && offset + size <= table->size[buffer], "upload out of range");
+    return table->memory[buffer] + offset;
+}
+
+// -- chunked recording
+
+#define CMD_RECORDER_MAX_CHUNKS     64
+
+// # of chunks worth recording n_items in: at most max_chunks, at least min_items_per_chunk items
+// each (so small lists stay on one thread), never less than 1.
+int
+CmdRecorder_ChunkCount (int n_items, int max_chunks, int min_items_per_chunk);
+// Splits [0, n_items) into n_chunks contiguous ranges of (almost) equal size:
+// chunk c is [out_begin[c], out_begin[c + 1]), out_begin needs n_chunks + 1 entries.
+void
+CmdRecorder_SplitRange (int n_items, int n_chunks, int out_begin []);
+
+// Records chunk [begin, end) of the items into rec.
+typedef void (*CmdRecordChunkFn) (void * ctx, int chunk, CmdRecorder * rec, int begin, int end);
+// Records every chunk (at most CMD_RECORDER_MAX_CHUNKS) into its own recorder, recorders[chunk],
+// on the scheduler's threads and returns when all of them are done. Submitting the chunks in order
+// afterwards gives the same stream as recording [0, n_items) serially.
+void
+CmdRecorder_RecordChunks (Scheduler * sched, int n_items, int n_chunks, CmdRecorder recorders [], void * ctx, CmdRecordChunkFn fn);
+
+// One recorded call, as CmdCapture keeps them
+struct CmdPacket {
+    uint32_t op;                        // CMD_OP
+    uint32_t args[5];                   // draw: index_count, instance_count, start_index, base_vertex, start_instance
+                                        // upload: buffer, size, payload offset (CmdCapture)
+                                        // root constant: param, offset, value
+    uint64_t address;                   // root table / cbv, upload offset
+};
+
+// -- null backend: counts calls, uploads are written to the caller's memory (see uploads)
+
+struct CmdNull {
+    uint64_t n_calls[_COUNT_CMD_OP];
+    uint64_t n_indices;                 // index_count * instance_count over the draws
+    uint64_t n_upload_bytes;
+    CmdUploadTable uploads;             // set by the caller if the recording uploads
+};
+
+void
+CmdNull_Init (CmdNull * null);
+// Zeroes the counters, keeps the upload table
+void
+CmdNull_Reset (CmdNull * null);
+CmdRecorder
+CmdNull_GetRecorder (CmdNull * null);
+
+// -- capture backend: keeps the stream, upload payloads included
+
+struct CmdCapture {
+    CmdPacket * packets;
+    int count;
+    int capacity;
+    uint8_t * payload;                  // upload data, 16-byte aligned per upload
+    uint64_t payload_size;
+    uint64_t payload_capacity;
+};
+
+void
+CmdCapture_Init (CmdCapture * capture);
+void
+CmdCapture_Free (CmdCapture * capture);
+// Forgets the stream, keeps the memory
+void
+CmdCapture_Clear (CmdCapture * capture);
+CmdRecorder
+CmdCapture_GetRecorder (CmdCapture * capture);
+// The file is the packets and the payload behind a small header, in host byte order.
+// GPU addresses are stored as recorded, so only captures made with the same bindings (e.g.
+// render_bench's fixed ones) diff cleanly.
+bool
+CmdCapture_WriteFile (CmdCapture const * capture, char const * path);
+// Replaces the stream with the file's; false (and an empty stream) if it isn't a capture.
+bool
+CmdCapture_ReadFile (CmdCapture * capture, char const * path);
+// Issues the stream's calls on rec, copying the upload payloads.
+void
+CmdCapture_Replay (CmdCapture const * capture, CmdRecorder * rec);
+// Index of the first packet where the streams differ (upload payloads compared too),
+// the shorter stream's count if one is a prefix of the other, -1 if they are the same.
+int
+CmdCapture_Compare (CmdCapture const * a, CmdCapture const * b);
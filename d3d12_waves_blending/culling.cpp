@@ -0,0 +1,151 @@
+#include "culling.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULLING_X86_SIMD    1
+#include <immintrin.h>
+#else
+#define CULLING_X86_SIMD    0
+#endif
+
+#define CULLING_CACHE_LINE  64
+
+using namespace DirectX;
+
+static size_t
+culling_align (size_t size) {
+    return (size + (CULLING_CACHE_LINE - 1)) & ~((size_t)CULLING_CACHE_LINE - 1);
+}
+static int
+culling_capacity (int count) {
+    return (count + CULLING_BATCH - 1) / CULLING_BATCH * CULLING_BATCH;
+}
+size_t
+Culling_CalculateRequiredSize (int count) {
+    SIMPLE_ASSERT(count >= 0, "Invalid bounds count");
+    return culling_align(sizeof(CullingBounds)) + 6 * culling_align(sizeof(float) * culling_capacity(count));
+}
+CullingBounds *
+Culling_InitBounds (uint8_t * memory, int count) {
+    CullingBounds * ret = reinterpret_cast<CullingBounds *>(memory);
+    ret->count = count;
+    ret->capacity = culling_capacity(count);
+
+    // Setup pointers (arrays), each one starts on its own cache line
+    size_t array_size = culling_align(sizeof(float) * ret->capacity);
+    uint8_t * arrays = memory + culling_align(sizeof(CullingBounds));
+    ret->center_x = reinterpret_cast<float *>(arrays + 0 * array_size);
+    ret->center_y = reinterpret_cast<float *>(arrays + 1 * array_size);
+    ret->center_z = reinterpret_cast<float *>(arrays + 2 * array_size);
+    ret->extent_x = reinterpret_cast<float *>(arrays + 3 * array_size);
+    ret->extent_y = reinterpret_cast<float *>(arrays + 4 * array_size);
+    ret->extent_z = reinterpret_cast<float *>(arrays + 5 * array_size);
+    for (int i = 0; i < ret->capacity; ++i) {
+        ret->center_x[i] = ret->center_y[i] = ret->center_z[i] = 0.0f;
+        ret->extent_x[i] = ret->extent_y[i] = ret->extent_z[i] = 0.0f;
+    }
+    return ret;
+}
+// Arvo's method: the world center is the transformed center, each world extent sums the
+// local extents weighted by the absolute matrix entries.
+void
+Culling_SetBounds (CullingBounds * bounds, int i, XMFLOAT3 center, XMFLOAT3 extents, XMFLOAT4X4 const & world) {
+    SIMPLE_ASSERT(i >= 0 && i < bounds->count, "Invalid bounds index");
+    float const c[3] = {center.x, center.y, center.z};
+    float const e[3] = {extents.x, extents.y, extents.z};
+    float wc[3];
+    float we[3];
+    for (int j = 0; j < 3; ++j) {
+        wc[j] = world.m[3][j];
+        we[j] = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            wc[j] += c[k] * world.m[k][j];
+            we[j] += e[k] * fabsf(world.m[k][j]);
+        }
+    }
+    bounds->center_x[i] = wc[0];
+    bounds->center_y[i] = wc[1];
+    bounds->center_z[i] = wc[2];
+    bounds->extent_x[i] = we[0];
+    bounds->extent_y[i] = we[1];
+    bounds->extent_z[i] = we[2];
+}
+// Gribb/Hartmann: with clip = v * M, the planes are sums/differences of M's columns.
+void
+Culling_ExtractFrustum (XMFLOAT4X4 const & view, XMFLOAT4X4 const & proj, CullingFrustum * out_frustum) {
+    float m[4][4];
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            m[r][c] = 0.0f;
+            for (int k = 0; k < 4; ++k)
+                m[r][c] += view.m[r][k] * proj.m[k][c];
+        }
+    }
+    float planes[CULLING_PLANE_COUNT][4];
+    for (int r = 0; r < 4; ++r) {
+        planes[0][r] = m[r][3] + m[r][0];   // left
+        planes[1][r] = m[r][3] - m[r][0];   // right
+        planes[2][r] = m[r][3] + m[r][1];   // bottom
+        planes[3][r] = m[r][3] - m[r][1];   // top
+        planes[4][r] = m[r][2];             // near (z >= 0)
+        planes[5][r] = m[r][3] - m[r][2];   // far
+    }
+    for (int p = 0; p < CULLING_PLANE_COUNT; ++p) {
+        float len = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        float s = (len > 0.0f) ? 1.0f / len : 0.0f;
+        out_frustum->planes[p] = XMFLOAT4(planes[p][0] * s, planes[p][1] * s, planes[p][2] * s, planes[p][3] * s);
+    }
+}
+// A box is outside a plane when even its most positive corner is behind it:
+// dot(n, center) + d + dot(|n|, extents) < 0
+int
+Culling_FrustumCull (CullingFrustum const * frustum, CullingBounds const * bounds, uint32_t out_visible []) {
+    int n_visible = 0;
+    int count = bounds->count;
+    for (int i = 0; i < count; i += CULLING_BATCH) {
+        int mask;
+#if CULLING_X86_SIMD
+        __m128 cx = _mm_loadu_ps(bounds->center_x + i);
+        __m128 cy = _mm_loadu_ps(bounds->center_y + i);
+        __m128 cz = _mm_loadu_ps(bounds->center_z + i);
+        __m128 ex = _mm_loadu_ps(bounds->extent_x + i);
+        __m128 ey = _mm_loadu_ps(bounds->extent_y + i);
+        __m128 ez = _mm_loadu_ps(bounds->extent_z + i);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < CULLING_PLANE_COUNT; ++p) {
+            XMFLOAT4 const & pl = frustum->planes[p];
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(pl.x)), _mm_mul_ps(cy, _mm_set1_ps(pl.y))),
+                _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(pl.z)), _mm_set1_ps(pl.w))
+            );
+            __m128 r = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(pl.x))), _mm_mul_ps(ey, _mm_set1_ps(fabsf(pl.y)))),
+                _mm_mul_ps(ez, _mm_set1_ps(fabsf(pl.z)))
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        mask = _mm_movemask_ps(inside);
+#else
+        mask = 0;
+        for (int k = 0; k < CULLING_BATCH; ++k) {
+            bool in = true;
+            for (int p = 0; p < CULLING_PLANE_COUNT; ++p) {
+                XMFLOAT4 const & pl = frustum->planes[p];
+                float d = bounds->center_x[i + k] * pl.x + bounds->center_y[i + k] * pl.y + bounds->center_z[i + k] * pl.z + pl.w;
+                float r = bounds->extent_x[i + k] * fabsf(pl.x) + bounds->extent_y[i + k] * fabsf(pl.y) + bounds->extent_z[i + k] * fabsf(pl.z);
+                in = in && (d + r >= 0.0f);
+            }
+            mask |= in ? (1 << k) : 0;
+        }
+#endif
+        // padding lanes of the last batch
+        if (count - i < CULLING_BATCH)
+            mask &= (1 << (count - i)) - 1;
+
+        // branchless compaction: every lane is written, only the visible ones advance the cursor
+        for (int k = 0; k < CULLING_BATCH; ++k) {
+            out_visible[n_visible] = (uint32_t)(i + k);
+            n_visible += (mask >> k) & 1;
+        }
+    }
+    return n_visible;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "headers/common.h"
+#include <DirectXMath.h>
+
+// Frustum culling of world-space axis-aligned boxes.
+// Boxes are kept in SoA (one dense float array per component), so a batch of CULLING_BATCH boxes
+// loads straight into SSE registers and is tested against all six planes at once. The result is
+// a compacted list of the indices that survived, in increasing order.
+
+#define CULLING_BATCH       4
+#define CULLING_PLANE_COUNT 6
+
+// Planes (a, b, c, d) of a view frustum, normalized; a point is inside when a*x + b*y + c*z + d >= 0.
+struct CullingFrustum {
+    DirectX::XMFLOAT4 planes[CULLING_PLANE_COUNT];
+};
+
+// count boxes (center +- extents); the arrays are padded to a multiple of CULLING_BATCH.
+struct CullingBounds {
+    int count;
+    int capacity;
+    float * center_x;
+    float * center_y;
+    float * center_z;
+    float * extent_x;
+    float * extent_y;
+    float * extent_z;
+};
+
+size_t
+Culling_CalculateRequiredSize (int count);
+// All boxes start out empty at the origin (never culled).
+CullingBounds *
+Culling_InitBounds (uint8_t * memory, int count);
+// Stores the world-space box enclosing the local box (center, extents) transformed by world.
+void
+Culling_SetBounds (CullingBounds * bounds, int i, DirectX::XMFLOAT3 center, DirectX::XMFLOAT3 extents, DirectX::XMFLOAT4X4 const & world);
+// Extracts the planes of view * proj (row vectors, z in [0, 1] as the demos' XMMatrixPerspectiveFovLH).
+void
+Culling_ExtractFrustum (DirectX::XMFLOAT4X4 const & view, DirectX::XMFLOAT4X4 const & proj, CullingFrustum * out_frustum);
+// Writes the index of every box that intersects the frustum to out_visible and returns how many
+// there are. out_visible must hold bounds->capacity entries (the compaction writes whole batches).
+int
+Culling_FrustumCull (CullingFrustum const * frustum, CullingBounds const * bounds, uint32_t out_visible []);
@@ -29,6 +29,11 @@
 #include "headers/dds_loader.h"
 
 #include "waves.h"
+#include "water_lod.h"
+#include "culling.h"
+#include "render_items.h"
+#include "draw_list.h"
+#include "draw_recording.h"
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_win32.h"
@@ -38,6 +43,17 @@
 #define NUM_BACKBUFFERS         2
 #define NUM_QUEUING_FRAMES      3
 
+// Water heights stay well within this of y = 0 (splashes are 0.2..0.5 high and damped)
+#define WATER_BOUNDS_HALF_HEIGHT    2.0f
+
+// Smaller draw lists aren't worth another thread (see draw_main)
+#define MIN_DRAWS_PER_CHUNK         64
+
+#define CAPTURE_FILE_PATH           "frame_capture.cmd"
+
+// Initial upload ring space per queued frame, for what's written every frame (grown when short)
+#define UPLOAD_RING_FRAME_SIZE      (64 * 1024)
+
 enum RENDER_LAYER : int {
     OPAQUE_LAYER = 0,
     TRANSPARENT_LAYER = 1,
@@ -75,6 +91,15 @@ enum TEX_INDEX {
 
     _COUNT_TEX
 };
+// Upload buffers the frame's CmdRecorder writes into (indices into CmdUploadTable)
+enum UPLOAD_BUFFER : uint32_t {
+    UPLOAD_BUFFER_PASS_CB = 0,
+    UPLOAD_BUFFER_MAT_DATA = 1,
+    UPLOAD_BUFFER_INSTANCES = 2,
+    UPLOAD_BUFFER_DRAW_INSTANCES = 3,
+
+    _COUNT_UPLOAD_BUFFER
+};
 enum SAMPLER_INDEX {
     SAMPLER_POINT_WRAP = 0,
     SAMPLER_POINT_CLAMP = 1,
@@ -85,6 +110,9 @@ enum SAMPLER_INDEX {
 
     _COUNT_SAMPLER
 };
+// Water vertex (WavesVertexHalf): the solver's fp16 normals are copied as-is and texc is fp16 too (24 bytes vs 32 for Vertex).
+// Fetched as R16G16B16A16_FLOAT / R16G16_FLOAT, so the shader sees the usual float3 normal and float2 texc.
+typedef WavesVertexHalf WaterVertex;
 struct SceneContext {
     // camera settings (spherical coordinate)
     float theta;
@@ -115,10 +143,6 @@ bool global_resizing;
 bool global_mouse_active;
 SceneContext global_scene_ctx;
 
-struct RenderItemArray {
-    RenderItem  ritems[_COUNT_RENDERITEM];
-    uint32_t    size;
-};
 struct D3DRenderContext {
     // Pipeline stuff
     D3D12_VIEWPORT                  viewport;
@@ -133,6 +157,12 @@ struct D3DRenderContext {
     ID3D12CommandQueue *            cmd_queue;
     ID3D12CommandAllocator *        direct_cmd_list_alloc;
     ID3D12GraphicsCommandList *     direct_cmd_list;
+    // Multithreaded recording: one list per draw chunk and one for the frame's tail,
+    // reset every frame with the current FrameResource's allocators
+    ID3D12GraphicsCommandList *     chunk_cmd_lists[MAX_DRAW_CHUNKS];
+    ID3D12GraphicsCommandList *     tail_cmd_list;
+    bool                            mt_recording;
+    int                             n_draw_chunks;      // # of chunks the last frame was recorded in
 
     UINT                            rtv_descriptor_size;
     UINT                            cbv_srv_uav_descriptor_size;
@@ -144,21 +174,44 @@ struct D3DRenderContext {
     PassConstants                   main_pass_constants;
     UINT                            pass_cbv_offset;
 
-    // List of all the render items.
-    RenderItemArray                 all_ritems;
-    // Render items divided by PSO.
-    RenderItemArray                 opaque_ritems;
-    RenderItemArray                 transparent_ritems;
-    RenderItemArray                 alphatested_ritems;
+    // All the render items, ritem_handles keeps the ones the demo refers to.
+    RenderItems *                   ritems;
+    RenderItemHandle                ritem_handles[_COUNT_RENDERITEM];
+
+    uint32_t *                      culled_ritems;      // Culling_FrustumCull output
+    int                             n_visible_ritems;
+    // Visible render items (dense indices into ritems) sorted for submission, see build_draw_list
+    DrawList *                      draw_list;
+    DrawStats                       draw_stats;
+    DrawStats                       chunk_draw_stats[MAX_DRAW_CHUNKS];
+    // A captured frame is recorded into capture, replayed on the d3d12 backend and written to
+    // CAPTURE_FILE_PATH (see draw_main)
+    CmdCapture                      capture;
+    bool                            capture_requested;
+    CullingFrustum                  frustum;
 
     MeshGeometry                    geom[_COUNT_GEOM];
 
+    // Water patches picked by WaterLod_Select for the current frame.
+    // After culling the first n_water_draws entries are the visible patches.
+    WaterLodDraw *                  water_draws;
+    int                             n_water_patches;
+    int                             n_water_draws;
+    uint32_t                        n_water_tris;
+    CullingBounds *                 water_patch_bounds;
+    uint32_t *                      culled_water_patches;
+
     // Synchronization stuff
     UINT                            frame_index;
     HANDLE                          fence_event;
     ID3D12Fence *                   fence;
     FrameResource                   frame_resources[NUM_QUEUING_FRAMES];
-    UINT64                          main_current_fence;
+    // Upload heap shared by the queued frames, see create_upload_heap
+    ID3D12Resource *                upload_heap;
+    UploadRing                      upload_ring;
+    int                             upload_instance_capacity;   // render items each frame's instance data has room for
+    UINT64                          upload_ring_size;
+    int                             n_upload_heap_grows;
 
     // Each swapchain backbuffer needs a render target
     ID3D12Resource *                render_targets[NUM_BACKBUFFERS];
@@ -167,6 +220,7 @@ struct D3DRenderContext {
     ID3D12Resource *                depth_stencil_buffer;
 
     Material                        materials[_COUNT_MATERIAL];
+    DrawMaterial                    draw_materials[_COUNT_MATERIAL];    // what drawing needs from materials
     Texture                         textures[_COUNT_TEX];
 };
 static void
@@ -319,6 +373,7 @@ create_shape_geometry (D3DRenderContext * render_ctx) {
         vertices[k].normal = box_vertices[i].Normal;
         vertices[k].texc = box_vertices[i].TexC;
     }
+    BoundingBox::CreateFromPoints(box_submesh.bounds, nvtx, &vertices[0].position, sizeof(Vertex));
 
     // -- pack indices
     k = 0;
@@ -354,6 +409,12 @@ create_shape_geometry (D3DRenderContext * render_ctx) {
     free(indices);
     free(vertices);
 }
+template <typename T>
+static void
+print_vertex_cache_stats (char const * name, T const indices [], UINT32 n_idx, UINT32 n_vtx) {
+    VertexCacheStats stats = simulate_vertex_cache(indices, n_idx, n_vtx, GRID_DEFAULT_VCACHE_SIZE);
+    ::printf("Vertex cache (%d entries FIFO) %-10s %6u tris  ACMR %.3f  ATVR %.3f\n", GRID_DEFAULT_VCACHE_SIZE, name, stats.n_tris, stats.acmr, stats.atvr);
+}
 static void
 create_land_geometry (D3DRenderContext * render_ctx) {
 
@@ -367,7 +428,8 @@ create_land_geometry (D3DRenderContext * render_ctx) {
     uint16_t * indices = (uint16_t *)::malloc(sizeof(uint16_t) * nidx);
     GeomVertex * grid = (GeomVertex *)::malloc(sizeof(GeomVertex) * nvtx);
 
-    create_grid(320.0f, 320.0f, 50, 50, grid, indices);
+    create_grid(320.0f, 320.0f, 50, 50, GRID_INDEX_ORDER_CACHE_STRIPS, GRID_DEFAULT_VCACHE_SIZE, grid, indices);
+    print_vertex_cache_stats("land", indices, nidx, nvtx);
 
     // Extract the vertex elements we are interested and apply the height function to
     // each vertex.  In addition, color the vertices based on their height so we have
@@ -406,6 +468,7 @@ create_land_geometry (D3DRenderContext * render_ctx) {
     submesh.index_count = nidx;
     submesh.start_index_location = 0;
     submesh.base_vertex_location = 0;
+    BoundingBox::CreateFromPoints(submesh.bounds, nvtx, &vertices[0].position, sizeof(Vertex));
 
     render_ctx->geom[GEOM_GRID].submesh_names[0] = "grid";
     render_ctx->geom[GEOM_GRID].submesh_geoms[0] = submesh;
@@ -415,32 +478,20 @@ create_land_geometry (D3DRenderContext * render_ctx) {
     ::free(vertices);
 }
 static void
-create_water_geometry (UINT nrow, UINT ncol, UINT ntri, D3DRenderContext * render_ctx) {
-    uint32_t _WAVE_VTX_CNT = ncol * nrow;
+create_water_geometry (WaterLod * water_lod, D3DRenderContext * render_ctx) {
+    uint32_t _WAVE_VTX_CNT = water_lod->ncol * water_lod->nrow;
     SIMPLE_ASSERT(_WAVE_VTX_CNT < 0x000fffff, "Invalid vertex count");
-    Vertex * vertices = (Vertex *)::malloc(sizeof(Vertex) * _WAVE_VTX_CNT);
-    uint32_t _idx_cnt = 3 * ntri;
-    uint32_t * indices = (uint32_t *)::malloc(_idx_cnt * sizeof(uint32_t)); // 3 indices per face
-
-    // Iterate over each quad.
-    int m = nrow;
-    int n = ncol;
-    int k = 0;
-    for (int i = 0; i < m - 1; ++i) {
-        for (int j = 0; j < n - 1; ++j) {
-            indices[k] = (i * n + j);
-            indices[k + 1] = (i * n + j + 1);       // TODO(omid): address this warning 
-            indices[k + 2] = ((i + 1) * n + j);
-
-            indices[k + 3] = ((i + 1) * n + j);
-            indices[k + 4] = (i * n + j + 1);
-            indices[k + 5] = ((i + 1) * n + j + 1);
-
-            k += 6; // next quad
-        }
-    }
 
-    UINT vb_byte_size = _WAVE_VTX_CNT * sizeof(Vertex);
+    // NOTE(omid): The ib holds the lod templates of all patch sizes (see water_lod.h), not one grid.
+    // Each frame draws every patch with the template WaterLod_Select picked for it.
+    uint32_t _idx_cnt = WaterLod_GetIndexCount(water_lod);
+    uint32_t * indices = WaterLod_GetIndices(water_lod);
+
+    // full-res interior patch (class 0, lod 0, no stitched edges); patch-local vertex ids
+    WaterLodTemplate const * lod0 = &water_lod->templates[0];
+    print_vertex_cache_stats("water lod0", indices + lod0->start_index, lod0->index_count, water_lod->patch_quads * water_lod->ncol + water_lod->patch_quads + 1);
+
+    UINT vb_byte_size = _WAVE_VTX_CNT * sizeof(WaterVertex);
     UINT ib_byte_size = _idx_cnt * sizeof(uint32_t);
 
     // -- Fill out render_ctx geom (output)
@@ -455,7 +506,7 @@ create_water_geometry (UINT nrow, UINT ncol, UINT ntri, D3DRenderContext * rende
     //create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, vertices, vb_byte_size, &render_ctx->geom[GEOM_WATER].vb_uploader, &render_ctx->geom[GEOM_WATER].vb_gpu);
     create_default_buffer(render_ctx->device, render_ctx->direct_cmd_list, indices, ib_byte_size, &render_ctx->geom[GEOM_WATER].ib_uploader, &render_ctx->geom[GEOM_WATER].ib_gpu);
 
-    render_ctx->geom[GEOM_WATER].vb_byte_stide = sizeof(Vertex);
+    render_ctx->geom[GEOM_WATER].vb_byte_stide = sizeof(WaterVertex);
     render_ctx->geom[GEOM_WATER].vb_byte_size = vb_byte_size;
     render_ctx->geom[GEOM_WATER].ib_byte_size = ib_byte_size;
     render_ctx->geom[GEOM_WATER].index_format = DXGI_FORMAT_R32_UINT;
@@ -464,109 +515,136 @@ create_water_geometry (UINT nrow, UINT ncol, UINT ntri, D3DRenderContext * rende
     submesh.index_count = _idx_cnt;
     submesh.start_index_location = 0;
     submesh.base_vertex_location = 0;
+    // the solver moves the heights, so the box gets WATER_BOUNDS_HALF_HEIGHT of headroom
+    float half_width = (water_lod->ncol - 1) * water_lod->spatial_step * 0.5f;
+    float half_depth = (water_lod->nrow - 1) * water_lod->spatial_step * 0.5f;
+    submesh.bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(half_width, WATER_BOUNDS_HALF_HEIGHT, half_depth));
 
     render_ctx->geom[GEOM_WATER].submesh_names[0] = "water";
     render_ctx->geom[GEOM_WATER].submesh_geoms[0] = submesh;
+}
+static RenderItemHandle
+add_render_item (
+    RenderItems * ritems,
+    MeshGeometry geoms [], GEOM_INDEX geom_index,
+    MAT_INDEX mat_index, RENDER_LAYER layer,
+    XMFLOAT4X4 const & world, XMFLOAT4X4 const & tex_transform
+) {
+    SubmeshGeometry const * submesh = &geoms[geom_index].submesh_geoms[0];
+    RenderItemDesc desc = {};
+    desc.world = world;
+    desc.tex_transform = tex_transform;
+    desc.draw_args.index_count = submesh->index_count;
+    desc.draw_args.start_index = submesh->start_index_location;
+    desc.draw_args.base_vertex = submesh->base_vertex_location;
+    desc.draw_args.geom = (uint16_t)geom_index;
+    desc.draw_args.topology = (uint16_t)D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    desc.bounds.center = submesh->bounds.Center;
+    desc.bounds.extents = submesh->bounds.Extents;
+    desc.material = mat_index;
+    desc.layer = (uint8_t)layer;
+    RenderItemHandle ret = RenderItems_Add(ritems, &desc);
+    SIMPLE_ASSERT(RENDER_ITEMS_INVALID_HANDLE != ret, "render item store is full");
+    return ret;
+}
+static void
+create_render_items (RenderItems * ritems, RenderItemHandle out_handles [], MeshGeometry geoms [], Material materials []) {
+    XMFLOAT4X4 world = Identity4x4();
+    XMFLOAT4X4 tex_transform = Identity4x4();
 
-    ::free(indices);
-    ::free(vertices);
+    XMStoreFloat4x4(&tex_transform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
+    out_handles[RITEM_WATER] = add_render_item(ritems, geoms, GEOM_WATER, MAT_WATER, TRANSPARENT_LAYER, world, tex_transform);
+    materials[MAT_WATER].n_frames_dirty = NUM_QUEUING_FRAMES;
+
+    out_handles[RITEM_GRID] = add_render_item(ritems, geoms, GEOM_GRID, MAT_GRASS, OPAQUE_LAYER, world, tex_transform);
+    materials[MAT_GRASS].n_frames_dirty = NUM_QUEUING_FRAMES;
+
+    XMStoreFloat4x4(&world, XMMatrixTranslation(3.0f, 2.0f, -9.0f));
+    out_handles[RITEM_BOX] = add_render_item(ritems, geoms, GEOM_BOX, MAT_WOOD_CRATE, ALPHATESTED_LAYER, world, Identity4x4());
+    materials[MAT_WOOD_CRATE].n_frames_dirty = NUM_QUEUING_FRAMES;
 }
+// -- D3D12 backend of CmdRecorder
+struct D3D12Recorder {
+    ID3D12GraphicsCommandList * cmd_list;
+    ID3D12PipelineState * const * psos;     // indexed by RENDER_LAYER
+    MeshGeometry * geoms;                   // indexed by GEOM
+    CmdUploadTable uploads;                 // the frame's mapped upload buffers, indexed by UPLOAD_BUFFER
+};
 static void
-create_render_items (
-    RenderItemArray * all_ritems,
-    RenderItemArray * opaque_ritems,
-    RenderItemArray * transparent_ritems,
-    RenderItemArray * alphatested_ritems,
-    MeshGeometry * box_geom, MeshGeometry * water_geom, MeshGeometry * grid_geom,
-    Material materials []
-) {
-    all_ritems->ritems[RITEM_WATER].world = Identity4x4();
-    all_ritems->ritems[RITEM_WATER].tex_transform = Identity4x4();
-    XMStoreFloat4x4(&all_ritems->ritems[RITEM_WATER].tex_transform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-    all_ritems->ritems[RITEM_WATER].obj_cbuffer_index = 0;
-    all_ritems->ritems[RITEM_WATER].mat = &materials[MAT_WATER];
-    all_ritems->ritems[RITEM_WATER].geometry = water_geom;
-    all_ritems->ritems[RITEM_WATER].primitive_type = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    all_ritems->ritems[RITEM_WATER].index_count = water_geom->submesh_geoms[0].index_count;
-    all_ritems->ritems[RITEM_WATER].start_index_loc = water_geom->submesh_geoms[0].start_index_location;
-    all_ritems->ritems[RITEM_WATER].base_vertex_loc = water_geom->submesh_geoms[0].base_vertex_location;
-    all_ritems->ritems[RITEM_WATER].n_frames_dirty = NUM_QUEUING_FRAMES;
-    all_ritems->ritems[RITEM_WATER].mat->n_frames_dirty = NUM_QUEUING_FRAMES;
-    all_ritems->ritems[RITEM_WATER].initialized = true;
-    all_ritems->size++;
-    transparent_ritems->ritems[0] = all_ritems->ritems[RITEM_WATER];
-    transparent_ritems->size++;
-
-    all_ritems->ritems[RITEM_GRID].world = Identity4x4();
-    all_ritems->ritems[RITEM_GRID].tex_transform = Identity4x4();
-    XMStoreFloat4x4(&all_ritems->ritems[RITEM_GRID].tex_transform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-    all_ritems->ritems[RITEM_GRID].obj_cbuffer_index = 1;
-    all_ritems->ritems[RITEM_GRID].mat = &materials[MAT_GRASS];
-    all_ritems->ritems[RITEM_GRID].geometry = grid_geom;
-    all_ritems->ritems[RITEM_GRID].primitive_type = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    all_ritems->ritems[RITEM_GRID].index_count = grid_geom->submesh_geoms[0].index_count;
-    all_ritems->ritems[RITEM_GRID].start_index_loc = grid_geom->submesh_geoms[0].start_index_location;
-    all_ritems->ritems[RITEM_GRID].base_vertex_loc = grid_geom->submesh_geoms[0].base_vertex_location;
-    all_ritems->ritems[RITEM_GRID].n_frames_dirty = NUM_QUEUING_FRAMES;
-    all_ritems->ritems[RITEM_GRID].mat->n_frames_dirty = NUM_QUEUING_FRAMES;
-    all_ritems->ritems[RITEM_GRID].initialized = true;
-    all_ritems->size++;
-    opaque_ritems->ritems[0] = all_ritems->ritems[RITEM_GRID];
-    opaque_ritems->size++;
-
-    all_ritems->ritems[RITEM_BOX].world = Identity4x4();
-    XMStoreFloat4x4(&all_ritems->ritems[RITEM_BOX].world, XMMatrixTranslation(3.0f, 2.0f, -9.0f));
-    all_ritems->ritems[RITEM_BOX].tex_transform = Identity4x4();
-    all_ritems->ritems[RITEM_BOX].obj_cbuffer_index = 2;
-    all_ritems->ritems[RITEM_BOX].geometry = box_geom;
-    all_ritems->ritems[RITEM_BOX].mat = &materials[MAT_WOOD_CRATE];
-    all_ritems->ritems[RITEM_BOX].primitive_type = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    all_ritems->ritems[RITEM_BOX].index_count = box_geom->submesh_geoms[0].index_count;
-    all_ritems->ritems[RITEM_BOX].start_index_loc = box_geom->submesh_geoms[0].start_index_location;
-    all_ritems->ritems[RITEM_BOX].base_vertex_loc = box_geom->submesh_geoms[0].base_vertex_location;
-    all_ritems->ritems[RITEM_BOX].n_frames_dirty = NUM_QUEUING_FRAMES;
-    all_ritems->ritems[RITEM_BOX].mat->n_frames_dirty = NUM_QUEUING_FRAMES;
-    all_ritems->ritems[RITEM_BOX].initialized = true;
-    all_ritems->size++;
-    alphatested_ritems->ritems[0] = all_ritems->ritems[RITEM_BOX];
-    alphatested_ritems->size++;
+d3d12_set_pipeline_state (void * ctx, uint32_t pso) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    rec->cmd_list->SetPipelineState(rec->psos[pso]);
 }
-// -- indexed drawing
 static void
-draw_render_items (
-    ID3D12GraphicsCommandList * cmd_list,
-    ID3D12Resource * object_cbuffer,
-    ID3D12Resource * mat_cbuffer,
-    UINT64 descriptor_increment_size,
-    ID3D12DescriptorHeap * srv_heap,
-    RenderItemArray * ritem_array,
-    UINT current_frame_index
-) {
-    UINT objcb_byte_size = (UINT64)sizeof(ObjectConstants);
-    UINT matcb_byte_size = (UINT64)sizeof(MaterialConstants);
-    for (size_t i = 0; i < ritem_array->size; ++i) {
-        if (ritem_array->ritems[i].initialized) {
-            D3D12_VERTEX_BUFFER_VIEW vbv = Mesh_GetVertexBufferView(ritem_array->ritems[i].geometry);
-            D3D12_INDEX_BUFFER_VIEW ibv = Mesh_GetIndexBufferView(ritem_array->ritems[i].geometry);
-            cmd_list->IASetVertexBuffers(0, 1, &vbv);
-            cmd_list->IASetIndexBuffer(&ibv);
-            cmd_list->IASetPrimitiveTopology(ritem_array->ritems[i].primitive_type);
-
-            D3D12_GPU_DESCRIPTOR_HANDLE tex = srv_heap->GetGPUDescriptorHandleForHeapStart();
-            tex.ptr += descriptor_increment_size * ritem_array->ritems[i].mat->diffuse_srvheap_index;
-
-            D3D12_GPU_VIRTUAL_ADDRESS objcb_address = object_cbuffer->GetGPUVirtualAddress();
-            objcb_address += (UINT64)ritem_array->ritems[i].obj_cbuffer_index * objcb_byte_size;
-
-            D3D12_GPU_VIRTUAL_ADDRESS matcb_address = mat_cbuffer->GetGPUVirtualAddress();
-            matcb_address += (UINT64)ritem_array->ritems[i].mat->mat_cbuffer_index * matcb_byte_size;
-
-            cmd_list->SetGraphicsRootDescriptorTable(0, tex);
-            cmd_list->SetGraphicsRootConstantBufferView(1, objcb_address);
-            cmd_list->SetGraphicsRootConstantBufferView(3, matcb_address);
-            cmd_list->DrawIndexedInstanced(ritem_array->ritems[i].index_count, 1, ritem_array->ritems[i].start_index_loc, ritem_array->ritems[i].base_vertex_loc, 0);
-        }
-    }
+d3d12_set_geometry (void * ctx, uint32_t geom) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    D3D12_VERTEX_BUFFER_VIEW vbv = Mesh_GetVertexBufferView(&rec->geoms[geom]);
+    D3D12_INDEX_BUFFER_VIEW ibv = Mesh_GetIndexBufferView(&rec->geoms[geom]);
+    rec->cmd_list->IASetVertexBuffers(0, 1, &vbv);
+    rec->cmd_list->IASetIndexBuffer(&ibv);
+}
+static void
+d3d12_set_topology (void * ctx, uint32_t topology) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    rec->cmd_list->IASetPrimitiveTopology((D3D12_PRIMITIVE_TOPOLOGY)topology);
+}
+static void
+d3d12_set_root_table (void * ctx, uint32_t param, uint64_t gpu_descriptor) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    D3D12_GPU_DESCRIPTOR_HANDLE handle = {gpu_descriptor};
+    rec->cmd_list->SetGraphicsRootDescriptorTable(param, handle);
+}
+static void
+d3d12_set_root_cbv (void * ctx, uint32_t param, uint64_t gpu_address) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    rec->cmd_list->SetGraphicsRootConstantBufferView(param, gpu_address);
+}
+static void
+d3d12_set_root_constant (void * ctx, uint32_t param, uint32_t offset, uint32_t value) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    rec->cmd_list->SetGraphicsRoot32BitConstant(param, value, offset);
+}
+static void
+d3d12_draw_indexed (void * ctx, uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    rec->cmd_list->DrawIndexedInstanced(index_count, instance_count, start_index, base_vertex, start_instance);
+}
+static uint8_t *
+d3d12_upload (void * ctx, uint32_t buffer, uint64_t offset, uint32_t size) {
+    D3D12Recorder * rec = reinterpret_cast<D3D12Recorder *>(ctx);
+    return CmdUploadTable_Get(&rec->uploads, buffer, offset, size);
+}
+static CmdRecorderFns const d3d12_recorder_fns = {
+    d3d12_set_pipeline_state,
+    d3d12_set_geometry,
+    d3d12_set_topology,
+    d3d12_set_root_table,
+    d3d12_set_root_cbv,
+    d3d12_draw_indexed,
+    d3d12_upload,
+    d3d12_set_root_constant,
+};
+static CmdRecorder
+d3d12_recorder (D3D12Recorder * rec) {
+    CmdRecorder ret = {&d3d12_recorder_fns, rec};
+    return ret;
+}
+// Backend state for recording the current frame into cmd_list (nullptr if it only uploads)
+static void
+init_frame_recorder (D3DRenderContext * render_ctx, ID3D12GraphicsCommandList * cmd_list, D3D12Recorder * out) {
+    FrameResource * frame = &render_ctx->frame_resources[render_ctx->frame_index];
+    *out = {};
+    out->cmd_list = cmd_list;
+    out->psos = render_ctx->psos;
+    out->geoms = render_ctx->geom;
+    out->uploads.memory[UPLOAD_BUFFER_PASS_CB] = frame->pass_cb.cpu;
+    out->uploads.size[UPLOAD_BUFFER_PASS_CB] = frame->pass_cb.size;
+    out->uploads.memory[UPLOAD_BUFFER_MAT_DATA] = frame->mat_data.cpu;
+    out->uploads.size[UPLOAD_BUFFER_MAT_DATA] = frame->mat_data.size;
+    out->uploads.memory[UPLOAD_BUFFER_INSTANCES] = frame->instances.cpu;
+    out->uploads.size[UPLOAD_BUFFER_INSTANCES] = frame->instances.size;
+    out->uploads.memory[UPLOAD_BUFFER_DRAW_INSTANCES] = frame->draw_instances.cpu;
+    out->uploads.size[UPLOAD_BUFFER_DRAW_INSTANCES] = frame->draw_instances.size;
 }
 static void
 create_descriptor_heaps (D3DRenderContext * render_ctx) {
@@ -751,34 +829,48 @@ create_root_signature (ID3D12Device * device, ID3D12RootSignature ** root_signat
     tex_table.RegisterSpace = 0;
     tex_table.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
 
-    D3D12_ROOT_PARAMETER slot_root_params[4] = {};
+    D3D12_ROOT_PARAMETER slot_root_params[6] = {};
     // NOTE(omid): Perfomance tip! Order from most frequent to least frequent.
     slot_root_params[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
     slot_root_params[0].DescriptorTable.NumDescriptorRanges = 1;
     slot_root_params[0].DescriptorTable.pDescriptorRanges = &tex_table;
     slot_root_params[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
 
-    slot_root_params[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-    slot_root_params[1].Descriptor.ShaderRegister = 0;
-    slot_root_params[1].Descriptor.RegisterSpace = 0;
+    // -- per draw constants: first draw instance slot, material index
+    slot_root_params[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    slot_root_params[1].Constants.ShaderRegister = 0;
+    slot_root_params[1].Constants.RegisterSpace = 0;
+    slot_root_params[1].Constants.Num32BitValues = 2;
     slot_root_params[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
+    // -- pass cbuffer
     slot_root_params[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
     slot_root_params[2].Descriptor.ShaderRegister = 1;
     slot_root_params[2].Descriptor.RegisterSpace = 0;
     slot_root_params[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
-    slot_root_params[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-    slot_root_params[3].Descriptor.ShaderRegister = 2;
-    slot_root_params[3].Descriptor.RegisterSpace = 0;
-    slot_root_params[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+    // -- structured buffers <instance data>, <material data>, <draw instance slots>
+    slot_root_params[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+    slot_root_params[3].Descriptor.ShaderRegister = 0;
+    slot_root_params[3].Descriptor.RegisterSpace = 1;
+    slot_root_params[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+
+    slot_root_params[4].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+    slot_root_params[4].Descriptor.ShaderRegister = 1;
+    slot_root_params[4].Descriptor.RegisterSpace = 1;
+    slot_root_params[4].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+    slot_root_params[5].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+    slot_root_params[5].Descriptor.ShaderRegister = 2;
+    slot_root_params[5].Descriptor.RegisterSpace = 1;
+    slot_root_params[5].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
 
     D3D12_STATIC_SAMPLER_DESC samplers[_COUNT_SAMPLER] = {};
     get_static_samplers(samplers);
 
     // A root signature is an array of root parameters.
     D3D12_ROOT_SIGNATURE_DESC root_sig_desc = {};
-    root_sig_desc.NumParameters = 4;
+    root_sig_desc.NumParameters = _countof(slot_root_params);
     root_sig_desc.pParameters = slot_root_params;
     root_sig_desc.NumStaticSamplers = _COUNT_SAMPLER;
     root_sig_desc.pStaticSamplers = samplers;
@@ -886,7 +978,21 @@ create_pso (D3DRenderContext * render_ctx, IDxcBlob * vertex_shader_code, IDxcBl
     //
     // -- Create PSO for Transparent objs
     //
+    // NOTE(omid): The water is the only transparent obj, so this layer uses the compact WaterVertex layout.
+    D3D12_INPUT_ELEMENT_DESC water_input_desc[3];
+    water_input_desc[0] = input_desc[0];
+
+    water_input_desc[1] = input_desc[1];
+    water_input_desc[1].Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    water_input_desc[1].AlignedByteOffset = 12;
+
+    water_input_desc[2] = input_desc[2];
+    water_input_desc[2].Format = DXGI_FORMAT_R16G16_FLOAT;
+    water_input_desc[2].AlignedByteOffset = 20; // bc of the position and packed normal
+
     D3D12_GRAPHICS_PIPELINE_STATE_DESC transparent_pso_desc = opaque_pso_desc;
+    transparent_pso_desc.InputLayout.pInputElementDescs = water_input_desc;
+    transparent_pso_desc.InputLayout.NumElements = ARRAY_COUNT(water_input_desc);
 
     D3D12_RENDER_TARGET_BLEND_DESC transparency_blend_desc = {};
     transparency_blend_desc.BlendEnable = true;
@@ -974,51 +1080,39 @@ update_camera (SceneContext * sc) {
     XMStoreFloat4x4(&sc->view, view);
 }
 static void
-update_obj_cbuffers (D3DRenderContext * render_ctx) {
-    UINT frame_index = render_ctx->frame_index;
-    UINT cbuffer_size = sizeof(ObjectConstants);
-    // Only update the cbuffer data if the constants have changed.  
-    // This needs to be tracked per frame resource.
-    for (unsigned i = 0; i < render_ctx->all_ritems.size; i++) {
-        if (
-            render_ctx->all_ritems.ritems[i].n_frames_dirty > 0 &&
-            render_ctx->all_ritems.ritems[i].initialized
-            ) {
-            UINT obj_index = render_ctx->all_ritems.ritems[i].obj_cbuffer_index;
-            XMMATRIX world = XMLoadFloat4x4(&render_ctx->all_ritems.ritems[i].world);
-            XMMATRIX tex_transform = XMLoadFloat4x4(&render_ctx->all_ritems.ritems[i].tex_transform);
-
-            ObjectConstants obj_cbuffer = {};
-            XMStoreFloat4x4(&obj_cbuffer.world, XMMatrixTranspose(world));
-            XMStoreFloat4x4(&obj_cbuffer.tex_transform, XMMatrixTranspose(tex_transform));
-
-            uint8_t * obj_ptr = render_ctx->frame_resources[frame_index].obj_cb_data_ptr + ((UINT64)obj_index * cbuffer_size);
-            memcpy(obj_ptr, &obj_cbuffer, cbuffer_size);
-
-            // Next FrameResource need to be updated too.
-            render_ctx->all_ritems.ritems[i].n_frames_dirty--;
-        }
-    }
+update_instance_data (D3DRenderContext * render_ctx, CmdRecorder * rec, bool multithreaded) {
+    // The d3d12 backend only reads its upload table, so all threads can share rec;
+    // other recorders (a capture) aren't thread safe and get one chunk.
+    Scheduler * sched = Scheduler_GetDefault();
+    int n_recorders = multithreaded ? Scheduler_GetThreadCount(sched) : 1;
+    n_recorders = (n_recorders < CMD_RECORDER_MAX_CHUNKS) ? n_recorders : CMD_RECORDER_MAX_CHUNKS;
+    CmdRecorder recorders[CMD_RECORDER_MAX_CHUNKS];
+    for (int c = 0; c < n_recorders; ++c)
+        recorders[c] = *rec;
+    DrawRecording_UploadObjects(
+        sched, recorders, n_recorders,
+        UPLOAD_BUFFER_INSTANCES, sizeof(InstanceData),
+        render_ctx->ritems, (int)render_ctx->frame_index
+    );
 }
 static void
-update_mat_cbuffers (D3DRenderContext * render_ctx) {
-    UINT frame_index = render_ctx->frame_index;
-    UINT cbuffer_size = sizeof(MaterialConstants);
+update_mat_data (D3DRenderContext * render_ctx, CmdRecorder * rec) {
+    UINT data_size = sizeof(MaterialData);
     for (int i = 0; i < _COUNT_MATERIAL; ++i) {
-        // Only update the cbuffer data if the constants have changed.  If the cbuffer
+        // Only update the buffer data if the constants have changed.  If the buffer
         // data changes, it needs to be updated for each FrameResource.
         Material * mat = &render_ctx->materials[i];
         if (mat->n_frames_dirty > 0) {
             XMMATRIX mat_transform = XMLoadFloat4x4(&mat->mat_transform);
 
-            MaterialConstants mat_constants;
-            mat_constants.diffuse_albedo = render_ctx->materials[i].diffuse_albedo;
-            mat_constants.fresnel_r0 = render_ctx->materials[i].fresnel_r0;
-            mat_constants.roughness = render_ctx->materials[i].roughness;
-            XMStoreFloat4x4(&mat_constants.mat_transform, XMMatrixTranspose(mat_transform));
+            MaterialData mat_data;
+            mat_data.diffuse_albedo = render_ctx->materials[i].diffuse_albedo;
+            mat_data.fresnel_r0 = render_ctx->materials[i].fresnel_r0;
+            mat_data.roughness = render_ctx->materials[i].roughness;
+            XMStoreFloat4x4(&mat_data.mat_transform, XMMatrixTranspose(mat_transform));
 
-            uint8_t * mat_ptr = render_ctx->frame_resources[frame_index].mat_cb_data_ptr + ((UINT64)mat->mat_cbuffer_index * cbuffer_size);
-            memcpy(mat_ptr, &mat_constants, cbuffer_size);
+            uint8_t * mat_ptr = CmdRecorder_Upload(rec, UPLOAD_BUFFER_MAT_DATA, (UINT64)mat->mat_cbuffer_index * data_size, data_size);
+            memcpy(mat_ptr, &mat_data, data_size);
 
             // Next FrameResource need to be updated too.
             mat->n_frames_dirty--;
@@ -1026,7 +1120,7 @@ update_mat_cbuffers (D3DRenderContext * render_ctx) {
     }
 }
 static void
-update_pass_cbuffers (D3DRenderContext * render_ctx, GameTimer * timer) {
+update_pass_cbuffers (D3DRenderContext * render_ctx, GameTimer * timer, CmdRecorder * rec) {
 
     XMMATRIX view = XMLoadFloat4x4(&global_scene_ctx.view);
     XMMATRIX proj = XMLoadFloat4x4(&global_scene_ctx.proj);
@@ -1062,9 +1156,62 @@ update_pass_cbuffers (D3DRenderContext * render_ctx, GameTimer * timer) {
     render_ctx->main_pass_constants.lights[2].direction = {0.0f, -0.707f, -0.707f};
     render_ctx->main_pass_constants.lights[2].strength = {0.15f, 0.15f, 0.15f};
 
-    uint8_t * pass_ptr = render_ctx->frame_resources[render_ctx->frame_index].pass_cb_data_ptr;
+    uint8_t * pass_ptr = CmdRecorder_Upload(rec, UPLOAD_BUFFER_PASS_CB, 0, sizeof(PassConstants));
     memcpy(pass_ptr, &render_ctx->main_pass_constants, sizeof(PassConstants));
 }
+// Tests the render items and the water patches against the camera frustum. Visible render items
+// are listed in culled_ritems, visible water draws are moved to the front of water_draws.
+static void
+cull_scene (D3DRenderContext * render_ctx, SceneContext * sc) {
+    Culling_ExtractFrustum(sc->view, sc->proj, &render_ctx->frustum);
+
+    render_ctx->n_visible_ritems = Culling_FrustumCull(&render_ctx->frustum, render_ctx->ritems->world_bounds, render_ctx->culled_ritems);
+
+    // WaterLod_Select wrote one draw per patch; visible patches keep their order
+    int n_visible = Culling_FrustumCull(&render_ctx->frustum, render_ctx->water_patch_bounds, render_ctx->culled_water_patches);
+    render_ctx->n_water_tris = 0;
+    for (int i = 0; i < n_visible; ++i) {
+        render_ctx->water_draws[i] = render_ctx->water_draws[render_ctx->culled_water_patches[i]];
+        render_ctx->n_water_tris += render_ctx->water_draws[i].index_count / 3;
+    }
+    render_ctx->n_water_draws = n_visible;
+}
+// Sorts the visible render items for DrawRecording_DrawItems: passes in draw order, opaque items grouped
+// by pso/geometry/material and front to back within a group, transparent ones back to front.
+// The water is left out, it is drawn patch by patch after everything else.
+static void
+build_draw_list (D3DRenderContext * render_ctx, SceneContext * sc) {
+    static uint32_t const layer_pass[_COUNT_RENDER_LAYER] = {
+        0,      // OPAQUE_LAYER
+        2,      // TRANSPARENT_LAYER
+        1,      // ALPHATESTED_LAYER
+    };
+    RenderItems const * ritems = render_ctx->ritems;
+    CullingBounds const * bounds = ritems->world_bounds;
+    XMFLOAT4X4 const & view = sc->view;
+    uint32_t water_index = RenderItems_GetIndex(ritems, render_ctx->ritem_handles[RITEM_WATER]);
+
+    DrawList_Clear(render_ctx->draw_list);
+    for (int v = 0; v < render_ctx->n_visible_ritems; ++v) {
+        uint32_t i = render_ctx->culled_ritems[v];
+        if (i == water_index)
+            continue;
+        // view space z of the box center
+        float depth = bounds->center_x[i] * view.m[0][2] + bounds->center_y[i] * view.m[1][2] + bounds->center_z[i] * view.m[2][2] + view.m[3][2];
+        uint8_t layer = ritems->layer[i];
+        uint64_t key = (TRANSPARENT_LAYER == layer) ?
+            DrawList_TransparentKey(layer_pass[layer], layer, ritems->draw_args[i].geom, ritems->material[i], depth) :
+            DrawList_OpaqueKey(layer_pass[layer], layer, ritems->draw_args[i].geom, ritems->material[i], depth);
+        DrawList_Push(render_ctx->draw_list, key, i);
+    }
+    DrawList_Sort(render_ctx->draw_list);
+}
+// Draw instance slots for the frame: the sorted draw list, then the water (drawn after it).
+static void
+update_draw_instances (D3DRenderContext * render_ctx, CmdRecorder * rec) {
+    uint32_t water_index = RenderItems_GetIndex(render_ctx->ritems, render_ctx->ritem_handles[RITEM_WATER]);
+    DrawRecording_UploadDrawInstances(rec, UPLOAD_BUFFER_DRAW_INSTANCES, render_ctx->draw_list, &water_index, 1);
+}
 static void
 animate_material (Material * mat, GameTimer * timer) {
     // Scroll the water material texture coordinates.
@@ -1110,22 +1257,25 @@ update_waves_vb (Waves * waves, D3DRenderContext * render_ctx, GameTimer * timer
     if ((total_time - t_base) >= 0.25f) {
         t_base += 0.25f;
 
-        int i = rand_int(4, waves->nrow - 5);
-        int j = rand_int(4, waves->ncol - 5);
-
-        float r = rand_float(0.2f, 0.5f);
+        // Sub-cell gaussian splash, about as wide as the old 5-point one.
+        // (rain, wakes etc. would append more events here and go through the same single batch)
+        WavesDisturbance splash = {};
+        splash.i = rand_float(4.0f, (float)(waves->nrow - 5));
+        splash.j = rand_float(4.0f, (float)(waves->ncol - 5));
+        splash.magnitude = rand_float(0.2f, 0.5f);
+        splash.radius = 2.5f;
+        splash.splat = WAVES_SPLAT_GAUSSIAN;
 
-        Waves_Disturb(waves, i, j, r);
+        Waves_DisturbMany(waves, &splash, 1);
     }
 
     // Update the wave simulation.
-    XMFLOAT3 * temp = (XMFLOAT3 *)::malloc(sizeof(XMFLOAT3) * waves->nvtx);
-    Waves_Update(waves, delta_time, temp);
-    ::free(temp);
+    Waves_Update(waves, delta_time);
 
     // Update the wave vertex buffer with the new solution.
     UINT frame_index = render_ctx->frame_index;
-    uint8_t * wave_ptr = render_ctx->frame_resources[frame_index].waves_vb_data_ptr;
+    FrameResource * fr = &render_ctx->frame_resources[frame_index];
+    uint8_t * wave_ptr = fr->waves_vb.cpu;
 
     //D3D12_RANGE mem_range = {};
     //mem_range.Begin = 0;
@@ -1134,24 +1284,16 @@ update_waves_vb (Waves * waves, D3DRenderContext * render_ctx, GameTimer * timer
     //    render_ctx->frame_resources[frame_index].waves_vb->Map(0, &mem_range, reinterpret_cast<void**>(&wave_ptr))
     //);
 
-    UINT v_size = (UINT64)sizeof(Vertex);
-    for (int i = 0; i < waves->nvtx; ++i) {
-        Vertex v;
-
-        v.position = Waves_GetPosition(waves, i);
-        v.normal = waves->normal[i];
-
-            // Derive tex-coords from position by 
-        // mapping [-w/2,w/2] --> [0,1]
-        v.texc.x = 0.5f + v.position.x / waves->width;
-        v.texc.y = 0.5f - v.position.z / waves->depth;
-
-        ::memcpy(wave_ptr + (UINT64)i * v_size, &v, v_size);
-    }
+    // Vertices (with texcoords built once at init) are streamed straight into the mapped buffer.
+    // Each frame buffer only gets the tiles that changed since it was last written.
+    SIMPLE_ASSERT(Waves_GetVertexStride(waves) == sizeof(WaterVertex), "waves normal format does not match WaterVertex");
+    Waves_ExportDirtyVertices(waves, wave_ptr, fr->waves_vb_version);
+    fr->waves_vb_version = Waves_GetVersion(waves);
     // NOTE(omid): We did the upload_buffer mapping to data pointer (when creating the upload_buffer)
 
     // Set the dynamic VB of the wave renderitem to the current frame VB.
-    render_ctx->all_ritems.ritems[RITEM_WATER].geometry->vb_gpu = render_ctx->frame_resources[frame_index].waves_vb;
+    render_ctx->geom[GEOM_WATER].vb_gpu = render_ctx->upload_heap;
+    render_ctx->geom[GEOM_WATER].vb_offset = fr->waves_vb.offset;
 }
 static HRESULT
 move_to_next_frame (D3DRenderContext * render_ctx, UINT * out_frame_index, UINT * out_backbuffer_index) {
@@ -1170,14 +1312,17 @@ move_to_next_frame (D3DRenderContext * render_ctx, UINT * out_frame_index, UINT
     *out_frame_index = (render_ctx->frame_index + 1) % NUM_QUEUING_FRAMES;
 
     // -- 3. if the next frame is not ready to be rendered yet, wait until it is ready
-    if (render_ctx->fence->GetCompletedValue() < render_ctx->frame_resources[frame_index].fence) {
-        ret = render_ctx->fence->SetEventOnCompletion(render_ctx->frame_resources[frame_index].fence, render_ctx->fence_event);
+    // (its fence is the value signaled after its last use; the fence only ever increases,
+    // the upload ring relies on that, see UploadRing_EndFrame)
+    UINT const next_frame_index = *out_frame_index;
+    if (render_ctx->fence->GetCompletedValue() < render_ctx->frame_resources[next_frame_index].fence) {
+        ret = render_ctx->fence->SetEventOnCompletion(render_ctx->frame_resources[next_frame_index].fence, render_ctx->fence_event);
         CHECK_AND_FAIL(ret);
         WaitForSingleObjectEx(render_ctx->fence_event, INFINITE /*return only when the object is signaled*/, false);
     }
 
     // -- 3. set the fence value for the next frame
-    render_ctx->frame_resources[frame_index].fence = current_fence_value + 1;
+    render_ctx->frame_resources[next_frame_index].fence = current_fence_value + 1;
 
     return ret;
 }
@@ -1185,26 +1330,100 @@ static HRESULT
 wait_for_gpu (D3DRenderContext * render_ctx) {
     HRESULT ret = E_FAIL;
 
-    /*UINT frame_index = render_ctx->frame_index;*/
+    UINT frame_index = render_ctx->frame_index;
 
-    // Do it for all queuing frames to do a thorough cleanup
+    // The current frame's fence is the next value to signal, the other frames were signaled
+    // with smaller ones, so once it completes the GPU is done with every frame.
 
-    for (unsigned i = 0; i < NUM_QUEUING_FRAMES; i++) {
+    // -- 1. schedule a signal command in the queue
+    ret = render_ctx->cmd_queue->Signal(render_ctx->fence, render_ctx->frame_resources[frame_index].fence);
+    CHECK_AND_FAIL(ret);
 
-        // -- 1. schedule a signal command in the queue
-        ret = render_ctx->cmd_queue->Signal(render_ctx->fence, render_ctx->frame_resources[i].fence);
-        CHECK_AND_FAIL(ret);
+    // -- 2. wait until the fence has been processed
+    ret = render_ctx->fence->SetEventOnCompletion(render_ctx->frame_resources[frame_index].fence, render_ctx->fence_event);
+    CHECK_AND_FAIL(ret);
+    WaitForSingleObjectEx(render_ctx->fence_event, INFINITE /*return only when the object is signaled*/, false);
 
-        // -- 2. wait until the fence has been processed
-        ret = render_ctx->fence->SetEventOnCompletion(render_ctx->frame_resources[i].fence, render_ctx->fence_event);
-        CHECK_AND_FAIL(ret);
-        WaitForSingleObjectEx(render_ctx->fence_event, INFINITE /*return only when the object is signaled*/, false);
+    // -- 3. increment fence value for the current frame
+    ++render_ctx->frame_resources[frame_index].fence;
 
-        // -- 3. increment fence value for the current frame
-        ++render_ctx->frame_resources[i].fence;
-    }
     return ret;
 }
+// (Re)creates the upload heap the frames share: each frame's instance data (instance_capacity
+// items), material data and waves vb (waves_vb_size bytes) reserved up front, then a ring of
+// ring_size bytes.
+// When growing, waits for the GPU and carries the frames' reserved data over, so their dirty
+// tracking (render items, materials, waves vb version) stays valid.
+static void
+create_upload_heap (D3DRenderContext * render_ctx, int instance_capacity, UINT64 waves_vb_size, UINT64 ring_size) {
+    ID3D12Resource * old_heap = render_ctx->upload_heap;
+    if (old_heap) {
+        CHECK_AND_FAIL(wait_for_gpu(render_ctx));
+        ++render_ctx->n_upload_heap_grows;
+    }
+    UINT64 const instances_size = (UINT64)sizeof(InstanceData) * instance_capacity;
+    UINT64 const mat_data_size = (UINT64)sizeof(MaterialData) * _COUNT_MATERIAL;
+    UINT64 reserve_sizes[NUM_QUEUING_FRAMES * 3];
+    for (int i = 0; i < NUM_QUEUING_FRAMES; ++i) {
+        reserve_sizes[i * 3 + 0] = instances_size;
+        reserve_sizes[i * 3 + 1] = mat_data_size;
+        reserve_sizes[i * 3 + 2] = waves_vb_size;
+    }
+    UINT64 heap_size = UploadRing_CalculateRequiredSize(reserve_sizes, (int)ARRAY_COUNT(reserve_sizes), ring_size);
+    BYTE * upload_ptr = nullptr;
+    create_upload_buffer(render_ctx->device, heap_size, &upload_ptr, &render_ctx->upload_heap);
+    UploadRing_Init(&render_ctx->upload_ring, upload_ptr, render_ctx->upload_heap->GetGPUVirtualAddress(), heap_size);
+    for (int i = 0; i < NUM_QUEUING_FRAMES; ++i) {
+        FrameResource * frame = &render_ctx->frame_resources[i];
+        UploadAllocation const old_reserves[] = {frame->instances, frame->mat_data, frame->waves_vb};
+        bool reserved =
+            UploadRing_Reserve(&render_ctx->upload_ring, instances_size, UPLOAD_RING_CB_ALIGNMENT, &frame->instances) &&
+            UploadRing_Reserve(&render_ctx->upload_ring, mat_data_size, UPLOAD_RING_CB_ALIGNMENT, &frame->mat_data) &&
+            UploadRing_Reserve(&render_ctx->upload_ring, waves_vb_size, UPLOAD_RING_CB_ALIGNMENT, &frame->waves_vb);
+        SIMPLE_ASSERT(reserved, "upload heap sized for the reservations");
+        if (old_heap) {
+            UploadAllocation * new_reserves[] = {&frame->instances, &frame->mat_data, &frame->waves_vb};
+            for (int r = 0; r < (int)ARRAY_COUNT(old_reserves); ++r) {
+                UINT64 n_bytes = (old_reserves[r].size < new_reserves[r]->size) ? old_reserves[r].size : new_reserves[r]->size;
+                memcpy(new_reserves[r]->cpu, old_reserves[r].cpu, (size_t)n_bytes);
+            }
+        } else {
+            frame->waves_vb_version = 0;    // nothing exported yet
+        }
+    }
+    if (old_heap) {
+        old_heap->Unmap(0, nullptr);
+        old_heap->Release();
+    }
+    render_ctx->upload_instance_capacity = instance_capacity;
+    render_ctx->upload_ring_size = ring_size;
+}
+static bool
+alloc_frame_uploads (D3DRenderContext * render_ctx, FrameResource * frame, int n_items) {
+    // a slot per render item at most: every visible item is either in the draw list or the water
+    UINT64 draw_instances_size = sizeof(uint32_t) * (UINT64)((n_items > 0) ? n_items : 1);
+    return
+        UploadRing_Alloc(&render_ctx->upload_ring, sizeof(PassConstants), UPLOAD_RING_CB_ALIGNMENT, &frame->pass_cb) &&
+        UploadRing_Alloc(&render_ctx->upload_ring, draw_instances_size, UPLOAD_RING_CB_ALIGNMENT, &frame->draw_instances);
+}
+// Retires the ring space of the frames the GPU is done with and allocates what the frame
+// rewrites from scratch, sized for the live render items. Grows the upload heap when the items
+// outgrow the instance data or the frames in flight leave the ring too little space.
+static void
+begin_frame_uploads (D3DRenderContext * render_ctx) {
+    FrameResource * frame = &render_ctx->frame_resources[render_ctx->frame_index];
+    int n_items = render_ctx->ritems->count;
+    if (n_items > render_ctx->upload_instance_capacity) {
+        int capacity = render_ctx->upload_instance_capacity * 2;
+        create_upload_heap(render_ctx, (capacity > n_items) ? capacity : n_items, frame->waves_vb.size, render_ctx->upload_ring_size);
+    }
+    UploadRing_BeginFrame(&render_ctx->upload_ring, render_ctx->fence->GetCompletedValue());
+    while (!alloc_frame_uploads(render_ctx, frame, n_items)) {
+        // the new heap starts empty, the allocations that went through are dropped with the old one
+        create_upload_heap(render_ctx, render_ctx->upload_instance_capacity, frame->waves_vb.size, render_ctx->upload_ring_size * 2);
+        UploadRing_BeginFrame(&render_ctx->upload_ring, render_ctx->fence->GetCompletedValue());
+    }
+}
 static D3D12_RESOURCE_BARRIER
 create_barrier (ID3D12Resource * resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after) {
     D3D12_RESOURCE_BARRIER barrier = {};
@@ -1216,11 +1435,62 @@ create_barrier (ID3D12Resource * resource, D3D12_RESOURCE_STATES before, D3D12_R
     barrier.Transition.StateAfter = after;
     return barrier;
 }
+// Every command list starts without any state, so each list that draws needs these.
+static void
+bind_frame_state (D3DRenderContext * render_ctx, ID3D12GraphicsCommandList * cmd_list) {
+    cmd_list->RSSetViewports(1, &render_ctx->viewport);
+    cmd_list->RSSetScissorRects(1, &render_ctx->scissor_rect);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE dsv_handle = render_ctx->dsv_heap->GetCPUDescriptorHandleForHeapStart();
+    D3D12_CPU_DESCRIPTOR_HANDLE rtv_handle = render_ctx->rtv_heap->GetCPUDescriptorHandleForHeapStart();
+    rtv_handle.ptr = SIZE_T(INT64(rtv_handle.ptr) + INT64(render_ctx->backbuffer_index) * INT64(render_ctx->rtv_descriptor_size));
+    cmd_list->OMSetRenderTargets(1, &rtv_handle, true, &dsv_handle);
+
+    ID3D12DescriptorHeap* descriptor_heaps [] = {render_ctx->srv_heap};
+    cmd_list->SetDescriptorHeaps(_countof(descriptor_heaps), descriptor_heaps);
+
+    cmd_list->SetGraphicsRootSignature(render_ctx->root_signature);
+
+    // Bind per-pass constant buffer.  We only need to do this once per-pass.
+    FrameResource * frame = &render_ctx->frame_resources[render_ctx->frame_index];
+    cmd_list->SetGraphicsRootConstantBufferView(2, frame->pass_cb.gpu);
+
+    // The structured buffers hold every item/material, draws only index into them
+    cmd_list->SetGraphicsRootShaderResourceView(3, frame->instances.gpu);
+    cmd_list->SetGraphicsRootShaderResourceView(4, frame->mat_data.gpu);
+    cmd_list->SetGraphicsRootShaderResourceView(5, frame->draw_instances.gpu);
+}
+struct DrawChunkJob {
+    D3DRenderContext * render_ctx;
+    DrawBindings const * bindings;
+};
+// Runs on a scheduler thread: records one chunk of the draw list into the chunk's own list.
+static void
+record_draw_chunk (void * ctx, int chunk, CmdRecorder * rec, int begin, int end) {
+    DrawChunkJob const * job = reinterpret_cast<DrawChunkJob const *>(ctx);
+    D3DRenderContext * render_ctx = job->render_ctx;
+    ID3D12CommandAllocator * alloc = render_ctx->frame_resources[render_ctx->frame_index].chunk_cmd_allocs[chunk];
+    ID3D12GraphicsCommandList * cmd_list = render_ctx->chunk_cmd_lists[chunk];
+
+    alloc->Reset();
+    CHECK_AND_FAIL(cmd_list->Reset(alloc, render_ctx->psos[OPAQUE_LAYER]));
+    bind_frame_state(render_ctx, cmd_list);
+
+    // stats are per chunk so the threads don't share counters
+    render_ctx->chunk_draw_stats[chunk] = {};
+    DrawStateCache state;
+    DrawStateCache_Reset(&state, &render_ctx->chunk_draw_stats[chunk]);
+    state.bound[DRAW_STATE_PSO] = OPAQUE_LAYER;
+    DrawRecording_DrawItems(rec, job->bindings, render_ctx->ritems, render_ctx->draw_materials, render_ctx->draw_list, begin, end, &state);
+
+    CHECK_AND_FAIL(cmd_list->Close());
+}
 static HRESULT
 draw_main (D3DRenderContext * render_ctx) {
     HRESULT ret = E_FAIL;
     UINT frame_index = render_ctx->frame_index;
     UINT backbuffer_index = render_ctx->backbuffer_index;
+    FrameResource * frame = &render_ctx->frame_resources[frame_index];
 
     // Populate command list
 
@@ -1229,18 +1499,14 @@ draw_main (D3DRenderContext * render_ctx) {
     // Command list allocators can only be reset when the associated 
     // command lists have finished execution on the GPU; apps should use 
     // fences to determine GPU execution progress.
-    render_ctx->frame_resources[frame_index].cmd_list_alloc->Reset();
+    frame->cmd_list_alloc->Reset();
 
     // However, when ExecuteCommandList() is called on a particular command 
     // list, that command list can then be reset at any time and must be before 
     // re-recording.
-    ret = render_ctx->direct_cmd_list->Reset(render_ctx->frame_resources[frame_index].cmd_list_alloc, render_ctx->psos[OPAQUE_LAYER]);
+    ret = render_ctx->direct_cmd_list->Reset(frame->cmd_list_alloc, render_ctx->psos[OPAQUE_LAYER]);
     CHECK_AND_FAIL(ret);
 
-    // -- set viewport and scissor
-    render_ctx->direct_cmd_list->RSSetViewports(1, &render_ctx->viewport);
-    render_ctx->direct_cmd_list->RSSetScissorRects(1, &render_ctx->scissor_rect);
-
     // -- indicate that the backbuffer will be used as the render target
     D3D12_RESOURCE_BARRIER barrier1 = create_barrier(render_ctx->render_targets[backbuffer_index], D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
     render_ctx->direct_cmd_list->ResourceBarrier(1, &barrier1);
@@ -1252,60 +1518,100 @@ draw_main (D3DRenderContext * render_ctx) {
 
     render_ctx->direct_cmd_list->ClearRenderTargetView(rtv_handle, (float *)&render_ctx->main_pass_constants.fog_color, 0, nullptr);
     render_ctx->direct_cmd_list->ClearDepthStencilView(dsv_handle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-    render_ctx->direct_cmd_list->OMSetRenderTargets(1, &rtv_handle, true, &dsv_handle);
-
-    ID3D12DescriptorHeap* descriptor_heaps [] = {render_ctx->srv_heap};
-    render_ctx->direct_cmd_list->SetDescriptorHeaps(_countof(descriptor_heaps), descriptor_heaps);
 
-    render_ctx->direct_cmd_list->SetGraphicsRootSignature(render_ctx->root_signature);
-
-    // Bind per-pass constant buffer.  We only need to do this once per-pass.
-    ID3D12Resource * pass_cb = render_ctx->frame_resources[frame_index].pass_cb;
-    render_ctx->direct_cmd_list->SetGraphicsRootConstantBufferView(2, pass_cb->GetGPUVirtualAddress());
-
-    // 1. draw opaque objs first (opaque pso is currently used)
-    draw_render_items(
-        render_ctx->direct_cmd_list,
-        render_ctx->frame_resources[frame_index].obj_cb,
-        render_ctx->frame_resources[frame_index].mat_cb,
-        render_ctx->cbv_srv_uav_descriptor_size,
-        render_ctx->srv_heap,
-        &render_ctx->opaque_ritems, frame_index
-    );
-    // 2. draw alpha-tested obj(s)
-    render_ctx->direct_cmd_list->SetPipelineState(render_ctx->psos[ALPHATESTED_LAYER]);
-    draw_render_items(
-        render_ctx->direct_cmd_list,
-        render_ctx->frame_resources[frame_index].obj_cb,
-        render_ctx->frame_resources[frame_index].mat_cb,
-        render_ctx->cbv_srv_uav_descriptor_size,
-        render_ctx->srv_heap,
-        &render_ctx->alphatested_ritems, frame_index
-    );
-    // 3. draw transparent objs
-    render_ctx->direct_cmd_list->SetPipelineState(render_ctx->psos[TRANSPARENT_LAYER]);
-    draw_render_items(
-        render_ctx->direct_cmd_list,
-        render_ctx->frame_resources[frame_index].obj_cb,
-        render_ctx->frame_resources[frame_index].mat_cb,
-        render_ctx->cbv_srv_uav_descriptor_size,
-        render_ctx->srv_heap,
-        &render_ctx->transparent_ritems, frame_index
+    DrawBindings bindings = {};
+    bindings.srv_heap = render_ctx->srv_heap->GetGPUDescriptorHandleForHeapStart().ptr;
+    bindings.descriptor_size = render_ctx->cbv_srv_uav_descriptor_size;
+
+    // Only state changes between consecutive draws are recorded; lists are reset with the opaque pso
+    render_ctx->draw_stats = {};
+    DrawStateCache state;
+    DrawStateCache_Reset(&state, &render_ctx->draw_stats);
+    state.bound[DRAW_STATE_PSO] = OPAQUE_LAYER;
+
+    // 1. draw opaque, then alpha-tested objs (sorted by build_draw_list)
+    // Multithreaded: the direct list only clears, each chunk of the draw list is recorded into its
+    // own list on a scheduler thread, and the rest of the frame goes to the tail list.
+    // Submitted in that order, the GPU sees the same stream as the single-list path.
+    // A captured frame is always recorded on one list.
+    bool capturing = render_ctx->capture_requested;
+    bool split = render_ctx->mt_recording && !capturing;
+    ID3D12GraphicsCommandList * tail_cmd_list = render_ctx->direct_cmd_list;
+    if (split) {
+        CHECK_AND_FAIL(render_ctx->direct_cmd_list->Close());
+
+        Scheduler * sched = Scheduler_GetDefault();
+        int max_chunks = Scheduler_GetThreadCount(sched);
+        max_chunks = (max_chunks < MAX_DRAW_CHUNKS) ? max_chunks : MAX_DRAW_CHUNKS;
+        int n_chunks = CmdRecorder_ChunkCount(render_ctx->draw_list->count, max_chunks, MIN_DRAWS_PER_CHUNK);
+
+        D3D12Recorder chunk_d3d12[MAX_DRAW_CHUNKS];
+        CmdRecorder recorders[MAX_DRAW_CHUNKS];
+        for (int c = 0; c < n_chunks; ++c) {
+            init_frame_recorder(render_ctx, render_ctx->chunk_cmd_lists[c], &chunk_d3d12[c]);
+            recorders[c] = d3d12_recorder(&chunk_d3d12[c]);
+        }
+        DrawChunkJob job = {render_ctx, &bindings};
+        CmdRecorder_RecordChunks(sched, render_ctx->draw_list->count, n_chunks, recorders, &job, record_draw_chunk);
+        for (int c = 0; c < n_chunks; ++c)
+            DrawStats_Add(&render_ctx->draw_stats, &render_ctx->chunk_draw_stats[c]);
+        render_ctx->n_draw_chunks = n_chunks;
+
+        frame->tail_cmd_alloc->Reset();
+        CHECK_AND_FAIL(render_ctx->tail_cmd_list->Reset(frame->tail_cmd_alloc, render_ctx->psos[OPAQUE_LAYER]));
+        tail_cmd_list = render_ctx->tail_cmd_list;
+    } else {
+        render_ctx->n_draw_chunks = 1;
+    }
+    bind_frame_state(render_ctx, tail_cmd_list);
+    D3D12Recorder tail_d3d12;
+    init_frame_recorder(render_ctx, tail_cmd_list, &tail_d3d12);
+    CmdRecorder tail_rec = capturing ? CmdCapture_GetRecorder(&render_ctx->capture) : d3d12_recorder(&tail_d3d12);
+    if (!split)
+        DrawRecording_DrawItems(&tail_rec, &bindings, render_ctx->ritems, render_ctx->draw_materials, render_ctx->draw_list, 0, render_ctx->draw_list->count, &state);
+
+    // 2. draw transparent objs (only the water, drawn patch by patch at the selected lods, culled patches are skipped)
+    DrawRecording_DrawPatches(
+        &tail_rec, &bindings,
+        render_ctx->ritems, render_ctx->draw_materials,
+        RenderItems_GetIndex(render_ctx->ritems, render_ctx->ritem_handles[RITEM_WATER]), (uint32_t)render_ctx->draw_list->count, TRANSPARENT_LAYER,
+        render_ctx->water_draws, render_ctx->n_water_draws,
+        &state
     );
 
+    // The capture holds the whole frame (the cbuffer uploads too), replaying it does the real work
+    if (capturing) {
+        CmdRecorder d3d12_rec = d3d12_recorder(&tail_d3d12);
+        CmdCapture_Replay(&render_ctx->capture, &d3d12_rec);
+        if (!CmdCapture_WriteFile(&render_ctx->capture, CAPTURE_FILE_PATH))
+            ::printf("[ERROR] could not write %s\n", CAPTURE_FILE_PATH);
+        render_ctx->capture_requested = false;
+    }
+
     // Imgui draw call
-    ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), render_ctx->direct_cmd_list);
+    ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), tail_cmd_list);
 
     // -- indicate that the backbuffer will now be used to present
     D3D12_RESOURCE_BARRIER barrier2 = create_barrier(render_ctx->render_targets[backbuffer_index], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-    render_ctx->direct_cmd_list->ResourceBarrier(1, &barrier2);
+    tail_cmd_list->ResourceBarrier(1, &barrier2);
 
     // -- finish populating command list
-    render_ctx->direct_cmd_list->Close();
-
-    ID3D12CommandList * cmd_lists [] = {render_ctx->direct_cmd_list};
-    render_ctx->cmd_queue->ExecuteCommandLists(ARRAY_COUNT(cmd_lists), cmd_lists);
-
+    tail_cmd_list->Close();
+
+    if (split) {
+        ID3D12CommandList * cmd_lists [2 + MAX_DRAW_CHUNKS];
+        UINT n_lists = 0;
+        cmd_lists[n_lists++] = render_ctx->direct_cmd_list;
+        for (int c = 0; c < render_ctx->n_draw_chunks; ++c)
+            cmd_lists[n_lists++] = render_ctx->chunk_cmd_lists[c];
+        cmd_lists[n_lists++] = render_ctx->tail_cmd_list;
+        render_ctx->cmd_queue->ExecuteCommandLists(n_lists, cmd_lists);
+    } else {
+        ID3D12CommandList * cmd_lists [] = {render_ctx->direct_cmd_list};
+        render_ctx->cmd_queue->ExecuteCommandLists(ARRAY_COUNT(cmd_lists), cmd_lists);
+    }
+    // move_to_next_frame signals the frame's fence right after these commands
+    UploadRing_EndFrame(&render_ctx->upload_ring, frame->fence);
 
     render_ctx->swapchain->Present(1 /*sync interval*/, 0 /*present flag*/);
 
@@ -1345,6 +1651,11 @@ RenderContext_Init (D3DRenderContext * render_ctx) {
     render_ctx->scissor_rect.right = global_scene_ctx.width;
     render_ctx->scissor_rect.bottom = global_scene_ctx.height;
 
+    // draw lists too short to split are still recorded on one thread
+    render_ctx->mt_recording = true;
+    render_ctx->n_draw_chunks = 1;
+    CmdCapture_Init(&render_ctx->capture);
+
     // -- initialize fog data
     render_ctx->main_pass_constants.fog_color = {0.7f, 0.7f, 0.7f, 1.0f};
     render_ctx->main_pass_constants.fog_start = 5.0f;
@@ -1375,27 +1686,8 @@ RenderContext_Init (D3DRenderContext * render_ctx) {
 }
 static void
 flush_command_queue (D3DRenderContext * render_ctx) {
-    // Advance the fence value to mark commands up to this fence point.
-    render_ctx->main_current_fence++;
-
-    // Add an instruction to the command queue to set a new fence point.  Because we 
-    // are on the GPU timeline, the new fence point won't be set until the GPU finishes
-    // processing all the commands prior to this Signal().
-    render_ctx->cmd_queue->Signal(render_ctx->fence, render_ctx->main_current_fence);
-
-    // Wait until the GPU has completed commands up to this fence point.
-    if (render_ctx->fence->GetCompletedValue() < render_ctx->main_current_fence) {
-        HANDLE event_handle = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-
-        // Fire event when GPU hits current fence.  
-        render_ctx->fence->SetEventOnCompletion(render_ctx->main_current_fence, event_handle);
-
-        // Wait until the GPU hits current fence event is fired.
-        if (event_handle != 0) {
-            WaitForSingleObject(event_handle, INFINITE);
-            CloseHandle(event_handle);
-        }
-    }
+    // Through the frame fences, so the fence value keeps increasing
+    CHECK_AND_FAIL(wait_for_gpu(render_ctx));
 }
 static void
 d3d_resize (D3DRenderContext * render_ctx) {
@@ -1410,7 +1702,6 @@ d3d_resize (D3DRenderContext * render_ctx) {
         ) {
             // Flush before changing any resources.
         flush_command_queue(render_ctx);
-        //wait_for_gpu(render_ctx);
 
         render_ctx->direct_cmd_list->Reset(render_ctx->direct_cmd_list_alloc, nullptr);
 
@@ -1495,7 +1786,6 @@ d3d_resize (D3DRenderContext * render_ctx) {
 
         // Wait until resize is complete.
         flush_command_queue(render_ctx);
-        //wait_for_gpu(render_ctx);
 
         // Update the viewport transform to cover the client area.
         render_ctx->viewport.TopLeftX = 0;
@@ -1660,9 +1950,18 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
     uint32_t const nrow = 256;
     uint32_t const ncols = 256;
     uint32_t const N_VTX = nrow * ncols;
-    size_t wave_size = Waves_CalculateRequiredSize(nrow, ncols);
+    // fp16 normals/tangents: update_waves_vb streams them straight into WaterVertex
+    size_t wave_size = Waves_CalculateRequiredSize(nrow, ncols, WAVES_LAYOUT_SOA, WAVES_NORMAL_HALF4);
     BYTE * wave_memory = (BYTE *)::malloc(wave_size);
-    Waves * waves = Waves_Init(wave_memory, nrow, ncols, 1.0f, 0.03f, 4.0f, 0.2f);
+    Waves * waves = Waves_Init(wave_memory, nrow, ncols, 1.0f, 0.03f, 4.0f, 0.2f, WAVES_LAYOUT_SOA, WAVES_KERNEL_AUTO, WAVES_NORMAL_HALF4);
+    Waves_SetFusedBands(waves, WAVES_BANDS_AUTO);
+    Waves_SetActiveTiles(waves, true, WAVES_DEFAULT_QUIET_EPS);
+
+    // Water lods: full res within a patch's width of the camera, halving every doubling of distance
+    float const water_lod_distance = WATER_LOD_DEFAULT_PATCH_QUADS * 1.0f;
+    size_t water_lod_size = WaterLod_CalculateRequiredSize(nrow, ncols, WATER_LOD_DEFAULT_PATCH_QUADS, WATER_LOD_DEFAULT_COUNT);
+    BYTE * water_lod_memory = (BYTE *)::malloc(water_lod_size);
+    WaterLod * water_lod = WaterLod_Init(water_lod_memory, nrow, ncols, 1.0f, WATER_LOD_DEFAULT_PATCH_QUADS, WATER_LOD_DEFAULT_COUNT, water_lod_distance);
 
     // Query Adapter (PhysicalDevice)
     IDXGIFactory * dxgi_factory = nullptr;
@@ -1843,7 +2142,7 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
 #pragma endregion Dsv_Creation
 
 #pragma region Rtv_Creation
-    // -- create frame resources: rtv, cmd-allocator and cbuffers for each frame
+    // -- create frame resources: rtv, cmd-allocator and upload buffers for each frame
     render_ctx->rtv_descriptor_size = render_ctx->device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE::D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
     D3D12_CPU_DESCRIPTOR_HANDLE rtv_handle_start = render_ctx->rtv_heap->GetCPUDescriptorHandleForHeapStart();
     for (UINT i = 0; i < NUM_BACKBUFFERS; ++i) {
@@ -1856,32 +2155,25 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
     }
 #pragma endregion Rtv_Creation
 
-#pragma region Create CBuffers and Dynamic Vertex Buffer (waves_vb)
-    UINT obj_cb_size = sizeof(ObjectConstants);
-    UINT mat_cb_size = sizeof(MaterialConstants);
-    UINT pass_cb_size = sizeof(PassConstants);
-    UINT vertex_size = sizeof(Vertex);
+#pragma region Create Upload Buffers and Dynamic Vertex Buffer (waves_vb)
     for (UINT i = 0; i < NUM_QUEUING_FRAMES; ++i) {
+        FrameResource * frame = &render_ctx->frame_resources[i];
         // -- create a cmd-allocator for each frame
-        res = render_ctx->device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE::D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&render_ctx->frame_resources[i].cmd_list_alloc));
-
-        // -- create cbuffers as upload_buffer
-        create_upload_buffer(render_ctx->device, (UINT64)obj_cb_size * _COUNT_RENDERITEM, &render_ctx->frame_resources[i].obj_cb_data_ptr, &render_ctx->frame_resources[i].obj_cb);
-        // Initialize cb data
-        ::memcpy(render_ctx->frame_resources[i].obj_cb_data_ptr, &render_ctx->frame_resources[i].obj_cb_data, sizeof(render_ctx->frame_resources[i].obj_cb_data));
-
-        create_upload_buffer(render_ctx->device, (UINT64)mat_cb_size * _COUNT_MATERIAL, &render_ctx->frame_resources[i].mat_cb_data_ptr, &render_ctx->frame_resources[i].mat_cb);
-        // Initialize cb data
-        ::memcpy(render_ctx->frame_resources[i].mat_cb_data_ptr, &render_ctx->frame_resources[i].mat_cb_data, sizeof(render_ctx->frame_resources[i].mat_cb_data));
-
-        create_upload_buffer(render_ctx->device, pass_cb_size * 1, &render_ctx->frame_resources[i].pass_cb_data_ptr, &render_ctx->frame_resources[i].pass_cb);
-        // Initialize cb data
-        ::memcpy(render_ctx->frame_resources[i].pass_cb_data_ptr, &render_ctx->frame_resources[i].pass_cb_data, sizeof(render_ctx->frame_resources[i].pass_cb_data));
-
-        create_upload_buffer(render_ctx->device, (UINT64)vertex_size * N_VTX, &render_ctx->frame_resources[i].waves_vb_data_ptr, &render_ctx->frame_resources[i].waves_vb);
-        // Initialize cb data
-        ::memcpy(render_ctx->frame_resources[i].waves_vb_data_ptr, &render_ctx->frame_resources[i].waves_vb_data, sizeof(render_ctx->frame_resources[i].waves_vb_data));
+        res = render_ctx->device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE::D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&frame->cmd_list_alloc));
+        for (int c = 0; c < MAX_DRAW_CHUNKS; ++c)
+            CHECK_AND_FAIL(render_ctx->device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&frame->chunk_cmd_allocs[c])));
+        CHECK_AND_FAIL(render_ctx->device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&frame->tail_cmd_alloc)));
+    }
+    // -- the upload heap the frames share, mapped for the whole run; committed resources start zeroed
+    // (sized for the demo's render items, begin_frame_uploads grows it with the live count)
+    create_upload_heap(render_ctx, _COUNT_RENDERITEM, (UINT64)sizeof(WaterVertex) * N_VTX, (UINT64)UPLOAD_RING_FRAME_SIZE * NUM_QUEUING_FRAMES);
+    // -- lists for multithreaded recording; closed, draw_main resets them with the frame's allocators
+    for (int c = 0; c < MAX_DRAW_CHUNKS; ++c) {
+        CHECK_AND_FAIL(render_ctx->device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, render_ctx->frame_resources[0].chunk_cmd_allocs[c], nullptr, IID_PPV_ARGS(&render_ctx->chunk_cmd_lists[c])));
+        render_ctx->chunk_cmd_lists[c]->Close();
     }
+    CHECK_AND_FAIL(render_ctx->device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, render_ctx->frame_resources[0].tail_cmd_alloc, nullptr, IID_PPV_ARGS(&render_ctx->tail_cmd_list)));
+    render_ctx->tail_cmd_list->Close();
 #pragma endregion
 
     // ========================================================================================================
@@ -1956,20 +2248,36 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
 
 #pragma region Shapes_And_Renderitem_Creation
     create_land_geometry(render_ctx);
-    create_water_geometry(waves->nrow, waves->ncol, waves->ntri, render_ctx);
+    create_water_geometry(water_lod, render_ctx);
+    render_ctx->n_water_patches = WaterLod_GetPatchCount(water_lod);
+    render_ctx->n_water_draws = render_ctx->n_water_patches;
+    render_ctx->water_draws = (WaterLodDraw *)::malloc(sizeof(WaterLodDraw) * render_ctx->n_water_patches);
+    render_ctx->n_water_tris = WaterLod_Select(water_lod, global_scene_ctx.eye_pos, render_ctx->water_draws);
 
     create_shape_geometry(render_ctx);
     create_materials(render_ctx->materials);
-    create_render_items(
-        &render_ctx->all_ritems,
-        &render_ctx->opaque_ritems,
-        &render_ctx->transparent_ritems,
-        &render_ctx->alphatested_ritems,
-        &render_ctx->geom[GEOM_BOX],
-        &render_ctx->geom[GEOM_WATER],
-        &render_ctx->geom[GEOM_GRID],
-        render_ctx->materials
-    );
+    for (int i = 0; i < _COUNT_MATERIAL; ++i) {
+        render_ctx->draw_materials[i].data_index = render_ctx->materials[i].mat_cbuffer_index;
+        render_ctx->draw_materials[i].srv_index = render_ctx->materials[i].diffuse_srvheap_index;
+    }
+    // Instance data is sized for _COUNT_RENDERITEM, so is the store
+    BYTE * ritems_memory = (BYTE *)::malloc(RenderItems_CalculateRequiredSize(_COUNT_RENDERITEM));
+    render_ctx->ritems = RenderItems_Init(ritems_memory, _COUNT_RENDERITEM, NUM_QUEUING_FRAMES);
+    create_render_items(render_ctx->ritems, render_ctx->ritem_handles, render_ctx->geom, render_ctx->materials);
+
+    // Culling bounds: render items refresh theirs with the instance data, the water patches don't move
+    render_ctx->culled_ritems = (uint32_t *)::malloc(sizeof(uint32_t) * render_ctx->ritems->world_bounds->capacity);
+    BYTE * draw_list_memory = (BYTE *)::malloc(DrawList_CalculateRequiredSize(_COUNT_RENDERITEM));
+    render_ctx->draw_list = DrawList_Init(draw_list_memory, _COUNT_RENDERITEM);
+
+    BYTE * water_bounds_memory = (BYTE *)::malloc(Culling_CalculateRequiredSize(render_ctx->n_water_patches));
+    render_ctx->water_patch_bounds = Culling_InitBounds(water_bounds_memory, render_ctx->n_water_patches);
+    render_ctx->culled_water_patches = (uint32_t *)::malloc(sizeof(uint32_t) * render_ctx->water_patch_bounds->capacity);
+    for (int i = 0; i < render_ctx->n_water_patches; ++i) {
+        XMFLOAT3 center, extents;
+        WaterLod_GetPatchBounds(water_lod, i, WATER_BOUNDS_HALF_HEIGHT, &center, &extents);
+        Culling_SetBounds(render_ctx->water_patch_bounds, i, center, extents, render_ctx->ritems->world[RenderItems_GetIndex(render_ctx->ritems, render_ctx->ritem_handles[RITEM_WATER])]);
+    }
 
 #pragma endregion Shapes_And_Renderitem_Creation
 
@@ -2080,6 +2388,30 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
         ImGui::Text("\n\n");
         ImGui::Separator();
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Text("Water: %d / %d active tiles", waves->n_active_tiles, waves->tile_rows * waves->tile_cols);
+        ImGui::Text("Water: %u / %u triangles", render_ctx->n_water_tris, waves->ntri);
+        ImGui::Text("Water: %d / %d patches visible", render_ctx->n_water_draws, render_ctx->n_water_patches);
+        ImGui::Text("Render items: %d / %d visible", render_ctx->n_visible_ritems, render_ctx->ritems->count);
+        uint32_t n_state_sets = 0;
+        uint32_t n_state_redundant = 0;
+        for (int i = 0; i < _COUNT_DRAW_STATE; ++i) {
+            n_state_sets += render_ctx->draw_stats.n_sets[i];
+            n_state_redundant += render_ctx->draw_stats.n_redundant[i];
+        }
+        ImGui::Text("Draws: %u (%u instances), state changes: %u (%u redundant skipped)", render_ctx->draw_stats.n_draws, render_ctx->draw_stats.n_instances, n_state_sets, n_state_redundant);
+        ImGui::Checkbox("Multithreaded recording", &render_ctx->mt_recording);
+        ImGui::Text("Draw list recorded in %d command list(s)", render_ctx->n_draw_chunks);
+        if (ImGui::Button("Capture frame"))
+            render_ctx->capture_requested = true;
+        ImGui::SameLine();
+        ImGui::Text("%s: %d commands", CAPTURE_FILE_PATH, render_ctx->capture.count);
+        UploadRing const * upload_ring = &render_ctx->upload_ring;
+        ImGui::Text(
+            "Upload heap: %.1f KB reserved (%d items), ring %.2f / %.2f KB in use, frame %.2f KB (high water %.2f KB), grown %d times",
+            upload_ring->stats.reserved / 1024.0, render_ctx->upload_instance_capacity,
+            upload_ring->used / 1024.0, (upload_ring->size - upload_ring->stats.reserved) / 1024.0,
+            upload_ring->stats.frame_bytes / 1024.0, upload_ring->stats.high_water / 1024.0, render_ctx->n_upload_heap_grows
+        );
 
         ImGui::End();
         ImGui::Render();
@@ -2088,11 +2420,24 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
         Timer_Tick(&global_timer);
         handle_keyboard_input(&global_scene_ctx, &global_timer);
         update_camera(&global_scene_ctx);
+        // water world matrix is identity so eye_pos is already in grid space
+        WaterLod_Select(water_lod, global_scene_ctx.eye_pos, render_ctx->water_draws);
 
         animate_material(&render_ctx->materials[MAT_WATER], &global_timer);
-        update_obj_cbuffers(render_ctx);
-        update_mat_cbuffers(render_ctx);
-        update_pass_cbuffers(render_ctx, &global_timer);
+        begin_frame_uploads(render_ctx);
+        // buffer uploads; when a capture is requested they go to the capture (see draw_main)
+        D3D12Recorder upload_d3d12;
+        init_frame_recorder(render_ctx, nullptr, &upload_d3d12);
+        if (render_ctx->capture_requested)
+            CmdCapture_Clear(&render_ctx->capture);
+        CmdRecorder upload_rec = render_ctx->capture_requested ? CmdCapture_GetRecorder(&render_ctx->capture) : d3d12_recorder(&upload_d3d12);
+
+        update_instance_data(render_ctx, &upload_rec, !render_ctx->capture_requested);
+        cull_scene(render_ctx, &global_scene_ctx);
+        build_draw_list(render_ctx, &global_scene_ctx);
+        update_draw_instances(render_ctx, &upload_rec);
+        update_mat_data(render_ctx, &upload_rec);
+        update_pass_cbuffers(render_ctx, &global_timer, &upload_rec);
         update_waves_vb(waves, render_ctx, &global_timer);
 
         CHECK_AND_FAIL(draw_main(render_ctx));
@@ -2100,9 +2445,9 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
 
         // End of the loop updates
         if (0 == i_curr)
-            render_ctx->alphatested_ritems.ritems[0].mat = &render_ctx->materials[MAT_WOOD_CRATE];
+            RenderItems_SetMaterial(render_ctx->ritems, render_ctx->ritem_handles[RITEM_BOX], MAT_WOOD_CRATE);
         else if (1 == i_curr)
-            render_ctx->alphatested_ritems.ritems[0].mat = &render_ctx->materials[MAT_WIRED_CRATE];
+            RenderItems_SetMaterial(render_ctx->ritems, render_ctx->ritem_handles[RITEM_BOX], MAT_WIRED_CRATE);
         global_mouse_active = !(beginwnd || sliderf || coloredit);
     }
 #pragma endregion
@@ -2121,17 +2466,13 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
     render_ctx->fence->Release();
 
     // release queuing frame resources
+    render_ctx->upload_heap->Unmap(0, nullptr);
+    render_ctx->upload_heap->Release();
     for (size_t i = 0; i < NUM_QUEUING_FRAMES; i++) {
-        render_ctx->frame_resources[i].obj_cb->Unmap(0, nullptr);
-        render_ctx->frame_resources[i].mat_cb->Unmap(0, nullptr);
-        render_ctx->frame_resources[i].pass_cb->Unmap(0, nullptr);
-        render_ctx->frame_resources[i].waves_vb->Unmap(0, nullptr);
-        render_ctx->frame_resources[i].obj_cb->Release();
-        render_ctx->frame_resources[i].mat_cb->Release();
-        render_ctx->frame_resources[i].pass_cb->Release();
-        render_ctx->frame_resources[i].waves_vb->Release();
-
         render_ctx->frame_resources[i].cmd_list_alloc->Release();
+        for (int c = 0; c < MAX_DRAW_CHUNKS; ++c)
+            render_ctx->frame_resources[i].chunk_cmd_allocs[c]->Release();
+        render_ctx->frame_resources[i].tail_cmd_alloc->Release();
     }
     for (unsigned i = 0; i < _COUNT_GEOM; i++) {
         render_ctx->geom[i].ib_uploader->Release();
@@ -2170,12 +2511,23 @@ WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In_ INT) {
 
     //render_ctx->swapchain3->Release();
     render_ctx->swapchain->Release();
+    for (int c = 0; c < MAX_DRAW_CHUNKS; ++c)
+        render_ctx->chunk_cmd_lists[c]->Release();
+    render_ctx->tail_cmd_list->Release();
     render_ctx->direct_cmd_list->Release();
     render_ctx->direct_cmd_list_alloc->Release();
     render_ctx->cmd_queue->Release();
     render_ctx->device->Release();
     dxgi_factory->Release();
 
+    ::free(render_ctx->water_draws);
+    ::free(render_ctx->culled_water_patches);
+    ::free(water_bounds_memory);
+    ::free(render_ctx->culled_ritems);
+    ::free(draw_list_memory);
+    CmdCapture_Free(&render_ctx->capture);
+    ::free(ritems_memory);
+    ::free(water_lod_memory);
     ::free(wave_memory);
 
 #if (ENABLE_DEBUG_LAYER > 0)
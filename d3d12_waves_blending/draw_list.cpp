@@ -0,0 +1,133 @@
+#include "draw_list.h"
+
+#include <string.h>
+
+#define DRAW_LIST_CACHE_LINE    64
+#define DRAW_LIST_RADIX_BITS    8
+#define DRAW_LIST_RADIX         (1 << DRAW_LIST_RADIX_BITS)
+#define DRAW_LIST_RADIX_PASSES  (64 / DRAW_LIST_RADIX_BITS)
+
+static size_t
+draw_list_align (size_t size) {
+    return (size + (DRAW_LIST_CACHE_LINE - 1)) & ~((size_t)DRAW_LIST_CACHE_LINE - 1);
+}
+size_t
+DrawList_CalculateRequiredSize (int capacity) {
+    SIMPLE_ASSERT(capacity >= 0, "Invalid draw list capacity");
+    return draw_list_align(sizeof(DrawList)) +
+        2 * draw_list_align(sizeof(uint64_t) * capacity) +
+        2 * draw_list_align(sizeof(uint32_t) * capacity);
+}
+DrawList *
+DrawList_Init (uint8_t * memory, int capacity) {
+    DrawList * ret = reinterpret_cast<DrawList *>(memory);
+    ret->count = 0;
+    ret->capacity = capacity;
+
+    size_t keys_size = draw_list_align(sizeof(uint64_t) * capacity);
+    size_t items_size = draw_list_align(sizeof(uint32_t) * capacity);
+    uint8_t * arrays = memory + draw_list_align(sizeof(DrawList));
+    ret->keys = reinterpret_cast<uint64_t *>(arrays);
+    ret->scratch_keys = reinterpret_cast<uint64_t *>(arrays + keys_size);
+    ret->items = reinterpret_cast<uint32_t *>(arrays + 2 * keys_size);
+    ret->scratch_items = reinterpret_cast<uint32_t *>(arrays + 2 * keys_size + items_size);
+    return ret;
+}
+void
+DrawList_Clear (DrawList * list) {
+    list->count = 0;
+}
+void
+DrawList_Push (DrawList * list, uint64_t key, uint32_t item) {
+    SIMPLE_ASSERT(list->count < list->capacity, "draw list is full");
+    list->keys[list->count] = key;
+    list->items[list->count] = item;
+    ++list->count;
+}
+void
+DrawList_Sort (DrawList * list) {
+    int n = list->count;
+    if (n < 2)
+        return;
+
+    // all the histograms in one read of the keys
+    static_assert(DRAW_LIST_RADIX_PASSES * DRAW_LIST_RADIX * sizeof(uint32_t) <= 8192, "histograms live on the stack");
+    uint32_t hist[DRAW_LIST_RADIX_PASSES][DRAW_LIST_RADIX] = {};
+    for (int i = 0; i < n; ++i) {
+        uint64_t k = list->keys[i];
+        for (int p = 0; p < DRAW_LIST_RADIX_PASSES; ++p)
+            ++hist[p][(k >> (p * DRAW_LIST_RADIX_BITS)) & (DRAW_LIST_RADIX - 1)];
+    }
+
+    uint64_t * src_keys = list->keys;
+    uint32_t * src_items = list->items;
+    uint64_t * dst_keys = list->scratch_keys;
+    uint32_t * dst_items = list->scratch_items;
+    for (int p = 0; p < DRAW_LIST_RADIX_PASSES; ++p) {
+        int shift = p * DRAW_LIST_RADIX_BITS;
+        uint32_t * h = hist[p];
+        if (h[(src_keys[0] >> shift) & (DRAW_LIST_RADIX - 1)] == (uint32_t)n)
+            continue;   // same digit everywhere, the pass wouldn't move anything
+
+        uint32_t offset = 0;
+        for (int d = 0; d < DRAW_LIST_RADIX; ++d) {
+            uint32_t c = h[d];
+            h[d] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint32_t dst = h[(src_keys[i] >> shift) & (DRAW_LIST_RADIX - 1)]++;
+            dst_keys[dst] = src_keys[i];
+            dst_items[dst] = src_items[i];
+        }
+        uint64_t * tk = src_keys; src_keys = dst_keys; dst_keys = tk;
+        uint32_t * ti = src_items; src_items = dst_items; dst_items = ti;
+    }
+    if (src_keys != list->keys) {
+        memcpy(list->keys, src_keys, sizeof(uint64_t) * n);
+        memcpy(list->items, src_items, sizeof(uint32_t) * n);
+    }
+}
+
+// Float bits of a non-negative float sort like the float; anything behind the eye counts as 0.
+static uint64_t
+draw_list_depth_bits (float depth) {
+    float d = (depth > 0.0f) ? depth : 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+static uint64_t
+draw_list_state_bits (uint32_t pso, uint32_t geom, uint32_t material) {
+    return ((uint64_t)(pso & ((1u << DRAW_LIST_PSO_BITS) - 1)) << (DRAW_LIST_GEOM_BITS + DRAW_LIST_MATERIAL_BITS)) |
+        ((uint64_t)(geom & ((1u << DRAW_LIST_GEOM_BITS) - 1)) << DRAW_LIST_MATERIAL_BITS) |
+        (uint64_t)(material & ((1u << DRAW_LIST_MATERIAL_BITS) - 1));
+}
+uint64_t
+DrawList_OpaqueKey (uint32_t pass, uint32_t pso, uint32_t geom, uint32_t material, float depth) {
+    return ((uint64_t)(pass & ((1u << DRAW_LIST_PASS_BITS) - 1)) << 60) |
+        (draw_list_state_bits(pso, geom, material) << 32) |
+        draw_list_depth_bits(depth);
+}
+uint64_t
+DrawList_TransparentKey (uint32_t pass, uint32_t pso, uint32_t geom, uint32_t material, float depth) {
+    return ((uint64_t)(pass & ((1u << DRAW_LIST_PASS_BITS) - 1)) << 60) |
+        ((~draw_list_depth_bits(depth) & 0xffffffffull) << 28) |
+        draw_list_state_bits(pso, geom, material);
+}
+
+void
+DrawStats_Add (DrawStats * dst, DrawStats const * src) {
+    dst->n_draws += src->n_draws;
+    dst->n_instances += src->n_instances;
+    for (int i = 0; i < _COUNT_DRAW_STATE; ++i) {
+        dst->n_sets[i] += src->n_sets[i];
+        dst->n_redundant[i] += src->n_redundant[i];
+    }
+}
+void
+DrawStateCache_Reset (DrawStateCache * cache, DrawStats * stats) {
+    for (int i = 0; i < _COUNT_DRAW_STATE; ++i)
+        cache->bound[i] = DRAW_STATE_UNKNOWN;
+    cache->stats = stats;
+}
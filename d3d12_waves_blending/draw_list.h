@@ -0,0 +1,88 @@
+#pragma once
+#include "headers/common.h"
+
+// Sorted draw submission.
+// Every visible item gets a 64-bit key and the keys are radix sorted, so items come out grouped by
+// the state they need and consecutive draws can skip the state they share (see DrawStateCache).
+//
+//  opaque:         | pass:4 | pso:6 | geom:10 | material:12 | depth:32 |     (front to back per state)
+//  transparent:    | pass:4 | ~depth:32 | pso:6 | geom:10 | material:12 |   (back to front first)
+//
+// pass orders the passes (opaque, alpha tested, transparent ...), depth is the view-space z as
+// float bits (monotonic for z >= 0, so it sorts as an integer).
+
+#define DRAW_LIST_PASS_BITS         4
+#define DRAW_LIST_PSO_BITS          6
+#define DRAW_LIST_GEOM_BITS         10
+#define DRAW_LIST_MATERIAL_BITS     12
+
+struct DrawList {
+    int count;
+    int capacity;
+    uint64_t * keys;
+    uint32_t * items;           // item index carried along with each key
+    uint64_t * scratch_keys;    // radix sort ping-pong buffers
+    uint32_t * scratch_items;
+};
+
+size_t
+DrawList_CalculateRequiredSize (int capacity);
+DrawList *
+DrawList_Init (uint8_t * memory, int capacity);
+void
+DrawList_Clear (DrawList * list);
+void
+DrawList_Push (DrawList * list, uint64_t key, uint32_t item);
+// Stable LSD radix sort on the keys, 8 bits per pass. Passes where every key has the same digit
+// (e.g. the pass/pso bits of a one-pso scene) are skipped.
+void
+DrawList_Sort (DrawList * list);
+
+uint64_t
+DrawList_OpaqueKey (uint32_t pass, uint32_t pso, uint32_t geom, uint32_t material, float depth);
+uint64_t
+DrawList_TransparentKey (uint32_t pass, uint32_t pso, uint32_t geom, uint32_t material, float depth);
+
+// -- redundant state filtering
+
+enum DRAW_STATE : int {
+    DRAW_STATE_PSO = 0,
+    DRAW_STATE_GEOMETRY = 1,        // vertex + index buffer
+    DRAW_STATE_TOPOLOGY = 2,
+    DRAW_STATE_TEXTURE = 3,
+    DRAW_STATE_INSTANCE_BASE = 4,   // first instance slot of the draw
+    DRAW_STATE_MATERIAL = 5,
+
+    _COUNT_DRAW_STATE
+};
+struct DrawStats {
+    uint32_t n_draws;
+    uint32_t n_instances;                       // over the draws
+    uint32_t n_sets[_COUNT_DRAW_STATE];         // state changes issued
+    uint32_t n_redundant[_COUNT_DRAW_STATE];    // state changes skipped, the value was already bound
+};
+// Sums src into dst (e.g. per-thread stats into the frame's)
+void
+DrawStats_Add (DrawStats * dst, DrawStats const * src);
+
+// Last value bound per state, DRAW_STATE_UNKNOWN until the first set
+#define DRAW_STATE_UNKNOWN  0xffffffffu
+struct DrawStateCache {
+    uint32_t bound[_COUNT_DRAW_STATE];
+    DrawStats * stats;
+};
+
+// Forgets what is bound (e.g. for a new command list); changes keep being counted into stats.
+void
+DrawStateCache_Reset (DrawStateCache * cache, DrawStats * stats);
+// Returns true (and remembers value) if state has to be set, counts a redundant change otherwise.
+inline bool
+DrawStateCache_Set (DrawStateCache * cache, DRAW_STATE state, uint32_t value) {
+    if (cache->bound[state] == value) {
+        ++cache->stats->n_redundant[state];
+        return false;
+    }
+    cache->bound[state] = value;
+    ++cache->stats->n_sets[state];
+    return true;
+}
@@ -0,0 +1,201 @@
+#include "draw_recording.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DRAW_X86_SIMD       1
+#include <immintrin.h>
+#else
+#define DRAW_X86_SIMD       0
+#endif
+
+using namespace DirectX;
+
+// root parameters, see create_root_signature
+#define DRAW_ROOT_TEXTURE           0
+#define DRAW_ROOT_DRAW_CONSTANTS    1
+// 32-bit values of DRAW_ROOT_DRAW_CONSTANTS
+#define DRAW_CONSTANT_INSTANCE_BASE 0
+#define DRAW_CONSTANT_MATERIAL      1
+
+// Fewer dirty bitset words (of 64 items) than this per chunk aren't worth another thread
+#define DRAW_UPLOAD_MIN_WORDS_PER_CHUNK     16
+
+static void
+draw_bind_item (
+    CmdRecorder * rec, DrawBindings const * bindings,
+    RenderItems const * ritems, DrawMaterial const materials [],
+    uint32_t i, uint32_t slot, uint32_t pso,
+    DrawStateCache * state
+) {
+    RenderItemDrawArgs const * args = &ritems->draw_args[i];
+    DrawMaterial const * mat = &materials[ritems->material[i]];
+
+    if (DrawStateCache_Set(state, DRAW_STATE_PSO, pso))
+        CmdRecorder_SetPipelineState(rec, pso);
+    if (DrawStateCache_Set(state, DRAW_STATE_GEOMETRY, args->geom))
+        CmdRecorder_SetGeometry(rec, args->geom);
+    if (DrawStateCache_Set(state, DRAW_STATE_TOPOLOGY, args->topology))
+        CmdRecorder_SetTopology(rec, args->topology);
+    if (DrawStateCache_Set(state, DRAW_STATE_TEXTURE, mat->srv_index))
+        CmdRecorder_SetRootTable(rec, DRAW_ROOT_TEXTURE, bindings->srv_heap + bindings->descriptor_size * mat->srv_index);
+    if (DrawStateCache_Set(state, DRAW_STATE_INSTANCE_BASE, slot))
+        CmdRecorder_SetRootConstant(rec, DRAW_ROOT_DRAW_CONSTANTS, DRAW_CONSTANT_INSTANCE_BASE, slot);
+    if (DrawStateCache_Set(state, DRAW_STATE_MATERIAL, mat->data_index))
+        CmdRecorder_SetRootConstant(rec, DRAW_ROOT_DRAW_CONSTANTS, DRAW_CONSTANT_MATERIAL, mat->data_index);
+}
+// Whether items a and b can be instances of the same draw
+static bool
+draw_same_batch (RenderItems const * ritems, uint32_t a, uint32_t b) {
+    RenderItemDrawArgs const * args_a = &ritems->draw_args[a];
+    RenderItemDrawArgs const * args_b = &ritems->draw_args[b];
+    return
+        ritems->layer[a] == ritems->layer[b] && ritems->material[a] == ritems->material[b] &&
+        args_a->geom == args_b->geom && args_a->topology == args_b->topology &&
+        args_a->index_count == args_b->index_count && args_a->start_index == args_b->start_index &&
+        args_a->base_vertex == args_b->base_vertex;
+}
+void
+DrawRecording_UploadDrawInstances (
+    CmdRecorder * rec, uint32_t buffer,
+    DrawList const * draw_list, uint32_t const extra_items [], int n_extra
+) {
+    int count = draw_list->count;
+    if (0 == count + n_extra)
+        return;
+    uint8_t * dst = CmdRecorder_Upload(rec, buffer, 0, (uint32_t)(sizeof(uint32_t) * (count + n_extra)));
+    memcpy(dst, draw_list->items, sizeof(uint32_t) * count);
+    if (n_extra > 0)
+        memcpy(dst + sizeof(uint32_t) * count, extra_items, sizeof(uint32_t) * n_extra);
+}
+void
+DrawRecording_DrawItems (
+    CmdRecorder * rec, DrawBindings const * bindings,
+    RenderItems const * ritems, DrawMaterial const materials [],
+    DrawList const * draw_list, int begin, int end,
+    DrawStateCache * state
+) {
+    // a list entry's draw instance slot is its position in the list
+    for (int d = begin; d < end;) {
+        uint32_t i = draw_list->items[d];
+        int n_instances = 1;
+        while (d + n_instances < end && draw_same_batch(ritems, i, draw_list->items[d + n_instances]))
+            ++n_instances;
+        RenderItemDrawArgs const * args = &ritems->draw_args[i];
+        draw_bind_item(rec, bindings, ritems, materials, i, (uint32_t)d, ritems->layer[i], state);
+        CmdRecorder_DrawIndexed(rec, args->index_count, (uint32_t)n_instances, args->start_index, args->base_vertex, 0);
+        ++state->stats->n_draws;
+        state->stats->n_instances += (uint32_t)n_instances;
+        d += n_instances;
+    }
+}
+void
+DrawRecording_DrawPatches (
+    CmdRecorder * rec, DrawBindings const * bindings,
+    RenderItems const * ritems, DrawMaterial const materials [],
+    uint32_t item, uint32_t slot, uint32_t pso,
+    WaterLodDraw const draws [], int n_draws,
+    DrawStateCache * state
+) {
+    if (0 == n_draws)
+        return;
+    draw_bind_item(rec, bindings, ritems, materials, item, slot, pso, state);
+    for (int i = 0; i < n_draws; ++i)
+        CmdRecorder_DrawIndexed(rec, draws[i].index_count, 1, draws[i].start_index, draws[i].base_vertex, 0);
+    state->stats->n_draws += n_draws;
+    state->stats->n_instances += n_draws;
+}
+// Writes m transposed (the shaders read column major) to 16-byte aligned dst, bypassing the
+// cache on x86: dst is write-combined upload memory that isn't read back.
+static void
+draw_stream_transposed (float * dst, XMFLOAT4X4 const * m) {
+#if DRAW_X86_SIMD
+    __m128 r0 = _mm_loadu_ps(&m->m[0][0]);
+    __m128 r1 = _mm_loadu_ps(&m->m[1][0]);
+    __m128 r2 = _mm_loadu_ps(&m->m[2][0]);
+    __m128 r3 = _mm_loadu_ps(&m->m[3][0]);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_stream_ps(dst + 0, r0);
+    _mm_stream_ps(dst + 4, r1);
+    _mm_stream_ps(dst + 8, r2);
+    _mm_stream_ps(dst + 12, r3);
+#else
+    for (int r = 0; r < 4; ++r)
+        for (int c = 0; c < 4; ++c)
+            dst[4 * r + c] = m->m[c][r];
+#endif
+}
+struct DrawUploadJob {
+    RenderItems * ritems;
+    uint32_t buffer;
+    uint32_t stride;
+    int frame;
+    int n_written[CMD_RECORDER_MAX_CHUNKS];
+};
+// Uploads items [begin, end) in one go
+static void
+draw_upload_run (DrawUploadJob const * job, CmdRecorder * rec, int begin, int end) {
+    RenderItems * ritems = job->ritems;
+    uint32_t stride = job->stride;
+    uint8_t * dst = CmdRecorder_Upload(rec, job->buffer, (uint64_t)begin * stride, (uint32_t)(end - begin) * stride);
+    SIMPLE_ASSERT(0 == ((uintptr_t)dst & 15), "instance data must be 16-byte aligned");
+    for (int i = begin; i < end; ++i, dst += stride) {
+        draw_stream_transposed(reinterpret_cast<float *>(dst), &ritems->world[i]);
+        draw_stream_transposed(reinterpret_cast<float *>(dst + sizeof(XMFLOAT4X4)), &ritems->tex_transform[i]);
+        Culling_SetBounds(ritems->world_bounds, i, ritems->local_bounds[i].center, ritems->local_bounds[i].extents, ritems->world[i]);
+    }
+}
+// Dirty bitset words [begin, end) of the frame; consecutive dirty items go out as one upload.
+static void
+draw_upload_chunk (void * ctx, int chunk, CmdRecorder * rec, int begin, int end) {
+    DrawUploadJob * job = reinterpret_cast<DrawUploadJob *>(ctx);
+    uint64_t * dirty = job->ritems->dirty[job->frame];
+    int n_written = 0;
+    int run_begin = 0;
+    int run_end = 0;
+    for (int w = begin; w < end; ++w) {
+        uint64_t bits = dirty[w];
+        if (0 == bits)
+            continue;
+        dirty[w] = 0;
+        for (int b = 0; b < 64; ++b) {
+            if (0 == (bits & (1ull << b)))
+                continue;
+            int i = 64 * w + b;
+            if (i != run_end) {
+                if (run_end > run_begin)
+                    draw_upload_run(job, rec, run_begin, run_end);
+                run_begin = i;
+            }
+            run_end = i + 1;
+            ++n_written;
+        }
+    }
+    if (run_end > run_begin)
+        draw_upload_run(job, rec, run_begin, run_end);
+#if DRAW_X86_SIMD
+    // streaming stores are weakly ordered, make them visible before the frame is submitted
+    _mm_sfence();
+#endif
+    job->n_written[chunk] = n_written;
+}
+int
+DrawRecording_UploadObjects (
+    Scheduler * sched, CmdRecorder recorders [], int n_recorders,
+    uint32_t buffer, uint32_t stride,
+    RenderItems * ritems, int frame
+) {
+    SIMPLE_ASSERT(stride >= 2 * sizeof(XMFLOAT4X4) && 0 == (stride & 15), "instance data stride too small or unaligned");
+    SIMPLE_ASSERT(frame >= 0 && frame < ritems->n_frames, "Invalid frame");
+    // bits past count are clear, so only the words covering count need scanning
+    int n_words = (ritems->count + 63) / 64;
+    int max_chunks = (n_recorders < CMD_RECORDER_MAX_CHUNKS) ? n_recorders : CMD_RECORDER_MAX_CHUNKS;
+    int n_chunks = CmdRecorder_ChunkCount(n_words, max_chunks, DRAW_UPLOAD_MIN_WORDS_PER_CHUNK);
+
+    DrawUploadJob job = {ritems, buffer, stride, frame, {}};
+    CmdRecorder_RecordChunks(sched, n_words, n_chunks, recorders, &job, draw_upload_chunk);
+    int n_written = 0;
+    for (int c = 0; c < n_chunks; ++c)
+        n_written += job.n_written[c];
+    return n_written;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "headers/common.h"
+#include "cmd_recorder.h"
+#include "draw_list.h"
+#include "render_items.h"
+#include "water_lod.h"
+
+// The per-frame recording the app does through a CmdRecorder: instance data uploads and the
+// draws of the sorted draw list / the water patches.
+// Kept apart from the app so render_bench runs the same code against CmdNull/CmdCapture.
+//
+// Per-object data lives in structured buffers the app binds once per frame instead of a cbuffer
+// per draw: instance data (world + tex_transform, tightly packed) per dense render item index,
+// and the draw instance slots, the dense index of every draw list entry in draw order (see
+// DrawRecording_UploadDrawInstances). A draw only sets two root constants, its first slot and its
+// material; the vertex shader finds its instance at slots[first slot + SV_InstanceID], so list
+// entries that share a submesh and material go out as one instanced draw.
+
+// GPU addresses the draws bind from, for the frame being recorded
+struct DrawBindings {
+    uint64_t srv_heap;              // first descriptor of the srv heap
+    uint64_t descriptor_size;
+};
+// What a draw binds for its material
+struct DrawMaterial {
+    uint32_t data_index;            // into the material structured buffer
+    uint32_t srv_index;             // diffuse texture in the srv heap
+};
+
+// Writes the dense index of draw list entries [0, count), then of extra_items (drawn outside the
+// list, e.g. the water), to buffer as uint32s. Entry d's slot is d, extra_items[k]'s is count + k.
+void
+DrawRecording_UploadDrawInstances (
+    CmdRecorder * rec, uint32_t buffer,
+    DrawList const * draw_list, uint32_t const extra_items [], int n_extra
+);
+// Draws entries [begin, end) of the sorted list with each item's layer as pso, only setting the
+// state that differs from the previous draw. Consecutive entries with the same pso, material and
+// submesh are drawn as one instanced draw.
+void
+DrawRecording_DrawItems (
+    CmdRecorder * rec, DrawBindings const * bindings,
+    RenderItems const * ritems, DrawMaterial const materials [],
+    DrawList const * draw_list, int begin, int end,
+    DrawStateCache * state
+);
+// Binds item (at draw instance slot) with pso, then issues one draw per patch.
+void
+DrawRecording_DrawPatches (
+    CmdRecorder * rec, DrawBindings const * bindings,
+    RenderItems const * ritems, DrawMaterial const materials [],
+    uint32_t item, uint32_t slot, uint32_t pso,
+    WaterLodDraw const draws [], int n_draws,
+    DrawStateCache * state
+);
+// Uploads world and tex_transform (transposed, as the shaders read them) of the items whose
+// instance data for frame is out of date into buffer, stride apart per dense index, clears
+// their dirty bits for frame and refreshes their world bounds. Returns # of items written.
+// Only the 128 bytes of the two matrices are written per item (streaming stores on x86), the rest
+// of the stride is left as it is. Consecutive dirty items go out as one CmdRecorder_Upload.
+// The dirty bitset is split into at most n_recorders chunks, recorded on sched's threads into
+// recorders[chunk] (see CmdRecorder_RecordChunks); one recorder keeps it on the calling thread.
+int
+DrawRecording_UploadObjects (
+    Scheduler * sched, CmdRecorder recorders [], int n_recorders,
+    uint32_t buffer, uint32_t stride,
+    RenderItems * ritems, int frame
+);
@@ -8,6 +8,9 @@
    =========================================================== */
 #pragma once
 
+// NOTE(omid): The simulation code (waves, scheduler) only needs the portable part of this header,
+// so it also builds on non-windows hosts.
+#if defined(_WIN32)
 #include <windows.h>
 #include <d3d12.h>
 #include <d3dcommon.h>
@@ -17,7 +20,10 @@
 
 #include <DirectXColors.h>
 #include <DirectXCollision.h>
+#endif
 
+#include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
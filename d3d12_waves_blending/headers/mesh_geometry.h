@@ -21,8 +21,8 @@ struct SubmeshGeometry {
     UINT start_index_location;
     INT base_vertex_location;
 
-    // Bounding box of the geometry defined by this submesh. 
-    // Not used for now
+    // Local space bounding box of the geometry defined by this submesh.
+    // Filled by the create_*_geometry functions, render items cull with it.
     DirectX::BoundingBox bounds;
 };
 struct MeshGeometry {
@@ -40,6 +40,7 @@ struct MeshGeometry {
 
     ID3D12Resource * vb_gpu;
     ID3D12Resource * ib_gpu;
+    UINT64 vb_offset;           // of the vertices in vb_gpu (dynamic vbs share an upload heap)
 
     ID3D12Resource * vb_uploader;
     ID3D12Resource * ib_uploader;
@@ -56,7 +57,7 @@ struct MeshGeometry {
 D3D12_VERTEX_BUFFER_VIEW
 Mesh_GetVertexBufferView (MeshGeometry * mesh) {
     D3D12_VERTEX_BUFFER_VIEW vbv;
-    vbv.BufferLocation = mesh->vb_gpu->GetGPUVirtualAddress();
+    vbv.BufferLocation = mesh->vb_gpu->GetGPUVirtualAddress() + mesh->vb_offset;
     vbv.StrideInBytes = mesh->vb_byte_stide;
     vbv.SizeInBytes = mesh->vb_byte_size;
 
@@ -10,6 +10,7 @@
 
 #include "common.h"
 #include "mesh_geometry.h"
+#include "../upload_ring.h"
 
 #define ARRAY_COUNT(arr)                sizeof(arr)/sizeof(arr[0])
 #define CLAMP_VALUE(val, lb, ub)        ((val) < (lb)) ? (lb) : ((val) > (ub) ? (ub) : (val))
@@ -27,13 +28,12 @@ struct Light {
 
 #define MAX_LIGHTS  16
 
-// -- per object constants
-struct ObjectConstants {
+// -- per object data, one per render item in a structured buffer
+struct InstanceData {
     XMFLOAT4X4 world;
     XMFLOAT4X4 tex_transform;
-    float padding[32];  // Padding so the constant buffer is 256-byte aligned
 };
-static_assert(256 == sizeof(ObjectConstants), "Constant buffer size must be 256b aligned");
+static_assert(128 == sizeof(InstanceData), "Must match the shader's InstanceData stride");
 // -- per pass constants
 struct PassConstants {
     XMFLOAT4X4 view;
@@ -80,25 +80,23 @@ struct GeomVertex {
     XMFLOAT2 TexC;
 };
 
-// -- relevant material data in cbuffer
-struct MaterialConstants {
+// -- relevant material data in a structured buffer
+struct MaterialData {
     XMFLOAT4    diffuse_albedo;
     XMFLOAT3    fresnel_r0;
     float       roughness;
 
     // used in texture mapping
     XMFLOAT4X4  mat_transform;
-
-    float padding[40];  // Padding so the constant buffer is 256-byte aligned
 };
-static_assert(256 == sizeof(MaterialConstants), "Constant buffer size must be 256b aligned");
+static_assert(96 == sizeof(MaterialData), "Must match the shader's MaterialData stride");
 
 // NOTE(omid): A production 3D engine would likely create a hierarchy of Materials.
 // -- simple struct to represent a material. 
 struct Material {
     char name[50];
 
-    // Index into constant buffer corresponding to this material.
+    // Index into the material structured buffer corresponding to this material.
     int mat_cbuffer_index;
 
     // Index into SRV heap for diffuse texture.
@@ -128,67 +126,35 @@ struct Texture {
     ID3D12Resource * upload_heap;
 };
 
+// Most command lists the draw list is split into when recording on several threads
+#define MAX_DRAW_CHUNKS     8
+
 // FrameResource stores the resources needed for the CPU to build the command lists for a frame.
 struct FrameResource {
     // We cannot reset the allocator until the GPU is done processing the commands.
     // So each frame needs their own allocator.
     ID3D12CommandAllocator * cmd_list_alloc;
+    // Multithreaded recording: every draw chunk records on its own thread with its own allocator,
+    // the frame's tail (water, imgui, present barrier) gets one too.
+    ID3D12CommandAllocator * chunk_cmd_allocs[MAX_DRAW_CHUNKS];
+    ID3D12CommandAllocator * tail_cmd_alloc;
 
     // We cannot update a cbuffer until the GPU is done processing the commands
     // that reference it.  So each frame needs their own cbuffers.
-    ID3D12Resource * pass_cb;
-    PassConstants pass_cb_data;
-    uint8_t * pass_cb_data_ptr;
-
-    ID3D12Resource * mat_cb;
-    MaterialConstants mat_cb_data;
-    uint8_t * mat_cb_data_ptr;
-
-    ID3D12Resource * obj_cb;
-    ObjectConstants obj_cb_data;
-    uint8_t * obj_cb_data_ptr;
-
-    // We cannot update a dynamic vertex buffer until the GPU is done processing
-    // the commands that reference it.  So each frame needs their own.
-    ID3D12Resource * waves_vb;
-    Vertex waves_vb_data;
-    uint8_t * waves_vb_data_ptr;
+    // They all live in the upload heap the frames share (see upload_ring.h): the instance/material
+    // structured buffers and the waves vb are reserved for each frame, the pass cbuffer and the
+    // draw instance slots are allocated from the ring every frame.
+    UploadAllocation instances;
+    UploadAllocation mat_data;
+    UploadAllocation waves_vb;
+    UploadAllocation pass_cb;
+    UploadAllocation draw_instances;
+    uint32_t waves_vb_version;  // Waves version this frame's vb was last exported at
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 fence;
 };
-struct RenderItem {
-    bool initialized;
-
-    // World matrix of the shape that describes the object's local space
-    // relative to the world space, which defines the position, orientation,
-    // and scale of the object in the world.
-    XMFLOAT4X4 world;
-
-    XMFLOAT4X4 tex_transform;
-
-    // Dirty flag indicating the object data has changed and we need to update the constant buffer.
-    // Because we have an object cbuffer for each FrameResource, we have to apply the
-    // update to each FrameResource.  Thus, when we modify obect data we should set 
-    // n_frames_dirty = NUM_QUEUING_FRAMES so that each frame resource gets the update.
-    int n_frames_dirty;
-
-    // Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-    UINT obj_cbuffer_index;
-
-    // TODO(omid): add mesh/geometry data 
-
-    D3D12_PRIMITIVE_TOPOLOGY primitive_type;
-
-    // DrawIndexedInstanced parameters.
-    UINT index_count;
-    UINT start_index_loc;
-    int base_vertex_loc;
-
-    Material * mat;
-    MeshGeometry * geometry;
-};
 
 static XMFLOAT4X4
 Identity4x4() {
@@ -842,8 +808,91 @@ create_cylinder (float bottom_radius, float top_radius, float height, GeomVertex
 #pragma endregion build cylinder bottom
 
 }
+// -- vertex cache friendly grid indices
+
+// Post-transform cache entries assumed by GRID_INDEX_ORDER_CACHE_STRIPS
+#define GRID_DEFAULT_VCACHE_SIZE    16
+
+enum GRID_INDEX_ORDER : int {
+    // quads row by row over the whole width (a row of vertices is long gone from the cache
+    // when the next row needs it, so every vertex is transformed ~twice)
+    GRID_INDEX_ORDER_ROW_MAJOR = 0,
+    // quads row by row inside vertical strips narrow enough that two rows of strip vertices
+    // fit in the cache, so each vertex is transformed ~once (plus the strip seams)
+    GRID_INDEX_ORDER_CACHE_STRIPS = 1,
+
+    _COUNT_GRID_INDEX_ORDER
+};
+
+// Same triangles (and winding) for every order, only the sequence changes:
+// 6 * (m - 1) * (n - 1) indices.
+template <typename T>
 static void
-create_grid (float width, float depth, UINT32 m, UINT32 n, GeomVertex out_vtx [], uint16_t out_idx []) {
+create_grid_indices (UINT32 m, UINT32 n, GRID_INDEX_ORDER order, UINT32 cache_size, T out_idx []) {
+    // Strip of w quads has w + 1 vertices per row. The strip's first quad row loads both of its
+    // vertex rows interleaved, so the lower row's first vertex is next used 2 * w insertions
+    // later; 2 * w < cache_size keeps it, and every row after it, cached (FIFO).
+    UINT32 strip = n - 1;
+    if (GRID_INDEX_ORDER_CACHE_STRIPS == order)
+        strip = (cache_size >= 3) ? (cache_size - 1) / 2 : 1;
+
+    UINT32 k = 0;
+    for (UINT32 j0 = 0; j0 < n - 1; j0 += strip) {
+        UINT32 j1 = (j0 + strip < n - 1) ? j0 + strip : n - 1;
+        for (UINT32 i = 0; i < m - 1; ++i) {
+            for (UINT32 j = j0; j < j1; ++j) {
+                out_idx[k] = (T)(i * n + j);
+                out_idx[k + 1] = (T)(i * n + j + 1);
+                out_idx[k + 2] = (T)((i + 1) * n + j);
+
+                out_idx[k + 3] = (T)((i + 1) * n + j);
+                out_idx[k + 4] = (T)(i * n + j + 1);
+                out_idx[k + 5] = (T)((i + 1) * n + j + 1);
+
+                k += 6; // next quad
+            }
+        }
+    }
+}
+
+// Post-transform vertex cache simulation (FIFO of cache_size entries, the usual model for
+// comparing index orders offline; real hardware differs in details but ranks them the same).
+//  ACMR: average cache miss ratio = transformed vertices per triangle (3 = no reuse, ~0.5 ideal grid)
+//  ATVR: average transformed vertex ratio = transformed / referenced vertices (1 = ideal)
+struct VertexCacheStats {
+    UINT32 n_tris;
+    UINT32 n_referenced;
+    UINT32 n_transformed;
+    float acmr;
+    float atvr;
+};
+template <typename T>
+static VertexCacheStats
+simulate_vertex_cache (T const indices [], UINT32 n_idx, UINT32 n_vtx, UINT32 cache_size) {
+    // # of the insertion that last brought the vertex in (1-based), 0 = never referenced;
+    // the vertex is cached while fewer than cache_size insertions happened after it
+    UINT32 * inserted = (UINT32 *)::calloc(n_vtx, sizeof(UINT32));
+    VertexCacheStats ret = {};
+    ret.n_tris = n_idx / 3;
+
+    UINT32 n_insertions = 0;
+    for (UINT32 k = 0; k < n_idx; ++k) {
+        UINT32 v = (UINT32)indices[k];
+        SIMPLE_ASSERT(v < n_vtx, "index out of range");
+        if (0 == inserted[v])
+            ++ret.n_referenced;
+        if (0 == inserted[v] || n_insertions - inserted[v] >= cache_size) {
+            inserted[v] = ++n_insertions;
+            ++ret.n_transformed;
+        }
+    }
+    ret.acmr = (ret.n_tris > 0) ? (float)ret.n_transformed / ret.n_tris : 0.0f;
+    ret.atvr = (ret.n_referenced > 0) ? (float)ret.n_transformed / ret.n_referenced : 0.0f;
+    ::free(inserted);
+    return ret;
+}
+static void
+create_grid (float width, float depth, UINT32 m, UINT32 n, GRID_INDEX_ORDER order, UINT32 cache_size, GeomVertex out_vtx [], uint16_t out_idx []) {
 
     // -- Create the vertices.
 
@@ -872,21 +921,5 @@ create_grid (float width, float depth, UINT32 m, UINT32 n, GeomVertex out_vtx []
     }
 
     // -- Create the indices.
-
-    // Iterate over each quad and compute indices.
-    UINT32 k = 0;
-    UINT16 nn = (UINT16)n; // cast to avoid compiler warnings
-    for (UINT16 i = 0; i < m - 1; ++i) {
-        for (UINT16 j = 0; j < n - 1; ++j) {
-            out_idx[k] = i * nn + j;
-            out_idx[k + 1] = i * nn + j + 1;
-            out_idx[k + 2] = (i + 1) * nn + j;
-
-            out_idx[k + 3] = (i + 1) * nn + j;
-            out_idx[k + 4] = i * nn + j + 1;
-            out_idx[k + 5] = (i + 1) * nn + j + 1;
-
-            k += 6; // next quad
-        }
-    }
+    create_grid_indices(m, n, order, cache_size, out_idx);
 }
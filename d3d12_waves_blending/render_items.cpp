@@ -0,0 +1,181 @@
+#include "render_items.h"
+
+#include <string.h>
+
+#define RENDER_ITEMS_CACHE_LINE     64
+
+using namespace DirectX;
+
+static size_t
+render_items_align (size_t size) {
+    return (size + (RENDER_ITEMS_CACHE_LINE - 1)) & ~((size_t)RENDER_ITEMS_CACHE_LINE - 1);
+}
+static int
+render_items_dirty_words (int capacity) {
+    return (capacity + 63) / 64;
+}
+size_t
+RenderItems_CalculateRequiredSize (int capacity) {
+    SIMPLE_ASSERT(capacity > 0 && capacity <= RENDER_ITEMS_MAX_CAPACITY, "Invalid render item capacity");
+    return render_items_align(sizeof(RenderItems)) +
+        2 * render_items_align(sizeof(XMFLOAT4X4) * capacity) +
+        RENDER_ITEMS_MAX_FRAMES * render_items_align(sizeof(uint64_t) * render_items_dirty_words(capacity)) +
+        render_items_align(sizeof(RenderItemDrawArgs) * capacity) +
+        render_items_align(sizeof(RenderItemBounds) * capacity) +
+        render_items_align(sizeof(uint32_t) * capacity) +
+        render_items_align(sizeof(uint8_t) * capacity) +
+        render_items_align(sizeof(RenderItemHandle) * capacity) +
+        render_items_align(Culling_CalculateRequiredSize(capacity)) +
+        render_items_align(sizeof(uint32_t) * capacity) +
+        render_items_align(sizeof(uint8_t) * capacity);
+}
+RenderItems *
+RenderItems_Init (uint8_t * memory, int capacity, int n_frames) {
+    SIMPLE_ASSERT(n_frames > 0 && n_frames <= RENDER_ITEMS_MAX_FRAMES, "Invalid queued frame count");
+    RenderItems * ret = reinterpret_cast<RenderItems *>(memory);
+    ret->count = 0;
+    ret->capacity = capacity;
+    ret->n_frames = n_frames;
+    ret->n_dirty_words = render_items_dirty_words(capacity);
+
+    // Setup pointers (arrays), each one starts on its own cache line
+    uint8_t * p = memory + render_items_align(sizeof(RenderItems));
+    ret->world = reinterpret_cast<XMFLOAT4X4 *>(p);
+    p += render_items_align(sizeof(XMFLOAT4X4) * capacity);
+    ret->tex_transform = reinterpret_cast<XMFLOAT4X4 *>(p);
+    p += render_items_align(sizeof(XMFLOAT4X4) * capacity);
+    for (int f = 0; f < RENDER_ITEMS_MAX_FRAMES; ++f) {
+        ret->dirty[f] = reinterpret_cast<uint64_t *>(p);
+        memset(ret->dirty[f], 0, sizeof(uint64_t) * ret->n_dirty_words);
+        p += render_items_align(sizeof(uint64_t) * ret->n_dirty_words);
+    }
+    ret->draw_args = reinterpret_cast<RenderItemDrawArgs *>(p);
+    p += render_items_align(sizeof(RenderItemDrawArgs) * capacity);
+    ret->local_bounds = reinterpret_cast<RenderItemBounds *>(p);
+    p += render_items_align(sizeof(RenderItemBounds) * capacity);
+    ret->material = reinterpret_cast<uint32_t *>(p);
+    p += render_items_align(sizeof(uint32_t) * capacity);
+    ret->layer = p;
+    p += render_items_align(sizeof(uint8_t) * capacity);
+    ret->handle = reinterpret_cast<RenderItemHandle *>(p);
+    p += render_items_align(sizeof(RenderItemHandle) * capacity);
+    ret->world_bounds = Culling_InitBounds(p, capacity);
+    ret->world_bounds->count = 0;
+    p += render_items_align(Culling_CalculateRequiredSize(capacity));
+    ret->slot_dense = reinterpret_cast<uint32_t *>(p);
+    p += render_items_align(sizeof(uint32_t) * capacity);
+    ret->slot_generation = p;
+
+    // every slot free, chained in order
+    for (int i = 0; i < capacity; ++i) {
+        ret->slot_dense[i] = (uint32_t)(i + 1);
+        ret->slot_generation[i] = 0;
+    }
+    ret->free_slot = 0;
+    return ret;
+}
+static uint32_t
+render_items_slot (RenderItemHandle handle) {
+    return (handle & RENDER_ITEMS_SLOT_MASK) - 1;
+}
+// Item i is out of date in every frame's instance data
+static void
+render_items_set_dirty (RenderItems * items, int i) {
+    uint64_t bit = 1ull << (i & 63);
+    for (int f = 0; f < items->n_frames; ++f)
+        items->dirty[f][i >> 6] |= bit;
+}
+static void
+render_items_clear_dirty (RenderItems * items, int i) {
+    uint64_t bit = 1ull << (i & 63);
+    for (int f = 0; f < items->n_frames; ++f)
+        items->dirty[f][i >> 6] &= ~bit;
+}
+bool
+RenderItems_IsValid (RenderItems const * items, RenderItemHandle handle) {
+    uint32_t slot = render_items_slot(handle);
+    if (RENDER_ITEMS_INVALID_HANDLE == handle || slot >= (uint32_t)items->capacity)
+        return false;
+    if (items->slot_generation[slot] != (uint8_t)(handle >> RENDER_ITEMS_SLOT_BITS))
+        return false;
+    uint32_t dense = items->slot_dense[slot];
+    return dense < (uint32_t)items->count && items->handle[dense] == handle;
+}
+int
+RenderItems_GetIndex (RenderItems const * items, RenderItemHandle handle) {
+    SIMPLE_ASSERT(RenderItems_IsValid(items, handle), "Invalid render item handle");
+    return (int)items->slot_dense[render_items_slot(handle)];
+}
+RenderItemHandle
+RenderItems_Add (RenderItems * items, RenderItemDesc const * desc) {
+    if (items->free_slot >= (uint32_t)items->capacity)
+        return RENDER_ITEMS_INVALID_HANDLE;
+    uint32_t slot = items->free_slot;
+    items->free_slot = items->slot_dense[slot];
+
+    int i = items->count++;
+    items->world_bounds->count = items->count;
+    items->slot_dense[slot] = (uint32_t)i;
+    RenderItemHandle handle = ((RenderItemHandle)items->slot_generation[slot] << RENDER_ITEMS_SLOT_BITS) | (slot + 1);
+
+    items->world[i] = desc->world;
+    items->tex_transform[i] = desc->tex_transform;
+    render_items_set_dirty(items, i);
+    items->draw_args[i] = desc->draw_args;
+    items->local_bounds[i] = desc->bounds;
+    items->material[i] = desc->material;
+    items->layer[i] = desc->layer;
+    items->handle[i] = handle;
+    // so the item culls right from the first frame, before its cbuffer is written
+    Culling_SetBounds(items->world_bounds, i, desc->bounds.center, desc->bounds.extents, desc->world);
+    return handle;
+}
+void
+RenderItems_Remove (RenderItems * items, RenderItemHandle handle) {
+    SIMPLE_ASSERT(RenderItems_IsValid(items, handle), "Invalid render item handle");
+    uint32_t slot = render_items_slot(handle);
+    int i = (int)items->slot_dense[slot];
+    int last = --items->count;
+    items->world_bounds->count = items->count;
+
+    if (i != last) {
+        items->world[i] = items->world[last];
+        items->tex_transform[i] = items->tex_transform[last];
+        render_items_set_dirty(items, i);   // it moved to another cbuffer slot
+        items->draw_args[i] = items->draw_args[last];
+        items->local_bounds[i] = items->local_bounds[last];
+        items->material[i] = items->material[last];
+        items->layer[i] = items->layer[last];
+        items->handle[i] = items->handle[last];
+        CullingBounds * wb = items->world_bounds;
+        wb->center_x[i] = wb->center_x[last];
+        wb->center_y[i] = wb->center_y[last];
+        wb->center_z[i] = wb->center_z[last];
+        wb->extent_x[i] = wb->extent_x[last];
+        wb->extent_y[i] = wb->extent_y[last];
+        wb->extent_z[i] = wb->extent_z[last];
+        items->slot_dense[render_items_slot(items->handle[i])] = (uint32_t)i;
+    }
+    render_items_clear_dirty(items, last);
+
+    // a new generation makes stale copies of the handle invalid
+    ++items->slot_generation[slot];
+    items->slot_dense[slot] = items->free_slot;
+    items->free_slot = slot;
+}
+void
+RenderItems_SetWorld (RenderItems * items, RenderItemHandle handle, XMFLOAT4X4 const & world) {
+    int i = RenderItems_GetIndex(items, handle);
+    items->world[i] = world;
+    render_items_set_dirty(items, i);
+}
+void
+RenderItems_SetTexTransform (RenderItems * items, RenderItemHandle handle, XMFLOAT4X4 const & tex_transform) {
+    int i = RenderItems_GetIndex(items, handle);
+    items->tex_transform[i] = tex_transform;
+    render_items_set_dirty(items, i);
+}
+void
+RenderItems_SetMaterial (RenderItems * items, RenderItemHandle handle, uint32_t material) {
+    items->material[RenderItems_GetIndex(items, handle)] = material;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "headers/common.h"
+#include "culling.h"
+#include <DirectXMath.h>
+
+// Render items stored field by field: every attribute has its own dense array, all indexed by the
+// same dense index, so a pass only streams the arrays it needs (cbuffer update: transforms and
+// dirty bits, culling: world bounds, drawing: draw args and materials).
+//
+// Items are referred to by handles that stay valid until the item is removed. Removing an item
+// moves the last one into its place, so the arrays never have holes; the dense index of an item
+// (also its instance data index) can therefore change, its handle never does.
+
+#define RENDER_ITEMS_SLOT_BITS      24
+#define RENDER_ITEMS_SLOT_MASK      ((1u << RENDER_ITEMS_SLOT_BITS) - 1)
+#define RENDER_ITEMS_MAX_CAPACITY   ((int)RENDER_ITEMS_SLOT_MASK)
+// Most queued frames (instance data copies) the dirty bits are tracked for
+#define RENDER_ITEMS_MAX_FRAMES     4
+
+// generation (high 8 bits) | slot + 1 (low 24 bits); 0 is never a valid handle
+typedef uint32_t RenderItemHandle;
+#define RENDER_ITEMS_INVALID_HANDLE 0u
+
+// DrawIndexedInstanced parameters and the geometry they index
+struct RenderItemDrawArgs {
+    uint32_t index_count;
+    uint32_t start_index;
+    int32_t base_vertex;
+    uint16_t geom;              // index into the app's geometry table
+    uint16_t topology;          // D3D_PRIMITIVE_TOPOLOGY
+};
+// Local space box of the drawn submesh
+struct RenderItemBounds {
+    DirectX::XMFLOAT3 center;
+    DirectX::XMFLOAT3 extents;
+};
+struct RenderItemDesc {
+    DirectX::XMFLOAT4X4 world;
+    DirectX::XMFLOAT4X4 tex_transform;
+    RenderItemDrawArgs draw_args;
+    RenderItemBounds bounds;
+    uint32_t material;          // index into the app's material table
+    uint8_t layer;              // PSO the item is drawn with
+};
+
+struct RenderItems {
+    int count;
+    int capacity;
+    int n_frames;               // queued frames, each has its own copy of the instance data
+    int n_dirty_words;          // 64-bit words per dirty bitset, enough for capacity items
+
+    // -- dense arrays, [0, count)
+    DirectX::XMFLOAT4X4 * world;
+    DirectX::XMFLOAT4X4 * tex_transform;
+    // bit i of dirty[frame] (word i / 64, bit i % 64): that frame's instance data still misses
+    // item i's latest world/tex_transform; bits past count are always clear
+    uint64_t * dirty[RENDER_ITEMS_MAX_FRAMES];
+    RenderItemDrawArgs * draw_args;
+    RenderItemBounds * local_bounds;
+    uint32_t * material;
+    uint8_t * layer;
+    RenderItemHandle * handle;
+    // world space boxes for Culling_FrustumCull, refreshed by the app with the instance data
+    CullingBounds * world_bounds;
+
+    // -- per slot, [0, capacity)
+    uint32_t * slot_dense;      // dense index of a live slot, next free slot otherwise
+    uint8_t * slot_generation;
+    uint32_t free_slot;         // head of the free list, capacity when full
+};
+
+size_t
+RenderItems_CalculateRequiredSize (int capacity);
+RenderItems *
+RenderItems_Init (uint8_t * memory, int capacity, int n_frames);
+// Returns RENDER_ITEMS_INVALID_HANDLE when the store is full. The item starts dirty for all frames.
+RenderItemHandle
+RenderItems_Add (RenderItems * items, RenderItemDesc const * desc);
+// The last item takes the removed one's dense index and is marked dirty for all frames.
+void
+RenderItems_Remove (RenderItems * items, RenderItemHandle handle);
+bool
+RenderItems_IsValid (RenderItems const * items, RenderItemHandle handle);
+// Current dense index of a live item (valid until the next RenderItems_Remove)
+int
+RenderItems_GetIndex (RenderItems const * items, RenderItemHandle handle);
+void
+RenderItems_SetWorld (RenderItems * items, RenderItemHandle handle, DirectX::XMFLOAT4X4 const & world);
+void
+RenderItems_SetTexTransform (RenderItems * items, RenderItemHandle handle, DirectX::XMFLOAT4X4 const & tex_transform);
+void
+RenderItems_SetMaterial (RenderItems * items, RenderItemHandle handle, uint32_t material);
@@ -0,0 +1,267 @@
+#include "scheduler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <ppl.h>    // Parallel Patterns Library
+#define SCHEDULER_HAS_PPL   1
+#else
+#define SCHEDULER_HAS_PPL   0
+#endif
+
+#define SCHEDULER_CACHE_LINE        64
+#define SCHEDULER_CHUNKS_PER_THREAD 4
+
+// Chunk indices owned by one thread, packed as (head << 32 | tail) so the owner (popping the front)
+// and thieves (popping the back) race on a single atomic word.
+struct alignas(SCHEDULER_CACHE_LINE) SchedulerQueue {
+    std::atomic<uint64_t> range;
+};
+
+struct Scheduler {
+    SCHEDULER_BACKEND backend;
+    int n_threads;
+    int grain;
+
+    // -- pool backend
+    std::thread * workers;          // n_threads - 1
+    SchedulerQueue * queues;        // n_threads, queue 0 belongs to the calling thread
+
+    std::mutex submit;              // one job at a time, held by the submitting thread until it is done
+    std::mutex mutex;
+    std::condition_variable wake;   // new job or quit
+    std::condition_variable idle;   // all workers left the previous job
+    uint64_t generation;
+    int n_busy;
+    bool quit;
+
+    // current job (written under mutex while no worker is busy)
+    void * job_ctx;
+    SchedulerRangeFn job_fn;
+    int job_begin;
+    int job_end;
+    int job_chunk;
+    alignas(SCHEDULER_CACHE_LINE) std::atomic<int> chunks_left;
+};
+
+// Set while a thread runs chunks, so nested loops fall back to serial instead of deadlocking.
+static thread_local Scheduler * scheduler_running = nullptr;
+
+static bool
+queue_pop_front (SchedulerQueue * q, int * out_chunk) {
+    uint64_t r = q->range.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t head = (uint32_t)(r >> 32);
+        uint32_t tail = (uint32_t)r;
+        if (head >= tail)
+            return false;
+        uint64_t next = ((uint64_t)(head + 1) << 32) | tail;
+        if (q->range.compare_exchange_weak(r, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            *out_chunk = (int)head;
+            return true;
+        }
+    }
+}
+static bool
+queue_pop_back (SchedulerQueue * q, int * out_chunk) {
+    uint64_t r = q->range.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t head = (uint32_t)(r >> 32);
+        uint32_t tail = (uint32_t)r;
+        if (head >= tail)
+            return false;
+        uint64_t next = ((uint64_t)head << 32) | (tail - 1);
+        if (q->range.compare_exchange_weak(r, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            *out_chunk = (int)(tail - 1);
+            return true;
+        }
+    }
+}
+static void
+scheduler_run_chunk (Scheduler * sched, int chunk) {
+    int b = sched->job_begin + chunk * sched->job_chunk;
+    int e = (b + sched->job_chunk < sched->job_end) ? b + sched->job_chunk : sched->job_end;
+    sched->job_fn(sched->job_ctx, b, e);
+    sched->chunks_left.fetch_sub(1, std::memory_order_release);
+}
+// Drain own queue front-to-back (keeps each thread on neighbouring rows), then steal from the back of others.
+static void
+scheduler_work (Scheduler * sched, int self) {
+    Scheduler * outer = scheduler_running;
+    scheduler_running = sched;
+
+    int chunk = 0;
+    while (queue_pop_front(&sched->queues[self], &chunk))
+        scheduler_run_chunk(sched, chunk);
+
+    for (int k = 1; k < sched->n_threads; ++k) {
+        SchedulerQueue * victim = &sched->queues[(self + k) % sched->n_threads];
+        while (queue_pop_back(victim, &chunk))
+            scheduler_run_chunk(sched, chunk);
+    }
+    scheduler_running = outer;
+}
+static void
+scheduler_worker_main (Scheduler * sched, int self) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(sched->mutex);
+            sched->wake.wait(lock, [sched, seen] { return sched->quit || sched->generation != seen; });
+            if (sched->quit)
+                return;
+            seen = sched->generation;
+            ++sched->n_busy;
+        }
+
+        scheduler_work(sched, self);
+
+        {
+            std::lock_guard<std::mutex> lock(sched->mutex);
+            if (0 == --sched->n_busy)
+                sched->idle.notify_one();
+        }
+    }
+}
+static int
+scheduler_resolve_chunk (Scheduler * sched, int count, int grain) {
+    if (grain <= 0)
+        grain = sched->grain;
+    if (grain <= 0)
+        grain = count / (sched->n_threads * SCHEDULER_CHUNKS_PER_THREAD);
+    return (grain > 0) ? grain : 1;
+}
+Scheduler *
+Scheduler_Create (SCHEDULER_BACKEND backend, int n_threads, int grain) {
+    if (n_threads <= 0)
+        n_threads = (int)std::thread::hardware_concurrency();
+    if (n_threads <= 0)
+        n_threads = 1;
+    if (SCHEDULER_BACKEND_PPL == backend && !SCHEDULER_HAS_PPL)
+        backend = SCHEDULER_BACKEND_POOL;
+    if (SCHEDULER_BACKEND_SERIAL == backend)
+        n_threads = 1;
+
+    Scheduler * ret = new Scheduler;
+    ret->backend = backend;
+    ret->n_threads = n_threads;
+    ret->grain = grain;
+    ret->workers = nullptr;
+    ret->queues = nullptr;
+    ret->generation = 0;
+    ret->n_busy = 0;
+    ret->quit = false;
+    ret->job_ctx = nullptr;
+    ret->job_fn = nullptr;
+    ret->job_begin = ret->job_end = ret->job_chunk = 0;
+    ret->chunks_left.store(0);
+
+    if (SCHEDULER_BACKEND_POOL == backend) {
+        ret->queues = new SchedulerQueue[n_threads];
+        for (int i = 0; i < n_threads; ++i)
+            ret->queues[i].range.store(0);
+        if (n_threads > 1) {
+            ret->workers = new std::thread[n_threads - 1];
+            for (int i = 1; i < n_threads; ++i)
+                ret->workers[i - 1] = std::thread(scheduler_worker_main, ret, i);
+        }
+    }
+    return ret;
+}
+void
+Scheduler_Destroy (Scheduler * sched) {
+    if (nullptr == sched)
+        return;
+    if (sched->workers) {
+        {
+            std::lock_guard<std::mutex> lock(sched->mutex);
+            sched->quit = true;
+        }
+        sched->wake.notify_all();
+        for (int i = 0; i < sched->n_threads - 1; ++i)
+            sched->workers[i].join();
+        delete [] sched->workers;
+    }
+    delete [] sched->queues;
+    delete sched;
+}
+Scheduler *
+Scheduler_GetDefault () {
+    // Destroyed (and its threads joined) at process exit.
+    struct DefaultScheduler {
+        Scheduler * sched;
+        DefaultScheduler () : sched(Scheduler_Create(SCHEDULER_HAS_PPL ? SCHEDULER_BACKEND_PPL : SCHEDULER_BACKEND_POOL, 0, SCHEDULER_GRAIN_AUTO)) {}
+        ~DefaultScheduler () { Scheduler_Destroy(sched); }
+    };
+    static DefaultScheduler def;
+    return def.sched;
+}
+SCHEDULER_BACKEND
+Scheduler_GetBackend (Scheduler * sched) {
+    return sched->backend;
+}
+int
+Scheduler_GetThreadCount (Scheduler * sched) {
+    return sched->n_threads;
+}
+void
+Scheduler_SetGrain (Scheduler * sched, int grain) {
+    sched->grain = grain;
+}
+void
+Scheduler_ParallelForRange (Scheduler * sched, int begin, int end, int grain, void * ctx, SchedulerRangeFn fn) {
+    int count = end - begin;
+    if (count <= 0)
+        return;
+
+    int chunk = scheduler_resolve_chunk(sched, count, grain);
+    int n_chunks = (count + chunk - 1) / chunk;
+
+    if (SCHEDULER_BACKEND_SERIAL == sched->backend || 1 == n_chunks || 1 == sched->n_threads || sched == scheduler_running) {
+        fn(ctx, begin, end);
+        return;
+    }
+
+#if SCHEDULER_HAS_PPL
+    if (SCHEDULER_BACKEND_PPL == sched->backend) {
+        concurrency::parallel_for(0, n_chunks, [=](int c) {
+            int b = begin + c * chunk;
+            fn(ctx, b, (b + chunk < end) ? b + chunk : end);
+        });
+        return;
+    }
+#endif
+
+    // Jobs from other threads wait here, the queues and job fields only hold one at a time.
+    std::lock_guard<std::mutex> submit(sched->submit);
+    {
+        // Workers still spinning on the previous job must leave before we reuse the queues.
+        std::unique_lock<std::mutex> lock(sched->mutex);
+        sched->idle.wait(lock, [sched] { return 0 == sched->n_busy; });
+
+        sched->job_ctx = ctx;
+        sched->job_fn = fn;
+        sched->job_begin = begin;
+        sched->job_end = end;
+        sched->job_chunk = chunk;
+        sched->chunks_left.store(n_chunks, std::memory_order_relaxed);
+
+        // Each thread starts with a contiguous block of chunks.
+        for (int q = 0; q < sched->n_threads; ++q) {
+            uint64_t head = (uint64_t)n_chunks * q / sched->n_threads;
+            uint64_t tail = (uint64_t)n_chunks * (q + 1) / sched->n_threads;
+            sched->queues[q].range.store((head << 32) | tail, std::memory_order_relaxed);
+        }
+        ++sched->generation;
+    }
+    sched->wake.notify_all();
+
+    scheduler_work(sched, 0);
+
+    // Everything is either done or being finished by a thief.
+    while (sched->chunks_left.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+// Backends for running a parallel loop.
+// POOL is a portable work-stealing thread pool (std::thread), PPL is only available on MSVC.
+enum SCHEDULER_BACKEND : int {
+    SCHEDULER_BACKEND_SERIAL = 0,
+    SCHEDULER_BACKEND_POOL = 1,
+    SCHEDULER_BACKEND_PPL = 2,
+
+    _COUNT_SCHEDULER_BACKEND
+};
+
+// grain <= 0 means "auto": a few chunks per thread so idle threads have something to steal.
+#define SCHEDULER_GRAIN_AUTO    0
+
+// Called with a contiguous sub-range [begin, end) of the loop.
+typedef void (*SchedulerRangeFn) (void * ctx, int begin, int end);
+
+struct Scheduler;
+
+// n_threads <= 0 uses all hardware threads. The calling thread always takes part in the work,
+// so a pool of n_threads spawns n_threads - 1 workers.
+Scheduler *
+Scheduler_Create (SCHEDULER_BACKEND backend, int n_threads, int grain);
+void
+Scheduler_Destroy (Scheduler * sched);
+// Process-wide scheduler: PPL when available, otherwise a pool over all hardware threads.
+Scheduler *
+Scheduler_GetDefault ();
+SCHEDULER_BACKEND
+Scheduler_GetBackend (Scheduler * sched);
+int
+Scheduler_GetThreadCount (Scheduler * sched);
+void
+Scheduler_SetGrain (Scheduler * sched, int grain);
+// Splits [begin, end) into contiguous chunks of grain items (grain <= 0 uses the scheduler's grain)
+// and returns when all of them are done. Chunks are contiguous so threads never interleave
+// single rows; only the rows at chunk edges can share a cache line with another thread.
+// Any thread may call it; on the pool backend loops submitted from different threads run one
+// after the other, and a loop nested in a chunk of the same scheduler runs serially.
+void
+Scheduler_ParallelForRange (Scheduler * sched, int begin, int end, int grain, void * ctx, SchedulerRangeFn fn);
+
+template <typename F>
+inline void
+Scheduler_ParallelFor (Scheduler * sched, int begin, int end, int grain, F const & body) {
+    Scheduler_ParallelForRange(sched, begin, end, grain, (void *)&body, [](void * ctx, int b, int e) {
+        F const & f = *reinterpret_cast<F const *>(ctx);
+        for (int i = b; i < e; ++i)
+            f(i);
+    });
+}
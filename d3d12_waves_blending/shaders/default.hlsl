@@ -18,9 +18,28 @@ SamplerState global_sam_linear_clamp : register(s3);
 SamplerState global_sam_anisotropic_wrap : register(s4);
 SamplerState global_sam_anisotropic_clamp : register(s5);
 
-cbuffer PerObjectConstantBuffer : register(b0) {
-    float4x4 global_world;
-    float4x4 global_tex_transform;
+struct InstanceData {
+    float4x4 world;
+    float4x4 tex_transform;
+};
+struct MaterialData {
+    float4 diffuse_albedo;
+    float3 fresnel_r0;
+    float roughness;
+    float4x4 mat_transform;
+};
+
+// Put in space1, so they do not overlap with the diffuse map in space0.
+// Instance data per render item, tightly packed (no 256-byte cbuffer padding).
+StructuredBuffer<InstanceData> global_instances : register(t0, space1);
+StructuredBuffer<MaterialData> global_materials : register(t1, space1);
+// Render item index per draw instance slot, in draw order.
+StructuredBuffer<uint> global_draw_instances : register(t2, space1);
+
+// Root constants, set per draw
+cbuffer PerDrawConstants : register(b0) {
+    uint global_instance_base;      // draw instance slot of the draw's first instance
+    uint global_material_index;
 }
 cbuffer PerPassConstantBuffer : register(b1) {
     float4x4 global_view;
@@ -52,13 +71,6 @@ cbuffer PerPassConstantBuffer : register(b1) {
     // are spot lights for a maximum of MAX_LIGHTS per object.
     Light global_lights[MAX_LIGHTS];
 }
-cbuffer MaterialConstantBuffer : register(b2) {
-    float4 global_diffuse_albedo;
-    float3 global_fresnel_r0;
-    float global_roughness;
-    float4x4 global_mat_transform;
-};
-
 struct VertexShaderInput {
     float3 pos_local : POSITION;
     float3 normal_local : NORMAL;
@@ -71,29 +83,34 @@ struct VertexShaderOutput {
     float2 texc : TEXCOORD;
 };
 VertexShaderOutput
-VertexShader_Main (VertexShaderInput vin) {
+VertexShader_Main (VertexShaderInput vin, uint instance_id : SV_InstanceID) {
     VertexShaderOutput result = (VertexShaderOutput) 0.0f;
 
+    // SV_InstanceID starts at 0 for every draw, the draw's slots start at global_instance_base
+    InstanceData inst = global_instances[global_draw_instances[global_instance_base + instance_id]];
+    MaterialData mat_data = global_materials[global_material_index];
+
     // transform to world space
-    float4 pos_world = mul(float4(vin.pos_local, 1.0f), global_world);
+    float4 pos_world = mul(float4(vin.pos_local, 1.0f), inst.world);
     result.pos_world = pos_world.xyz;
     
     // assuming nonuniform scale (otherwise have to use inverse-transpose of world-matrix)
-    result.normal_world = mul(vin.normal_local, (float3x3) global_world);
+    result.normal_world = mul(vin.normal_local, (float3x3) inst.world);
 
     // transform to homogenous clip space
     result.pos_homogenous_clip_space = mul(pos_world, global_view_proj);
 
     // output vertex attributes for interpolation across triangle
-    float4 texc = mul(float4(vin.texc, 0.0f, 1.0f), global_tex_transform);
-    result.texc = mul(texc, global_mat_transform).xy;
+    float4 texc = mul(float4(vin.texc, 0.0f, 1.0f), inst.tex_transform);
+    result.texc = mul(texc, mat_data.mat_transform).xy;
 
     return result;
 }
 float4
 PixelShader_Main (VertexShaderOutput pin) : SV_Target {
+    MaterialData mat_data = global_materials[global_material_index];
     float4 diffuse_albedo =
-        global_diffuse_map.Sample(global_sam_anisotropic_wrap, pin.texc) * global_diffuse_albedo;
+        global_diffuse_map.Sample(global_sam_anisotropic_wrap, pin.texc) * mat_data.diffuse_albedo;
 
 #ifdef ALPHA_TEST
     clip(diffuse_albedo.a - 0.1f);
@@ -110,8 +127,8 @@ PixelShader_Main (VertexShaderOutput pin) : SV_Target {
     // indirect lighting
     float4 ambient = global_ambient_light * diffuse_albedo;
 
-    const float shininess = 1.0f - global_roughness;
-    Material mat = { diffuse_albedo, global_fresnel_r0, shininess };
+    const float shininess = 1.0f - mat_data.roughness;
+    Material mat = { diffuse_albedo, mat_data.fresnel_r0, shininess };
     float3 shadow_factor = 1.0f;
     float4 direct_light = compute_lighting(
         global_lights, mat, pin.pos_world, pin.normal_world, to_eye, shadow_factor
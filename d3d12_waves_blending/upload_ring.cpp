@@ -0,0 +1,104 @@
+#include "upload_ring.h"
+
+static uint64_t
+upload_ring_align (uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+static void
+upload_ring_fill (UploadRing * ring, uint64_t begin, uint64_t size, UploadAllocation * out) {
+    out->cpu = ring->memory + begin;
+    out->gpu = ring->gpu_base + begin;
+    out->offset = begin;
+    out->size = size;
+}
+
+uint64_t
+UploadRing_CalculateRequiredSize (uint64_t const reserve_sizes [], int n_reserves, uint64_t ring_size) {
+    uint64_t size = 0;
+    for (int i = 0; i < n_reserves; ++i)
+        size = upload_ring_align(size, UPLOAD_RING_CB_ALIGNMENT) + reserve_sizes[i];
+    return upload_ring_align(size, UPLOAD_RING_CB_ALIGNMENT) + ring_size;
+}
+void
+UploadRing_Init (UploadRing * ring, uint8_t * mapped, uint64_t gpu_base, uint64_t size) {
+    SIMPLE_ASSERT(mapped, "upload heap not mapped");
+    *ring = {};
+    ring->memory = mapped;
+    ring->gpu_base = gpu_base;
+    ring->size = size;
+}
+bool
+UploadRing_Reserve (UploadRing * ring, uint64_t size, uint64_t alignment, UploadAllocation * out) {
+    // reservations sit in front of the ring, so it has to be empty
+    SIMPLE_ASSERT(!ring->in_frame && 0 == ring->n_frames && 0 == ring->used, "reserve before the first frame");
+    SIMPLE_ASSERT(alignment > 0 && 0 == (alignment & (alignment - 1)), "alignment must be a power of 2");
+    uint64_t begin = upload_ring_align(ring->stats.reserved, alignment);
+    if (begin > ring->size || size > ring->size - begin)
+        return false;
+    upload_ring_fill(ring, begin, size, out);
+    ring->stats.reserved = begin + size;
+    ring->head = ring->tail = ring->stats.reserved;
+    return true;
+}
+void
+UploadRing_BeginFrame (UploadRing * ring, uint64_t completed_fence) {
+    SIMPLE_ASSERT(!ring->in_frame, "previous frame not ended");
+    while (ring->n_frames > 0 && ring->frames[ring->first_frame].fence <= completed_fence) {
+        UploadRingFrame const * frame = &ring->frames[ring->first_frame];
+        ring->tail = frame->end;
+        ring->used -= frame->bytes;
+        ring->first_frame = (ring->first_frame + 1) % UPLOAD_RING_MAX_FRAMES;
+        --ring->n_frames;
+    }
+    // nothing in flight, start over at the front so the next allocations don't wrap
+    if (0 == ring->n_frames)
+        ring->head = ring->tail = ring->stats.reserved;
+    ring->in_frame = true;
+    ring->stats.frame_bytes = 0;
+    ring->stats.n_allocs = 0;
+}
+bool
+UploadRing_Alloc (UploadRing * ring, uint64_t size, uint64_t alignment, UploadAllocation * out) {
+    SIMPLE_ASSERT(ring->in_frame, "allocating outside of a frame");
+    SIMPLE_ASSERT(alignment > 0 && 0 == (alignment & (alignment - 1)), "alignment must be a power of 2");
+    uint64_t const start = ring->stats.reserved;
+    uint64_t begin = upload_ring_align(ring->head, alignment);
+    bool fits = false;
+    if (ring->used > 0 && ring->head <= ring->tail) {
+        // wrapped: free space is [head, tail)
+        fits = begin <= ring->tail && size <= ring->tail - begin;
+    } else {
+        // free space is [head, size) then [start, tail)
+        fits = begin <= ring->size && size <= ring->size - begin;
+        if (!fits) {
+            // skip the end of the ring, the skipped bytes retire with this frame
+            begin = upload_ring_align(start, alignment);
+            fits = begin <= ring->tail && size <= ring->tail - begin;
+        }
+    }
+    if (!fits) {
+        ++ring->stats.n_failed;
+        return false;
+    }
+    // bytes taken from the free space, the alignment padding and a skipped ring end included
+    uint64_t taken = (begin >= ring->head) ? (begin + size - ring->head) : (ring->size - ring->head) + (begin + size - start);
+    upload_ring_fill(ring, begin, size, out);
+    ring->head = begin + size;
+    ring->used += taken;
+    ++ring->stats.n_allocs;
+    ring->stats.frame_bytes += taken;
+    ring->stats.high_water = (ring->stats.frame_bytes > ring->stats.high_water) ? ring->stats.frame_bytes : ring->stats.high_water;
+    return true;
+}
+void
+UploadRing_EndFrame (UploadRing * ring, uint64_t fence) {
+    SIMPLE_ASSERT(ring->in_frame, "frame not begun");
+    SIMPLE_ASSERT(ring->n_frames < UPLOAD_RING_MAX_FRAMES, "too many frames in flight");
+    SIMPLE_ASSERT(0 == ring->n_frames || fence > ring->frames[(ring->first_frame + ring->n_frames - 1) % UPLOAD_RING_MAX_FRAMES].fence, "fence values have to increase");
+    UploadRingFrame * frame = &ring->frames[(ring->first_frame + ring->n_frames) % UPLOAD_RING_MAX_FRAMES];
+    frame->fence = fence;
+    frame->end = ring->head;
+    frame->bytes = ring->stats.frame_bytes;
+    ++ring->n_frames;
+    ring->in_frame = false;
+}
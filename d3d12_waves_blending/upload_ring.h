@@ -0,0 +1,72 @@
+#pragma once
+#include "headers/common.h"
+
+// Sub-allocator over one persistently mapped upload heap, shared by all queued frames, so the
+// frames' constants and dynamic vertices live in a single heap instead of one buffer apiece.
+//  - Reserve: carved off the front once, before the first frame, for data that is only partly
+//    rewritten each frame and has to survive until the frame comes around again (dirty-tracked
+//    instance/material data, the waves vb that only gets its changed tiles).
+//  - Alloc: taken from the head of the ring that follows the reservations, wrapping back to its
+//    start, for data rewritten every frame (pass constants, draw instance slots).
+// EndFrame tags the frame's allocations with its fence value, BeginFrame retires every frame
+// whose fence has completed, moving the tail up to where that frame ended. The fence values
+// passed to EndFrame have to increase.
+
+// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
+#define UPLOAD_RING_CB_ALIGNMENT    256
+
+// Most ended frames the GPU may still be reading
+#define UPLOAD_RING_MAX_FRAMES      8
+
+struct UploadAllocation {
+    uint8_t * cpu;                  // mapped, write only
+    uint64_t gpu;                   // GPU virtual address
+    uint64_t offset;                // in the heap
+    uint64_t size;
+};
+struct UploadRingStats {
+    uint64_t reserved;              // bytes reserved, [0, reserved) of the heap
+    uint64_t frame_bytes;           // allocated by the current/last frame (alignment and wrap included)
+    uint64_t high_water;            // most frame_bytes seen
+    uint32_t n_allocs;              // by the current/last frame
+    uint32_t n_failed;              // allocations that didn't fit, over the ring's lifetime
+};
+struct UploadRingFrame {
+    uint64_t fence;
+    uint64_t end;                   // head when the frame ended
+    uint64_t bytes;                 // frame_bytes
+};
+struct UploadRing {
+    uint8_t * memory;
+    uint64_t gpu_base;
+    uint64_t size;
+    // the ring is [stats.reserved, size)
+    uint64_t head;                  // next free byte
+    uint64_t tail;                  // oldest byte still in use
+    uint64_t used;                  // bytes from tail to head, full when used and head == tail
+    // ended frames not retired yet, oldest first
+    UploadRingFrame frames[UPLOAD_RING_MAX_FRAMES];
+    int first_frame;
+    int n_frames;
+    bool in_frame;
+    UploadRingStats stats;
+};
+
+// Heap size for the given reservations (UPLOAD_RING_CB_ALIGNMENT aligned each) plus ring_size
+uint64_t
+UploadRing_CalculateRequiredSize (uint64_t const reserve_sizes [], int n_reserves, uint64_t ring_size);
+void
+UploadRing_Init (UploadRing * ring, uint8_t * mapped, uint64_t gpu_base, uint64_t size);
+// Permanent allocation, only before the first BeginFrame. False if it doesn't fit.
+bool
+UploadRing_Reserve (UploadRing * ring, uint64_t size, uint64_t alignment, UploadAllocation * out);
+// Starts a frame, retiring the allocations of the ended frames whose fence is <= completed_fence.
+void
+UploadRing_BeginFrame (UploadRing * ring, uint64_t completed_fence);
+// Valid until the frame is retired. False (counted in n_failed, nothing allocated) if the free
+// space left by the frames still in flight is too small.
+bool
+UploadRing_Alloc (UploadRing * ring, uint64_t size, uint64_t alignment, UploadAllocation * out);
+// The frame's commands are submitted, they are done with its allocations once fence completes.
+void
+UploadRing_EndFrame (UploadRing * ring, uint64_t fence);
@@ -0,0 +1,266 @@
+#include "water_lod.h"
+
+using namespace DirectX;
+
+#define WATER_LOD_ALIGNMENT     64
+
+static size_t
+water_lod_align (size_t size) {
+    return (size + (WATER_LOD_ALIGNMENT - 1)) & ~((size_t)WATER_LOD_ALIGNMENT - 1);
+}
+static int
+water_lod_patch_count (int quads, int patch_quads) {
+    return (quads + patch_quads - 1) / patch_quads;
+}
+static int
+water_lod_template_count (int n_lods) {
+    return _COUNT_WATER_LOD_PATCH_CLASS * n_lods * WATER_LOD_EDGE_MASKS;
+}
+// Quads of the last patch along an axis (patch_quads unless the grid doesn't divide evenly)
+static int
+water_lod_last_quads (int quads, int patch_quads) {
+    return quads - (water_lod_patch_count(quads, patch_quads) - 1) * patch_quads;
+}
+static int
+water_lod_max_lod (int qx, int qz, int n_lods) {
+    int l = 0;
+    while (l + 1 < n_lods && 0 == qx % (1 << (l + 1)) && 0 == qz % (1 << (l + 1)))
+        ++l;
+    return l;
+}
+// Upper bound of a template's indices (degenerate triangles of stitched edges are dropped)
+static size_t
+water_lod_template_bound (int qx, int qz, int lod) {
+    int s = 1 << lod;
+    return (size_t)6 * (qx / s) * (qz / s);
+}
+static size_t
+water_lod_index_bound (int m, int n, int patch_quads, int n_lods) {
+    int qx[2] = {patch_quads, water_lod_last_quads(n - 1, patch_quads)};
+    int qz[2] = {patch_quads, water_lod_last_quads(m - 1, patch_quads)};
+    size_t ret = 0;
+    for (int c = 0; c < _COUNT_WATER_LOD_PATCH_CLASS; ++c) {
+        int x = qx[c & WATER_LOD_PATCH_LAST_COL ? 1 : 0];
+        int z = qz[c & WATER_LOD_PATCH_LAST_ROW ? 1 : 0];
+        int max_lod = water_lod_max_lod(x, z, n_lods);
+        for (int l = 0; l <= max_lod; ++l)
+            ret += WATER_LOD_EDGE_MASKS * water_lod_template_bound(x, z, l);
+    }
+    return ret;
+}
+size_t
+WaterLod_CalculateRequiredSize (int m, int n, int patch_quads, int n_lods) {
+    SIMPLE_ASSERT(m > 1 && n > 1, "Invalid water grid dimensions");
+    SIMPLE_ASSERT(n_lods > 0 && n_lods <= WATER_LOD_MAX_COUNT, "Invalid lod count");
+    int n_patches = water_lod_patch_count(m - 1, patch_quads) * water_lod_patch_count(n - 1, patch_quads);
+    return water_lod_align(sizeof(WaterLod)) +
+        water_lod_align(sizeof(WaterLodTemplate) * water_lod_template_count(n_lods)) +
+        water_lod_align(sizeof(uint8_t) * n_patches) +
+        water_lod_align(sizeof(uint32_t) * water_lod_index_bound(m, n, patch_quads, n_lods));
+}
+// Vertex (i, j) of the patch (quads from its top-left corner). On an edge next to a coarser
+// patch, vertices at odd multiples of the stride fold onto the previous even one.
+static uint32_t
+water_lod_vertex (int i, int j, int qx, int qz, int s, int mask, int pitch) {
+    if ((mask & WATER_LOD_EDGE_TOP) && 0 == i && ((j / s) & 1))
+        j -= s;
+    if ((mask & WATER_LOD_EDGE_BOTTOM) && qz == i && ((j / s) & 1))
+        j -= s;
+    if ((mask & WATER_LOD_EDGE_LEFT) && 0 == j && ((i / s) & 1))
+        i -= s;
+    if ((mask & WATER_LOD_EDGE_RIGHT) && qx == j && ((i / s) & 1))
+        i -= s;
+    return (uint32_t)(i * pitch + j);
+}
+static uint32_t
+water_lod_emit (uint32_t * out, uint32_t k, uint32_t a, uint32_t b, uint32_t c) {
+    if (a == b || b == c || a == c)
+        return k;
+    out[k] = a;
+    out[k + 1] = b;
+    out[k + 2] = c;
+    return k + 3;
+}
+// Same triangulation (and winding) as the full-res water grid, with stride s.
+// Cells go row by row inside vertical strips narrow enough that two rows of strip vertices
+// stay in the post-transform cache (see create_grid_indices in headers/utils.h).
+static uint32_t
+water_lod_build_template (int qx, int qz, int lod, int mask, int pitch, uint32_t * out) {
+    int s = 1 << lod;
+    int strip = (WATER_LOD_VCACHE_SIZE - 1) / 2 * s;
+    uint32_t k = 0;
+    for (int j0 = 0; j0 < qx; j0 += strip) {
+        int j1 = (j0 + strip < qx) ? j0 + strip : qx;
+        for (int i = 0; i < qz; i += s) {
+            for (int j = j0; j < j1; j += s) {
+                uint32_t a = water_lod_vertex(i, j, qx, qz, s, mask, pitch);
+                uint32_t b = water_lod_vertex(i, j + s, qx, qz, s, mask, pitch);
+                uint32_t c = water_lod_vertex(i + s, j, qx, qz, s, mask, pitch);
+                uint32_t d = water_lod_vertex(i + s, j + s, qx, qz, s, mask, pitch);
+                k = water_lod_emit(out, k, a, b, c);
+                k = water_lod_emit(out, k, c, b, d);
+            }
+        }
+    }
+    return k;
+}
+WaterLod *
+WaterLod_Init (uint8_t * memory, int m, int n, float dx, int patch_quads, int n_lods, float lod_distance) {
+    SIMPLE_ASSERT(0 == patch_quads % (1 << (n_lods - 1)), "patch_quads must be a multiple of the coarsest stride");
+
+    WaterLod * ret = reinterpret_cast<WaterLod *>(memory);
+    ret->nrow = m;
+    ret->ncol = n;
+    ret->spatial_step = dx;
+    ret->patch_quads = patch_quads;
+    ret->patch_rows = water_lod_patch_count(m - 1, patch_quads);
+    ret->patch_cols = water_lod_patch_count(n - 1, patch_quads);
+    ret->n_lods = n_lods;
+    ret->lod_distance = lod_distance;
+
+    int n_templates = water_lod_template_count(n_lods);
+    int n_patches = ret->patch_rows * ret->patch_cols;
+    uint8_t * templates_array = memory + water_lod_align(sizeof(WaterLod));
+    uint8_t * patch_array = templates_array + water_lod_align(sizeof(WaterLodTemplate) * n_templates);
+    uint8_t * indices_array = patch_array + water_lod_align(sizeof(uint8_t) * n_patches);
+    ret->templates = reinterpret_cast<WaterLodTemplate *>(templates_array);
+    ret->patch_lod = patch_array;
+    ret->indices = reinterpret_cast<uint32_t *>(indices_array);
+
+    for (int p = 0; p < n_patches; ++p)
+        ret->patch_lod[p] = 0;
+
+    int last_x = water_lod_last_quads(n - 1, patch_quads);
+    int last_z = water_lod_last_quads(m - 1, patch_quads);
+    uint32_t k = 0;
+    for (int c = 0; c < _COUNT_WATER_LOD_PATCH_CLASS; ++c) {
+        int qx = (c & WATER_LOD_PATCH_LAST_COL) ? last_x : patch_quads;
+        int qz = (c & WATER_LOD_PATCH_LAST_ROW) ? last_z : patch_quads;
+        ret->class_quads_x[c] = qx;
+        ret->class_quads_z[c] = qz;
+        ret->class_max_lod[c] = water_lod_max_lod(qx, qz, n_lods);
+        for (int l = 0; l < n_lods; ++l) {
+            for (int mask = 0; mask < WATER_LOD_EDGE_MASKS; ++mask) {
+                WaterLodTemplate * t = &ret->templates[(c * n_lods + l) * WATER_LOD_EDGE_MASKS + mask];
+                t->start_index = k;
+                t->index_count = 0;
+                if (l <= ret->class_max_lod[c])
+                    t->index_count = water_lod_build_template(qx, qz, l, mask, n, ret->indices + k);
+                k += t->index_count;
+            }
+        }
+    }
+    ret->n_indices = k;
+    return ret;
+}
+uint32_t *
+WaterLod_GetIndices (WaterLod * lod) {
+    return lod->indices;
+}
+uint32_t
+WaterLod_GetIndexCount (WaterLod * lod) {
+    return lod->n_indices;
+}
+int
+WaterLod_GetPatchCount (WaterLod * lod) {
+    return lod->patch_rows * lod->patch_cols;
+}
+static int
+water_lod_patch_class (WaterLod * lod, int pr, int pc) {
+    return ((pc == lod->patch_cols - 1) ? WATER_LOD_PATCH_LAST_COL : 0) |
+        ((pr == lod->patch_rows - 1) ? WATER_LOD_PATCH_LAST_ROW : 0);
+}
+void
+WaterLod_GetPatchBounds (WaterLod * lod, int patch, float half_height, XMFLOAT3 * out_center, XMFLOAT3 * out_extents) {
+    SIMPLE_ASSERT(patch >= 0 && patch < WaterLod_GetPatchCount(lod), "Invalid patch index");
+    int pr = patch / lod->patch_cols;
+    int pc = patch % lod->patch_cols;
+    int c = water_lod_patch_class(lod, pr, pc);
+    float dx = lod->spatial_step;
+    float half_width = (lod->ncol - 1) * dx * 0.5f;
+    float half_depth = (lod->nrow - 1) * dx * 0.5f;
+    float qx = (float)lod->class_quads_x[c];
+    float qz = (float)lod->class_quads_z[c];
+    *out_center = XMFLOAT3(-half_width + (pc * lod->patch_quads + 0.5f * qx) * dx, 0.0f, half_depth - (pr * lod->patch_quads + 0.5f * qz) * dx);
+    *out_extents = XMFLOAT3(0.5f * qx * dx, half_height, 0.5f * qz * dx);
+}
+// Lod of a neighbour, or -1 past the grid edge
+static int
+water_lod_neighbour (WaterLod * lod, int pr, int pc) {
+    if (pr < 0 || pr >= lod->patch_rows || pc < 0 || pc >= lod->patch_cols)
+        return -1;
+    return lod->patch_lod[pr * lod->patch_cols + pc];
+}
+uint32_t
+WaterLod_Select (WaterLod * lod, XMFLOAT3 eye_pos, WaterLodDraw out_draws []) {
+    float dx = lod->spatial_step;
+    float half_width = (lod->ncol - 1) * dx * 0.5f;
+    float half_depth = (lod->nrow - 1) * dx * 0.5f;
+
+    // 1. Distance from the eye to the patch's bounding circle (the water is flat enough)
+    for (int pr = 0; pr < lod->patch_rows; ++pr) {
+        for (int pc = 0; pc < lod->patch_cols; ++pc) {
+            int c = water_lod_patch_class(lod, pr, pc);
+            float qx = (float)lod->class_quads_x[c];
+            float qz = (float)lod->class_quads_z[c];
+            float cx = -half_width + (pc * lod->patch_quads + 0.5f * qx) * dx;
+            float cz = half_depth - (pr * lod->patch_quads + 0.5f * qz) * dx;
+            float ex = eye_pos.x - cx;
+            float ez = eye_pos.z - cz;
+            float d = sqrtf(ex * ex + eye_pos.y * eye_pos.y + ez * ez) - 0.5f * sqrtf(qx * qx + qz * qz) * dx;
+
+            int l = 0;
+            float limit = lod->lod_distance;
+            while (l < lod->class_max_lod[c] && d >= limit) {
+                ++l;
+                limit *= 2.0f;
+            }
+            lod->patch_lod[pr * lod->patch_cols + pc] = (uint8_t)l;
+        }
+    }
+
+    // 2. Only refine: pull patches down until no neighbour is more than one lod finer
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int pr = 0; pr < lod->patch_rows; ++pr) {
+            for (int pc = 0; pc < lod->patch_cols; ++pc) {
+                int l = lod->patch_lod[pr * lod->patch_cols + pc];
+                int nb[4] = {
+                    water_lod_neighbour(lod, pr - 1, pc), water_lod_neighbour(lod, pr + 1, pc),
+                    water_lod_neighbour(lod, pr, pc - 1), water_lod_neighbour(lod, pr, pc + 1),
+                };
+                for (int k = 0; k < 4; ++k) {
+                    if (nb[k] >= 0 && l > nb[k] + 1)
+                        l = nb[k] + 1;
+                }
+                if (l != lod->patch_lod[pr * lod->patch_cols + pc]) {
+                    lod->patch_lod[pr * lod->patch_cols + pc] = (uint8_t)l;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // 3. Stitch edges facing a coarser neighbour and emit the draws
+    uint32_t n_tris = 0;
+    for (int pr = 0; pr < lod->patch_rows; ++pr) {
+        for (int pc = 0; pc < lod->patch_cols; ++pc) {
+            int l = lod->patch_lod[pr * lod->patch_cols + pc];
+            int mask = 0;
+            mask |= (water_lod_neighbour(lod, pr - 1, pc) > l) ? WATER_LOD_EDGE_TOP : 0;
+            mask |= (water_lod_neighbour(lod, pr + 1, pc) > l) ? WATER_LOD_EDGE_BOTTOM : 0;
+            mask |= (water_lod_neighbour(lod, pr, pc - 1) > l) ? WATER_LOD_EDGE_LEFT : 0;
+            mask |= (water_lod_neighbour(lod, pr, pc + 1) > l) ? WATER_LOD_EDGE_RIGHT : 0;
+
+            int c = water_lod_patch_class(lod, pr, pc);
+            WaterLodTemplate const * t = &lod->templates[(c * lod->n_lods + l) * WATER_LOD_EDGE_MASKS + mask];
+            WaterLodDraw * draw = &out_draws[pr * lod->patch_cols + pc];
+            draw->index_count = t->index_count;
+            draw->start_index = t->start_index;
+            draw->base_vertex = pr * lod->patch_quads * lod->ncol + pc * lod->patch_quads;
+            n_tris += t->index_count / 3;
+        }
+    }
+    return n_tris;
+}
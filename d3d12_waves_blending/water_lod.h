@@ -0,0 +1,96 @@
+#pragma once
+#include "headers/common.h"
+#include <DirectXMath.h>
+
+// Chunked LOD for a regular nrow x ncol vertex grid (the waves grid).
+// The grid is split in patches of patch_quads x patch_quads quads; a patch at lod l uses every
+// (1 << l)th vertex. All patches index the same full-res vertex buffer, so one index template
+// (relative to the patch's top-left vertex, row pitch ncol) serves every patch of the same size;
+// the patch is drawn with its first vertex as BaseVertexLocation.
+//
+// Neighbours differ by at most one lod. An edge next to a coarser patch skips the vertices the
+// neighbour doesn't have (its odd vertices are folded onto the previous even one), which closes
+// the T-junction cracks without extra vertices.
+
+#define WATER_LOD_DEFAULT_PATCH_QUADS   32
+#define WATER_LOD_DEFAULT_COUNT         4       // strides 1, 2, 4, 8
+#define WATER_LOD_MAX_COUNT             6
+// Post-transform cache entries the templates are ordered for
+#define WATER_LOD_VCACHE_SIZE           16
+
+// Edge mask bits: set when the neighbour on that side is one lod coarser.
+#define WATER_LOD_EDGE_TOP      1       // row 0 side
+#define WATER_LOD_EDGE_BOTTOM   2
+#define WATER_LOD_EDGE_LEFT     4       // col 0 side
+#define WATER_LOD_EDGE_RIGHT    8
+#define WATER_LOD_EDGE_MASKS    16
+
+// Patches on the last row/column can be narrower when (nrow - 1) or (ncol - 1) is not a
+// multiple of patch_quads; each class gets its own templates.
+enum WATER_LOD_PATCH_CLASS : int {
+    WATER_LOD_PATCH_FULL = 0,
+    WATER_LOD_PATCH_LAST_COL = 1,
+    WATER_LOD_PATCH_LAST_ROW = 2,
+    WATER_LOD_PATCH_CORNER = 3,
+
+    _COUNT_WATER_LOD_PATCH_CLASS
+};
+
+struct WaterLodTemplate {
+    uint32_t start_index;
+    uint32_t index_count;
+};
+
+// DrawIndexedInstanced parameters of one patch
+struct WaterLodDraw {
+    uint32_t index_count;
+    uint32_t start_index;
+    int base_vertex;
+};
+
+struct WaterLod {
+    int nrow;
+    int ncol;
+    float spatial_step;
+    int patch_quads;
+    int patch_rows;
+    int patch_cols;
+    int n_lods;
+
+    // A patch at least lod_distance away (from its bounding circle) uses lod 1,
+    // twice that lod 2 and so on.
+    float lod_distance;
+
+    // Per class: patch size in quads and the coarsest lod its size allows
+    int class_quads_x[_COUNT_WATER_LOD_PATCH_CLASS];
+    int class_quads_z[_COUNT_WATER_LOD_PATCH_CLASS];
+    int class_max_lod[_COUNT_WATER_LOD_PATCH_CLASS];
+
+    // [class][lod][edge mask], index_count 0 for lods a class can't use
+    WaterLodTemplate * templates;
+    uint32_t * indices;
+    uint32_t n_indices;
+
+    uint8_t * patch_lod;        // result of the last WaterLod_Select
+};
+
+size_t
+WaterLod_CalculateRequiredSize (int m, int n, int patch_quads, int n_lods);
+// patch_quads must be a multiple of 1 << (n_lods - 1).
+WaterLod *
+WaterLod_Init (uint8_t * memory, int m, int n, float dx, int patch_quads, int n_lods, float lod_distance);
+// Index buffer shared by all patches (32-bit, n_indices entries)
+uint32_t *
+WaterLod_GetIndices (WaterLod * lod);
+uint32_t
+WaterLod_GetIndexCount (WaterLod * lod);
+int
+WaterLod_GetPatchCount (WaterLod * lod);
+// Grid space box of a patch (same index as its draw), half_height above and below y = 0.
+void
+WaterLod_GetPatchBounds (WaterLod * lod, int patch, float half_height, DirectX::XMFLOAT3 * out_center, DirectX::XMFLOAT3 * out_extents);
+// Picks every patch's lod from its distance to eye_pos (in grid space, i.e. the water's local
+// space), limits neighbours to one lod apart and writes one draw per patch to out_draws
+// (WaterLod_GetPatchCount entries). Returns the # of triangles drawn.
+uint32_t
+WaterLod_Select (WaterLod * lod, DirectX::XMFLOAT3 eye_pos, WaterLodDraw out_draws []);
@@ -1,20 +1,139 @@
 #include "waves.h"
 
+#include <string.h>
 
-#include <ppl.h>    // Parallel Patterns Library
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WAVES_X86_SIMD  1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define WAVES_X86_SIMD  0
+#endif
+
+// MSVC lets us emit avx intrinsics anywhere; gcc/clang need per-function target
+#if defined(__GNUC__) || defined(__clang__)
+#define WAVES_TARGET_AVX    __attribute__((target("avx")))
+#else
+#define WAVES_TARGET_AVX
+#endif
+
+#define WAVES_CACHE_LINE    64
+
+// Vertices staged per streaming write. A multiple of 4 keeps every block a multiple of 16 bytes
+// for all vertex layouts, so blocks start 16-byte aligned in the destination.
+#define WAVES_EXPORT_BLOCK  16
+
+// Per-band working set targeted by WAVES_BANDS_AUTO (half of a typical 256KB L2)
+#define WAVES_BAND_CACHE_BUDGET     (128 * 1024)
 
 
 using namespace DirectX;
-using namespace concurrency;
+using namespace DirectX::PackedVector;
 
+static size_t
+waves_align (size_t size) {
+    return (size + (WAVES_CACHE_LINE - 1)) & ~((size_t)WAVES_CACHE_LINE - 1);
+}
+static size_t
+waves_solution_size (int n_vtx, WAVES_LAYOUT layout) {
+    return (WAVES_LAYOUT_SOA == layout) ? sizeof(float) * n_vtx : sizeof(XMFLOAT3) * n_vtx;
+}
+static size_t
+waves_normal_size (int n_vtx, WAVES_NORMAL_FORMAT format) {
+    switch (format) {
+    case WAVES_NORMAL_HALF4: return sizeof(XMHALF4) * n_vtx;
+    case WAVES_NORMAL_UDECN4: return sizeof(XMUDECN4) * n_vtx;
+    default: return sizeof(XMFLOAT3) * n_vtx;
+    }
+}
+static size_t
+waves_texc_size (int n_vtx, WAVES_NORMAL_FORMAT format) {
+    return (WAVES_NORMAL_FLOAT3 == format) ? sizeof(XMFLOAT2) * n_vtx : sizeof(XMHALF2) * n_vtx;
+}
+static int
+waves_tile_count (int m, int n) {
+    return ((m + WAVES_TILE_SIZE - 1) / WAVES_TILE_SIZE) * ((n + WAVES_TILE_SIZE - 1) / WAVES_TILE_SIZE);
+}
+static bool
+waves_cpu_has_avx () {
+#if WAVES_X86_SIMD
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    // The OS has to save ymm registers on context switch too.
+    return osxsave && avx && ((_xgetbv(0) & 0x6) == 0x6);
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+#else
+    return false;
+#endif
+}
+static WAVES_KERNEL
+waves_resolve_kernel (WAVES_LAYOUT layout, WAVES_KERNEL requested) {
+    if (WAVES_LAYOUT_SOA != layout)
+        return WAVES_KERNEL_SCALAR;
+#if WAVES_X86_SIMD
+    // SSE2 is baseline on every x86 target we build for.
+    if (WAVES_KERNEL_AUTO == requested || WAVES_KERNEL_AVX == requested)
+        return waves_cpu_has_avx() ? WAVES_KERNEL_AVX : WAVES_KERNEL_SSE;
+    return requested;
+#else
+    return WAVES_KERNEL_SCALAR;
+#endif
+}
 size_t
-Waves_CalculateRequiredSize (int m, int n) {
+Waves_CalculateRequiredSize (int m, int n, WAVES_LAYOUT layout, WAVES_NORMAL_FORMAT normal_format) {
     int n_vtx = m * n;
     SIMPLE_ASSERT(n_vtx > 0, "Invalid waves dimensions");
-    return sizeof(Waves) + 4 * (sizeof(XMFLOAT3) * n_vtx);
+    return waves_align(sizeof(Waves)) +
+        2 * waves_align(waves_solution_size(n_vtx, layout)) +
+        2 * waves_align(waves_normal_size(n_vtx, normal_format)) +
+        waves_align(waves_texc_size(n_vtx, normal_format)) +
+        2 * waves_align(sizeof(uint8_t) * waves_tile_count(m, n)) +
+        waves_align(sizeof(uint32_t) * waves_tile_count(m, n));
+}
+// Packed formats drop w (HALF4 stores 0, UDECN4 has 2 unused bits).
+static void
+waves_store_normal (Waves * wave, int idx, FXMVECTOR n, FXMVECTOR t) {
+    switch (wave->normal_format) {
+    case WAVES_NORMAL_HALF4: {
+        XMStoreHalf4(&wave->normal_h[idx], XMVectorSetW(n, 0.0f));
+        XMStoreHalf4(&wave->tangent_h[idx], XMVectorSetW(t, 0.0f));
+    } break;
+    case WAVES_NORMAL_UDECN4: {
+        XMVECTOR half = XMVectorReplicate(0.5f);
+        XMStoreUDecN4(&wave->normal_p[idx], XMVectorSetW(XMVectorMultiplyAdd(n, half, half), 0.0f));
+        XMStoreUDecN4(&wave->tangent_p[idx], XMVectorSetW(XMVectorMultiplyAdd(t, half, half), 0.0f));
+    } break;
+    default: {
+        XMStoreFloat3(&wave->normal[idx], n);
+        XMStoreFloat3(&wave->tangent_x[idx], t);
+    } break;
+    }
+}
+static XMFLOAT3
+waves_load_normal (Waves * wave, XMFLOAT3 const * f, XMHALF4 const * h, XMUDECN4 const * p, int idx) {
+    XMFLOAT3 ret;
+    switch (wave->normal_format) {
+    case WAVES_NORMAL_HALF4: {
+        XMStoreFloat3(&ret, XMLoadHalf4(&h[idx]));
+    } break;
+    case WAVES_NORMAL_UDECN4: {
+        XMStoreFloat3(&ret, XMVectorMultiplyAdd(XMLoadUDecN4(&p[idx]), XMVectorReplicate(2.0f), XMVectorReplicate(-1.0f)));
+    } break;
+    default: {
+        ret = f[idx];
+    } break;
+    }
+    return ret;
 }
 Waves *
-Waves_Init (BYTE * memory, int m, int n, float dx, float dt, float speed, float damping) {
+Waves_Init (uint8_t * memory, int m, int n, float dx, float dt, float speed, float damping, WAVES_LAYOUT layout, WAVES_KERNEL kernel, WAVES_NORMAL_FORMAT normal_format) {
 
     Waves * ret = nullptr;
     ret = reinterpret_cast<Waves *>(memory);
@@ -22,14 +141,75 @@ Waves_Init (BYTE * memory, int m, int n, float dx, float dt, float speed, float
     ret->ncol = n;
     ret->nvtx = m * n;
     ret->ntri = (m - 1) * (n - 1) * 2;
+    ret->layout = layout;
+    ret->kernel = waves_resolve_kernel(layout, kernel);
+    ret->normal_format = normal_format;
+    ret->band_rows = WAVES_BANDS_OFF;
+    ret->sched = nullptr;
+
+    // Setup pointers (arrays), each one starts on its own cache line
+    size_t sol_size = waves_align(waves_solution_size(ret->nvtx, layout));
+    size_t vec_size = waves_align(waves_normal_size(ret->nvtx, normal_format));
+    uint8_t * arrays = memory + waves_align(sizeof(Waves));
+    if (WAVES_LAYOUT_SOA == layout) {
+        ret->prev_sol = nullptr;
+        ret->curr_sol = nullptr;
+        ret->prev_h = reinterpret_cast<float *>(arrays);
+        ret->curr_h = reinterpret_cast<float *>(arrays + sol_size);
+    } else {
+        ret->prev_sol = reinterpret_cast<XMFLOAT3 *>(arrays);
+        ret->curr_sol = reinterpret_cast<XMFLOAT3 *>(arrays + sol_size);
+        ret->prev_h = nullptr;
+        ret->curr_h = nullptr;
+    }
+    uint8_t * normal_array = arrays + 2 * sol_size;
+    uint8_t * tangent_array = arrays + 2 * sol_size + vec_size;
+    ret->normal = nullptr;
+    ret->tangent_x = nullptr;
+    ret->normal_h = nullptr;
+    ret->tangent_h = nullptr;
+    ret->normal_p = nullptr;
+    ret->tangent_p = nullptr;
+    switch (normal_format) {
+    case WAVES_NORMAL_HALF4: {
+        ret->normal_h = reinterpret_cast<XMHALF4 *>(normal_array);
+        ret->tangent_h = reinterpret_cast<XMHALF4 *>(tangent_array);
+    } break;
+    case WAVES_NORMAL_UDECN4: {
+        ret->normal_p = reinterpret_cast<XMUDECN4 *>(normal_array);
+        ret->tangent_p = reinterpret_cast<XMUDECN4 *>(tangent_array);
+    } break;
+    default: {
+        ret->normal = reinterpret_cast<XMFLOAT3 *>(normal_array);
+        ret->tangent_x = reinterpret_cast<XMFLOAT3 *>(tangent_array);
+    } break;
+    }
+    uint8_t * texc_array = arrays + 2 * sol_size + 2 * vec_size;
+    ret->texc = (WAVES_NORMAL_FLOAT3 == normal_format) ? reinterpret_cast<XMFLOAT2 *>(texc_array) : nullptr;
+    ret->texc_h = (WAVES_NORMAL_FLOAT3 == normal_format) ? nullptr : reinterpret_cast<XMHALF2 *>(texc_array);
 
-    // Setup pointers (arrays)
-    ret->prev_sol   = reinterpret_cast<XMFLOAT3 *>(memory + sizeof(Waves));
-    ret->curr_sol   = reinterpret_cast<XMFLOAT3 *>(memory + sizeof(Waves) + ret->nvtx * sizeof(XMFLOAT3));
-    ret->normal     = reinterpret_cast<XMFLOAT3 *>(memory + sizeof(Waves) + 2 * (ret->nvtx * sizeof(XMFLOAT3)));
-    ret->tangent_x  = reinterpret_cast<XMFLOAT3 *>(memory + sizeof(Waves) + 3 * (ret->nvtx * sizeof(XMFLOAT3)));
+    int n_tiles = waves_tile_count(m, n);
+    size_t tile_flags_size = waves_align(sizeof(uint8_t) * n_tiles);
+    uint8_t * tile_array = texc_array + waves_align(waves_texc_size(ret->nvtx, normal_format));
+    ret->tile_rows = (m + WAVES_TILE_SIZE - 1) / WAVES_TILE_SIZE;
+    ret->tile_cols = (n + WAVES_TILE_SIZE - 1) / WAVES_TILE_SIZE;
+    ret->tile_live = tile_array;
+    ret->tile_active = tile_array + tile_flags_size;
+    ret->tile_version = reinterpret_cast<uint32_t *>(tile_array + 2 * tile_flags_size);
+    ret->active_tiles = false;
+    ret->quiet_eps = WAVES_DEFAULT_QUIET_EPS;
+    ret->n_active_tiles = n_tiles;
+    // Everything starts dirty (version 1), so exporting since version 0 writes the whole grid.
+    ret->version = 1;
+    for (int t = 0; t < n_tiles; ++t) {
+        ret->tile_live[t] = 0;
+        ret->tile_active[t] = 0;
+        ret->tile_version[t] = ret->version;
+    }
 
     ret->time_step = dt;
+    ret->time_accum = 0.0f;
+    ret->max_substeps = WAVES_DEFAULT_MAX_SUBSTEPS;
     ret->spatial_step = dx;
 
     float d = damping * dt + 2.0f;
@@ -40,6 +220,9 @@ Waves_Init (BYTE * memory, int m, int n, float dx, float dt, float speed, float
 
     // Generate grid vertices in system memory.
 
+    XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    XMVECTOR right = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+
     float half_width = (n - 1) * dx * 0.5f;
     float half_depth = (m - 1) * dx * 0.5f;
     for (int i = 0; i < m; ++i) {
@@ -47,101 +230,475 @@ Waves_Init (BYTE * memory, int m, int n, float dx, float dt, float speed, float
         for (int j = 0; j < n; ++j) {
             float x = -half_width + j * dx;
 
-            ret->prev_sol[i * n + j] = XMFLOAT3(x, 0.0f, z);
-            ret->curr_sol[i * n + j] = XMFLOAT3(x, 0.0f, z);
-            ret->normal[i * n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            ret->tangent_x[i * n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
+            if (WAVES_LAYOUT_SOA == layout) {
+                ret->prev_h[i * n + j] = 0.0f;
+                ret->curr_h[i * n + j] = 0.0f;
+            } else {
+                ret->prev_sol[i * n + j] = XMFLOAT3(x, 0.0f, z);
+                ret->curr_sol[i * n + j] = XMFLOAT3(x, 0.0f, z);
+            }
+            waves_store_normal(ret, i * n + j, up, right);
         }
     }
 
     ret->width = ret->ncol * ret->spatial_step;
     ret->depth = ret->nrow * ret->spatial_step;
 
+    // Derive tex-coords from position by
+    // mapping [-w/2,w/2] --> [0,1]
+    for (int i = 0; i < m; ++i) {
+        float z = half_depth - i * dx;
+        for (int j = 0; j < n; ++j) {
+            float x = -half_width + j * dx;
+            XMFLOAT2 uv = XMFLOAT2(0.5f + x / ret->width, 0.5f - z / ret->depth);
+            if (ret->texc)
+                ret->texc[i * n + j] = uv;
+            else
+                XMStoreHalf2(&ret->texc_h[i * n + j], XMLoadFloat2(&uv));
+        }
+    }
+
     return ret;
 }
-DirectX::XMFLOAT3 &
+void
+Waves_SetFusedBands (Waves * wave, int band_rows) {
+    if (WAVES_BANDS_AUTO == band_rows) {
+        // Size a band so its working set (both height rows + normal + tangent rows)
+        // stays within WAVES_BAND_CACHE_BUDGET.
+        size_t bytes_per_row = (2 * waves_solution_size(1, wave->layout) + 2 * waves_normal_size(1, wave->normal_format)) * wave->ncol;
+        band_rows = (int)(WAVES_BAND_CACHE_BUDGET / bytes_per_row);
+        if (band_rows < 4)
+            band_rows = 4;
+    }
+    wave->band_rows = (band_rows > 0) ? band_rows : WAVES_BANDS_OFF;
+}
+void
+Waves_SetMaxSubsteps (Waves * wave, int max_substeps) {
+    wave->max_substeps = (max_substeps > 0) ? max_substeps : 1;
+}
+void
+Waves_SetActiveTiles (Waves * wave, bool enable, float quiet_eps) {
+    if (enable && !wave->active_tiles) {
+        // We know nothing about the current heights, so start from everything live;
+        // calm tiles drop out after the first step.
+        int n_tiles = wave->tile_rows * wave->tile_cols;
+        for (int t = 0; t < n_tiles; ++t) {
+            wave->tile_live[t] = 1;
+            wave->tile_active[t] = 1;
+        }
+    }
+    wave->active_tiles = enable;
+    wave->quiet_eps = (quiet_eps > 0.0f) ? quiet_eps : 0.0f;
+}
+void
+Waves_SetScheduler (Waves * wave, Scheduler * sched) {
+    wave->sched = sched;
+}
+DirectX::XMFLOAT3
 Waves_GetPosition (Waves * wave, int i) {
+    if (WAVES_LAYOUT_SOA == wave->layout) {
+        // x/z never change, so rebuild them from the grid instead of storing them
+        int row = i / wave->ncol;
+        int col = i % wave->ncol;
+        float half_width = (wave->ncol - 1) * wave->spatial_step * 0.5f;
+        float half_depth = (wave->nrow - 1) * wave->spatial_step * 0.5f;
+        return XMFLOAT3(-half_width + col * wave->spatial_step, wave->curr_h[i], half_depth - row * wave->spatial_step);
+    }
     return wave->curr_sol[i];
 }
-DirectX::XMFLOAT3 &
+DirectX::XMFLOAT3
 Waves_GetNormal (Waves * wave, int i) {
-    return wave->normal[i];
+    return waves_load_normal(wave, wave->normal, wave->normal_h, wave->normal_p, i);
 }
-DirectX::XMFLOAT3 &
+DirectX::XMFLOAT3
 Waves_GetTangentX (Waves * wave, int i) {
-    return wave->tangent_x[i];
+    return waves_load_normal(wave, wave->tangent_x, wave->tangent_h, wave->tangent_p, i);
+}
+static void
+waves_step_row_aos (Waves * wave, int i, int j_begin, int j_end) {
+    for (int j = j_begin; j < j_end; ++j) {
+        // After this update we will be discarding the old previous
+        // buffer, so overwrite that buffer with the new update.
+        // Note how we can do this inplace (read/write to same element) 
+        // because we won't need prev_ij again and the assignment happens last.
+
+        // Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+        // Moreover, our +z axis goes "down"; this is just to 
+        // keep consistent with our row indices going down.
+
+        wave->prev_sol[i * wave->ncol + j].y =
+            wave->k1 * wave->prev_sol[i * wave->ncol + j].y +
+            wave->k2 * wave->curr_sol[i * wave->ncol + j].y +
+            wave->k3 * (wave->curr_sol[(i + 1) * wave->ncol + j].y +
+                        wave->curr_sol[(i - 1) * wave->ncol + j].y +
+                        wave->curr_sol[i * wave->ncol + j + 1].y +
+                        wave->curr_sol[i * wave->ncol + j - 1].y);
+    }
+}
+// -- SOA stencil kernels: columns [j_begin, j_end) of one interior row (1 <= i < nrow-1) per call.
+// NOTE(omid): All kernels evaluate the exact same expression in the same order as the scalar path
+// (no fma contraction), so their results match bit-for-bit.
+static void
+waves_step_row_scalar (Waves * wave, int i, int j_begin, int j_end) {
+    int n = wave->ncol;
+    float k1 = wave->k1, k2 = wave->k2, k3 = wave->k3;
+    float * prev = wave->prev_h + i * n;
+    float const * curr = wave->curr_h + i * n;
+    float const * up = curr - n;
+    float const * down = curr + n;
+    for (int j = j_begin; j < j_end; ++j) {
+        prev[j] = k1 * prev[j] + k2 * curr[j] + k3 * (down[j] + up[j] + curr[j + 1] + curr[j - 1]);
+    }
+}
+#if WAVES_X86_SIMD
+static void
+waves_step_row_sse (Waves * wave, int i, int j_begin, int j_end) {
+    int n = wave->ncol;
+    __m128 k1 = _mm_set1_ps(wave->k1);
+    __m128 k2 = _mm_set1_ps(wave->k2);
+    __m128 k3 = _mm_set1_ps(wave->k3);
+    float * prev = wave->prev_h + i * n;
+    float const * curr = wave->curr_h + i * n;
+    float const * up = curr - n;
+    float const * down = curr + n;
+    int j = j_begin;
+    for (; j + 4 <= j_end; j += 4) {
+        __m128 neighbors = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j)),
+                                                 _mm_loadu_ps(curr + j + 1)),
+                                      _mm_loadu_ps(curr + j - 1));
+        __m128 res = _mm_add_ps(_mm_add_ps(_mm_mul_ps(k1, _mm_loadu_ps(prev + j)), _mm_mul_ps(k2, _mm_loadu_ps(curr + j))),
+                                _mm_mul_ps(k3, neighbors));
+        _mm_storeu_ps(prev + j, res);
+    }
+    waves_step_row_scalar(wave, i, j, j_end);
+}
+WAVES_TARGET_AVX static void
+waves_step_row_avx (Waves * wave, int i, int j_begin, int j_end) {
+    int n = wave->ncol;
+    __m256 k1 = _mm256_set1_ps(wave->k1);
+    __m256 k2 = _mm256_set1_ps(wave->k2);
+    __m256 k3 = _mm256_set1_ps(wave->k3);
+    float * prev = wave->prev_h + i * n;
+    float const * curr = wave->curr_h + i * n;
+    float const * up = curr - n;
+    float const * down = curr + n;
+    int j = j_begin;
+    for (; j + 8 <= j_end; j += 8) {
+        __m256 neighbors = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j)),
+                                                       _mm256_loadu_ps(curr + j + 1)),
+                                         _mm256_loadu_ps(curr + j - 1));
+        __m256 res = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(k1, _mm256_loadu_ps(prev + j)), _mm256_mul_ps(k2, _mm256_loadu_ps(curr + j))),
+                                   _mm256_mul_ps(k3, neighbors));
+        _mm256_storeu_ps(prev + j, res);
+    }
+    waves_step_row_scalar(wave, i, j, j_end);
+}
+#endif
+static void
+waves_step_row_soa (Waves * wave, int i, int j_begin, int j_end) {
+    switch (wave->kernel) {
+#if WAVES_X86_SIMD
+    case WAVES_KERNEL_SSE: {
+        waves_step_row_sse(wave, i, j_begin, j_end);
+    } break;
+    case WAVES_KERNEL_AVX: {
+        waves_step_row_avx(wave, i, j_begin, j_end);
+    } break;
+#endif
+    default: {
+        waves_step_row_scalar(wave, i, j_begin, j_end);
+    } break;
+    }
+}
+static void
+waves_write_normal (Waves * wave, int idx, float l, float r, float t, float b) {
+    XMFLOAT3 normal = XMFLOAT3(-r + l, 2.0f * wave->spatial_step, b - t);
+    XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&normal));
+
+    XMFLOAT3 tangent = XMFLOAT3(2.0f * wave->spatial_step, r - l, 0.0f);
+    XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&tangent));
+
+    waves_store_normal(wave, idx, n, T);
+}
+static void
+waves_step_span (Waves * wave, int i, int j_begin, int j_end) {
+    if (WAVES_LAYOUT_SOA == wave->layout)
+        waves_step_row_soa(wave, i, j_begin, j_end);
+    else
+        waves_step_row_aos(wave, i, j_begin, j_end);
+}
+static void
+waves_step_row (Waves * wave, int i) {
+    waves_step_span(wave, i, 1, wave->ncol - 1);
+}
+// Normals/tangents of columns [j_begin, j_end) of row i from the given height buffer (sol for AOS, h for SOA).
+static void
+waves_normals_span_from (Waves * wave, int i, int j_begin, int j_end, XMFLOAT3 const * sol, float const * heights) {
+    int n = wave->ncol;
+    if (WAVES_LAYOUT_SOA == wave->layout) {
+        float const * h = heights + i * n;
+        for (int j = j_begin; j < j_end; ++j) {
+            waves_write_normal(wave, i * n + j, h[j - 1], h[j + 1], h[j - n], h[j + n]);
+        }
+    } else {
+        for (int j = j_begin; j < j_end; ++j) {
+            float l = sol[i * n + j - 1].y;
+            float r = sol[i * n + j + 1].y;
+            float t = sol[(i - 1) * n + j].y;
+            float b = sol[(i + 1) * n + j].y;
+            waves_write_normal(wave, i * n + j, l, r, t, b);
+        }
+    }
+}
+static void
+waves_normals_row_from (Waves * wave, int i, XMFLOAT3 const * sol, float const * heights) {
+    waves_normals_span_from(wave, i, 1, wave->ncol - 1, sol, heights);
+}
+static void
+waves_normals_row (Waves * wave, int i) {
+    waves_normals_row_from(wave, i, wave->curr_sol, wave->curr_h);
+}
+// -- Fused (banded) update
+// Interior rows [1, nrow-1) are split in bands of band_rows. A band steps its rows and
+// computes normals one row behind while the freshly written rows are still in cache.
+// Normal of row r needs the new heights of rows r-1 and r+1; those are only known
+// in-band if they belong to the same band or are a (never changing) boundary row.
+// The other rows (at most the first and last row of a band) are deferred to a
+// second, tiny pass after all bands are done.
+static bool
+waves_band_row_deferred (Waves * wave, int r, int b0, int b1) {
+    bool above_ready = (r - 1 >= b0) || (0 == r - 1);
+    bool below_ready = (r + 1 < b1) || (wave->nrow - 1 == r + 1);
+    return !(above_ready && below_ready);
+}
+static void
+waves_fused_band (Waves * wave, int b0, int b1) {
+    for (int i = b0; i < b1; ++i) {
+        waves_step_row(wave, i);
+        // New heights are still in "prev" buffer at this point (rotation happens after the step)
+        if (i - 1 >= b0 && !waves_band_row_deferred(wave, i - 1, b0, b1))
+            waves_normals_row_from(wave, i - 1, wave->prev_sol, wave->prev_h);
+    }
+    if (!waves_band_row_deferred(wave, b1 - 1, b0, b1))
+        waves_normals_row_from(wave, b1 - 1, wave->prev_sol, wave->prev_h);
+}
+static void
+waves_fused_band_edges (Waves * wave, int b0, int b1) {
+    if (waves_band_row_deferred(wave, b0, b0, b1))
+        waves_normals_row_from(wave, b0, wave->prev_sol, wave->prev_h);
+    if (b1 - 1 != b0 && waves_band_row_deferred(wave, b1 - 1, b0, b1))
+        waves_normals_row_from(wave, b1 - 1, wave->prev_sol, wave->prev_h);
+}
+static Scheduler *
+waves_scheduler (Waves * wave) {
+    return wave->sched ? wave->sched : Scheduler_GetDefault();
+}
+static void
+waves_update_fused (Waves * wave) {
+    int n_interior = wave->nrow - 2;
+    int band_rows = wave->band_rows;
+    int n_bands = (n_interior + band_rows - 1) / band_rows;
+
+    // A band is already sized to fill the cache, so hand them out one at a time.
+    Scheduler * sched = waves_scheduler(wave);
+    Scheduler_ParallelFor(sched, 0, n_bands, 1, [wave, band_rows](int band) {
+        int b0 = 1 + band * band_rows;
+        int b1 = (b0 + band_rows < wave->nrow - 1) ? b0 + band_rows : wave->nrow - 1;
+        waves_fused_band(wave, b0, b1);
+    });
+    Scheduler_ParallelFor(sched, 0, n_bands, 1, [wave, band_rows](int band) {
+        int b0 = 1 + band * band_rows;
+        int b1 = (b0 + band_rows < wave->nrow - 1) ? b0 + band_rows : wave->nrow - 1;
+        waves_fused_band_edges(wave, b0, b1);
+    });
+}
+// We just overwrote the previous buffer with the new data, so
+// this data needs to become the current solution and the old
+// current solution becomes the new previous solution.
+// NOTE(omid): Both buffers live in the waves memory block for their whole lifetime;
+// a step only rotates which one is "prev" and which one is "curr" (no copy, no allocation).
+// In AOS layout x/z are identical in both buffers so rotating them is safe.
+static void
+waves_rotate_solutions (Waves * wave) {
+    XMFLOAT3 * sol = wave->prev_sol;
+    wave->prev_sol = wave->curr_sol;
+    wave->curr_sol = sol;
+
+    float * h = wave->prev_h;
+    wave->prev_h = wave->curr_h;
+    wave->curr_h = h;
+}
+// -- Active tiles
+// Interior part (rows [r0, r1), cols [c0, c1)) of tile t.
+static void
+waves_tile_interior (Waves * wave, int t, int * r0, int * r1, int * c0, int * c1) {
+    int tr = t / wave->tile_cols;
+    int tc = t % wave->tile_cols;
+    *r0 = (tr * WAVES_TILE_SIZE > 1) ? tr * WAVES_TILE_SIZE : 1;
+    *r1 = ((tr + 1) * WAVES_TILE_SIZE < wave->nrow - 1) ? (tr + 1) * WAVES_TILE_SIZE : wave->nrow - 1;
+    *c0 = (tc * WAVES_TILE_SIZE > 1) ? tc * WAVES_TILE_SIZE : 1;
+    *c1 = ((tc + 1) * WAVES_TILE_SIZE < wave->ncol - 1) ? (tc + 1) * WAVES_TILE_SIZE : wave->ncol - 1;
+}
+// Largest |height| of the tile in both solution buffers (the next step reads both).
+static float
+waves_tile_amplitude (Waves * wave, int r0, int r1, int c0, int c1) {
+    int n = wave->ncol;
+    float amp = 0.0f;
+    for (int i = r0; i < r1; ++i) {
+        for (int j = c0; j < c1; ++j) {
+            float a = (WAVES_LAYOUT_SOA == wave->layout) ? fabsf(wave->prev_h[i * n + j]) : fabsf(wave->prev_sol[i * n + j].y);
+            float b = (WAVES_LAYOUT_SOA == wave->layout) ? fabsf(wave->curr_h[i * n + j]) : fabsf(wave->curr_sol[i * n + j].y);
+            if (a > amp) amp = a;
+            if (b > amp) amp = b;
+        }
+    }
+    return amp;
+}
+// A calm tile that is no longer stepped: remove the residual so it stays exactly flat.
+static void
+waves_flatten_tile (Waves * wave, int t) {
+    int r0, r1, c0, c1;
+    waves_tile_interior(wave, t, &r0, &r1, &c0, &c1);
+    XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    XMVECTOR right = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+    int n = wave->ncol;
+    for (int i = r0; i < r1; ++i) {
+        for (int j = c0; j < c1; ++j) {
+            if (WAVES_LAYOUT_SOA == wave->layout) {
+                wave->prev_h[i * n + j] = 0.0f;
+                wave->curr_h[i * n + j] = 0.0f;
+            } else {
+                wave->prev_sol[i * n + j].y = 0.0f;
+                wave->curr_sol[i * n + j].y = 0.0f;
+            }
+            waves_store_normal(wave, i * n + j, up, right);
+        }
+    }
+}
+static bool
+waves_tile_near_live (Waves * wave, int tr, int tc) {
+    for (int r = tr - 1; r <= tr + 1; ++r) {
+        for (int c = tc - 1; c <= tc + 1; ++c) {
+            if (r >= 0 && r < wave->tile_rows && c >= 0 && c < wave->tile_cols && wave->tile_live[r * wave->tile_cols + c])
+                return true;
+        }
+    }
+    return false;
+}
+// Waves move one vertex per step and a tile is wider than that, so stepping the live tiles
+// plus one ring of neighbours gives the same heights as stepping the whole grid.
+static void
+waves_step_tiled (Waves * wave, uint32_t version) {
+    int n_active = 0;
+    for (int tr = 0; tr < wave->tile_rows; ++tr) {
+        for (int tc = 0; tc < wave->tile_cols; ++tc) {
+            int t = tr * wave->tile_cols + tc;
+            bool active = waves_tile_near_live(wave, tr, tc);
+            if (wave->tile_active[t] && !active) {
+                waves_flatten_tile(wave, t);
+                wave->tile_version[t] = version;
+            }
+            wave->tile_active[t] = active ? 1 : 0;
+            n_active += active ? 1 : 0;
+        }
+    }
+    wave->n_active_tiles = n_active;
+    if (0 == n_active)
+        return;
+
+    // One tile row per task, the rows of a tile row are only touched by that task.
+    Scheduler * sched = waves_scheduler(wave);
+    Scheduler_ParallelFor(sched, 0, wave->tile_rows, 1, [wave, version](int tr) {
+        for (int t = tr * wave->tile_cols; t < (tr + 1) * wave->tile_cols; ++t) {
+            if (!wave->tile_active[t])
+                continue;
+            int r0, r1, c0, c1;
+            waves_tile_interior(wave, t, &r0, &r1, &c0, &c1);
+            for (int i = r0; i < r1; ++i)
+                waves_step_span(wave, i, c0, c1);
+            wave->tile_live[t] = (waves_tile_amplitude(wave, r0, r1, c0, c1) > wave->quiet_eps) ? 1 : 0;
+            wave->tile_version[t] = version;
+        }
+    });
+    waves_rotate_solutions(wave);
+    Scheduler_ParallelFor(sched, 0, wave->tile_rows, 1, [wave](int tr) {
+        for (int t = tr * wave->tile_cols; t < (tr + 1) * wave->tile_cols; ++t) {
+            if (!wave->tile_active[t])
+                continue;
+            int r0, r1, c0, c1;
+            waves_tile_interior(wave, t, &r0, &r1, &c0, &c1);
+            for (int i = r0; i < r1; ++i)
+                waves_normals_span_from(wave, i, c0, c1, wave->curr_sol, wave->curr_h);
+        }
+    });
+}
+static void
+waves_touch_all_tiles (Waves * wave, uint32_t version) {
+    int n_tiles = wave->tile_rows * wave->tile_cols;
+    for (int t = 0; t < n_tiles; ++t)
+        wave->tile_version[t] = version;
+    wave->n_active_tiles = n_tiles;
 }
 void
-Waves_Update (Waves * wave, float dt, XMFLOAT3 temp []) {
-    static float t = 0;
+Waves_Step (Waves * wave) {
+    uint32_t version = ++wave->version;
+    if (wave->active_tiles) {
+        waves_step_tiled(wave, version);
+        return;
+    }
+    waves_touch_all_tiles(wave, version);
 
-    // Accumulate time.
-    t += dt;
-
-    // Only update the simulation at the specified time step.
-    if (t >= wave->time_step) {
-        // Only update interior points; we use zero boundary conditions.
-        concurrency::parallel_for(1, wave->nrow - 1, [wave](int i)
-        //for(int i = 1; i < wave->nrow-1; ++i)
-                                  {
-                                      for (int j = 1; j < wave->ncol - 1; ++j) {
-                                          // After this update we will be discarding the old previous
-                                          // buffer, so overwrite that buffer with the new update.
-                                          // Note how we can do this inplace (read/write to same element) 
-                                          // because we won't need prev_ij again and the assignment happens last.
-
-                                          // Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-                                          // Moreover, our +z axis goes "down"; this is just to 
-                                          // keep consistent with our row indices going down.
-
-                                          wave->prev_sol[i * wave->ncol + j].y =
-                                              wave->k1 * wave->prev_sol[i * wave->ncol + j].y +
-                                              wave->k2 * wave->curr_sol[i * wave->ncol + j].y +
-                                              wave->k3 * (wave->curr_sol[(i + 1) * wave->ncol + j].y +
-                                                          wave->curr_sol[(i - 1) * wave->ncol + j].y +
-                                                          wave->curr_sol[i * wave->ncol + j + 1].y +
-                                                          wave->curr_sol[i * wave->ncol + j - 1].y);
-                                      }
-                                  });
-
-        // We just overwrote the previous buffer with the new data, so
-        // this data needs to become the current solution and the old
-        // current solution becomes the new previous solution.
-
-        // Swap prev with curr solution
-        for (int i = 0; i < wave->nvtx; i++) {
-        //write any swapping technique
-            temp[i] = wave->prev_sol[i];
-            wave->prev_sol[i] = wave->curr_sol[i];
-            wave->curr_sol[i] = temp[i];
-        }
-
-        t = 0.0f; // reset time
+    // Only update interior points; we use zero boundary conditions.
+    if (wave->band_rows > 0) {
+        // Heights and normals in one cache-blocked sweep.
+        waves_update_fused(wave);
+        waves_rotate_solutions(wave);
+    } else {
+        // Rows go out in contiguous chunks, so neighbouring rows (which may share
+        // the cache line at their seam) mostly stay on the same thread.
+        Scheduler * sched = waves_scheduler(wave);
+        Scheduler_ParallelFor(sched, 1, wave->nrow - 1, SCHEDULER_GRAIN_AUTO, [wave](int i) {
+            waves_step_row(wave, i);
+        });
+        waves_rotate_solutions(wave);
 
         //
         // Compute normals using finite difference scheme.
         //
-        concurrency::parallel_for(1, wave->nrow - 1, [wave](int i)
-        //for(int i = 1; i < wave->nrow - 1; ++i)
-                                  {
-                                      for (int j = 1; j < wave->ncol - 1; ++j) {
-                                          float l = wave->curr_sol[i * wave->ncol + j - 1].y;
-                                          float r = wave->curr_sol[i * wave->ncol + j + 1].y;
-                                          float t = wave->curr_sol[(i - 1) * wave->ncol + j].y;
-                                          float b = wave->curr_sol[(i + 1) * wave->ncol + j].y;
-                                          wave->normal[i * wave->ncol + j].x = -r + l;
-                                          wave->normal[i * wave->ncol + j].y = 2.0f * wave->spatial_step;
-                                          wave->normal[i * wave->ncol + j].z = b - t;
-
-                                          XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&wave->normal[i * wave->ncol + j]));
-                                          XMStoreFloat3(&wave->normal[i * wave->ncol + j], n);
-
-                                          wave->tangent_x[i * wave->ncol + j] = XMFLOAT3(2.0f * wave->spatial_step, r - l, 0.0f);
-                                          XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&wave->tangent_x[i * wave->ncol + j]));
-                                          XMStoreFloat3(&wave->tangent_x[i * wave->ncol + j], T);
-                                      }
-                                  });
+        Scheduler_ParallelFor(sched, 1, wave->nrow - 1, SCHEDULER_GRAIN_AUTO, [wave](int i) {
+            waves_normals_row(wave, i);
+        });
+    }
+}
+int
+Waves_Update (Waves * wave, float dt) {
+    // Accumulate time.
+    wave->time_accum += dt;
+
+    // Only update the simulation at the specified time step,
+    // catching up with several steps after a slow frame.
+    int n_steps = 0;
+    while (wave->time_accum >= wave->time_step && n_steps < wave->max_substeps) {
+        Waves_Step(wave);
+        wave->time_accum -= wave->time_step;
+        ++n_steps;
     }
+
+    // Out of budget: drop the whole steps we could not afford so the backlog does not
+    // keep growing (simulation slows down instead of spiraling), keep the fraction.
+    if (wave->time_accum >= wave->time_step)
+        wave->time_accum = fmodf(wave->time_accum, wave->time_step);
+
+    return n_steps;
+}
+float
+Waves_GetInterpolationAlpha (Waves * wave) {
+    return wave->time_accum / wave->time_step;
+}
+void
+Waves_Update (Waves * wave, float dt, XMFLOAT3 temp []) {
+    (void)temp;
+    Waves_Update(wave, dt);
 }
 void
 Waves_Disturb (Waves * wave, int i, int j, float magnitude) {
@@ -151,11 +708,312 @@ Waves_Disturb (Waves * wave, int i, int j, float magnitude) {
 
     float half_mag = 0.5f * magnitude;
 
+    // The touched vertices span at most 2x2 tiles; wake them up and mark them changed.
+    uint32_t version = ++wave->version;
+    int tiles[4] = {
+        ((i - 1) / WAVES_TILE_SIZE) * wave->tile_cols + (j - 1) / WAVES_TILE_SIZE,
+        ((i - 1) / WAVES_TILE_SIZE) * wave->tile_cols + (j + 1) / WAVES_TILE_SIZE,
+        ((i + 1) / WAVES_TILE_SIZE) * wave->tile_cols + (j - 1) / WAVES_TILE_SIZE,
+        ((i + 1) / WAVES_TILE_SIZE) * wave->tile_cols + (j + 1) / WAVES_TILE_SIZE,
+    };
+    for (int k = 0; k < 4; ++k) {
+        wave->tile_live[tiles[k]] = 1;
+        wave->tile_version[tiles[k]] = version;
+    }
+
     // Disturb the ijth vertex height and its neighbors.
-    wave->curr_sol[i * wave->ncol + j].y += magnitude;
-    wave->curr_sol[i * wave->ncol + j + 1].y += half_mag;
-    wave->curr_sol[i * wave->ncol + j - 1].y += half_mag;
-    wave->curr_sol[(i + 1) * wave->ncol + j].y += half_mag;
-    wave->curr_sol[(i - 1) * wave->ncol + j].y += half_mag;
+    if (WAVES_LAYOUT_SOA == wave->layout) {
+        wave->curr_h[i * wave->ncol + j] += magnitude;
+        wave->curr_h[i * wave->ncol + j + 1] += half_mag;
+        wave->curr_h[i * wave->ncol + j - 1] += half_mag;
+        wave->curr_h[(i + 1) * wave->ncol + j] += half_mag;
+        wave->curr_h[(i - 1) * wave->ncol + j] += half_mag;
+    } else {
+        wave->curr_sol[i * wave->ncol + j].y += magnitude;
+        wave->curr_sol[i * wave->ncol + j + 1].y += half_mag;
+        wave->curr_sol[i * wave->ncol + j - 1].y += half_mag;
+        wave->curr_sol[(i + 1) * wave->ncol + j].y += half_mag;
+        wave->curr_sol[(i - 1) * wave->ncol + j].y += half_mag;
+    }
+}
+// Interior vertices an event can touch: rows [*i0, *i1), cols [*j0, *j1). False if there are none.
+static bool
+waves_splat_box (Waves * wave, WavesDisturbance const * e, int * i0, int * i1, int * j0, int * j1) {
+    float lo_i, hi_i, lo_j, hi_j;
+    if (WAVES_SPLAT_POINT == e->splat) {
+        float ci = floorf(e->i + 0.5f);
+        float cj = floorf(e->j + 0.5f);
+        lo_i = ci - 1.0f; hi_i = ci + 1.0f;
+        lo_j = cj - 1.0f; hi_j = cj + 1.0f;
+    } else {
+        float r = (e->radius > 1.0f) ? e->radius : 1.0f;
+        lo_i = ceilf(e->i - r); hi_i = floorf(e->i + r);
+        lo_j = ceilf(e->j - r); hi_j = floorf(e->j + r);
+    }
+    // Clamp in float first, events can be anywhere (even far outside the grid).
+    float max_i = (float)(wave->nrow - 2);
+    float max_j = (float)(wave->ncol - 2);
+    lo_i = (lo_i > 1.0f) ? lo_i : 1.0f; hi_i = (hi_i < max_i) ? hi_i : max_i;
+    lo_j = (lo_j > 1.0f) ? lo_j : 1.0f; hi_j = (hi_j < max_j) ? hi_j : max_j;
+    if (!(lo_i <= hi_i && lo_j <= hi_j))    // also rejects NaN
+        return false;
+    *i0 = (int)lo_i; *i1 = (int)hi_i + 1;
+    *j0 = (int)lo_j; *j1 = (int)hi_j + 1;
+    return true;
+}
+static float
+waves_splat_weight (WavesDisturbance const * e, int i, int j) {
+    switch (e->splat) {
+    case WAVES_SPLAT_POINT: {
+        int di = abs(i - (int)floorf(e->i + 0.5f));
+        int dj = abs(j - (int)floorf(e->j + 0.5f));
+        return (0 == di + dj) ? 1.0f : ((1 == di + dj) ? 0.5f : 0.0f);
+    }
+    case WAVES_SPLAT_BILINEAR: {
+        float inv_r = 1.0f / ((e->radius > 1.0f) ? e->radius : 1.0f);
+        float wi = 1.0f - fabsf((float)i - e->i) * inv_r;
+        float wj = 1.0f - fabsf((float)j - e->j) * inv_r;
+        // 1 / r^2 makes the tent sum to 1 on the grid (exactly for integer radii).
+        return (wi > 0.0f && wj > 0.0f) ? wi * wj * inv_r * inv_r : 0.0f;
+    }
+    case WAVES_SPLAT_GAUSSIAN: {
+        float r = (e->radius > 1.0f) ? e->radius : 1.0f;
+        float di = (float)i - e->i;
+        float dj = (float)j - e->j;
+        float d2 = di * di + dj * dj;
+        return (d2 <= r * r) ? expf(-4.5f * d2 / (r * r)) : 0.0f;
+    }
+    default:
+        return 0.0f;
+    }
 }
+struct WavesDisturbJob {
+    Waves * wave;
+    WavesDisturbance const * events;
+    int count;
+};
+// Every task owns a block of rows and walks the whole batch, so no two threads write the same
+// height and events are applied in order.
+static void
+waves_disturb_rows (void * ctx, int row_begin, int row_end) {
+    WavesDisturbJob * job = reinterpret_cast<WavesDisturbJob *>(ctx);
+    Waves * wave = job->wave;
+    for (int k = 0; k < job->count; ++k) {
+        WavesDisturbance const * e = &job->events[k];
+        int i0, i1, j0, j1;
+        if (!waves_splat_box(wave, e, &i0, &i1, &j0, &j1))
+            continue;
+        i0 = (i0 > row_begin) ? i0 : row_begin;
+        i1 = (i1 < row_end) ? i1 : row_end;
+        for (int i = i0; i < i1; ++i) {
+            for (int j = j0; j < j1; ++j) {
+                float w = waves_splat_weight(e, i, j);
+                if (0.0f == w)
+                    continue;
+                if (WAVES_LAYOUT_SOA == wave->layout)
+                    wave->curr_h[i * wave->ncol + j] += w * e->magnitude;
+                else
+                    wave->curr_sol[i * wave->ncol + j].y += w * e->magnitude;
+            }
+        }
+    }
+}
+void
+Waves_DisturbMany (Waves * wave, WavesDisturbance const events [], int count) {
+    // Wake up and version the touched tiles first (cheap, and tiles are shared between row blocks).
+    bool touched = false;
+    uint32_t version = wave->version + 1;
+    for (int k = 0; k < count; ++k) {
+        int i0, i1, j0, j1;
+        if (!waves_splat_box(wave, &events[k], &i0, &i1, &j0, &j1))
+            continue;
+        for (int tr = i0 / WAVES_TILE_SIZE; tr <= (i1 - 1) / WAVES_TILE_SIZE; ++tr) {
+            for (int tc = j0 / WAVES_TILE_SIZE; tc <= (j1 - 1) / WAVES_TILE_SIZE; ++tc) {
+                wave->tile_live[tr * wave->tile_cols + tc] = 1;
+                wave->tile_version[tr * wave->tile_cols + tc] = version;
+            }
+        }
+        touched = true;
+    }
+    if (!touched)
+        return;
+    wave->version = version;
+
+    WavesDisturbJob job = {};
+    job.wave = wave;
+    job.events = events;
+    job.count = count;
+    Scheduler_ParallelForRange(waves_scheduler(wave), 1, wave->nrow - 1, SCHEDULER_GRAIN_AUTO, &job, waves_disturb_rows);
+}
+size_t
+Waves_GetVertexStride (Waves * wave) {
+    switch (wave->normal_format) {
+    case WAVES_NORMAL_HALF4: return sizeof(WavesVertexHalf);
+    case WAVES_NORMAL_UDECN4: return sizeof(WavesVertexDec);
+    default: return sizeof(WavesVertex);
+    }
+}
+// Builds vertices [v0, v1) into out (tightly packed, Waves_GetVertexStride apart).
+static void
+waves_build_vertices (Waves * wave, int v0, int v1, uint8_t * out) {
+    int n = wave->ncol;
+    float dx = wave->spatial_step;
+    float half_width = (n - 1) * dx * 0.5f;
+    float half_depth = (wave->nrow - 1) * dx * 0.5f;
+    int row = v0 / n;
+    int col = v0 % n;
+    for (int v = v0; v < v1; ++v) {
+        XMFLOAT3 pos;
+        if (WAVES_LAYOUT_SOA == wave->layout)
+            pos = XMFLOAT3(-half_width + col * dx, wave->curr_h[v], half_depth - row * dx);
+        else
+            pos = wave->curr_sol[v];
+
+        switch (wave->normal_format) {
+        case WAVES_NORMAL_HALF4: {
+            WavesVertexHalf * vtx = reinterpret_cast<WavesVertexHalf *>(out);
+            vtx->position = pos;
+            vtx->normal = wave->normal_h[v];
+            vtx->texc = wave->texc_h[v];
+            out += sizeof(WavesVertexHalf);
+        } break;
+        case WAVES_NORMAL_UDECN4: {
+            WavesVertexDec * vtx = reinterpret_cast<WavesVertexDec *>(out);
+            vtx->position = pos;
+            vtx->normal = wave->normal_p[v];
+            vtx->texc = wave->texc_h[v];
+            out += sizeof(WavesVertexDec);
+        } break;
+        default: {
+            WavesVertex * vtx = reinterpret_cast<WavesVertex *>(out);
+            vtx->position = pos;
+            vtx->normal = wave->normal[v];
+            vtx->texc = wave->texc[v];
+            out += sizeof(WavesVertex);
+        } break;
+        }
+
+        if (++col == n) {
+            col = 0;
+            ++row;
+        }
+    }
+}
+// Builds [v0, v1) block by block; each block is staged in cache then streamed out, so the
+// (write-combined) upload heap only sees full 16-byte non-temporal writes and never pollutes
+// the cpu caches. Unaligned pieces fall back to memcpy. The caller issues the fence.
+static void
+waves_export_span (Waves * wave, uint8_t * dst_base, size_t stride, int v0, int v1) {
+    alignas(16) uint8_t stage[WAVES_EXPORT_BLOCK * sizeof(WavesVertex)];
+
+    for (int b0 = v0; b0 < v1; b0 += WAVES_EXPORT_BLOCK) {
+        int b1 = (b0 + WAVES_EXPORT_BLOCK < v1) ? b0 + WAVES_EXPORT_BLOCK : v1;
+        size_t bytes = (size_t)(b1 - b0) * stride;
+        uint8_t * dst = dst_base + (size_t)b0 * stride;
+        waves_build_vertices(wave, b0, b1, stage);
 
+#if WAVES_X86_SIMD
+        if (0 == ((uintptr_t)dst & 15) && 0 == (bytes & 15)) {
+            for (size_t k = 0; k < bytes; k += 16)
+                _mm_stream_si128(reinterpret_cast<__m128i *>(dst + k), _mm_load_si128(reinterpret_cast<__m128i const *>(stage + k)));
+            continue;
+        }
+#endif
+        ::memcpy(dst, stage, bytes);
+    }
+}
+static void
+waves_export_fence () {
+#if WAVES_X86_SIMD
+    // Streaming stores are weakly ordered; make them visible before this thread reports the range done.
+    _mm_sfence();
+#endif
+}
+struct WavesExportJob {
+    Waves * wave;
+    uint8_t * dst;
+    size_t stride;
+    uint32_t since_version;
+};
+static void
+waves_export_blocks (void * ctx, int b0, int b1) {
+    WavesExportJob * job = reinterpret_cast<WavesExportJob *>(ctx);
+    int v0 = b0 * WAVES_EXPORT_BLOCK;
+    int v1 = (b1 * WAVES_EXPORT_BLOCK < job->wave->nvtx) ? b1 * WAVES_EXPORT_BLOCK : job->wave->nvtx;
+    waves_export_span(job->wave, job->dst, job->stride, v0, v1);
+    waves_export_fence();
+}
+void
+Waves_ExportVertices (Waves * wave, void * dst) {
+    WavesExportJob job = {};
+    job.wave = wave;
+    job.dst = reinterpret_cast<uint8_t *>(dst);
+    job.stride = Waves_GetVertexStride(wave);
+
+    int n_blocks = (wave->nvtx + WAVES_EXPORT_BLOCK - 1) / WAVES_EXPORT_BLOCK;
+    Scheduler_ParallelForRange(waves_scheduler(wave), 0, n_blocks, SCHEDULER_GRAIN_AUTO, &job, waves_export_blocks);
+}
+uint32_t
+Waves_GetVersion (Waves * wave) {
+    return wave->version;
+}
+// Calls fn(v0, v1) for every dirty vertex span of row i (runs of dirty tiles in the tile row).
+template <typename F>
+static void
+waves_for_dirty_spans (Waves * wave, int i, uint32_t since_version, F const & fn) {
+    uint32_t const * versions = wave->tile_version + (i / WAVES_TILE_SIZE) * wave->tile_cols;
+    int tc = 0;
+    while (tc < wave->tile_cols) {
+        if (versions[tc] <= since_version) {
+            ++tc;
+            continue;
+        }
+        int c0 = tc * WAVES_TILE_SIZE;
+        while (tc < wave->tile_cols && versions[tc] > since_version)
+            ++tc;
+        int c1 = (tc * WAVES_TILE_SIZE < wave->ncol) ? tc * WAVES_TILE_SIZE : wave->ncol;
+        fn(i * wave->ncol + c0, i * wave->ncol + c1);
+    }
+}
+int
+Waves_GetDirtyRanges (Waves * wave, uint32_t since_version, WavesRange out_ranges [], int max_ranges) {
+    SIMPLE_ASSERT(max_ranges > 0, "Need room for at least one range");
+    size_t stride = Waves_GetVertexStride(wave);
+    int count = 0;
+    for (int i = 0; i < wave->nrow; ++i) {
+        waves_for_dirty_spans(wave, i, since_version, [&](int v0, int v1) {
+            size_t begin = (size_t)v0 * stride;
+            size_t end = (size_t)v1 * stride;
+            if (count > 0 && (out_ranges[count - 1].end == begin || count == max_ranges)) {
+                out_ranges[count - 1].end = end;    // contiguous (e.g. whole rows) or out of room
+            } else {
+                out_ranges[count].begin = begin;
+                out_ranges[count].end = end;
+                ++count;
+            }
+        });
+    }
+    return count;
+}
+static void
+waves_export_dirty_tile_rows (void * ctx, int tr0, int tr1) {
+    WavesExportJob * job = reinterpret_cast<WavesExportJob *>(ctx);
+    Waves * wave = job->wave;
+    int r0 = tr0 * WAVES_TILE_SIZE;
+    int r1 = (tr1 * WAVES_TILE_SIZE < wave->nrow) ? tr1 * WAVES_TILE_SIZE : wave->nrow;
+    for (int i = r0; i < r1; ++i) {
+        waves_for_dirty_spans(wave, i, job->since_version, [job](int v0, int v1) {
+            waves_export_span(job->wave, job->dst, job->stride, v0, v1);
+        });
+    }
+    waves_export_fence();
+}
+void
+Waves_ExportDirtyVertices (Waves * wave, void * dst, uint32_t since_version) {
+    WavesExportJob job = {};
+    job.wave = wave;
+    job.dst = reinterpret_cast<uint8_t *>(dst);
+    job.stride = Waves_GetVertexStride(wave);
+    job.since_version = since_version;
+    Scheduler_ParallelForRange(waves_scheduler(wave), 0, wave->tile_rows, 1, &job, waves_export_dirty_tile_rows);
+}
@@ -1,6 +1,99 @@
 #pragma once
 #include "headers/common.h"
+#include "scheduler.h"
 #include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+
+// Storage layout of the height field.
+// AOS keeps full XMFLOAT3 positions per vertex (only .y is simulated).
+// SOA keeps heights only, so the stencil touches dense float rows and can be vectorized.
+enum WAVES_LAYOUT : int {
+    WAVES_LAYOUT_AOS = 0,
+    WAVES_LAYOUT_SOA = 1,
+
+    _COUNT_WAVES_LAYOUT
+};
+// Stencil kernel used by SOA layout (AOS always runs the scalar path).
+// AUTO picks the widest kernel supported by the running cpu.
+enum WAVES_KERNEL : int {
+    WAVES_KERNEL_SCALAR = 0,
+    WAVES_KERNEL_SSE = 1,
+    WAVES_KERNEL_AVX = 2,
+    WAVES_KERNEL_AUTO = 3,
+
+    _COUNT_WAVES_KERNEL
+};
+
+// Storage of normals and tangents. Heights always stay fp32.
+// HALF4 is xyz fp16 (w = 0), fetched as R16G16B16A16_FLOAT.
+// UDECN4 is 10:10:10:2 with xyz biased to [0,1] (v * 0.5 + 0.5), fetched as R10G10B10A2_UNORM
+// (there is no snorm 10:10:10:2 vertex format), the shader has to expand it back.
+enum WAVES_NORMAL_FORMAT : int {
+    WAVES_NORMAL_FLOAT3 = 0,
+    WAVES_NORMAL_HALF4 = 1,
+    WAVES_NORMAL_UDECN4 = 2,
+
+    _COUNT_WAVES_NORMAL_FORMAT
+};
+
+// Shape of a disturbance applied by Waves_DisturbMany.
+// POINT is the 5-point splat of Waves_Disturb at the nearest vertex (radius is ignored).
+// BILINEAR spreads magnitude over a tent of the given radius (>= 1, 1 = plain bilinear over the
+// 4 surrounding vertices), so the total added height is magnitude at any sub-cell position.
+// GAUSSIAN adds magnitude at the center falling off to ~1% at radius (sigma = radius / 3).
+enum WAVES_SPLAT : int {
+    WAVES_SPLAT_POINT = 0,
+    WAVES_SPLAT_BILINEAR = 1,
+    WAVES_SPLAT_GAUSSIAN = 2,
+
+    _COUNT_WAVES_SPLAT
+};
+// i (row) and j (column) are in vertex units and may be fractional.
+struct WavesDisturbance {
+    float i;
+    float j;
+    float magnitude;
+    float radius;
+    WAVES_SPLAT splat;
+};
+
+// Vertex layouts written by Waves_ExportVertices, picked by normal_format.
+struct WavesVertex {                            // WAVES_NORMAL_FLOAT3 (32 bytes)
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT3 normal;
+    DirectX::XMFLOAT2 texc;
+};
+struct WavesVertexHalf {                        // WAVES_NORMAL_HALF4 (24 bytes)
+    DirectX::XMFLOAT3 position;
+    DirectX::PackedVector::XMHALF4 normal;
+    DirectX::PackedVector::XMHALF2 texc;
+};
+struct WavesVertexDec {                         // WAVES_NORMAL_UDECN4 (20 bytes)
+    DirectX::XMFLOAT3 position;
+    DirectX::PackedVector::XMUDECN4 normal;
+    DirectX::PackedVector::XMHALF2 texc;
+};
+
+// Fused update: rows are processed in bands of band_rows, computing heights and
+// normals/tangents of a band in one pass while it is still in cache.
+#define WAVES_BANDS_OFF     0
+#define WAVES_BANDS_AUTO    -1
+
+// Substeps Waves_Update may run per call before dropping the backlog
+#define WAVES_DEFAULT_MAX_SUBSTEPS  4
+
+// Active tiles: the grid is split in WAVES_TILE_SIZE x WAVES_TILE_SIZE vertex tiles.
+// A tile is live while some height in it is above quiet_eps; only live tiles and their
+// neighbours are stepped, a tile that drops out is flattened to exactly zero.
+// quiet_eps = 0 only skips exactly flat tiles (same result as stepping everything).
+#define WAVES_TILE_SIZE             32
+#define WAVES_DEFAULT_QUIET_EPS     1e-4f
+
+// Byte range [begin, end) of the exported vertex buffer
+struct WavesRange {
+    size_t begin;
+    size_t end;
+};
 
 struct Waves {
     int nrow;
@@ -15,23 +108,113 @@ struct Waves {
 
     float time_step, spatial_step;
 
+    // Fixed-timestep accumulator: Waves_Update runs whole steps out of time_accum
+    // (at most max_substeps per call) and keeps the remainder for the next call.
+    float time_accum;
+    int max_substeps;
+
+    WAVES_LAYOUT layout;
+    WAVES_KERNEL kernel;    // resolved kernel (never AUTO after init)
+    WAVES_NORMAL_FORMAT normal_format;
+    int band_rows;          // rows per band in fused update (WAVES_BANDS_OFF = two separate sweeps)
+    Scheduler * sched;      // runs the row loops (nullptr = Scheduler_GetDefault())
+
+    // prev/curr point into a fixed pair of buffers and are rotated after each step.
+
+    // AOS layout
     DirectX::XMFLOAT3 * prev_sol;
     DirectX::XMFLOAT3 * curr_sol;
+
+    // SOA layout
+    float * prev_h;
+    float * curr_h;
+
+    // Only the pair matching normal_format is allocated, the others are nullptr.
     DirectX::XMFLOAT3 * normal;
     DirectX::XMFLOAT3 * tangent_x;
 
+    DirectX::PackedVector::XMHALF4 * normal_h;
+    DirectX::PackedVector::XMHALF4 * tangent_h;
+
+    DirectX::PackedVector::XMUDECN4 * normal_p;
+    DirectX::PackedVector::XMUDECN4 * tangent_p;
+
+    // Texcoords never change for a fixed grid, so they are built once in the export format
+    // (texc for FLOAT3, texc_h for the packed formats).
+    DirectX::XMFLOAT2 * texc;
+    DirectX::PackedVector::XMHALF2 * texc_h;
+
+    // Change tracking (always on) and active tiles (see Waves_SetActiveTiles).
+    // version goes up with every step/disturb, tile_version is the version of the last change
+    // to a tile's vertices; callers remember the version they exported to get the dirty part.
+    bool active_tiles;
+    float quiet_eps;
+    int tile_rows;
+    int tile_cols;
+    int n_active_tiles;     // stepped by the last step
+    uint32_t version;
+    uint8_t * tile_live;
+    uint8_t * tile_active;
+    uint32_t * tile_version;
+
 };
 size_t
-Waves_CalculateRequiredSize (int m, int n);
+Waves_CalculateRequiredSize (int m, int n, WAVES_LAYOUT layout, WAVES_NORMAL_FORMAT normal_format);
 Waves *
-Waves_Init (BYTE * memory, int m, int n, float dx, float dt, float speed, float damping);
-DirectX::XMFLOAT3 &
+Waves_Init (uint8_t * memory, int m, int n, float dx, float dt, float speed, float damping, WAVES_LAYOUT layout, WAVES_KERNEL kernel, WAVES_NORMAL_FORMAT normal_format);
+void
+Waves_SetFusedBands (Waves * wave, int band_rows);
+void
+Waves_SetScheduler (Waves * wave, Scheduler * sched);
+// Only step live tiles (and their neighbours). Overrides the fused update while enabled.
+void
+Waves_SetActiveTiles (Waves * wave, bool enable, float quiet_eps);
+DirectX::XMFLOAT3
 Waves_GetPosition (Waves * wave, int i);
-DirectX::XMFLOAT3 &
+// Decoded from the storage format (packed formats are quantized).
+DirectX::XMFLOAT3
 Waves_GetNormal (Waves * wave, int i);
-DirectX::XMFLOAT3 &
+DirectX::XMFLOAT3
 Waves_GetTangentX (Waves * wave, int i);
 void
+Waves_SetMaxSubsteps (Waves * wave, int max_substeps);
+// Advances the accumulator by dt and runs as many fixed steps as fit (bounded by max_substeps).
+// Returns the # of steps taken.
+int
+Waves_Update (Waves * wave, float dt);
+// Runs exactly one simulation step, independent of the accumulator.
+void
+Waves_Step (Waves * wave);
+// Fraction of a time_step left in the accumulator, in [0, 1).
+// Blend prev (previous step) towards curr (latest step) by this to render between steps.
+float
+Waves_GetInterpolationAlpha (Waves * wave);
+[[deprecated("temp is not used anymore, solution buffers are rotated in place. Use Waves_Update(wave, dt)")]]
+void
 Waves_Update (Waves * wave, float dt, DirectX::XMFLOAT3 temp []);
 void
 Waves_Disturb (Waves * wave, int i, int j, float magnitude);
+// Applies a batch of disturbances in one parallel pass over the rows (call it between steps).
+// Parts falling on or outside the boundary are clipped instead of asserting. Overlapping events
+// add up in array order, so the result does not depend on the thread count.
+void
+Waves_DisturbMany (Waves * wave, WavesDisturbance const events [], int count);
+// Byte size of one exported vertex (sizeof WavesVertex/WavesVertexHalf/WavesVertexDec).
+size_t
+Waves_GetVertexStride (Waves * wave);
+// Writes all nvtx vertices of the current solution to dst (e.g. a mapped upload buffer),
+// nvtx * Waves_GetVertexStride() bytes. Uses streaming stores when dst is 16-byte aligned,
+// so dst should be write-only memory that is not read back on the cpu.
+void
+Waves_ExportVertices (Waves * wave, void * dst);
+uint32_t
+Waves_GetVersion (Waves * wave);
+// Byte ranges of the exported buffer that changed after since_version (0 = everything), row-major
+// and merged. Returns the # of ranges written; when max_ranges is not enough the last range is
+// grown to cover the rest.
+int
+Waves_GetDirtyRanges (Waves * wave, uint32_t since_version, WavesRange out_ranges [], int max_ranges);
+// Like Waves_ExportVertices but only writes the ranges that changed after since_version.
+// A buffer that was exported at version v is brought up to date with since_version = v.
+void
+Waves_ExportDirtyVertices (Waves * wave, void * dst, uint32_t since_version);
@@ -0,0 +1,154 @@
+/* ===========================================================
+   #File: model_bench.cpp #
+   #Description: Headless benchmark for the text model loader #
+   =========================================================== */
+// Loads the skull/car text models with the old fgets/sscanf loop of create_skull_geometry and with
+// ModelLoader_LoadText at several thread counts, and checks every load bit-for-bit against the
+// sscanf result.
+//
+// Usage: model_bench [-runs N] [-threads 1,2,4,...] [model.txt ...]
+//
+// Builds without windows.h (see bench_common.h), e.g.
+//   g++ -std=c++17 -O2 -pthread -I../d3d12_skull model_bench.cpp ../d3d12_skull/model_loader.cpp
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS     // plain fopen/sscanf, like the loop being replaced
+#endif
+
+#include "model_loader.h"
+#include "../bench_common/bench_common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAX_MODELS            8
+#define BENCH_DEFAULT_RUNS          9
+
+// -- reference: the line loop create_skull_geometry used (fgets into a 100-byte buffer + sscanf)
+static bool
+bench_load_reference (char const * path, Model * out_model) {
+    *out_model = {};
+    FILE * f = fopen(path, "r");
+    if (nullptr == f)
+        return false;
+    char linebuf[100] = {};
+    unsigned vcount = 0;
+    unsigned tcount = 0;
+    bool ok =
+        fgets(linebuf, sizeof(linebuf), f) && 1 == sscanf(linebuf, "%*s %u", &vcount) &&
+        fgets(linebuf, sizeof(linebuf), f) && 1 == sscanf(linebuf, "%*s %u", &tcount) &&
+        fgets(linebuf, sizeof(linebuf), f) && fgets(linebuf, sizeof(linebuf), f);
+    Model model = {};
+    model.n_vtx = vcount;
+    model.n_idx = tcount * 3;
+    model.vertices = (ModelVertex *)::calloc(vcount ? vcount : 1, sizeof(ModelVertex));
+    model.indices = (uint32_t *)::calloc(tcount ? tcount * 3 : 1, sizeof(uint32_t));
+    for (unsigned i = 0; ok && i < vcount; ++i) {
+        ModelVertex * v = &model.vertices[i];
+        ok = fgets(linebuf, sizeof(linebuf), f) && 6 == sscanf(
+            linebuf, "%f %f %f %f %f %f",
+            &v->position.x, &v->position.y, &v->position.z, &v->normal.x, &v->normal.y, &v->normal.z
+        );
+    }
+    ok = ok && fgets(linebuf, sizeof(linebuf), f) && fgets(linebuf, sizeof(linebuf), f) && fgets(linebuf, sizeof(linebuf), f);
+    for (unsigned i = 0; ok && i < tcount; ++i) {
+        uint32_t * tri = &model.indices[i * 3];
+        ok = fgets(linebuf, sizeof(linebuf), f) && 3 == sscanf(linebuf, "%u %u %u", &tri[0], &tri[1], &tri[2]);
+    }
+    fclose(f);
+    if (!ok) {
+        ModelLoader_Free(&model);
+        return false;
+    }
+    *out_model = model;
+    return true;
+}
+static bool
+bench_same (Model const * a, Model const * b) {
+    return a->n_vtx == b->n_vtx && a->n_idx == b->n_idx &&
+           0 == memcmp(a->vertices, b->vertices, sizeof(ModelVertex) * a->n_vtx) &&
+           0 == memcmp(a->indices, b->indices, sizeof(uint32_t) * a->n_idx);
+}
+
+// -- timing
+// Median of runs (at most BENCH_MAX_RUNS) loads in ms; *out_ok is false if any load failed or
+// differed from ref. threads == 0 times the reference loop.
+static double
+bench_run (char const * path, int threads, int runs, Model const * ref, bool * out_ok) {
+    double times[BENCH_MAX_RUNS];
+    *out_ok = true;
+    for (int r = 0; r < runs; ++r) {
+        Model model = {};
+        double start = bench_seconds();
+        bool ok = (0 == threads) ? bench_load_reference(path, &model) : ModelLoader_LoadText(path, threads, &model);
+        times[r] = 1000.0 * (bench_seconds() - start);
+        *out_ok = *out_ok && ok && bench_same(&model, ref);
+        ModelLoader_Free(&model);
+    }
+    return bench_median(times, runs);
+}
+
+int
+main (int argc, char ** argv) {
+    char const * models[BENCH_MAX_MODELS] = {};
+    int n_models = 0;
+    int threads[BENCH_MAX_LIST] = {};
+    int n_threads = 0;
+    int runs = BENCH_DEFAULT_RUNS;
+
+    for (int a = 1; a < argc; ++a) {
+        if (0 == strcmp(argv[a], "-threads") && a + 1 < argc) {
+            n_threads = bench_parse_list(argv[++a], threads);
+        } else if (0 == strcmp(argv[a], "-runs") && a + 1 < argc) {
+            runs = atoi(argv[++a]);
+        } else if ('-' != argv[a][0] && n_models < BENCH_MAX_MODELS) {
+            models[n_models++] = argv[a];
+        } else {
+            ::printf("usage: %s [-runs N] [-threads 1,2,4,...] [model.txt ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (0 == n_models) {
+        models[n_models++] = "../d3d12_skull/models/skull.txt";
+        models[n_models++] = "../d3d12_skull/models/car.txt";
+    }
+    runs = bench_clamp_runs(runs);
+
+    int hw_threads = bench_hardware_threads();
+    if (0 == n_threads)
+        n_threads = bench_default_threads(hw_threads, threads);
+
+    ::printf("model_bench: %d hardware threads, median of %d runs\n\n", hw_threads, runs);
+    ::printf("%-32s %-10s %10s %10s %8s  %s\n", "model", "loader", "ms", "MB/s", "speedup", "result");
+
+    bool all_ok = true;
+    for (int m = 0; m < n_models; ++m) {
+        Model ref = {};
+        if (!bench_load_reference(models[m], &ref)) {
+            ::printf("%-32s could not be read\n", models[m]);
+            all_ok = false;
+            continue;
+        }
+        FILE * f = fopen(models[m], "rb");
+        fseek(f, 0, SEEK_END);
+        double mb = (double)ftell(f) / (1024.0 * 1024.0);
+        fclose(f);
+
+        bool ok;
+        double ref_ms = bench_run(models[m], 0, runs, &ref, &ok);
+        ::printf("%-32s %-10s %10.3f %10.1f %8.2f  %s\n", models[m], "sscanf", ref_ms, mb / (ref_ms / 1000.0), 1.0, ok ? "OK" : "FAILED");
+        all_ok = all_ok && ok;
+        for (int t = 0; t < n_threads; ++t) {
+            double ms = bench_run(models[m], threads[t], runs, &ref, &ok);
+            char name[32];
+            snprintf(name, sizeof(name), "%d thr", threads[t]);
+            ::printf("%-32s %-10s %10.3f %10.1f %8.2f  %s\n", models[m], name, ms, mb / (ms / 1000.0), ref_ms / ms, ok ? "OK" : "MISMATCH");
+            all_ok = all_ok && ok;
+        }
+        ModelLoader_Free(&ref);
+    }
+
+    ::printf("\n%s\n", all_ok ? "all loads match the sscanf reference" : "REFERENCE MISMATCH");
+    return all_ok ? 0 : 2;
+}
@@ -0,0 +1,577 @@
+/* ===========================================================
+   #File: render_bench.cpp #
+   #Description: Headless benchmark for the CPU side of a frame #
+   =========================================================== */
+// Runs the per-frame CPU work of d3d12_waves_blending on a synthetic scene without a window or
+// device: instance data uploads, frustum culling, draw list build + sort and draw recording, all
+// recorded through CmdNull. Then records the draw list in chunks at several thread counts and
+// checks every configuration draws the same instances, in the same order, as the serial recording,
+// and times uploading every item's instance data at the same thread counts.
+//
+// Usage: render_bench [-items N] [-frames N] [-moving PERCENT] [-threads 1,2,4,...]
+//                     [-capture out.cmd] [-compare a.cmd b.cmd]
+//   -capture writes the last frame's command stream (uploads included) and times replaying it
+//   -compare diffs two captures and exits with 3 if they differ
+//
+// Builds without windows.h (see bench_common.h), e.g.
+//   g++ -std=c++17 -O2 -pthread -I../d3d12_waves_blending render_bench.cpp
+//       ../d3d12_waves_blending/{cmd_recorder,culling,draw_list,draw_recording,render_items,scheduler}.cpp
+
+#include "draw_recording.h"
+#include "scheduler.h"
+#include "../bench_common/bench_common.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace DirectX;
+
+#define BENCH_DEFAULT_ITEMS         20000
+#define BENCH_DEFAULT_FRAMES        60
+#define BENCH_DEFAULT_MOVING        10      // percent of the items moved every frame
+#define BENCH_WARMUP_FRAMES         3
+#define BENCH_REPLAY_RUNS           9
+#define BENCH_RECORD_RUNS           16      // timed runs of each chunked recording / upload configuration
+#define BENCH_N_FRAMES_QUEUED       3
+#define BENCH_N_GEOMS               16
+#define BENCH_N_MATERIALS           32
+#define BENCH_SCENE_EXTENT          500.0f
+#define BENCH_INSTANCE_STRIDE       128     // sizeof(InstanceData), tightly packed
+#define BENCH_INSTANCE_ALIGNMENT    256     // placement of the app's upload ring reservations
+#define BENCH_MIN_DRAWS_PER_CHUNK   64
+#define BENCH_TOPOLOGY_TRIANGLELIST 4       // D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST
+
+// same layers (and pso indices) as the demo
+enum BENCH_LAYER : uint8_t {
+    BENCH_LAYER_OPAQUE = 0,
+    BENCH_LAYER_TRANSPARENT = 1,
+    BENCH_LAYER_ALPHATESTED = 2,
+
+    _COUNT_BENCH_LAYER
+};
+
+// Fixed bindings, so captures of the same scene are identical run to run.
+static DrawBindings const g_bindings = {
+    0x0000000300000000ull,      // srv_heap
+    32,
+};
+// upload buffers the recording writes into
+enum BENCH_UPLOAD_BUFFER : uint32_t {
+    BENCH_UPLOAD_INSTANCES = 0,
+    BENCH_UPLOAD_DRAW_INSTANCES = 1,
+};
+
+// -- deterministic scene
+static uint32_t
+bench_rand (uint32_t * state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+static float
+bench_randf (uint32_t * state, float lo, float hi) {
+    return lo + (hi - lo) * (float)(bench_rand(state) >> 8) / (float)(1 << 24);
+}
+static XMFLOAT4X4
+bench_translation (float x, float y, float z, float scale) {
+    XMFLOAT4X4 m = {};
+    m.m[0][0] = m.m[1][1] = m.m[2][2] = scale;
+    m.m[3][0] = x;
+    m.m[3][1] = y;
+    m.m[3][2] = z;
+    m.m[3][3] = 1.0f;
+    return m;
+}
+struct BenchScene {
+    uint8_t * ritems_memory;
+    RenderItems * ritems;
+    RenderItemHandle * handles;
+    DrawMaterial materials[BENCH_N_MATERIALS];
+    uint8_t * draw_list_memory;
+    DrawList * draw_list;
+    uint32_t * visible;
+    int n_visible;
+    uint8_t * instances_memory;
+    uint8_t * instances;            // stands in for the mapped instance data, aligned like the app's
+    uint32_t * draw_instances;      // draw instance slots
+    XMFLOAT4X4 view;
+    CullingFrustum frustum;
+    uint32_t rng;
+};
+static void
+bench_scene_init (BenchScene * scene, int n_items) {
+    *scene = {};
+    scene->rng = 0x9e3779b9u;
+    scene->ritems_memory = (uint8_t *)::malloc(RenderItems_CalculateRequiredSize(n_items));
+    scene->ritems = RenderItems_Init(scene->ritems_memory, n_items, BENCH_N_FRAMES_QUEUED);
+    scene->handles = (RenderItemHandle *)::malloc(sizeof(RenderItemHandle) * n_items);
+    scene->draw_list_memory = (uint8_t *)::malloc(DrawList_CalculateRequiredSize(n_items));
+    scene->draw_list = DrawList_Init(scene->draw_list_memory, n_items);
+    scene->visible = (uint32_t *)::malloc(sizeof(uint32_t) * scene->ritems->world_bounds->capacity);
+    // misaligned instance data would split every streaming store across cache lines
+    scene->instances_memory = (uint8_t *)::malloc((size_t)BENCH_INSTANCE_STRIDE * n_items + BENCH_INSTANCE_ALIGNMENT);
+    scene->instances = (uint8_t *)(((uintptr_t)scene->instances_memory + BENCH_INSTANCE_ALIGNMENT - 1) & ~(uintptr_t)(BENCH_INSTANCE_ALIGNMENT - 1));
+    scene->draw_instances = (uint32_t *)::malloc(sizeof(uint32_t) * n_items);
+
+    for (int m = 0; m < BENCH_N_MATERIALS; ++m) {
+        scene->materials[m].data_index = (uint32_t)m;
+        scene->materials[m].srv_index = (uint32_t)(m % 8);
+    }
+    for (int i = 0; i < n_items; ++i) {
+        RenderItemDesc desc = {};
+        desc.world = bench_translation(
+            bench_randf(&scene->rng, -BENCH_SCENE_EXTENT, BENCH_SCENE_EXTENT),
+            bench_randf(&scene->rng, 0.0f, 20.0f),
+            bench_randf(&scene->rng, -BENCH_SCENE_EXTENT, BENCH_SCENE_EXTENT),
+            bench_randf(&scene->rng, 0.5f, 2.0f)
+        );
+        desc.tex_transform = bench_translation(0.0f, 0.0f, 0.0f, 1.0f);
+        uint32_t geom = bench_rand(&scene->rng) % BENCH_N_GEOMS;
+        desc.draw_args.index_count = 36 + 36 * geom;
+        desc.draw_args.start_index = 0;
+        desc.draw_args.base_vertex = 0;
+        desc.draw_args.geom = (uint16_t)geom;
+        desc.draw_args.topology = BENCH_TOPOLOGY_TRIANGLELIST;
+        desc.bounds.center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        desc.bounds.extents = XMFLOAT3(1.0f, 1.0f, 1.0f);
+        desc.material = bench_rand(&scene->rng) % BENCH_N_MATERIALS;
+        uint32_t r = bench_rand(&scene->rng) % 100;
+        desc.layer = (r < 80) ? BENCH_LAYER_OPAQUE : (r < 95) ? BENCH_LAYER_ALPHATESTED : BENCH_LAYER_TRANSPARENT;
+        scene->handles[i] = RenderItems_Add(scene->ritems, &desc);
+    }
+
+    // camera above the near edge looking across the scene (LH, like XMMatrixLookAtLH/PerspectiveFovLH)
+    float eye[3] = {0.0f, 150.0f, -BENCH_SCENE_EXTENT - 100.0f};
+    float at[3] = {0.0f, 0.0f, 0.0f};
+    float z[3] = {at[0] - eye[0], at[1] - eye[1], at[2] - eye[2]};
+    float zl = sqrtf(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+    for (int k = 0; k < 3; ++k)
+        z[k] /= zl;
+    float x[3] = {z[2], 0.0f, -z[0]};      // up (0, 1, 0) cross z
+    float xl = sqrtf(x[0] * x[0] + x[2] * x[2]);
+    x[0] /= xl;
+    x[2] /= xl;
+    float y[3] = {z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0]};
+    XMFLOAT4X4 view = {};
+    for (int k = 0; k < 3; ++k) {
+        view.m[k][0] = x[k];
+        view.m[k][1] = y[k];
+        view.m[k][2] = z[k];
+    }
+    view.m[3][0] = -(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]);
+    view.m[3][1] = -(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]);
+    view.m[3][2] = -(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]);
+    view.m[3][3] = 1.0f;
+    float near_z = 1.0f;
+    float far_z = 2000.0f;
+    float fov_y = 0.25f * 3.14159265f;
+    float aspect = 16.0f / 9.0f;
+    float h = 1.0f / tanf(0.5f * fov_y);
+    XMFLOAT4X4 proj = {};
+    proj.m[0][0] = h / aspect;
+    proj.m[1][1] = h;
+    proj.m[2][2] = far_z / (far_z - near_z);
+    proj.m[2][3] = 1.0f;
+    proj.m[3][2] = -near_z * far_z / (far_z - near_z);
+    scene->view = view;
+    Culling_ExtractFrustum(view, proj, &scene->frustum);
+}
+static void
+bench_scene_free (BenchScene * scene) {
+    ::free(scene->draw_instances);
+    ::free(scene->instances_memory);
+    ::free(scene->visible);
+    ::free(scene->draw_list_memory);
+    ::free(scene->handles);
+    ::free(scene->ritems_memory);
+}
+
+// -- one frame, the same steps as the demo's main loop
+static void
+bench_move_items (BenchScene * scene, int frame, int n_moving) {
+    int n = scene->ritems->count;
+    for (int m = 0; m < n_moving; ++m) {
+        RenderItemHandle handle = scene->handles[((int64_t)frame * n_moving + m) % n];
+        int i = RenderItems_GetIndex(scene->ritems, handle);
+        XMFLOAT4X4 world = scene->ritems->world[i];
+        world.m[3][1] = 10.0f + 10.0f * sinf(0.1f * (float)frame + (float)i);
+        RenderItems_SetWorld(scene->ritems, handle, world);
+    }
+}
+static void
+bench_build_draw_list (BenchScene * scene) {
+    // same pass order and keys as build_draw_list
+    static uint32_t const layer_pass[_COUNT_BENCH_LAYER] = {0, 2, 1};
+    RenderItems const * ritems = scene->ritems;
+    CullingBounds const * bounds = ritems->world_bounds;
+    XMFLOAT4X4 const & view = scene->view;
+    DrawList_Clear(scene->draw_list);
+    for (int v = 0; v < scene->n_visible; ++v) {
+        uint32_t i = scene->visible[v];
+        float depth = bounds->center_x[i] * view.m[0][2] + bounds->center_y[i] * view.m[1][2] + bounds->center_z[i] * view.m[2][2] + view.m[3][2];
+        uint8_t layer = ritems->layer[i];
+        uint64_t key = (BENCH_LAYER_TRANSPARENT == layer) ?
+            DrawList_TransparentKey(layer_pass[layer], layer, ritems->draw_args[i].geom, ritems->material[i], depth) :
+            DrawList_OpaqueKey(layer_pass[layer], layer, ritems->draw_args[i].geom, ritems->material[i], depth);
+        DrawList_Push(scene->draw_list, key, i);
+    }
+    DrawList_Sort(scene->draw_list);
+}
+static void
+bench_record_draws (BenchScene * scene, CmdRecorder * rec, int begin, int end, DrawStats * stats) {
+    DrawStateCache state;
+    DrawStateCache_Reset(&state, stats);
+    state.bound[DRAW_STATE_PSO] = BENCH_LAYER_OPAQUE;
+    DrawRecording_DrawItems(rec, &g_bindings, scene->ritems, scene->materials, scene->draw_list, begin, end, &state);
+}
+
+// -- timing
+enum BENCH_PHASE : int {
+    BENCH_PHASE_UPLOAD = 0,
+    BENCH_PHASE_CULL = 1,
+    BENCH_PHASE_SORT = 2,
+    BENCH_PHASE_RECORD = 3,
+
+    _COUNT_BENCH_PHASE
+};
+static char const * const g_phase_names[_COUNT_BENCH_PHASE] = {"upload", "cull", "sort", "record"};
+
+// Runs one frame into rec, adding each phase's time (ms) to phase_ms.
+static void
+bench_frame (BenchScene * scene, int frame, int n_moving, CmdRecorder * rec, DrawStats * stats, double phase_ms []) {
+    bench_move_items(scene, frame, n_moving);
+    double t0 = bench_seconds();
+    DrawRecording_UploadObjects(Scheduler_GetDefault(), rec, 1, BENCH_UPLOAD_INSTANCES, BENCH_INSTANCE_STRIDE, scene->ritems, frame % BENCH_N_FRAMES_QUEUED);
+    double t1 = bench_seconds();
+    scene->n_visible = Culling_FrustumCull(&scene->frustum, scene->ritems->world_bounds, scene->visible);
+    double t2 = bench_seconds();
+    bench_build_draw_list(scene);
+    double t3 = bench_seconds();
+    DrawRecording_UploadDrawInstances(rec, BENCH_UPLOAD_DRAW_INSTANCES, scene->draw_list, nullptr, 0);
+    bench_record_draws(scene, rec, 0, scene->draw_list->count, stats);
+    double t4 = bench_seconds();
+    phase_ms[BENCH_PHASE_UPLOAD] += 1000.0 * (t1 - t0);
+    phase_ms[BENCH_PHASE_CULL] += 1000.0 * (t2 - t1);
+    phase_ms[BENCH_PHASE_SORT] += 1000.0 * (t3 - t2);
+    phase_ms[BENCH_PHASE_RECORD] += 1000.0 * (t4 - t3);
+}
+
+// -- instance data uploads of every item, split across threads
+// Checks the instance data holds every item's transposed matrices.
+static bool
+bench_check_instances (BenchScene const * scene) {
+    RenderItems const * ritems = scene->ritems;
+    for (int i = 0; i < ritems->count; ++i) {
+        float const * inst = reinterpret_cast<float const *>(scene->instances + (size_t)BENCH_INSTANCE_STRIDE * i);
+        for (int r = 0; r < 4; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                if (inst[4 * r + c] != ritems->world[i].m[c][r] || inst[16 + 4 * r + c] != ritems->tex_transform[i].m[c][r])
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+// Returns the median ms of uploading all items (every one dirty) on sched with n_threads chunks.
+static double
+bench_uploads (BenchScene * scene, Scheduler * sched, int n_threads, int runs, bool * out_ok) {
+    RenderItems * ritems = scene->ritems;
+    CmdNull nulls[CMD_RECORDER_MAX_CHUNKS];
+    CmdRecorder recorders[CMD_RECORDER_MAX_CHUNKS];
+    int n_recorders = (n_threads < CMD_RECORDER_MAX_CHUNKS) ? n_threads : CMD_RECORDER_MAX_CHUNKS;
+    for (int c = 0; c < n_recorders; ++c) {
+        CmdNull_Init(&nulls[c]);
+        nulls[c].uploads.memory[BENCH_UPLOAD_INSTANCES] = scene->instances;
+        nulls[c].uploads.size[BENCH_UPLOAD_INSTANCES] = (uint64_t)BENCH_INSTANCE_STRIDE * ritems->count;
+        recorders[c] = CmdNull_GetRecorder(&nulls[c]);
+    }
+    double times[BENCH_MAX_RUNS];
+    runs = bench_clamp_runs(runs);
+    *out_ok = true;
+    memset(scene->instances, 0, (size_t)BENCH_INSTANCE_STRIDE * ritems->count);
+    for (int r = 0; r < runs; ++r) {
+        for (int m = 0; m < ritems->count; ++m)
+            RenderItems_SetWorld(ritems, scene->handles[m], ritems->world[RenderItems_GetIndex(ritems, scene->handles[m])]);
+        double start = bench_seconds();
+        int n_written = DrawRecording_UploadObjects(sched, recorders, n_recorders, BENCH_UPLOAD_INSTANCES, BENCH_INSTANCE_STRIDE, ritems, 0);
+        times[r] = 1000.0 * (bench_seconds() - start);
+        *out_ok = *out_ok && (n_written == ritems->count);
+    }
+    *out_ok = *out_ok && bench_check_instances(scene);
+    return bench_median(times, runs);
+}
+
+// -- chunked recording
+struct BenchChunkJob {
+    BenchScene * scene;
+    DrawStats stats[CMD_RECORDER_MAX_CHUNKS];
+};
+static void
+bench_record_chunk (void * ctx, int chunk, CmdRecorder * rec, int begin, int end) {
+    BenchChunkJob * job = reinterpret_cast<BenchChunkJob *>(ctx);
+    job->stats[chunk] = {};
+    bench_record_draws(job->scene, rec, begin, end, &job->stats[chunk]);
+}
+// Expands the draws of capture into one entry per instance: draw args and draw instance slot
+// (instance base + instance). Returns the entry count; out_instances has room for max_instances.
+struct BenchInstance {
+    uint32_t index_count;
+    uint32_t start_index;
+    int32_t base_vertex;
+    uint32_t slot;
+};
+static int
+bench_expand_instances (CmdCapture const * capture, BenchInstance * out_instances, int n_instances, int max_instances) {
+    uint32_t base = 0;
+    for (int k = 0; k < capture->count; ++k) {
+        CmdPacket const * p = &capture->packets[k];
+        // root constant 0 of the draw constants is the instance base, see draw_recording.cpp
+        if (CMD_OP_SET_ROOT_CONSTANT == p->op && 0 == p->args[1]) {
+            base = p->args[2];
+        } else if (CMD_OP_DRAW_INDEXED == p->op) {
+            for (uint32_t i = 0; i < p->args[1] && n_instances < max_instances; ++i) {
+                BenchInstance * inst = &out_instances[n_instances++];
+                inst->index_count = p->args[0];
+                inst->start_index = p->args[2];
+                inst->base_vertex = (int32_t)p->args[3];
+                inst->slot = base + p->args[4] + i;
+            }
+        }
+    }
+    return n_instances;
+}
+// Only the instances: chunks re-bind their state, and a batch split across chunks becomes two
+// draws, so the state packets and instance counts legitimately differ.
+static bool
+bench_same_instances (CmdCapture const * serial, CmdCapture const chunks [], int n_chunks, int max_instances) {
+    BenchInstance * a = (BenchInstance *)::malloc(sizeof(BenchInstance) * max_instances);
+    BenchInstance * b = (BenchInstance *)::malloc(sizeof(BenchInstance) * max_instances);
+    int n_a = bench_expand_instances(serial, a, 0, max_instances);
+    int n_b = 0;
+    for (int c = 0; c < n_chunks; ++c)
+        n_b = bench_expand_instances(&chunks[c], b, n_b, max_instances);
+    bool same = (n_a == n_b);
+    for (int i = 0; same && i < n_a; ++i) {
+        same = a[i].index_count == b[i].index_count && a[i].start_index == b[i].start_index &&
+            a[i].base_vertex == b[i].base_vertex && a[i].slot == b[i].slot;
+    }
+    // every list entry is drawn exactly once, at its own slot
+    for (int i = 0; same && i < n_a; ++i)
+        same = (uint32_t)i == a[i].slot;
+    ::free(b);
+    ::free(a);
+    return same;
+}
+// Checks the chunked draws against the serial ones, then returns the median ms of recording the
+// draw list in chunks on sched.
+static double
+bench_chunked (BenchScene * scene, Scheduler * sched, int n_threads, int runs, bool * out_ok) {
+    int n_chunks = CmdRecorder_ChunkCount(scene->draw_list->count, (n_threads < CMD_RECORDER_MAX_CHUNKS) ? n_threads : CMD_RECORDER_MAX_CHUNKS, BENCH_MIN_DRAWS_PER_CHUNK);
+    BenchChunkJob * job = (BenchChunkJob *)::malloc(sizeof(BenchChunkJob));
+    job->scene = scene;
+
+    CmdCapture serial;
+    CmdCapture_Init(&serial);
+    CmdRecorder serial_rec = CmdCapture_GetRecorder(&serial);
+    DrawStats serial_stats = {};
+    bench_record_draws(scene, &serial_rec, 0, scene->draw_list->count, &serial_stats);
+
+    CmdCapture captures[CMD_RECORDER_MAX_CHUNKS];
+    CmdRecorder recorders[CMD_RECORDER_MAX_CHUNKS];
+    for (int c = 0; c < n_chunks; ++c) {
+        CmdCapture_Init(&captures[c]);
+        recorders[c] = CmdCapture_GetRecorder(&captures[c]);
+    }
+    CmdRecorder_RecordChunks(sched, scene->draw_list->count, n_chunks, recorders, job, bench_record_chunk);
+    // one more slot than the list so a stray extra instance shows up as a count mismatch
+    *out_ok = bench_same_instances(&serial, captures, n_chunks, scene->draw_list->count + 1);
+    for (int c = 0; c < n_chunks; ++c)
+        CmdCapture_Free(&captures[c]);
+    CmdCapture_Free(&serial);
+
+    CmdNull nulls[CMD_RECORDER_MAX_CHUNKS];
+    for (int c = 0; c < n_chunks; ++c) {
+        CmdNull_Init(&nulls[c]);
+        recorders[c] = CmdNull_GetRecorder(&nulls[c]);
+    }
+    double times[BENCH_MAX_RUNS];
+    runs = bench_clamp_runs(runs);
+    for (int r = 0; r < runs; ++r) {
+        double start = bench_seconds();
+        CmdRecorder_RecordChunks(sched, scene->draw_list->count, n_chunks, recorders, job, bench_record_chunk);
+        times[r] = 1000.0 * (bench_seconds() - start);
+    }
+    ::free(job);
+    return bench_median(times, runs);
+}
+
+static int
+bench_compare_files (char const * path_a, char const * path_b) {
+    CmdCapture a;
+    CmdCapture b;
+    CmdCapture_Init(&a);
+    CmdCapture_Init(&b);
+    int ret = 0;
+    if (!CmdCapture_ReadFile(&a, path_a) || !CmdCapture_ReadFile(&b, path_b)) {
+        ::printf("could not read %s / %s as captures\n", path_a, path_b);
+        ret = 1;
+    } else {
+        int diff = CmdCapture_Compare(&a, &b);
+        if (diff < 0) {
+            ::printf("%s and %s match (%d commands)\n", path_a, path_b, a.count);
+        } else {
+            ::printf("%s and %s differ at command %d (%d vs %d commands)\n", path_a, path_b, diff, a.count, b.count);
+            ret = 3;
+        }
+    }
+    CmdCapture_Free(&a);
+    CmdCapture_Free(&b);
+    return ret;
+}
+
+int
+main (int argc, char ** argv) {
+    int n_items = BENCH_DEFAULT_ITEMS;
+    int n_frames = BENCH_DEFAULT_FRAMES;
+    int moving_percent = BENCH_DEFAULT_MOVING;
+    int threads[BENCH_MAX_LIST] = {};
+    int n_threads = 0;
+    char const * capture_path = nullptr;
+
+    for (int a = 1; a < argc; ++a) {
+        if (0 == strcmp(argv[a], "-items") && a + 1 < argc) {
+            n_items = atoi(argv[++a]);
+        } else if (0 == strcmp(argv[a], "-frames") && a + 1 < argc) {
+            n_frames = atoi(argv[++a]);
+        } else if (0 == strcmp(argv[a], "-moving") && a + 1 < argc) {
+            moving_percent = atoi(argv[++a]);
+        } else if (0 == strcmp(argv[a], "-threads") && a + 1 < argc) {
+            n_threads = bench_parse_list(argv[++a], threads);
+        } else if (0 == strcmp(argv[a], "-capture") && a + 1 < argc) {
+            capture_path = argv[++a];
+        } else if (0 == strcmp(argv[a], "-compare") && a + 2 < argc) {
+            return bench_compare_files(argv[a + 1], argv[a + 2]);
+        } else {
+            ::printf("usage: %s [-items N] [-frames N] [-moving PERCENT] [-threads 1,2,4,...] [-capture out.cmd] [-compare a.cmd b.cmd]\n", argv[0]);
+            return 1;
+        }
+    }
+    n_items = (n_items < 1) ? 1 : (n_items > RENDER_ITEMS_MAX_CAPACITY) ? RENDER_ITEMS_MAX_CAPACITY : n_items;
+    n_frames = (n_frames < 1) ? 1 : n_frames;
+    moving_percent = (moving_percent < 0) ? 0 : (moving_percent > 100) ? 100 : moving_percent;
+    int n_moving = (int)((int64_t)n_items * moving_percent / 100);
+
+    int hw_threads = bench_hardware_threads();
+    if (0 == n_threads)
+        n_threads = bench_default_threads(hw_threads, threads);
+
+    ::printf("render_bench: %d items, %d%% moving per frame, %d hardware threads\n\n", n_items, moving_percent, hw_threads);
+
+    BenchScene scene;
+    bench_scene_init(&scene, n_items);
+
+    CmdNull null;
+    CmdNull_Init(&null);
+    null.uploads.memory[BENCH_UPLOAD_INSTANCES] = scene.instances;
+    null.uploads.size[BENCH_UPLOAD_INSTANCES] = (uint64_t)BENCH_INSTANCE_STRIDE * n_items;
+    null.uploads.memory[BENCH_UPLOAD_DRAW_INSTANCES] = reinterpret_cast<uint8_t *>(scene.draw_instances);
+    null.uploads.size[BENCH_UPLOAD_DRAW_INSTANCES] = sizeof(uint32_t) * n_items;
+    CmdRecorder null_rec = CmdNull_GetRecorder(&null);
+
+    // -- serial frames; the first few upload every item (all start dirty) and aren't timed
+    double phase_ms[_COUNT_BENCH_PHASE] = {};
+    double * frame_ms = (double *)::malloc(sizeof(double) * n_frames);
+    DrawStats stats = {};
+    for (int f = 0; f < BENCH_WARMUP_FRAMES; ++f)
+        bench_frame(&scene, f, n_moving, &null_rec, &stats, phase_ms);
+    memset(phase_ms, 0, sizeof(phase_ms));
+    CmdNull_Reset(&null);
+    stats = {};
+    for (int f = 0; f < n_frames; ++f) {
+        double start = bench_seconds();
+        bench_frame(&scene, BENCH_WARMUP_FRAMES + f, n_moving, &null_rec, &stats, phase_ms);
+        frame_ms[f] = 1000.0 * (bench_seconds() - start);
+    }
+    double median_ms = bench_median(frame_ms, n_frames);
+    ::free(frame_ms);
+
+    uint32_t n_sets = 0;
+    uint32_t n_redundant = 0;
+    for (int i = 0; i < _COUNT_DRAW_STATE; ++i) {
+        n_sets += stats.n_sets[i];
+        n_redundant += stats.n_redundant[i];
+    }
+    ::printf("frame: %.3f ms median over %d frames\n", median_ms, n_frames);
+    for (int p = 0; p < _COUNT_BENCH_PHASE; ++p)
+        ::printf("  %-8s %8.3f ms/frame\n", g_phase_names[p], phase_ms[p] / n_frames);
+    ::printf("per frame: %u draws (%u instances) of %d items, %u state changes (%u redundant skipped), %llu uploads (%.1f KB)\n",
+        stats.n_draws / n_frames, stats.n_instances / n_frames, n_items, n_sets / n_frames, n_redundant / n_frames,
+        (unsigned long long)(null.n_calls[CMD_OP_UPLOAD] / n_frames), (double)null.n_upload_bytes / n_frames / 1024.0);
+
+    // -- chunked recording of the last frame's draw list
+    bool all_ok = true;
+    ::printf("\n%-8s %7s %12s %8s  %s\n", "threads", "chunks", "record ms", "speedup", "result");
+    double single_ms = 0.0;
+    for (int t = 0; t < n_threads; ++t) {
+        Scheduler * sched = Scheduler_Create(SCHEDULER_BACKEND_POOL, threads[t], SCHEDULER_GRAIN_AUTO);
+        bool ok;
+        double ms = bench_chunked(&scene, sched, threads[t], BENCH_RECORD_RUNS, &ok);
+        Scheduler_Destroy(sched);
+        if (0 == t)
+            single_ms = ms;
+        int n_chunks = CmdRecorder_ChunkCount(scene.draw_list->count, threads[t], BENCH_MIN_DRAWS_PER_CHUNK);
+        ::printf("%-8d %7d %12.3f %8.2f  %s\n", threads[t], n_chunks, ms, (ms > 0.0) ? single_ms / ms : 0.0, ok ? "OK" : "MISMATCH");
+        all_ok = all_ok && ok;
+    }
+
+    // -- instance data uploads with every item moving
+    ::printf("\n%-8s %12s %8s  %s\n", "threads", "upload ms", "speedup", "result (all items dirty)");
+    for (int t = 0; t < n_threads; ++t) {
+        Scheduler * sched = Scheduler_Create(SCHEDULER_BACKEND_POOL, threads[t], SCHEDULER_GRAIN_AUTO);
+        bool ok;
+        double ms = bench_uploads(&scene, sched, threads[t], BENCH_RECORD_RUNS, &ok);
+        Scheduler_Destroy(sched);
+        if (0 == t)
+            single_ms = ms;
+        ::printf("%-8d %12.3f %8.2f  %s\n", threads[t], ms, (ms > 0.0) ? single_ms / ms : 0.0, ok ? "OK" : "MISMATCH");
+        all_ok = all_ok && ok;
+    }
+
+    // -- capture one more frame, write it, read it back and time replaying it
+    if (capture_path) {
+        CmdCapture capture;
+        CmdCapture_Init(&capture);
+        CmdRecorder capture_rec = CmdCapture_GetRecorder(&capture);
+        DrawStats capture_stats = {};
+        double capture_phase_ms[_COUNT_BENCH_PHASE] = {};
+        bench_frame(&scene, BENCH_WARMUP_FRAMES + n_frames, n_moving, &capture_rec, &capture_stats, capture_phase_ms);
+
+        CmdCapture loaded;
+        CmdCapture_Init(&loaded);
+        bool ok = CmdCapture_WriteFile(&capture, capture_path) && CmdCapture_ReadFile(&loaded, capture_path) &&
+            CmdCapture_Compare(&capture, &loaded) < 0;
+
+        double times[BENCH_REPLAY_RUNS];
+        for (int r = 0; r < BENCH_REPLAY_RUNS; ++r) {
+            CmdNull_Reset(&null);
+            double start = bench_seconds();
+            CmdCapture_Replay(&loaded, &null_rec);
+            times[r] = 1000.0 * (bench_seconds() - start);
+        }
+        ::printf("\ncapture: %s, %d commands, %.1f KB payload, replay %.3f ms  %s\n",
+            capture_path, capture.count, (double)capture.payload_size / 1024.0, bench_median(times, BENCH_REPLAY_RUNS), ok ? "OK" : "FAILED");
+        all_ok = all_ok && ok;
+        CmdCapture_Free(&loaded);
+        CmdCapture_Free(&capture);
+    }
+
+    bench_scene_free(&scene);
+    ::printf("\n%s\n", all_ok ? "all recordings match the serial one" : "RECORDING MISMATCH");
+    return all_ok ? 0 : 2;
+}
@@ -0,0 +1,472 @@
+/* ===========================================================
+   #File: waves_bench.cpp #
+   #Description: Headless benchmark for the Waves solver #
+   =========================================================== */
+// Runs Waves_Init/Waves_Disturb/Waves_Step without a window or device at several
+// grid sizes and thread counts, and checks every configuration bit-for-bit against
+// a serial reference solver (the original AOS implementation).
+//
+// Usage: waves_bench [-quick] [-sizes 128,256,...] [-threads 1,2,4,...] [-steps N]
+//
+// Builds without windows.h (see bench_common.h), e.g.
+//   g++ -std=c++17 -O2 -pthread -I../d3d12_waves_blending waves_bench.cpp
+//       ../d3d12_waves_blending/waves.cpp ../d3d12_waves_blending/scheduler.cpp
+
+#include "waves.h"
+#include "scheduler.h"
+#include "../bench_common/bench_common.h"
+
+#include <string.h>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+// Vertex-steps timed per run; small grids get more steps so every run takes a similar time.
+#define BENCH_WORK_PER_RUN          (1 << 26)
+#define BENCH_MIN_STEPS             8
+#define BENCH_WARMUP_STEPS          2
+#define BENCH_VERIFY_STEPS          40
+#define BENCH_DISTURB_INTERVAL      4
+#define BENCH_BATCH_EVENTS          256
+
+struct BenchConfig {
+    char const * name;
+    WAVES_LAYOUT layout;
+    WAVES_KERNEL kernel;
+    int band_rows;
+    WAVES_NORMAL_FORMAT normal_format;
+    bool active_tiles;      // with quiet_eps 0, so the result stays exact
+};
+static BenchConfig const g_configs[] = {
+    {"aos-scalar",      WAVES_LAYOUT_AOS, WAVES_KERNEL_SCALAR,  WAVES_BANDS_OFF,    WAVES_NORMAL_FLOAT3,    false},
+    {"soa-auto",        WAVES_LAYOUT_SOA, WAVES_KERNEL_AUTO,    WAVES_BANDS_OFF,    WAVES_NORMAL_FLOAT3,    false},
+    {"soa-auto-fused",  WAVES_LAYOUT_SOA, WAVES_KERNEL_AUTO,    WAVES_BANDS_AUTO,   WAVES_NORMAL_FLOAT3,    false},
+    {"soa-fused-half4", WAVES_LAYOUT_SOA, WAVES_KERNEL_AUTO,    WAVES_BANDS_AUTO,   WAVES_NORMAL_HALF4,     false},
+    {"soa-fused-udecn4",WAVES_LAYOUT_SOA, WAVES_KERNEL_AUTO,    WAVES_BANDS_AUTO,   WAVES_NORMAL_UDECN4,    false},
+    {"aos-tiles",       WAVES_LAYOUT_AOS, WAVES_KERNEL_SCALAR,  WAVES_BANDS_OFF,    WAVES_NORMAL_FLOAT3,    true},
+    {"soa-tiles-half4", WAVES_LAYOUT_SOA, WAVES_KERNEL_AUTO,    WAVES_BANDS_OFF,    WAVES_NORMAL_HALF4,     true},
+};
+#define BENCH_CONFIG_COUNT  ((int)(sizeof(g_configs) / sizeof(g_configs[0])))
+
+// -- reference solver: serial, AOS, same arithmetic as the original Waves_Update
+struct RefWaves {
+    int nrow;
+    int ncol;
+    float k1, k2, k3;
+    float spatial_step;
+    XMFLOAT3 * prev_sol;
+    XMFLOAT3 * curr_sol;
+    XMFLOAT3 * normal;
+    XMFLOAT3 * tangent_x;
+};
+static void
+ref_init (RefWaves * ref, int m, int n, float dx, float dt, float speed, float damping) {
+    int nvtx = m * n;
+    ref->nrow = m;
+    ref->ncol = n;
+    ref->spatial_step = dx;
+    float d = damping * dt + 2.0f;
+    float e = (speed * speed) * (dt * dt) / (dx * dx);
+    ref->k1 = (damping * dt - 2.0f) / d;
+    ref->k2 = (4.0f - 8.0f * e) / d;
+    ref->k3 = (2.0f * e) / d;
+
+    ref->prev_sol = (XMFLOAT3 *)::malloc(sizeof(XMFLOAT3) * nvtx);
+    ref->curr_sol = (XMFLOAT3 *)::malloc(sizeof(XMFLOAT3) * nvtx);
+    ref->normal = (XMFLOAT3 *)::malloc(sizeof(XMFLOAT3) * nvtx);
+    ref->tangent_x = (XMFLOAT3 *)::malloc(sizeof(XMFLOAT3) * nvtx);
+
+    float half_width = (n - 1) * dx * 0.5f;
+    float half_depth = (m - 1) * dx * 0.5f;
+    for (int i = 0; i < m; ++i) {
+        float z = half_depth - i * dx;
+        for (int j = 0; j < n; ++j) {
+            float x = -half_width + j * dx;
+            ref->prev_sol[i * n + j] = XMFLOAT3(x, 0.0f, z);
+            ref->curr_sol[i * n + j] = XMFLOAT3(x, 0.0f, z);
+            ref->normal[i * n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
+            ref->tangent_x[i * n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
+        }
+    }
+}
+static void
+ref_free (RefWaves * ref) {
+    ::free(ref->prev_sol);
+    ::free(ref->curr_sol);
+    ::free(ref->normal);
+    ::free(ref->tangent_x);
+}
+static void
+ref_step (RefWaves * ref) {
+    int n = ref->ncol;
+    for (int i = 1; i < ref->nrow - 1; ++i) {
+        for (int j = 1; j < n - 1; ++j) {
+            ref->prev_sol[i * n + j].y =
+                ref->k1 * ref->prev_sol[i * n + j].y +
+                ref->k2 * ref->curr_sol[i * n + j].y +
+                ref->k3 * (ref->curr_sol[(i + 1) * n + j].y +
+                           ref->curr_sol[(i - 1) * n + j].y +
+                           ref->curr_sol[i * n + j + 1].y +
+                           ref->curr_sol[i * n + j - 1].y);
+        }
+    }
+    XMFLOAT3 * tmp = ref->prev_sol;
+    ref->prev_sol = ref->curr_sol;
+    ref->curr_sol = tmp;
+
+    for (int i = 1; i < ref->nrow - 1; ++i) {
+        for (int j = 1; j < n - 1; ++j) {
+            float l = ref->curr_sol[i * n + j - 1].y;
+            float r = ref->curr_sol[i * n + j + 1].y;
+            float t = ref->curr_sol[(i - 1) * n + j].y;
+            float b = ref->curr_sol[(i + 1) * n + j].y;
+            ref->normal[i * n + j] = XMFLOAT3(-r + l, 2.0f * ref->spatial_step, b - t);
+            XMStoreFloat3(&ref->normal[i * n + j], XMVector3Normalize(XMLoadFloat3(&ref->normal[i * n + j])));
+
+            ref->tangent_x[i * n + j] = XMFLOAT3(2.0f * ref->spatial_step, r - l, 0.0f);
+            XMStoreFloat3(&ref->tangent_x[i * n + j], XMVector3Normalize(XMLoadFloat3(&ref->tangent_x[i * n + j])));
+        }
+    }
+}
+static void
+ref_disturb (RefWaves * ref, int i, int j, float magnitude) {
+    int n = ref->ncol;
+    float half_mag = 0.5f * magnitude;
+    ref->curr_sol[i * n + j].y += magnitude;
+    ref->curr_sol[i * n + j + 1].y += half_mag;
+    ref->curr_sol[i * n + j - 1].y += half_mag;
+    ref->curr_sol[(i + 1) * n + j].y += half_mag;
+    ref->curr_sol[(i - 1) * n + j].y += half_mag;
+}
+
+// -- shared setup
+struct BenchDisturber {
+    uint32_t state;
+};
+// Deterministic so the solver under test and the reference see the same events.
+static void
+bench_next_disturb (BenchDisturber * d, int m, int n, int * out_i, int * out_j, float * out_mag) {
+    d->state = d->state * 1664525u + 1013904223u;
+    *out_i = 2 + (int)((d->state >> 8) % (uint32_t)(m - 4));
+    d->state = d->state * 1664525u + 1013904223u;
+    *out_j = 2 + (int)((d->state >> 8) % (uint32_t)(n - 4));
+    d->state = d->state * 1664525u + 1013904223u;
+    *out_mag = 0.2f + 0.3f * (float)(d->state >> 8) / (float)(1u << 24);
+}
+
+// Same constants as the blending demo
+#define BENCH_DX        1.0f
+#define BENCH_DT        0.03f
+#define BENCH_SPEED     4.0f
+#define BENCH_DAMPING   0.2f
+
+static Waves *
+bench_create_waves (BenchConfig const * cfg, int size, Scheduler * sched, uint8_t ** out_memory) {
+    size_t bytes = Waves_CalculateRequiredSize(size, size, cfg->layout, cfg->normal_format);
+    uint8_t * memory = (uint8_t *)::malloc(bytes);
+    SIMPLE_ASSERT(memory, "bench memory allocation failed");
+    Waves * wave = Waves_Init(memory, size, size, BENCH_DX, BENCH_DT, BENCH_SPEED, BENCH_DAMPING, cfg->layout, cfg->kernel, cfg->normal_format);
+    Waves_SetFusedBands(wave, cfg->band_rows);
+    Waves_SetScheduler(wave, sched);
+    Waves_SetActiveTiles(wave, cfg->active_tiles, 0.0f);
+    *out_memory = memory;
+    return wave;
+}
+static void
+bench_step (Waves * wave) {
+    Waves_Step(wave);
+}
+// Minimum traffic of one step: read prev+curr heights, write new heights, write normal+tangent.
+static double
+bench_bytes_per_step (BenchConfig const * cfg, int size) {
+    double sol_elem = (WAVES_LAYOUT_SOA == cfg->layout) ? sizeof(float) : sizeof(XMFLOAT3);
+    double normal_elem = sizeof(XMFLOAT3);
+    if (WAVES_NORMAL_HALF4 == cfg->normal_format)
+        normal_elem = sizeof(XMHALF4);
+    else if (WAVES_NORMAL_UDECN4 == cfg->normal_format)
+        normal_elem = sizeof(XMUDECN4);
+    double interior = (double)(size - 2) * (size - 2);
+    return interior * (3.0 * sol_elem + 2.0 * normal_elem);
+}
+// Reference normal run through the same storage format as the solver under test.
+static XMFLOAT3
+bench_quantize (WAVES_NORMAL_FORMAT format, XMFLOAT3 v) {
+    XMFLOAT3 ret = v;
+    XMVECTOR x = XMVectorSetW(XMLoadFloat3(&v), 0.0f);
+    if (WAVES_NORMAL_HALF4 == format) {
+        XMHALF4 h;
+        XMStoreHalf4(&h, x);
+        XMStoreFloat3(&ret, XMLoadHalf4(&h));
+    } else if (WAVES_NORMAL_UDECN4 == format) {
+        XMVECTOR half = XMVectorReplicate(0.5f);
+        XMUDECN4 p;
+        XMStoreUDecN4(&p, XMVectorSetW(XMVectorMultiplyAdd(x, half, half), 0.0f));
+        XMStoreFloat3(&ret, XMVectorMultiplyAdd(XMLoadUDecN4(&p), XMVectorReplicate(2.0f), XMVectorReplicate(-1.0f)));
+    }
+    return ret;
+}
+
+// -- verification
+// Exported vertices must match the solver's own accessors (and the original texc formula).
+// dirty_vb is the buffer kept up to date with Waves_ExportDirtyVertices during the run,
+// it has to end up identical to a full export.
+static bool
+bench_verify_export (Waves * wave, uint8_t const * dirty_vb) {
+    size_t stride = Waves_GetVertexStride(wave);
+    uint8_t * vb = (uint8_t *)::malloc(stride * wave->nvtx);
+    Waves_ExportVertices(wave, vb);
+
+    bool ok = true;
+    for (int v = 0; v < wave->nvtx && ok; ++v) {
+        uint8_t const * vtx = vb + v * stride;
+        XMFLOAT3 p = Waves_GetPosition(wave, v);
+        XMFLOAT2 uv = XMFLOAT2(0.5f + p.x / wave->width, 0.5f - p.z / wave->depth);
+        XMFLOAT3 n = Waves_GetNormal(wave, v);
+
+        XMFLOAT3 out_p, out_n;
+        XMFLOAT2 out_uv;
+        memcpy(&out_p, vtx, sizeof(XMFLOAT3));
+        if (WAVES_NORMAL_FLOAT3 == wave->normal_format) {
+            WavesVertex const * w = reinterpret_cast<WavesVertex const *>(vtx);
+            out_n = w->normal;
+            out_uv = w->texc;
+        } else {
+            XMHALF2 h;
+            XMStoreHalf2(&h, XMLoadFloat2(&uv));
+            uv = XMFLOAT2(XMConvertHalfToFloat(h.x), XMConvertHalfToFloat(h.y));
+            if (WAVES_NORMAL_HALF4 == wave->normal_format) {
+                WavesVertexHalf const * w = reinterpret_cast<WavesVertexHalf const *>(vtx);
+                XMStoreFloat3(&out_n, XMLoadHalf4(&w->normal));
+                out_uv = XMFLOAT2(XMConvertHalfToFloat(w->texc.x), XMConvertHalfToFloat(w->texc.y));
+            } else {
+                WavesVertexDec const * w = reinterpret_cast<WavesVertexDec const *>(vtx);
+                XMStoreFloat3(&out_n, XMVectorMultiplyAdd(XMLoadUDecN4(&w->normal), XMVectorReplicate(2.0f), XMVectorReplicate(-1.0f)));
+                out_uv = XMFLOAT2(XMConvertHalfToFloat(w->texc.x), XMConvertHalfToFloat(w->texc.y));
+            }
+        }
+        ok = (0 == memcmp(&p, &out_p, sizeof(p))) && (0 == memcmp(&n, &out_n, sizeof(n))) && (0 == memcmp(&uv, &out_uv, sizeof(uv)));
+        if (!ok)
+            ::printf("  mismatch: exported vertex %d\n", v);
+    }
+    if (ok && 0 != memcmp(vb, dirty_vb, stride * wave->nvtx)) {
+        ::printf("  mismatch: dirty export differs from full export\n");
+        ok = false;
+    }
+    ::free(vb);
+    return ok;
+}
+static bool
+bench_verify (BenchConfig const * cfg, int size, Scheduler * sched) {
+    uint8_t * memory = nullptr;
+    Waves * wave = bench_create_waves(cfg, size, sched, &memory);
+    RefWaves ref;
+    ref_init(&ref, size, size, BENCH_DX, BENCH_DT, BENCH_SPEED, BENCH_DAMPING);
+
+    uint8_t * dirty_vb = (uint8_t *)::malloc(Waves_GetVertexStride(wave) * wave->nvtx);
+    uint32_t exported_version = 0;
+
+    BenchDisturber dist = {12345u};
+    for (int s = 0; s < BENCH_VERIFY_STEPS; ++s) {
+        if (0 == s % BENCH_DISTURB_INTERVAL) {
+            int i, j;
+            float mag;
+            bench_next_disturb(&dist, size, size, &i, &j, &mag);
+            Waves_Disturb(wave, i, j, mag);
+            ref_disturb(&ref, i, j, mag);
+        }
+        bench_step(wave);
+        ref_step(&ref);
+        Waves_ExportDirtyVertices(wave, dirty_vb, exported_version);
+        exported_version = Waves_GetVersion(wave);
+    }
+
+    bool ok = true;
+    int nvtx = size * size;
+    for (int v = 0; v < nvtx && ok; ++v) {
+        XMFLOAT3 p = Waves_GetPosition(wave, v);
+        ok = (0 == memcmp(&p, &ref.curr_sol[v], sizeof(XMFLOAT3)));
+        if (!ok)
+            ::printf("  mismatch: position %d (%d, %d): %.9g vs %.9g\n", v, v / size, v % size, p.y, ref.curr_sol[v].y);
+    }
+    for (int v = 0; v < nvtx && ok; ++v) {
+        XMFLOAT3 n = Waves_GetNormal(wave, v);
+        XMFLOAT3 t = Waves_GetTangentX(wave, v);
+        XMFLOAT3 ref_n = bench_quantize(cfg->normal_format, ref.normal[v]);
+        XMFLOAT3 ref_t = bench_quantize(cfg->normal_format, ref.tangent_x[v]);
+        ok = (0 == memcmp(&n, &ref_n, sizeof(XMFLOAT3))) && (0 == memcmp(&t, &ref_t, sizeof(XMFLOAT3)));
+        if (!ok)
+            ::printf("  mismatch: normal/tangent %d (%d, %d)\n", v, v / size, v % size);
+    }
+
+    if (ok)
+        ok = bench_verify_export(wave, dirty_vb);
+
+    ::free(dirty_vb);
+    ref_free(&ref);
+    ::free(memory);
+    return ok;
+}
+// A batch of POINT splats must match the same Waves_Disturb calls one by one, and splats
+// hanging over (or entirely outside) the edge must be clipped, never touching the boundary.
+static bool
+bench_verify_disturb_many (int size, Scheduler * sched) {
+    BenchConfig const * cfg = &g_configs[1];
+    uint8_t * memory_a = nullptr;
+    uint8_t * memory_b = nullptr;
+    Waves * wave_a = bench_create_waves(cfg, size, sched, &memory_a);
+    Waves * wave_b = bench_create_waves(cfg, size, sched, &memory_b);
+
+    WavesDisturbance events[BENCH_BATCH_EVENTS];
+    BenchDisturber dist = {777u};
+    for (int k = 0; k < BENCH_BATCH_EVENTS; ++k) {
+        int i, j;
+        float mag;
+        bench_next_disturb(&dist, size, size, &i, &j, &mag);
+        Waves_Disturb(wave_a, i, j, mag);
+        events[k] = {(float)i, (float)j, mag, 0.0f, WAVES_SPLAT_POINT};
+    }
+    Waves_DisturbMany(wave_b, events, BENCH_BATCH_EVENTS);
+
+    bool ok = true;
+    for (int v = 0; v < wave_a->nvtx && ok; ++v) {
+        XMFLOAT3 pa = Waves_GetPosition(wave_a, v);
+        XMFLOAT3 pb = Waves_GetPosition(wave_b, v);
+        ok = (0 == memcmp(&pa, &pb, sizeof(pa)));
+        if (!ok)
+            ::printf("  mismatch: batched disturb at %d (%d, %d)\n", v, v / size, v % size);
+    }
+
+    float far = (float)size * 4.0f;
+    WavesDisturbance edges[] = {
+        {0.0f, 0.0f, 1.0f, 0.0f, WAVES_SPLAT_POINT},
+        {1.3f, (float)size - 1.5f, 1.0f, 1.0f, WAVES_SPLAT_BILINEAR},
+        {(float)size * 0.5f, -2.0f, 1.0f, 6.0f, WAVES_SPLAT_GAUSSIAN},
+        {(float)size, (float)size, 1.0f, 3.0f, WAVES_SPLAT_BILINEAR},
+        {-far, far, 1.0f, 2.0f, WAVES_SPLAT_GAUSSIAN},
+    };
+    Waves_DisturbMany(wave_b, edges, (int)(sizeof(edges) / sizeof(edges[0])));
+    for (int v = 0; v < wave_b->nvtx && ok; ++v) {
+        int i = v / size;
+        int j = v % size;
+        if (i > 0 && i < size - 1 && j > 0 && j < size - 1)
+            continue;
+        ok = (0.0f == Waves_GetPosition(wave_b, v).y);
+        if (!ok)
+            ::printf("  mismatch: batched disturb touched boundary vertex (%d, %d)\n", i, j);
+    }
+
+    ::free(memory_a);
+    ::free(memory_b);
+    return ok;
+}
+
+// -- timing
+// Returns steps per second.
+static double
+bench_run (BenchConfig const * cfg, int size, Scheduler * sched, int steps) {
+    uint8_t * memory = nullptr;
+    Waves * wave = bench_create_waves(cfg, size, sched, &memory);
+
+    BenchDisturber dist = {777u};
+    for (int s = 0; s < BENCH_WARMUP_STEPS; ++s)
+        bench_step(wave);
+
+    double start = bench_seconds();
+    for (int s = 0; s < steps; ++s) {
+        if (0 == s % BENCH_DISTURB_INTERVAL) {
+            int i, j;
+            float mag;
+            bench_next_disturb(&dist, size, size, &i, &j, &mag);
+            Waves_Disturb(wave, i, j, mag);
+        }
+        bench_step(wave);
+    }
+    double elapsed = bench_seconds() - start;
+
+    ::free(memory);
+    return (elapsed > 0.0) ? steps / elapsed : 0.0;
+}
+
+int
+main (int argc, char ** argv) {
+    int sizes[BENCH_MAX_LIST] = {128, 256, 512, 1024, 2048, 4096};
+    int n_sizes = 6;
+    int threads[BENCH_MAX_LIST] = {};
+    int n_threads = 0;
+    int fixed_steps = 0;
+    bool quick = false;
+
+    for (int a = 1; a < argc; ++a) {
+        if (0 == strcmp(argv[a], "-quick")) {
+            quick = true;
+        } else if (0 == strcmp(argv[a], "-sizes") && a + 1 < argc) {
+            n_sizes = bench_parse_list(argv[++a], sizes);
+        } else if (0 == strcmp(argv[a], "-threads") && a + 1 < argc) {
+            n_threads = bench_parse_list(argv[++a], threads);
+        } else if (0 == strcmp(argv[a], "-steps") && a + 1 < argc) {
+            fixed_steps = atoi(argv[++a]);
+        } else {
+            ::printf("usage: %s [-quick] [-sizes 128,256,...] [-threads 1,2,4,...] [-steps N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (quick && n_sizes > 3)
+        n_sizes = 3;
+
+    int hw_threads = bench_hardware_threads();
+    if (0 == n_threads)
+        n_threads = bench_default_threads(hw_threads, threads);
+
+    ::printf("waves_bench: %d hardware threads\n\n", hw_threads);
+
+    // Every config must match the reference before its timings mean anything.
+    // Verification runs at the smallest size with the most threads so chunk seams are exercised.
+    bool all_ok = true;
+    {
+        int verify_size = sizes[0];
+        int verify_threads = threads[n_threads - 1];
+        Scheduler * sched = Scheduler_Create(SCHEDULER_BACKEND_POOL, verify_threads, SCHEDULER_GRAIN_AUTO);
+        for (int c = 0; c < BENCH_CONFIG_COUNT; ++c) {
+            bool ok = bench_verify(&g_configs[c], verify_size, sched);
+            ::printf("verify %-17s %4dx%-4d %2d threads: %s\n", g_configs[c].name, verify_size, verify_size, verify_threads, ok ? "OK" : "FAILED");
+            all_ok = all_ok && ok;
+        }
+        bool ok = bench_verify_disturb_many(verify_size, sched);
+        ::printf("verify %-17s %4dx%-4d %2d threads: %s\n", "disturb-many", verify_size, verify_size, verify_threads, ok ? "OK" : "FAILED");
+        all_ok = all_ok && ok;
+        Scheduler_Destroy(sched);
+    }
+    ::printf("\n%-17s %6s %7s %12s %10s %10s\n", "config", "grid", "threads", "steps/s", "GB/s", "efficiency");
+
+    for (int s = 0; s < n_sizes; ++s) {
+        int size = sizes[s];
+        int steps = fixed_steps;
+        if (steps <= 0) {
+            steps = BENCH_WORK_PER_RUN / (size * size);
+            if (quick)
+                steps /= 8;
+            if (steps < BENCH_MIN_STEPS)
+                steps = BENCH_MIN_STEPS;
+        }
+
+        for (int c = 0; c < BENCH_CONFIG_COUNT; ++c) {
+            double single_rate = 0.0;
+            for (int t = 0; t < n_threads; ++t) {
+                Scheduler * sched = Scheduler_Create(SCHEDULER_BACKEND_POOL, threads[t], SCHEDULER_GRAIN_AUTO);
+                double rate = bench_run(&g_configs[c], size, sched, steps);
+                Scheduler_Destroy(sched);
+
+                // Parallel efficiency is relative to the first (lowest) thread count.
+                if (0 == t)
+                    single_rate = rate * threads[0];
+
+                double gbps = rate * bench_bytes_per_step(&g_configs[c], size) / 1.0e9;
+                double efficiency = (single_rate > 0.0) ? rate / (single_rate * threads[t]) : 0.0;
+                ::printf("%-17s %6d %7d %12.1f %10.2f %9.0f%%\n", g_configs[c].name, size, threads[t], rate, gbps, 100.0 * efficiency);
+            }
+        }
+    }
+
+    ::printf("\n%s\n", all_ok ? "all configurations match the reference" : "REFERENCE MISMATCH");
+    return all_ok ? 0 : 2;
+}